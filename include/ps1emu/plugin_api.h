@@ -1,11 +1,14 @@
 #ifndef PS1EMU_PLUGIN_API_H
 #define PS1EMU_PLUGIN_API_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define PS1EMU_PLUGIN_API_VERSION 1
+/* 2: adds the in-process GPU/SPU vtables below. */
+#define PS1EMU_PLUGIN_API_VERSION 2
 
 typedef enum ps1emu_plugin_type {
   PS1EMU_PLUGIN_GPU = 1,
@@ -20,6 +23,45 @@ typedef struct ps1emu_plugin_info {
   const char *name;
 } ps1emu_plugin_info_t;
 
+/*
+ * In-process plugins (plugin.<type>_mode=library) are shared libraries that
+ * export PS1EMU_PLUGIN_ENTRY_SYMBOL. The host passes its API version and gets
+ * back the vtable for info.type, or NULL if the plugin cannot serve that
+ * version. Every vtable starts with ps1emu_plugin_info_t. All calls come from
+ * the emulation thread, in the order the host would have sent the matching
+ * IPC frames.
+ */
+#define PS1EMU_PLUGIN_ENTRY_SYMBOL "ps1emu_plugin_entry"
+
+typedef const ps1emu_plugin_info_t *(*ps1emu_plugin_entry_fn)(int host_api_version);
+
+typedef struct ps1emu_gpu_vtable {
+  ps1emu_plugin_info_t info;
+  void *(*create)(void);
+  void (*destroy)(void *self);
+  /* GP0 packets back to back, each prefixed with its word count (the 0x0006 frame layout). */
+  void (*submit_gp0)(void *self, const uint32_t *data, uint32_t data_words);
+  void (*write_gp1)(void *self, const uint32_t *words, uint32_t count);
+  /* Fills out with min(w, 1024) x min(h, 512) pixels; pixels outside VRAM read as 0. */
+  void (*read_vram)(void *self, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t *out);
+  /* Called once per emulated VBlank. */
+  void (*present)(void *self);
+} ps1emu_gpu_vtable_t;
+
+typedef struct ps1emu_spu_vtable {
+  ps1emu_plugin_info_t info;
+  void *(*create)(void);
+  void (*destroy)(void *self);
+  /* Decoded XA audio: frames interleaved 16-bit samples per channel (1 or 2 channels). */
+  void (*submit_pcm)(void *self,
+                     uint32_t lba,
+                     uint32_t sample_rate,
+                     uint32_t channels,
+                     const int16_t *samples,
+                     uint32_t frames);
+  void (*set_volume)(void *self, int16_t left, int16_t right);
+} ps1emu_spu_vtable_t;
+
 #ifdef __cplusplus
 }
 #endif
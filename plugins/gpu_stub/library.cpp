@@ -0,0 +1,74 @@
+#include "ps1emu/plugin_api.h"
+
+#include "software_gpu.h"
+
+#include <new>
+
+// In-process build of the GPU stub (plugin.gpu_mode=library). The host calls
+// straight into SoftwareGpu instead of exchanging frames with main.cpp's loop.
+
+static void *gpu_create() {
+  auto *gpu = new (std::nothrow) SoftwareGpu();
+  if (!gpu) {
+    return nullptr;
+  }
+  gpu->configure_from_env();
+  gpu->init_display();
+  return gpu;
+}
+
+static void gpu_destroy(void *self) {
+  auto *gpu = static_cast<SoftwareGpu *>(self);
+  gpu->shutdown_display();
+  delete gpu;
+}
+
+static void gpu_submit_gp0(void *self, const uint32_t *data, uint32_t data_words) {
+  auto *gpu = static_cast<SoftwareGpu *>(self);
+  std::vector<uint32_t> words;
+  uint32_t pos = 0;
+  while (pos < data_words) {
+    uint32_t count = data[pos++];
+    if (count > data_words - pos) {
+      break;
+    }
+    words.assign(data + pos, data + pos + count);
+    gpu->handle_packet(words);
+    pos += count;
+  }
+}
+
+static void gpu_write_gp1(void *self, const uint32_t *words, uint32_t count) {
+  auto *gpu = static_cast<SoftwareGpu *>(self);
+  for (uint32_t i = 0; i < count; ++i) {
+    gpu->handle_gp1(words[i]);
+  }
+}
+
+static void gpu_read_vram(void *self, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t *out) {
+  static_cast<SoftwareGpu *>(self)->copy_vram_region(x, y, w, h, out);
+}
+
+static void gpu_present(void *self) {
+  auto *gpu = static_cast<SoftwareGpu *>(self);
+  gpu->pump_events();
+  gpu->present_field();
+}
+
+static const ps1emu_gpu_vtable_t kGpuVtable = {
+    {PS1EMU_PLUGIN_API_VERSION, PS1EMU_PLUGIN_GPU, "ps1emu software GPU"},
+    gpu_create,
+    gpu_destroy,
+    gpu_submit_gp0,
+    gpu_write_gp1,
+    gpu_read_vram,
+    gpu_present,
+};
+
+extern "C" __attribute__((visibility("default"))) const ps1emu_plugin_info_t *ps1emu_plugin_entry(
+    int host_api_version) {
+  if (host_api_version != PS1EMU_PLUGIN_API_VERSION) {
+    return nullptr;
+  }
+  return &kGpuVtable.info;
+}
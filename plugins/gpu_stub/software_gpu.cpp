@@ -0,0 +1,1224 @@
+#include "software_gpu.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+#ifdef PS1EMU_GPU_SDL
+#include "ui/sdl_backend.h"
+#endif
+
+static bool ensure_dir(const std::string &path) {
+  if (path.empty()) {
+    return false;
+  }
+  if (mkdir(path.c_str(), 0755) == 0) {
+    return true;
+  }
+  return errno == EEXIST;
+}
+
+static bool write_ppm(const std::string &path,
+                      const std::vector<uint32_t> &frame,
+                      int width,
+                      int height) {
+  if (frame.empty() || width <= 0 || height <= 0) {
+    return false;
+  }
+  size_t expected = static_cast<size_t>(width) * height;
+  size_t count = std::min(frame.size(), expected);
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  file << "P6\n" << width << " " << height << "\n255\n";
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t argb = frame[i];
+    char rgb[3] = {
+        static_cast<char>((argb >> 16) & 0xFFu),
+        static_cast<char>((argb >> 8) & 0xFFu),
+        static_cast<char>(argb & 0xFFu),
+    };
+    file.write(rgb, sizeof(rgb));
+  }
+  return file.good();
+}
+
+static uint16_t color24_to_15(uint32_t color) {
+  uint8_t r = static_cast<uint8_t>(color & 0xFFu);
+  uint8_t g = static_cast<uint8_t>((color >> 8) & 0xFFu);
+  uint8_t b = static_cast<uint8_t>((color >> 16) & 0xFFu);
+  return static_cast<uint16_t>(((b >> 3) << 10) | ((g >> 3) << 5) | (r >> 3));
+}
+
+static uint32_t color15_to_32(uint16_t color) {
+  uint8_t r = static_cast<uint8_t>((color & 0x1Fu) << 3);
+  uint8_t g = static_cast<uint8_t>(((color >> 5) & 0x1Fu) << 3);
+  uint8_t b = static_cast<uint8_t>(((color >> 10) & 0x1Fu) << 3);
+  return 0xFF000000u | (static_cast<uint32_t>(r) << 16) |
+         (static_cast<uint32_t>(g) << 8) | static_cast<uint32_t>(b);
+}
+
+bool gpu_log_enabled() {
+  static int cached = -1;
+  if (cached < 0) {
+    const char *env = getenv("PS1EMU_LOG_GPU");
+    cached = (env && env[0] != '\0' && env[0] != '0') ? 1 : 0;
+  }
+  return cached == 1;
+}
+
+SoftwareGpu::SoftwareGpu() {
+  vram_storage_.resize(kVramWidth * kVramHeight);
+  vram_ = vram_storage_.data();
+  draw_x1_ = 0;
+  draw_y1_ = 0;
+  draw_x2_ = kVramWidth - 1;
+  draw_y2_ = kVramHeight - 1;
+}
+
+void SoftwareGpu::configure_from_env() {
+  const char *headless_env = getenv("PS1EMU_HEADLESS");
+  set_headless(headless_env && headless_env[0] != '\0');
+  const char *dump_dir_env = getenv("PS1EMU_FRAME_DUMP_DIR");
+  const char *dump_every_env = getenv("PS1EMU_FRAME_DUMP_EVERY");
+  int dump_every = 1;
+  if (dump_every_env && dump_every_env[0] != '\0') {
+    dump_every = std::max(1, atoi(dump_every_env));
+  }
+  if (dump_dir_env && dump_dir_env[0] != '\0') {
+    set_frame_dump(dump_dir_env, dump_every);
+  }
+}
+
+void SoftwareGpu::set_frame_dump(const std::string &dir, int every) {
+  dump_dir_ = dir;
+  dump_every_ = std::max(1, every);
+  dump_counter_ = 0;
+  dump_frames_ = !dump_dir_.empty();
+  if (dump_frames_) {
+    ensure_dir(dump_dir_);
+  }
+}
+
+bool SoftwareGpu::init_display() {
+#ifdef PS1EMU_GPU_SDL
+  if (headless_) {
+    return true;
+  }
+  shutdown_display();
+  if (!ps1emu::init_sdl_video_with_fallback()) {
+    headless_ = true;
+    return true;
+  }
+  {
+    window_ = SDL_CreateWindow("PS1 GPU",
+                               SDL_WINDOWPOS_CENTERED,
+                               SDL_WINDOWPOS_CENTERED,
+                               display_width_ * scale_,
+                               display_height_ * scale_,
+                               SDL_WINDOW_SHOWN);
+    if (!window_) {
+      shutdown_display();
+      headless_ = true;
+      return true;
+    }
+    renderer_ = SDL_CreateRenderer(window_, -1, SDL_RENDERER_ACCELERATED);
+    if (!renderer_) {
+      shutdown_display();
+      headless_ = true;
+      return true;
+    }
+    SDL_RenderSetLogicalSize(renderer_, display_width_, display_height_);
+    texture_ = SDL_CreateTexture(renderer_,
+                                 SDL_PIXELFORMAT_ARGB8888,
+                                 SDL_TEXTUREACCESS_STREAMING,
+                                 display_width_,
+                                 display_height_);
+    if (!texture_) {
+      shutdown_display();
+      headless_ = true;
+      return true;
+    }
+    frame_.resize(static_cast<size_t>(display_width_) * display_height_);
+  }
+  return true;
+#else
+  return true;
+#endif
+}
+
+void SoftwareGpu::shutdown_display() {
+#ifdef PS1EMU_GPU_SDL
+  if (texture_) {
+    SDL_DestroyTexture(texture_);
+    texture_ = nullptr;
+  }
+  if (renderer_) {
+    SDL_DestroyRenderer(renderer_);
+    renderer_ = nullptr;
+  }
+  if (window_) {
+    SDL_DestroyWindow(window_);
+    window_ = nullptr;
+  }
+  SDL_Quit();
+#endif
+}
+
+void SoftwareGpu::handle_packet(const std::vector<uint32_t> &words) {
+  if (words.empty()) {
+    return;
+  }
+  uint8_t cmd = static_cast<uint8_t>(words[0] >> 24);
+  if (cmd == 0x00 || cmd == 0x01) {
+    return;
+  }
+  frame_dirty_ = true;
+  if (cmd == 0x02 && words.size() >= 3) {
+    uint16_t color = color24_to_15(words[0]);
+    int16_t x = static_cast<int16_t>(words[1] & 0xFFFF);
+    int16_t y = static_cast<int16_t>((words[1] >> 16) & 0xFFFF);
+    uint16_t w = static_cast<uint16_t>(words[2] & 0xFFFF);
+    uint16_t h = static_cast<uint16_t>((words[2] >> 16) & 0xFFFF);
+    draw_rect(x, y, w, h, color, false);
+    return;
+  }
+  if (cmd >= 0x20 && cmd <= 0x3F) {
+    handle_polygon(words);
+    return;
+  }
+  if (cmd >= 0x40 && cmd <= 0x5F) {
+    handle_line(words);
+    return;
+  }
+  if (cmd >= 0x60 && cmd <= 0x7F) {
+    handle_rect(words);
+    return;
+  }
+  if (cmd >= 0x80 && cmd <= 0x9F && words.size() >= 4) {
+    handle_vram_copy(words);
+    return;
+  }
+  if (cmd == 0xA0) {
+    handle_image_load(words);
+    return;
+  }
+  if (cmd >= 0xE1 && cmd <= 0xE6) {
+    handle_state(cmd, words[0]);
+    return;
+  }
+}
+
+void SoftwareGpu::handle_gp1(uint32_t word) {
+  uint8_t cmd = static_cast<uint8_t>(word >> 24);
+  switch (cmd) {
+    case 0x00: { // Reset GPU
+      std::fill(vram_, vram_ + kVramWidth * kVramHeight, 0);
+      display_enabled_ = false;
+      display_x_ = 0;
+      display_y_ = 0;
+      h_range_start_ = 0x200;
+      h_range_end_ = 0x200 + 256 * 10;
+      v_range_start_ = 0x10;
+      v_range_end_ = 0x10 + 240;
+      draw_x1_ = 0;
+      draw_y1_ = 0;
+      draw_x2_ = kVramWidth - 1;
+      draw_y2_ = kVramHeight - 1;
+      draw_offset_x_ = 0;
+      draw_offset_y_ = 0;
+      texpage_x_ = 0;
+      texpage_y_ = 0;
+      tex_depth_ = 0;
+      blend_mode_ = 0;
+      dithering_enabled_ = false;
+      draw_to_display_ = false;
+      mask_set_ = false;
+      mask_eval_ = false;
+      rect_flip_x_ = false;
+      rect_flip_y_ = false;
+      tex_window_mask_x_ = 0;
+      tex_window_mask_y_ = 0;
+      tex_window_offset_x_ = 0;
+      tex_window_offset_y_ = 0;
+      display_flip_x_ = false;
+      display_depth24_ = false;
+      set_display_mode(0x00000000);
+      break;
+    }
+    case 0x03: { // Display enable (0=on,1=off)
+      display_enabled_ = ((word & 0x1u) == 0);
+      break;
+    }
+    case 0x05: { // Display start (VRAM)
+      int x = static_cast<int>(word & 0x3FFu);
+      int y = static_cast<int>((word >> 10) & 0x1FFu);
+      // A moved display start is a page flip: the next field must show it
+      // even if no drawing happened since.
+      if (x == display_x_ && y == display_y_) {
+        return;
+      }
+      display_x_ = x;
+      display_y_ = y;
+      break;
+    }
+    case 0x06: { // Horizontal display range (store for future)
+      h_range_start_ = static_cast<int>(word & 0xFFFu);
+      h_range_end_ = static_cast<int>((word >> 12) & 0xFFFu);
+      apply_display_ranges();
+      break;
+    }
+    case 0x07: { // Vertical display range (store for future)
+      v_range_start_ = static_cast<int>(word & 0x3FFu);
+      v_range_end_ = static_cast<int>((word >> 10) & 0x3FFu);
+      apply_display_ranges();
+      break;
+    }
+    case 0x08: { // Display mode
+      set_display_mode(word);
+      break;
+    }
+    default:
+      return;
+  }
+  frame_dirty_ = true;
+}
+
+void SoftwareGpu::use_shared_vram(uint16_t *pixels) {
+  std::copy(vram_, vram_ + kVramWidth * kVramHeight, pixels);
+  vram_ = pixels;
+  vram_storage_.clear();
+  vram_storage_.shrink_to_fit();
+}
+
+void SoftwareGpu::present_field() {
+  if (!frame_dirty_ && !interlaced_) {
+    return;
+  }
+  present();
+  frame_dirty_ = false;
+}
+
+void SoftwareGpu::copy_vram_region(int x, int y, int w, int h, uint16_t *out) const {
+  w = std::min(w, kVramWidth);
+  h = std::min(h, kVramHeight);
+  for (int yy = 0; yy < h; ++yy) {
+    int sy = y + yy;
+    for (int xx = 0; xx < w; ++xx) {
+      int sx = x + xx;
+      *out++ = in_vram(sx, sy) ? vram_[static_cast<size_t>(sy) * kVramWidth + sx] : 0;
+    }
+  }
+}
+
+std::vector<uint8_t> SoftwareGpu::read_vram_region(int x, int y, int w, int h) {
+  std::vector<uint8_t> out;
+  if (w <= 0 || h <= 0) {
+    return out;
+  }
+  w = std::min(w, kVramWidth);
+  h = std::min(h, kVramHeight);
+  std::vector<uint16_t> pixels(static_cast<size_t>(w) * h);
+  copy_vram_region(x, y, w, h, pixels.data());
+  out.reserve(pixels.size() * 2);
+  for (uint16_t color : pixels) {
+    out.push_back(static_cast<uint8_t>(color & 0xFF));
+    out.push_back(static_cast<uint8_t>((color >> 8) & 0xFF));
+  }
+  return out;
+}
+
+void SoftwareGpu::pump_events() {
+#ifdef PS1EMU_GPU_SDL
+  if (headless_ || !window_ || !renderer_) {
+    return;
+  }
+  SDL_Event evt;
+  while (SDL_PollEvent(&evt)) {
+    if (evt.type == SDL_QUIT) {
+      running_ = false;
+    }
+  }
+#endif
+}
+
+void SoftwareGpu::present() {
+  bool want_dump = dump_frames_;
+  bool want_output = false;
+#ifdef PS1EMU_GPU_SDL
+  want_output = !headless_ && texture_ && renderer_;
+#endif
+  if (!want_dump && !want_output) {
+    return;
+  }
+
+  if (!display_enabled_) {
+    std::fill(frame_.begin(), frame_.end(), 0xFF000000u);
+#ifdef PS1EMU_GPU_SDL
+    if (want_output) {
+      SDL_SetRenderDrawColor(renderer_, 0, 0, 0, 255);
+      SDL_RenderClear(renderer_);
+      SDL_RenderPresent(renderer_);
+    }
+#endif
+    if (want_dump) {
+      dump_frame();
+    }
+    if (interlaced_) {
+      field_parity_ = !field_parity_;
+    }
+    return;
+  }
+
+  int field = interlaced_ ? (field_parity_ ? 1 : 0) : 0;
+  for (int y = 0; y < display_height_; ++y) {
+    int src_y = display_y_ + y + field;
+    if (interlaced_ && src_y >= kVramHeight) {
+      src_y = kVramHeight - 1;
+    }
+    for (int x = 0; x < display_width_; ++x) {
+      int pixel_index = display_flip_x_ ? (display_width_ - 1 - x) : x;
+      if (display_depth24_) {
+        int byte_x = display_x_ * 2 + pixel_index * 3;
+        if (byte_x + 2 >= kVramWidth * 2) {
+          frame_[static_cast<size_t>(y) * display_width_ + x] = 0xFF000000u;
+          continue;
+        }
+        uint8_t r = vram_byte(byte_x, src_y);
+        uint8_t g = vram_byte(byte_x + 1, src_y);
+        uint8_t b = vram_byte(byte_x + 2, src_y);
+        frame_[static_cast<size_t>(y) * display_width_ + x] =
+            0xFF000000u | (static_cast<uint32_t>(r) << 16) |
+            (static_cast<uint32_t>(g) << 8) | static_cast<uint32_t>(b);
+      } else {
+        int src_x = display_x_ + pixel_index;
+        uint16_t color = vram_[static_cast<size_t>(src_y) * kVramWidth + src_x];
+        frame_[static_cast<size_t>(y) * display_width_ + x] = color15_to_32(color);
+      }
+    }
+  }
+
+#ifdef PS1EMU_GPU_SDL
+  if (want_output) {
+    SDL_UpdateTexture(texture_, nullptr, frame_.data(), display_width_ * 4);
+    SDL_RenderClear(renderer_);
+    SDL_RenderCopy(renderer_, texture_, nullptr, nullptr);
+    SDL_RenderPresent(renderer_);
+    pump_events();
+  }
+#endif
+  if (want_dump) {
+    dump_frame();
+  }
+  if (interlaced_) {
+    field_parity_ = !field_parity_;
+  }
+}
+
+void SoftwareGpu::handle_state(uint8_t cmd, uint32_t word) {
+  if (cmd == 0xE1) { // draw mode
+    uint32_t mode = word & 0x00FFFFFFu;
+    texpage_x_ = static_cast<int>(mode & 0x0Fu) * 64;
+    texpage_y_ = (mode & 0x10u) ? 256 : 0;
+    tex_depth_ = static_cast<int>((mode >> 7) & 0x3u);
+    blend_mode_ = static_cast<int>((mode >> 5) & 0x3u);
+    dithering_enabled_ = (mode & (1u << 9)) != 0;
+    draw_to_display_ = (mode & (1u << 10)) != 0;
+    rect_flip_x_ = (mode & (1u << 12)) != 0;
+    rect_flip_y_ = (mode & (1u << 13)) != 0;
+  } else if (cmd == 0xE3) { // draw area top-left
+    draw_x1_ = static_cast<int>(word & 0x3FFu);
+    draw_y1_ = static_cast<int>((word >> 10) & 0x3FFu);
+  } else if (cmd == 0xE4) { // draw area bottom-right
+    draw_x2_ = static_cast<int>(word & 0x3FFu);
+    draw_y2_ = static_cast<int>((word >> 10) & 0x3FFu);
+  } else if (cmd == 0xE5) { // draw offset
+    int32_t x = static_cast<int32_t>(word & 0x7FFu);
+    int32_t y = static_cast<int32_t>((word >> 11) & 0x7FFu);
+    if (x & 0x400) {
+      x |= ~0x7FF;
+    }
+    if (y & 0x400) {
+      y |= ~0x7FF;
+    }
+    draw_offset_x_ = static_cast<int>(x);
+    draw_offset_y_ = static_cast<int>(y);
+  } else if (cmd == 0xE2) { // texture window
+    tex_window_mask_x_ = static_cast<int>(word & 0x1Fu);
+    tex_window_mask_y_ = static_cast<int>((word >> 5) & 0x1Fu);
+    tex_window_offset_x_ = static_cast<int>((word >> 10) & 0x1Fu);
+    tex_window_offset_y_ = static_cast<int>((word >> 15) & 0x1Fu);
+  } else if (cmd == 0xE6) { // mask bit setting
+    mask_set_ = (word & 0x1u) != 0;
+    mask_eval_ = (word & 0x2u) != 0;
+  }
+}
+
+void SoftwareGpu::set_display_mode(uint32_t word) {
+  int hres = static_cast<int>(word & 0x3u);
+  bool hres2 = (word & (1u << 6)) != 0;
+  interlaced_ = (word & (1u << 5)) != 0;
+  display_flip_x_ = (word & (1u << 7)) != 0;
+  display_depth24_ = (word & (1u << 4)) != 0;
+  int width = 320;
+  if (hres2) {
+    width = 368;
+  } else {
+    switch (hres) {
+      case 0:
+        width = 256;
+        break;
+      case 1:
+        width = 320;
+        break;
+      case 2:
+        width = 512;
+        break;
+      case 3:
+        width = 640;
+        break;
+      default:
+        width = 320;
+        break;
+    }
+  }
+  int height = (word & (1u << 2)) ? 480 : 240;
+  mode_width_ = width;
+  mode_height_ = height;
+  apply_display_ranges();
+}
+
+void SoftwareGpu::apply_display_ranges() {
+  int width = mode_width_;
+  int height = mode_height_;
+
+  if (h_range_end_ > h_range_start_) {
+    int span = h_range_end_ - h_range_start_;
+    int cycles_per_pixel = 8;
+    if (mode_width_ == 256) {
+      cycles_per_pixel = 10;
+    } else if (mode_width_ == 320) {
+      cycles_per_pixel = 8;
+    } else if (mode_width_ == 368) {
+      cycles_per_pixel = 7;
+    } else if (mode_width_ == 512) {
+      cycles_per_pixel = 5;
+    } else if (mode_width_ == 640) {
+      cycles_per_pixel = 4;
+    }
+    int derived = span / cycles_per_pixel;
+    derived = (derived + 2) & ~3;
+    if (derived >= 16) {
+      width = std::clamp(derived, 16, 640);
+    }
+  }
+  if (v_range_end_ > v_range_start_) {
+    int span = v_range_end_ - v_range_start_;
+    if (span >= 16) {
+      height = std::clamp(span, 16, 480);
+    }
+  }
+
+  if (display_depth24_) {
+    width = std::max(16, (width * 2) / 3);
+    width = (width + 1) & ~1;
+  }
+
+  update_display_size(width, height);
+}
+
+void SoftwareGpu::update_display_size(int width, int height) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  if (width == display_width_ && height == display_height_) {
+    return;
+  }
+  display_width_ = width;
+  display_height_ = height;
+#ifdef PS1EMU_GPU_SDL
+  if (!headless_ && renderer_) {
+    if (texture_) {
+      SDL_DestroyTexture(texture_);
+      texture_ = nullptr;
+    }
+    SDL_RenderSetLogicalSize(renderer_, display_width_, display_height_);
+    texture_ = SDL_CreateTexture(renderer_,
+                                 SDL_PIXELFORMAT_ARGB8888,
+                                 SDL_TEXTUREACCESS_STREAMING,
+                                 display_width_,
+                                 display_height_);
+  }
+#endif
+  frame_.assign(static_cast<size_t>(display_width_) * display_height_, 0);
+}
+
+void SoftwareGpu::handle_vram_copy(const std::vector<uint32_t> &words) {
+  int src_x = static_cast<int16_t>(words[1] & 0xFFFF);
+  int src_y = static_cast<int16_t>((words[1] >> 16) & 0xFFFF);
+  int dst_x = static_cast<int16_t>(words[2] & 0xFFFF);
+  int dst_y = static_cast<int16_t>((words[2] >> 16) & 0xFFFF);
+  int w = static_cast<int>(words[3] & 0xFFFF);
+  int h = static_cast<int>((words[3] >> 16) & 0xFFFF);
+  if (w <= 0 || h <= 0) {
+    return;
+  }
+  w = std::min(w, kVramWidth);
+  h = std::min(h, kVramHeight);
+  bool overlap = !(dst_x + w <= src_x || dst_x >= src_x + w ||
+                   dst_y + h <= src_y || dst_y >= src_y + h);
+  if (overlap) {
+    std::vector<uint16_t> temp(static_cast<size_t>(w) * h, 0);
+    for (int y = 0; y < h; ++y) {
+      for (int x = 0; x < w; ++x) {
+        int sx = src_x + x;
+        int sy = src_y + y;
+        if (!in_vram(sx, sy)) {
+          continue;
+        }
+        temp[static_cast<size_t>(y) * w + x] =
+            vram_[static_cast<size_t>(sy) * kVramWidth + sx];
+      }
+    }
+    for (int y = 0; y < h; ++y) {
+      for (int x = 0; x < w; ++x) {
+        int dx = dst_x + x;
+        int dy = dst_y + y;
+        write_vram_pixel(dx, dy, temp[static_cast<size_t>(y) * w + x]);
+      }
+    }
+    return;
+  }
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      int sx = src_x + x;
+      int sy = src_y + y;
+      int dx = dst_x + x;
+      int dy = dst_y + y;
+      if (!in_vram(sx, sy) || !in_vram(dx, dy)) {
+        continue;
+      }
+      uint16_t color = vram_[static_cast<size_t>(sy) * kVramWidth + sx];
+      write_vram_pixel(dx, dy, color);
+    }
+  }
+}
+
+void SoftwareGpu::handle_image_load(const std::vector<uint32_t> &words) {
+  if (words.size() < 3) {
+    return;
+  }
+  int dst_x = static_cast<int16_t>(words[1] & 0xFFFF);
+  int dst_y = static_cast<int16_t>((words[1] >> 16) & 0xFFFF);
+  int w = static_cast<int>(words[2] & 0xFFFF);
+  int h = static_cast<int>((words[2] >> 16) & 0xFFFF);
+  if (w <= 0 || h <= 0) {
+    return;
+  }
+  w = std::min(w, kVramWidth);
+  h = std::min(h, kVramHeight);
+  size_t pixel_count = static_cast<size_t>(w) * h;
+  size_t word_index = 3;
+  size_t pixel_index = 0;
+  while (pixel_index < pixel_count && word_index < words.size()) {
+    uint32_t packed = words[word_index++];
+    uint16_t p0 = static_cast<uint16_t>(packed & 0xFFFF);
+    uint16_t p1 = static_cast<uint16_t>((packed >> 16) & 0xFFFF);
+    for (int i = 0; i < 2 && pixel_index < pixel_count; ++i) {
+      uint16_t pixel = (i == 0) ? p0 : p1;
+      int x = dst_x + static_cast<int>(pixel_index % static_cast<size_t>(w));
+      int y = dst_y + static_cast<int>(pixel_index / static_cast<size_t>(w));
+      write_vram_pixel(x, y, pixel);
+      pixel_index++;
+    }
+  }
+}
+
+void SoftwareGpu::handle_polygon(const std::vector<uint32_t> &words) {
+  if (words.size() < 4) {
+    return;
+  }
+  uint8_t cmd = static_cast<uint8_t>(words[0] >> 24);
+  bool gouraud = (cmd & 0x10) != 0;
+  bool textured = (cmd & 0x04) != 0;
+  bool quad = (cmd & 0x08) != 0;
+  bool semi = (cmd & 0x02) != 0;
+  bool raw = (cmd & 0x01) != 0;
+
+  size_t vertices = quad ? 4 : 3;
+  std::vector<Vertex> verts(vertices);
+  size_t index = 0;
+  verts[0].color = words[0] & 0x00FFFFFFu;
+  index = 1;
+  int clut_x = 0;
+  int clut_y = 0;
+  int tpage_x = texpage_x_;
+  int tpage_y = texpage_y_;
+  int tex_depth = tex_depth_;
+  bool have_clut = false;
+  bool have_tpage = false;
+  uint16_t tpage_attr = 0;
+  for (size_t v = 0; v < vertices; ++v) {
+    if (gouraud && v > 0) {
+      if (index >= words.size()) {
+        return;
+      }
+      verts[v].color = words[index++] & 0x00FFFFFFu;
+    } else if (!gouraud) {
+      verts[v].color = verts[0].color;
+    }
+    if (index >= words.size()) {
+      return;
+    }
+    uint32_t xy = words[index++];
+    verts[v].x = static_cast<int16_t>(xy & 0xFFFF) + draw_offset_x_;
+    verts[v].y = static_cast<int16_t>((xy >> 16) & 0xFFFF) + draw_offset_y_;
+    if (textured) {
+      if (index >= words.size()) {
+        return;
+      }
+      uint32_t uv = words[index++];
+      verts[v].u = static_cast<uint8_t>(uv & 0xFF);
+      verts[v].v = static_cast<uint8_t>((uv >> 8) & 0xFF);
+      if (!have_clut) {
+        uint16_t clut = static_cast<uint16_t>(uv >> 16);
+        clut_x = static_cast<int>(clut & 0x3Fu) * 16;
+        clut_y = static_cast<int>((clut >> 6) & 0x1FFu);
+        have_clut = true;
+      } else if (!have_tpage) {
+        tpage_attr = static_cast<uint16_t>(uv >> 16);
+        tpage_x = static_cast<int>(tpage_attr & 0x0Fu) * 64;
+        tpage_y = (tpage_attr & 0x10u) ? 256 : 0;
+        tex_depth = static_cast<int>((tpage_attr >> 7) & 0x3u);
+        have_tpage = true;
+      }
+    }
+  }
+
+  if (textured) {
+    int poly_blend = have_tpage ? static_cast<int>((tpage_attr >> 5) & 0x3u)
+                                : blend_mode_;
+    draw_textured_triangle(verts[0],
+                           verts[1],
+                           verts[2],
+                           tex_depth,
+                           tpage_x,
+                           tpage_y,
+                           clut_x,
+                           clut_y,
+                           semi,
+                           poly_blend,
+                           gouraud,
+                           raw);
+    if (quad) {
+      draw_textured_triangle(verts[0],
+                             verts[2],
+                             verts[3],
+                             tex_depth,
+                             tpage_x,
+                             tpage_y,
+                             clut_x,
+                             clut_y,
+                             semi,
+                             poly_blend,
+                             gouraud,
+                             raw);
+    }
+  } else {
+    draw_triangle(verts[0], verts[1], verts[2], gouraud, semi);
+    if (quad) {
+      draw_triangle(verts[0], verts[2], verts[3], gouraud, semi);
+    }
+  }
+}
+
+void SoftwareGpu::handle_rect(const std::vector<uint32_t> &words) {
+  if (words.size() < 2) {
+    return;
+  }
+  uint8_t cmd = static_cast<uint8_t>(words[0] >> 24);
+  bool textured = (cmd & 0x04) != 0;
+  bool semi = (cmd & 0x02) != 0;
+  bool raw = (cmd & 0x01) != 0;
+  uint32_t size_code = (cmd >> 3) & 0x3;
+  int w = 0;
+  int h = 0;
+  if (size_code == 0) {
+    if (words.size() < 3) {
+      return;
+    }
+    w = static_cast<int>(words[2] & 0xFFFF);
+    h = static_cast<int>((words[2] >> 16) & 0xFFFF);
+  } else if (size_code == 1) {
+    w = 1;
+    h = 1;
+  } else if (size_code == 2) {
+    w = 8;
+    h = 8;
+  } else {
+    w = 16;
+    h = 16;
+  }
+
+  int x = static_cast<int16_t>(words[1] & 0xFFFF) + draw_offset_x_;
+  int y = static_cast<int16_t>((words[1] >> 16) & 0xFFFF) + draw_offset_y_;
+  uint16_t color = color24_to_15(words[0]);
+
+  if (textured && words.size() > 2) {
+    uint32_t uv = words[2];
+    uint8_t u = static_cast<uint8_t>(uv & 0xFF);
+    uint8_t v = static_cast<uint8_t>((uv >> 8) & 0xFF);
+    uint16_t clut = static_cast<uint16_t>(uv >> 16);
+    int clut_x = static_cast<int>(clut & 0x3Fu) * 16;
+    int clut_y = static_cast<int>((clut >> 6) & 0x1FFu);
+    draw_textured_rect(x,
+                       y,
+                       w,
+                       h,
+                       u,
+                       v,
+                       tex_depth_,
+                       texpage_x_,
+                       texpage_y_,
+                       clut_x,
+                       clut_y,
+                       semi,
+                       raw,
+                       words[0] & 0x00FFFFFFu);
+    return;
+  }
+
+  draw_rect(x, y, w, h, color, semi);
+}
+
+void SoftwareGpu::handle_line(const std::vector<uint32_t> &words) {
+  if (words.size() < 3) {
+    return;
+  }
+  uint8_t cmd = static_cast<uint8_t>(words[0] >> 24);
+  bool gouraud = (cmd & 0x10) != 0;
+  bool polyline = (cmd & 0x08) != 0;
+  bool semi = (cmd & 0x02) != 0;
+
+  auto decode_xy = [&](uint32_t word, int &x, int &y) {
+    x = static_cast<int16_t>(word & 0xFFFF) + draw_offset_x_;
+    y = static_cast<int16_t>((word >> 16) & 0xFFFF) + draw_offset_y_;
+  };
+
+  size_t index = 0;
+  uint32_t color0 = words[index++] & 0x00FFFFFFu;
+  int x0 = 0;
+  int y0 = 0;
+  if (index >= words.size()) {
+    return;
+  }
+  decode_xy(words[index++], x0, y0);
+
+  while (index < words.size()) {
+    uint32_t color1 = color0;
+    if (gouraud) {
+      if (index >= words.size()) {
+        return;
+      }
+      color1 = words[index++] & 0x00FFFFFFu;
+    }
+    if (index >= words.size()) {
+      return;
+    }
+    uint32_t word = words[index++];
+    if (polyline && (word & 0xF000F000u) == 0x50005000u) {
+      break;
+    }
+    int x1 = 0;
+    int y1 = 0;
+    decode_xy(word, x1, y1);
+    draw_line(x0, y0, x1, y1, color0, color1, gouraud, semi);
+    x0 = x1;
+    y0 = y1;
+    color0 = color1;
+
+    if (!polyline) {
+      break;
+    }
+  }
+}
+
+void SoftwareGpu::draw_line(int x0,
+                            int y0,
+                            int x1,
+                            int y1,
+                            uint32_t color0,
+                            uint32_t color1,
+                            bool gouraud,
+                            bool semi) {
+  int dx = std::abs(x1 - x0);
+  int dy = std::abs(y1 - y0);
+  int sx = (x0 < x1) ? 1 : -1;
+  int sy = (y0 < y1) ? 1 : -1;
+  int err = dx - dy;
+  int steps = std::max(dx, dy);
+  float inv = steps > 0 ? 1.0f / static_cast<float>(steps) : 0.0f;
+
+  int r0 = static_cast<int>(color0 & 0xFF);
+  int g0 = static_cast<int>((color0 >> 8) & 0xFF);
+  int b0 = static_cast<int>((color0 >> 16) & 0xFF);
+  int r1 = static_cast<int>(color1 & 0xFF);
+  int g1 = static_cast<int>((color1 >> 8) & 0xFF);
+  int b1 = static_cast<int>((color1 >> 16) & 0xFF);
+
+  int step = 0;
+  for (;;) {
+    uint32_t color = color0;
+    if (gouraud && steps > 0) {
+      float t = step * inv;
+      int r = static_cast<int>(r0 + (r1 - r0) * t);
+      int g = static_cast<int>(g0 + (g1 - g0) * t);
+      int b = static_cast<int>(b0 + (b1 - b0) * t);
+      color = (static_cast<uint32_t>(b) << 16) |
+              (static_cast<uint32_t>(g) << 8) |
+              static_cast<uint32_t>(r);
+    }
+    set_pixel(x0, y0, color24_to_15(color), semi);
+
+    if (x0 == x1 && y0 == y1) {
+      break;
+    }
+    int e2 = err * 2;
+    if (e2 > -dy) {
+      err -= dy;
+      x0 += sx;
+    }
+    if (e2 < dx) {
+      err += dx;
+      y0 += sy;
+    }
+    step++;
+  }
+}
+
+void SoftwareGpu::draw_rect(int x, int y, int w, int h, uint16_t color, bool semi) {
+  int begin = std::max(x, 0);
+  int end = std::min(x + w, kVramWidth);
+  if (h <= 0 || begin >= end) {
+    return;
+  }
+  std::fill(span_src_.begin(), span_src_.begin() + (end - begin), static_cast<uint16_t>(color | 0x8000u));
+  for (int yy = 0; yy < h; ++yy) {
+    write_span(begin, y + yy, end - begin, nullptr, semi, blend_mode_);
+  }
+}
+
+void SoftwareGpu::draw_textured_rect(int x,
+                                     int y,
+                                     int w,
+                                     int h,
+                                     uint8_t u,
+                                     uint8_t v,
+                                     int tex_depth,
+                                     int tpage_x,
+                                     int tpage_y,
+                                     int clut_x,
+                                     int clut_y,
+                                     bool semi,
+                                     bool raw,
+                                     uint32_t modulate) {
+  int begin = std::max(x, 0);
+  int end = std::min(x + w, kVramWidth);
+  if (h <= 0 || begin >= end) {
+    return;
+  }
+  int count = end - begin;
+  std::fill(span_shade_.begin(), span_shade_.begin() + count, modulate);
+  for (int yy = 0; yy < h; ++yy) {
+    if (y + yy < draw_y1_ || y + yy > draw_y2_) {
+      continue;
+    }
+    int tex_v = (static_cast<int>(v) + (rect_flip_y_ ? -yy : yy)) & 0xFF;
+    for (int i = 0; i < count; ++i) {
+      int xx = begin + i - x;
+      int tex_u = (static_cast<int>(u) + (rect_flip_x_ ? -xx : xx)) & 0xFF;
+      sample_span_texel(i, tex_u, tex_v, tex_depth, tpage_x, tpage_y, clut_x, clut_y);
+    }
+    write_textured_span(begin, y + yy, count, semi, blend_mode_, raw);
+  }
+}
+
+int SoftwareGpu::vertex_attr(const Vertex &v, int attr) {
+  switch (attr) {
+    case kAttrR:
+      return static_cast<int>(v.color & 0xFFu);
+    case kAttrG:
+      return static_cast<int>((v.color >> 8) & 0xFFu);
+    case kAttrB:
+      return static_cast<int>((v.color >> 16) & 0xFFu);
+    case kAttrU:
+      return v.u;
+    default:
+      return v.v;
+  }
+}
+
+int64_t SoftwareGpu::edge_function(const Vertex &a, const Vertex &b, int x, int y) {
+  return static_cast<int64_t>(x - a.x) * (b.y - a.y) -
+         static_cast<int64_t>(y - a.y) * (b.x - a.x);
+}
+
+uint32_t SoftwareGpu::attr_color(const int *attr) {
+  return (static_cast<uint32_t>(attr[kAttrB]) << 16) |
+         (static_cast<uint32_t>(attr[kAttrG]) << 8) |
+         static_cast<uint32_t>(attr[kAttrR]);
+}
+
+void SoftwareGpu::draw_triangle(const Vertex &v0,
+                                const Vertex &v1,
+                                const Vertex &v2,
+                                bool gouraud,
+                                bool semi) {
+  uint16_t flat = static_cast<uint16_t>(color24_to_15(v0.color) | 0x8000u);
+  rasterize_triangle(
+      v0,
+      v1,
+      v2,
+      [&](int i, const int *attr) {
+        span_src_[i] = gouraud ? static_cast<uint16_t>(color24_to_15(attr_color(attr)) | 0x8000u) : flat;
+      },
+      [&](int x, int y, int count) { write_span(x, y, count, nullptr, semi, blend_mode_); });
+}
+
+void SoftwareGpu::draw_textured_triangle(const Vertex &v0,
+                                         const Vertex &v1,
+                                         const Vertex &v2,
+                                         int tex_depth,
+                                         int tpage_x,
+                                         int tpage_y,
+                                         int clut_x,
+                                         int clut_y,
+                                         bool semi,
+                                         int blend_mode,
+                                         bool gouraud,
+                                         bool raw) {
+  rasterize_triangle(
+      v0,
+      v1,
+      v2,
+      [&](int i, const int *attr) {
+        sample_span_texel(i, attr[kAttrU], attr[kAttrV], tex_depth, tpage_x, tpage_y, clut_x, clut_y);
+        span_shade_[i] = gouraud ? attr_color(attr) : v0.color;
+      },
+      [&](int x, int y, int count) { write_textured_span(x, y, count, semi, blend_mode, raw); });
+}
+
+void SoftwareGpu::sample_span_texel(int i,
+                                    int u,
+                                    int v,
+                                    int tex_depth,
+                                    int tpage_x,
+                                    int tpage_y,
+                                    int clut_x,
+                                    int clut_y) {
+  uint16_t color = 0;
+  bool transparent = false;
+  bool hit = sample_texture(u, v, tex_depth, tpage_x, tpage_y, clut_x, clut_y, color, transparent);
+  span_texel_[i] = color;
+  span_cover_[i] = hit && !transparent ? 1 : 0;
+}
+
+void SoftwareGpu::write_textured_span(int x, int y, int count, bool semi, int blend_mode, bool raw) {
+  if (raw) {
+    std::copy(span_texel_.begin(), span_texel_.begin() + count, span_src_.begin());
+  } else {
+    span_kernels_.modulate(span_src_.data(), span_texel_.data(), span_shade_.data(), count);
+  }
+  write_span(x, y, count, span_cover_.data(), semi, blend_mode);
+}
+
+void SoftwareGpu::write_span(int x, int y, int count, const uint8_t *cover, bool semi, int blend_mode) {
+  if (y < draw_y1_ || y > draw_y2_ || y < 0 || y >= kVramHeight) {
+    return;
+  }
+  int begin = std::max({x, draw_x1_, 0});
+  int end = std::min({x + count - 1, draw_x2_, kVramWidth - 1});
+  if (!draw_to_display_ && y >= display_y_ && y <= display_y_ + display_height_ - 1) {
+    int dx0 = display_x_;
+    int dx1 = display_x_ + display_width_ - 1;
+    write_span_run(x, y, begin, std::min(end, dx0 - 1), cover, semi, blend_mode);
+    write_span_run(x, y, std::max(begin, dx1 + 1), end, cover, semi, blend_mode);
+    return;
+  }
+  write_span_run(x, y, begin, end, cover, semi, blend_mode);
+}
+
+void SoftwareGpu::write_span_run(int x, int y, int begin, int end, const uint8_t *cover, bool semi, int blend_mode) {
+  if (begin > end) {
+    return;
+  }
+  SpanWriteParams params = span_params(begin, y, semi, blend_mode);
+  span_kernels_.write(vram_ + static_cast<size_t>(y) * kVramWidth + begin,
+                      span_src_.data() + (begin - x),
+                      cover ? cover + (begin - x) : nullptr,
+                      end - begin + 1,
+                      params);
+}
+
+SpanWriteParams SoftwareGpu::span_params(int x, int y, bool semi, int blend_mode) const {
+  SpanWriteParams params;
+  params.x = x;
+  params.y = y;
+  params.blend_mode = blend_mode;
+  params.semi = semi;
+  params.dither = dithering_enabled_;
+  params.mask_set = mask_set_;
+  params.mask_eval = mask_eval_;
+  return params;
+}
+
+bool SoftwareGpu::sample_texture(int u,
+                                 int v,
+                                 int tex_depth,
+                                 int tpage_x,
+                                 int tpage_y,
+                                 int clut_x,
+                                 int clut_y,
+                                 uint16_t &out_color,
+                                 bool &out_transparent) {
+  out_transparent = false;
+  apply_texture_window(u, v);
+  u &= 0xFF;
+  v &= 0xFF;
+  if (tex_depth == 2) { // 15-bit direct
+    int x = tpage_x + u;
+    int y = tpage_y + v;
+    if (!in_vram(x, y)) {
+      return false;
+    }
+    out_color = vram_[static_cast<size_t>(y) * kVramWidth + x];
+    return true;
+  }
+  if (tex_depth == 1) { // 8-bit CLUT
+    int word_x = tpage_x + (u / 2);
+    int y = tpage_y + v;
+    if (!in_vram(word_x, y)) {
+      return false;
+    }
+    uint16_t word = vram_[static_cast<size_t>(y) * kVramWidth + word_x];
+    uint8_t index = (u & 1) ? static_cast<uint8_t>(word >> 8) : static_cast<uint8_t>(word & 0xFFu);
+    if (index == 0) {
+      out_transparent = true;
+      out_color = 0;
+      return true;
+    }
+    out_color = clut_lookup(index, clut_x, clut_y);
+    return true;
+  }
+  int word_x = tpage_x + (u / 4);
+  int y = tpage_y + v;
+  if (!in_vram(word_x, y)) {
+    return false;
+  }
+  uint16_t word = vram_[static_cast<size_t>(y) * kVramWidth + word_x];
+  uint8_t index = static_cast<uint8_t>((word >> ((u & 3) * 4)) & 0xFu);
+  if (index == 0) {
+    out_transparent = true;
+    out_color = 0;
+    return true;
+  }
+  out_color = clut_lookup(index, clut_x, clut_y);
+  return true;
+}
+
+void SoftwareGpu::apply_texture_window(int &u, int &v) const {
+  int mask_x = tex_window_mask_x_ * 8;
+  int mask_y = tex_window_mask_y_ * 8;
+  int offset_x = tex_window_offset_x_ * 8;
+  int offset_y = tex_window_offset_y_ * 8;
+
+  if (mask_x) {
+    u = (u & ~mask_x) | (offset_x & mask_x);
+  }
+  if (mask_y) {
+    v = (v & ~mask_y) | (offset_y & mask_y);
+  }
+}
+
+uint16_t SoftwareGpu::clut_lookup(uint8_t index, int clut_x, int clut_y) {
+  int x = clut_x + index;
+  int y = clut_y;
+  if (!in_vram(x, y)) {
+    return 0;
+  }
+  return vram_[static_cast<size_t>(y) * kVramWidth + x];
+}
+
+bool SoftwareGpu::in_vram(int x, int y) const {
+  return x >= 0 && x < kVramWidth && y >= 0 && y < kVramHeight;
+}
+
+void SoftwareGpu::write_vram_pixel(int x, int y, uint16_t color) {
+  if (!in_vram(x, y)) {
+    return;
+  }
+  size_t idx = static_cast<size_t>(y) * kVramWidth + x;
+  if (mask_eval_ && (vram_[idx] & 0x8000u)) {
+    return;
+  }
+  uint16_t out = mask_set_ ? static_cast<uint16_t>(color | 0x8000u) : color;
+  vram_[idx] = out;
+}
+
+void SoftwareGpu::dump_frame() {
+  if (!dump_frames_ || dump_dir_.empty() || frame_.empty()) {
+    return;
+  }
+  dump_counter_++;
+  if (dump_counter_ < dump_every_) {
+    return;
+  }
+  dump_counter_ = 0;
+  std::ostringstream path;
+  path << dump_dir_ << "/frame_"
+       << std::setw(6) << std::setfill('0') << dump_index_++
+       << ".ppm";
+  write_ppm(path.str(), frame_, display_width_, display_height_);
+}
+
+uint8_t SoftwareGpu::vram_byte(int byte_x, int y) const {
+  if (byte_x < 0 || byte_x >= kVramWidth * 2 || y < 0 || y >= kVramHeight) {
+    return 0;
+  }
+  int word_x = byte_x >> 1;
+  uint16_t word = vram_[static_cast<size_t>(y) * kVramWidth + word_x];
+  if (byte_x & 1) {
+    return static_cast<uint8_t>(word >> 8);
+  }
+  return static_cast<uint8_t>(word & 0xFFu);
+}
+
+void SoftwareGpu::set_pixel(int x, int y, uint16_t color, bool semi) {
+  set_pixel(x, y, color, semi, blend_mode_);
+}
+
+void SoftwareGpu::set_pixel(int x, int y, uint16_t color, bool semi, int blend_mode) {
+  if (x < draw_x1_ || x > draw_x2_ || y < draw_y1_ || y > draw_y2_) {
+    return;
+  }
+  if (!in_vram(x, y)) {
+    return;
+  }
+  if (!draw_to_display_) {
+    int dx1 = display_x_ + display_width_ - 1;
+    int dy1 = display_y_ + display_height_ - 1;
+    if (x >= display_x_ && x <= dx1 && y >= display_y_ && y <= dy1) {
+      return;
+    }
+  }
+  size_t idx = static_cast<size_t>(y) * kVramWidth + x;
+  span_write_pixel(vram_[idx], static_cast<uint16_t>(color | 0x8000u), x, span_params(x, y, semi, blend_mode));
+}
@@ -0,0 +1,340 @@
+#ifndef PS1EMU_SOFTWARE_GPU_H
+#define PS1EMU_SOFTWARE_GPU_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+#include "span_kernels.h"
+
+#ifdef PS1EMU_GPU_SDL
+#include <SDL2/SDL.h>
+#endif
+
+// Shared by the process stub (main.cpp) and the in-process library
+// (library.cpp); both wrap the same renderer, compiled from software_gpu.cpp.
+
+// PS1EMU_LOG_GPU.
+bool gpu_log_enabled();
+
+struct Vertex {
+  int x = 0;
+  int y = 0;
+  uint32_t color = 0;
+  uint8_t u = 0;
+  uint8_t v = 0;
+};
+
+class SoftwareGpu {
+public:
+  SoftwareGpu();
+  void set_headless(bool headless) { headless_ = headless; }
+  // PS1EMU_HEADLESS, PS1EMU_FRAME_DUMP_DIR and PS1EMU_FRAME_DUMP_EVERY.
+  void configure_from_env();
+  void set_frame_dump(const std::string &dir, int every);
+  bool init_display();
+  void shutdown_display();
+  void handle_packet(const std::vector<uint32_t> &words);
+  void handle_gp1(uint32_t word);
+
+  // Moves VRAM into memory the host also maps (VramMirror).
+  void use_shared_vram(uint16_t *pixels);
+
+  // Host VBlank. Interlaced output alternates fields, so it always presents.
+  void present_field();
+
+  // out receives min(w, 1024) x min(h, 512) pixels; outside VRAM reads 0.
+  void copy_vram_region(int x, int y, int w, int h, uint16_t *out) const;
+  std::vector<uint8_t> read_vram_region(int x, int y, int w, int h);
+  void pump_events();
+  void present();
+  bool running() const { return running_; }
+
+private:
+  static constexpr int kVramWidth = 1024;
+  static constexpr int kVramHeight = 512;
+
+  void handle_state(uint8_t cmd, uint32_t word);
+  void set_display_mode(uint32_t word);
+  void apply_display_ranges();
+  void update_display_size(int width, int height);
+  void handle_vram_copy(const std::vector<uint32_t> &words);
+  void handle_image_load(const std::vector<uint32_t> &words);
+  void handle_polygon(const std::vector<uint32_t> &words);
+  void handle_rect(const std::vector<uint32_t> &words);
+  void handle_line(const std::vector<uint32_t> &words);
+  void draw_line(int x0,
+                 int y0,
+                 int x1,
+                 int y1,
+                 uint32_t color0,
+                 uint32_t color1,
+                 bool gouraud,
+                 bool semi);
+  void draw_rect(int x, int y, int w, int h, uint16_t color, bool semi);
+  void draw_textured_rect(int x,
+                          int y,
+                          int w,
+                          int h,
+                          uint8_t u,
+                          uint8_t v,
+                          int tex_depth,
+                          int tpage_x,
+                          int tpage_y,
+                          int clut_x,
+                          int clut_y,
+                          bool semi,
+                          bool raw,
+                          uint32_t modulate);
+
+  // Interpolated per-pixel attributes, in the order rasterize_triangle() hands them out.
+  enum TriangleAttr {
+    kAttrR,
+    kAttrG,
+    kAttrB,
+    kAttrU,
+    kAttrV,
+    kAttrCount,
+  };
+
+  static constexpr int kAttrFracBits = 16;
+
+  static int vertex_attr(const Vertex &v, int attr);
+
+  // Edge function of a->b at (x, y): positive on the interior side once the
+  // triangle is wound so its area is positive.
+  static int64_t edge_function(const Vertex &a, const Vertex &b, int x, int y);
+
+  // Walks the triangle one row at a time. Coverage comes from integer edge
+  // functions stepped per row and solved for the covered span, so pixels
+  // outside the triangle are never visited. Like the hardware, right and
+  // bottom edges are not drawn, and polygons wider than 1023 or taller than
+  // 511 pixels are dropped. Attributes are planes with 16.16 per-pixel and
+  // per-row gradients set up once per triangle, stepped by addition and
+  // truncated. pixel(i, attrs) gets them as 0..255 integers for the i-th
+  // pixel of a row's span, then span(x, y, count) hands the row over.
+  template <typename Pixel, typename Span>
+  void rasterize_triangle(const Vertex &v0, const Vertex &v1, const Vertex &v2, Pixel pixel, Span span) {
+    const Vertex *p[3] = {&v0, &v1, &v2};
+    int64_t area = edge_function(*p[0], *p[1], p[2]->x, p[2]->y);
+    if (area == 0) {
+      return;
+    }
+    if (area < 0) {
+      std::swap(p[1], p[2]);
+    }
+    int vx_min = std::min({v0.x, v1.x, v2.x});
+    int vx_max = std::max({v0.x, v1.x, v2.x});
+    int vy_min = std::min({v0.y, v1.y, v2.y});
+    int vy_max = std::max({v0.y, v1.y, v2.y});
+    if (vx_max - vx_min >= kVramWidth || vy_max - vy_min >= kVramHeight) {
+      return;
+    }
+    int min_x = std::max(draw_x1_, vx_min);
+    int max_x = std::min(draw_x2_, vx_max);
+    int min_y = std::max(draw_y1_, vy_min);
+    int max_y = std::min(draw_y2_, vy_max);
+    if (min_x > max_x || min_y > max_y) {
+      return;
+    }
+
+    // Edge i is opposite vertex i. Values are taken at (min_x, y); edges that
+    // do not own their boundary pixels carry a -1 bias.
+    int64_t edge_row[3];
+    int64_t edge_dx[3];
+    int64_t edge_dy[3];
+    for (int i = 0; i < 3; ++i) {
+      const Vertex &a = *p[(i + 1) % 3];
+      const Vertex &b = *p[(i + 2) % 3];
+      edge_dx[i] = b.y - a.y;
+      edge_dy[i] = -(b.x - a.x);
+      bool owns_edge = edge_dx[i] > 0 || (edge_dx[i] == 0 && edge_dy[i] > 0);
+      edge_row[i] = edge_function(a, b, min_x, min_y) - (owns_edge ? 0 : 1);
+    }
+
+    const Vertex &o = *p[0];
+    int64_t ex1 = p[1]->x - o.x;
+    int64_t ey1 = p[1]->y - o.y;
+    int64_t ex2 = p[2]->x - o.x;
+    int64_t ey2 = p[2]->y - o.y;
+    int64_t det = ex1 * ey2 - ex2 * ey1;
+    int64_t attr_row[kAttrCount];
+    int64_t attr_dx[kAttrCount];
+    int64_t attr_dy[kAttrCount];
+    for (int i = 0; i < kAttrCount; ++i) {
+      int64_t s0 = vertex_attr(o, i);
+      int64_t d1 = vertex_attr(*p[1], i) - s0;
+      int64_t d2 = vertex_attr(*p[2], i) - s0;
+      attr_dx[i] = ((d1 * ey2 - d2 * ey1) * (int64_t(1) << kAttrFracBits)) / det;
+      attr_dy[i] = ((d2 * ex1 - d1 * ex2) * (int64_t(1) << kAttrFracBits)) / det;
+      attr_row[i] = (s0 << kAttrFracBits) + (int64_t(1) << (kAttrFracBits - 1)) +
+                    attr_dx[i] * (min_x - o.x) + attr_dy[i] * (min_y - o.y);
+    }
+
+    int width = max_x - min_x;
+    for (int y = min_y; y <= max_y; ++y) {
+      int64_t lo = 0;
+      int64_t hi = width;
+      for (int i = 0; i < 3; ++i) {
+        int64_t e = edge_row[i];
+        int64_t step = edge_dx[i];
+        if (step > 0) {
+          if (e < 0) {
+            lo = std::max(lo, (-e + step - 1) / step);
+          }
+        } else if (step < 0) {
+          hi = e < 0 ? -1 : std::min(hi, e / -step);
+        } else if (e < 0) {
+          hi = -1;
+        }
+      }
+      if (lo <= hi) {
+        int64_t attr[kAttrCount];
+        for (int i = 0; i < kAttrCount; ++i) {
+          attr[i] = attr_row[i] + attr_dx[i] * lo;
+        }
+        int count = static_cast<int>(hi - lo + 1);
+        for (int n = 0; n < count; ++n) {
+          int values[kAttrCount];
+          for (int i = 0; i < kAttrCount; ++i) {
+            values[i] = static_cast<int>(std::clamp<int64_t>(attr[i] >> kAttrFracBits, 0, 255));
+            attr[i] += attr_dx[i];
+          }
+          pixel(n, values);
+        }
+        span(min_x + static_cast<int>(lo), y, count);
+      }
+      for (int i = 0; i < 3; ++i) {
+        edge_row[i] += edge_dy[i];
+      }
+      for (int i = 0; i < kAttrCount; ++i) {
+        attr_row[i] += attr_dy[i];
+      }
+    }
+  }
+
+  static uint32_t attr_color(const int *attr);
+  void draw_triangle(const Vertex &v0,
+                     const Vertex &v1,
+                     const Vertex &v2,
+                     bool gouraud,
+                     bool semi);
+  void draw_textured_triangle(const Vertex &v0,
+                              const Vertex &v1,
+                              const Vertex &v2,
+                              int tex_depth,
+                              int tpage_x,
+                              int tpage_y,
+                              int clut_x,
+                              int clut_y,
+                              bool semi,
+                              int blend_mode,
+                              bool gouraud,
+                              bool raw);
+
+  // Samples into span_texel_[i]; texels that miss VRAM or are transparent
+  // clear span_cover_[i].
+  void sample_span_texel(int i,
+                         int u,
+                         int v,
+                         int tex_depth,
+                         int tpage_x,
+                         int tpage_y,
+                         int clut_x,
+                         int clut_y);
+
+  // Texels keep bit 15, so only semi-transparent texels blend.
+  void write_textured_span(int x, int y, int count, bool semi, int blend_mode, bool raw);
+
+  // Writes span_src_[0..count) (and cover) to row y starting at x, with the
+  // same clipping as set_pixel().
+  void write_span(int x, int y, int count, const uint8_t *cover, bool semi, int blend_mode);
+  void write_span_run(int x, int y, int begin, int end, const uint8_t *cover, bool semi, int blend_mode);
+  SpanWriteParams span_params(int x, int y, bool semi, int blend_mode) const;
+  bool sample_texture(int u,
+                      int v,
+                      int tex_depth,
+                      int tpage_x,
+                      int tpage_y,
+                      int clut_x,
+                      int clut_y,
+                      uint16_t &out_color,
+                      bool &out_transparent);
+  void apply_texture_window(int &u, int &v) const;
+  uint16_t clut_lookup(uint8_t index, int clut_x, int clut_y);
+  bool in_vram(int x, int y) const;
+  void write_vram_pixel(int x, int y, uint16_t color);
+  void dump_frame();
+  uint8_t vram_byte(int byte_x, int y) const;
+  void set_pixel(int x, int y, uint16_t color, bool semi);
+  void set_pixel(int x, int y, uint16_t color, bool semi, int blend_mode);
+
+  bool headless_ = false;
+  bool running_ = true;
+  bool display_enabled_ = true;
+  bool display_flip_x_ = false;
+  bool display_depth24_ = false;
+  bool interlaced_ = false;
+  bool field_parity_ = false;
+  int h_range_start_ = 0;
+  int h_range_end_ = 0;
+  int v_range_start_ = 0;
+  int v_range_end_ = 0;
+
+#ifdef PS1EMU_GPU_SDL
+  SDL_Window *window_ = nullptr;
+  SDL_Renderer *renderer_ = nullptr;
+  SDL_Texture *texture_ = nullptr;
+#endif
+  std::vector<uint32_t> frame_;
+  std::vector<uint16_t> vram_storage_;
+  uint16_t *vram_ = nullptr;
+
+  // One row of pixels on its way through span_kernels_.
+  SpanKernels span_kernels_ = span_kernels();
+  std::array<uint16_t, kVramWidth> span_src_ {};
+  std::array<uint16_t, kVramWidth> span_texel_ {};
+  std::array<uint32_t, kVramWidth> span_shade_ {};
+  std::array<uint8_t, kVramWidth> span_cover_ {};
+
+  int draw_x1_ = 0;
+  int draw_y1_ = 0;
+  int draw_x2_ = kVramWidth - 1;
+  int draw_y2_ = kVramHeight - 1;
+  int draw_offset_x_ = 0;
+  int draw_offset_y_ = 0;
+  int texpage_x_ = 0;
+  int texpage_y_ = 0;
+  int tex_depth_ = 0;
+  int blend_mode_ = 0;
+  bool mask_set_ = false;
+  bool mask_eval_ = false;
+  bool dithering_enabled_ = false;
+  bool draw_to_display_ = false;
+  bool rect_flip_x_ = false;
+  bool rect_flip_y_ = false;
+  int tex_window_mask_x_ = 0;
+  int tex_window_mask_y_ = 0;
+  int tex_window_offset_x_ = 0;
+  int tex_window_offset_y_ = 0;
+
+  int display_x_ = 0;
+  int display_y_ = 0;
+  bool frame_dirty_ = true;
+  int display_width_ = 320;
+  int display_height_ = 240;
+  int mode_width_ = 320;
+  int mode_height_ = 240;
+  int scale_ = 2;
+
+  bool dump_frames_ = false;
+  int dump_every_ = 1;
+  int dump_counter_ = 0;
+  uint64_t dump_index_ = 0;
+  std::string dump_dir_;
+};
+
+#endif
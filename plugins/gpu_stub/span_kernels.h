@@ -0,0 +1,450 @@
+#ifndef PS1EMU_SPAN_KERNELS_H
+#define PS1EMU_SPAN_KERNELS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PS1EMU_SPAN_X86 1
+#endif
+
+// Per-pixel back end of SoftwareGpu: texture modulation and the VRAM write
+// (dither, semi-transparency, mask test and mask set) over a horizontal run of
+// pixels. The scalar versions define the results; the SSE2 and AVX2 versions
+// handle 8 and 16 pixels per step and must match them bit for bit.
+
+enum class SpanIsa {
+  Scalar,
+  Sse2,
+  Avx2,
+};
+
+struct SpanWriteParams {
+  int x = 0; // VRAM position of the first pixel; picks the dither pattern
+  int y = 0;
+  int blend_mode = 0;
+  bool semi = false; // blend pixels whose source bit 15 is set
+  bool dither = false;
+  bool mask_set = false;
+  bool mask_eval = false;
+};
+
+// dst/src/cover hold count pixels. src bit 15 marks a pixel for blending;
+// cover, when given, skips pixels whose byte is 0.
+using SpanWriteFn = void (*)(uint16_t *dst,
+                             const uint16_t *src,
+                             const uint8_t *cover,
+                             int count,
+                             const SpanWriteParams &params);
+// out = texel modulated by the 24-bit shade colour, keeping the texel's bit 15.
+using SpanModulateFn = void (*)(uint16_t *out, const uint16_t *texel, const uint32_t *shade, int count);
+
+struct SpanKernels {
+  SpanIsa isa;
+  const char *name;
+  SpanWriteFn write;
+  SpanModulateFn modulate;
+};
+
+// (matrix - 8) >> 2 of the 4x4 ordered dither, i.e. -2..1 per 5-bit channel.
+static constexpr int8_t kSpanDither[4][4] = {
+    {-2, 0, -2, 0},
+    {1, -1, 1, -1},
+    {-2, 0, -2, 0},
+    {1, -1, 1, -1},
+};
+
+inline uint16_t span_blend(uint16_t dst, uint16_t src, int mode) {
+  int dr = dst & 0x1F;
+  int dg = (dst >> 5) & 0x1F;
+  int db = (dst >> 10) & 0x1F;
+  int sr = src & 0x1F;
+  int sg = (src >> 5) & 0x1F;
+  int sb = (src >> 10) & 0x1F;
+  int r = 0;
+  int g = 0;
+  int b = 0;
+  switch (mode & 0x3) {
+    case 0:
+      r = (dr + sr) >> 1;
+      g = (dg + sg) >> 1;
+      b = (db + sb) >> 1;
+      break;
+    case 1:
+      r = std::min(31, dr + sr);
+      g = std::min(31, dg + sg);
+      b = std::min(31, db + sb);
+      break;
+    case 2:
+      r = std::max(0, dr - sr);
+      g = std::max(0, dg - sg);
+      b = std::max(0, db - sb);
+      break;
+    case 3:
+      r = std::min(31, dr + (sr >> 2));
+      g = std::min(31, dg + (sg >> 2));
+      b = std::min(31, db + (sb >> 2));
+      break;
+  }
+  return static_cast<uint16_t>((b << 10) | (g << 5) | r);
+}
+
+inline uint16_t span_modulate(uint16_t texel, uint32_t color) {
+  int tr = (texel & 0x1F) << 3;
+  int tg = ((texel >> 5) & 0x1F) << 3;
+  int tb = ((texel >> 10) & 0x1F) << 3;
+  int cr = static_cast<int>(color & 0xFF);
+  int cg = static_cast<int>((color >> 8) & 0xFF);
+  int cb = static_cast<int>((color >> 16) & 0xFF);
+  int r = (tr * cr + 127) / 255;
+  int g = (tg * cg + 127) / 255;
+  int b = (tb * cb + 127) / 255;
+  return static_cast<uint16_t>(((b >> 3) << 10) | ((g >> 3) << 5) | (r >> 3));
+}
+
+inline uint16_t span_dither(uint16_t color, int x, int y) {
+  int d = kSpanDither[y & 3][x & 3];
+  int r = std::clamp((color & 0x1F) + d, 0, 31);
+  int g = std::clamp(((color >> 5) & 0x1F) + d, 0, 31);
+  int b = std::clamp(((color >> 10) & 0x1F) + d, 0, 31);
+  return static_cast<uint16_t>((b << 10) | (g << 5) | r);
+}
+
+inline void span_write_pixel(uint16_t &dst, uint16_t src, int x, const SpanWriteParams &p) {
+  if (p.mask_eval && (dst & 0x8000u)) {
+    return;
+  }
+  uint16_t color = static_cast<uint16_t>(src & 0x7FFFu);
+  if (p.dither) {
+    color = span_dither(color, x, p.y);
+  }
+  if (p.semi && (src & 0x8000u)) {
+    color = span_blend(static_cast<uint16_t>(dst & 0x7FFFu), color, p.blend_mode);
+  }
+  dst = p.mask_set ? static_cast<uint16_t>(color | 0x8000u) : color;
+}
+
+inline void span_write_scalar(uint16_t *dst,
+                              const uint16_t *src,
+                              const uint8_t *cover,
+                              int count,
+                              const SpanWriteParams &params) {
+  for (int i = 0; i < count; ++i) {
+    if (!cover || cover[i]) {
+      span_write_pixel(dst[i], src[i], params.x + i, params);
+    }
+  }
+}
+
+inline void span_modulate_scalar(uint16_t *out, const uint16_t *texel, const uint32_t *shade, int count) {
+  for (int i = 0; i < count; ++i) {
+    out[i] = static_cast<uint16_t>(span_modulate(texel[i], shade[i]) | (texel[i] & 0x8000u));
+  }
+}
+
+#ifdef PS1EMU_SPAN_X86
+
+// Dither offsets for pixels x..x+7 of row y; the pattern repeats every 4
+// pixels, so one vector serves a whole span stepped 8 or 16 at a time.
+__attribute__((target("sse2"))) inline __m128i span_dither_row_sse2(int x, int y) {
+  const int8_t *row = kSpanDither[y & 3];
+  return _mm_setr_epi16(row[x & 3],
+                        row[(x + 1) & 3],
+                        row[(x + 2) & 3],
+                        row[(x + 3) & 3],
+                        row[x & 3],
+                        row[(x + 1) & 3],
+                        row[(x + 2) & 3],
+                        row[(x + 3) & 3]);
+}
+
+__attribute__((target("sse2"))) inline void span_write_sse2(uint16_t *dst,
+                                                             const uint16_t *src,
+                                                             const uint8_t *cover,
+                                                             int count,
+                                                             const SpanWriteParams &params) {
+  const __m128i ch = _mm_set1_epi16(0x1F);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i all = _mm_set1_epi16(-1);
+  const __m128i dither = span_dither_row_sse2(params.x, params.y);
+  const __m128i mask_bit = _mm_set1_epi16(params.mask_set ? static_cast<int16_t>(0x8000) : 0);
+  const int mode = params.blend_mode & 0x3;
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i keep = all;
+    if (cover) {
+      __m128i c = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cover + i));
+      c = _mm_unpacklo_epi8(c, c);
+      keep = _mm_andnot_si128(_mm_cmpeq_epi16(c, zero), all);
+    }
+    if (params.mask_eval) {
+      keep = _mm_andnot_si128(_mm_srai_epi16(d, 15), keep);
+    }
+    __m128i sr = _mm_and_si128(s, ch);
+    __m128i sg = _mm_and_si128(_mm_srli_epi16(s, 5), ch);
+    __m128i sb = _mm_and_si128(_mm_srli_epi16(s, 10), ch);
+    if (params.dither) {
+      sr = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(sr, dither), zero), ch);
+      sg = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(sg, dither), zero), ch);
+      sb = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(sb, dither), zero), ch);
+    }
+    if (params.semi) {
+      __m128i blend = _mm_srai_epi16(s, 15);
+      __m128i dr = _mm_and_si128(d, ch);
+      __m128i dg = _mm_and_si128(_mm_srli_epi16(d, 5), ch);
+      __m128i db = _mm_and_si128(_mm_srli_epi16(d, 10), ch);
+      __m128i br;
+      __m128i bg;
+      __m128i bb;
+      switch (mode) {
+        case 0:
+          br = _mm_srli_epi16(_mm_add_epi16(dr, sr), 1);
+          bg = _mm_srli_epi16(_mm_add_epi16(dg, sg), 1);
+          bb = _mm_srli_epi16(_mm_add_epi16(db, sb), 1);
+          break;
+        case 1:
+          br = _mm_min_epi16(_mm_add_epi16(dr, sr), ch);
+          bg = _mm_min_epi16(_mm_add_epi16(dg, sg), ch);
+          bb = _mm_min_epi16(_mm_add_epi16(db, sb), ch);
+          break;
+        case 2:
+          br = _mm_max_epi16(_mm_sub_epi16(dr, sr), zero);
+          bg = _mm_max_epi16(_mm_sub_epi16(dg, sg), zero);
+          bb = _mm_max_epi16(_mm_sub_epi16(db, sb), zero);
+          break;
+        default:
+          br = _mm_min_epi16(_mm_add_epi16(dr, _mm_srli_epi16(sr, 2)), ch);
+          bg = _mm_min_epi16(_mm_add_epi16(dg, _mm_srli_epi16(sg, 2)), ch);
+          bb = _mm_min_epi16(_mm_add_epi16(db, _mm_srli_epi16(sb, 2)), ch);
+          break;
+      }
+      sr = _mm_or_si128(_mm_and_si128(blend, br), _mm_andnot_si128(blend, sr));
+      sg = _mm_or_si128(_mm_and_si128(blend, bg), _mm_andnot_si128(blend, sg));
+      sb = _mm_or_si128(_mm_and_si128(blend, bb), _mm_andnot_si128(blend, sb));
+    }
+    __m128i out = _mm_or_si128(
+        _mm_or_si128(sr, _mm_slli_epi16(sg, 5)), _mm_or_si128(_mm_slli_epi16(sb, 10), mask_bit));
+    out = _mm_or_si128(_mm_and_si128(keep, out), _mm_andnot_si128(keep, d));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), out);
+  }
+  SpanWriteParams tail = params;
+  tail.x += i;
+  span_write_scalar(dst + i, src + i, cover ? cover + i : nullptr, count - i, tail);
+}
+
+// (v + 1 + (v >> 8)) >> 8 == v / 255 for every v the modulation produces.
+__attribute__((target("sse2"))) inline __m128i span_div255_sse2(__m128i v) {
+  v = _mm_add_epi16(v, _mm_set1_epi16(127));
+  return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(v, _mm_set1_epi16(1)), _mm_srli_epi16(v, 8)), 8);
+}
+
+__attribute__((target("sse2"))) inline void span_modulate_sse2(uint16_t *out,
+                                                                const uint16_t *texel,
+                                                                const uint32_t *shade,
+                                                                int count) {
+  const __m128i ch = _mm_set1_epi16(0x1F);
+  const __m128i byte = _mm_set1_epi32(0xFF);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(texel + i));
+    __m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(shade + i));
+    __m128i c1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(shade + i + 4));
+    __m128i cr = _mm_packs_epi32(_mm_and_si128(c0, byte), _mm_and_si128(c1, byte));
+    __m128i cg = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(c0, 8), byte),
+                                 _mm_and_si128(_mm_srli_epi32(c1, 8), byte));
+    __m128i cb = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(c0, 16), byte),
+                                 _mm_and_si128(_mm_srli_epi32(c1, 16), byte));
+    __m128i tr = _mm_slli_epi16(_mm_and_si128(t, ch), 3);
+    __m128i tg = _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(t, 5), ch), 3);
+    __m128i tb = _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(t, 10), ch), 3);
+    __m128i r = _mm_srli_epi16(span_div255_sse2(_mm_mullo_epi16(tr, cr)), 3);
+    __m128i g = _mm_srli_epi16(span_div255_sse2(_mm_mullo_epi16(tg, cg)), 3);
+    __m128i b = _mm_srli_epi16(span_div255_sse2(_mm_mullo_epi16(tb, cb)), 3);
+    __m128i result = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi16(g, 5)), _mm_slli_epi16(b, 10));
+    result = _mm_or_si128(result, _mm_and_si128(t, _mm_set1_epi16(static_cast<int16_t>(0x8000))));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), result);
+  }
+  span_modulate_scalar(out + i, texel + i, shade + i, count - i);
+}
+
+__attribute__((target("avx2"))) inline void span_write_avx2(uint16_t *dst,
+                                                             const uint16_t *src,
+                                                             const uint8_t *cover,
+                                                             int count,
+                                                             const SpanWriteParams &params) {
+  const __m256i ch = _mm256_set1_epi16(0x1F);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i all = _mm256_set1_epi16(-1);
+  const __m128i dither_half = span_dither_row_sse2(params.x, params.y);
+  const __m256i dither = _mm256_inserti128_si256(_mm256_castsi128_si256(dither_half), dither_half, 1);
+  const __m256i mask_bit = _mm256_set1_epi16(params.mask_set ? static_cast<int16_t>(0x8000) : 0);
+  const int mode = params.blend_mode & 0x3;
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+    __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    __m256i keep = all;
+    if (cover) {
+      __m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cover + i)));
+      keep = _mm256_andnot_si256(_mm256_cmpeq_epi16(c, zero), all);
+    }
+    if (params.mask_eval) {
+      keep = _mm256_andnot_si256(_mm256_srai_epi16(d, 15), keep);
+    }
+    __m256i sr = _mm256_and_si256(s, ch);
+    __m256i sg = _mm256_and_si256(_mm256_srli_epi16(s, 5), ch);
+    __m256i sb = _mm256_and_si256(_mm256_srli_epi16(s, 10), ch);
+    if (params.dither) {
+      sr = _mm256_min_epi16(_mm256_max_epi16(_mm256_add_epi16(sr, dither), zero), ch);
+      sg = _mm256_min_epi16(_mm256_max_epi16(_mm256_add_epi16(sg, dither), zero), ch);
+      sb = _mm256_min_epi16(_mm256_max_epi16(_mm256_add_epi16(sb, dither), zero), ch);
+    }
+    if (params.semi) {
+      __m256i blend = _mm256_srai_epi16(s, 15);
+      __m256i dr = _mm256_and_si256(d, ch);
+      __m256i dg = _mm256_and_si256(_mm256_srli_epi16(d, 5), ch);
+      __m256i db = _mm256_and_si256(_mm256_srli_epi16(d, 10), ch);
+      __m256i br;
+      __m256i bg;
+      __m256i bb;
+      switch (mode) {
+        case 0:
+          br = _mm256_srli_epi16(_mm256_add_epi16(dr, sr), 1);
+          bg = _mm256_srli_epi16(_mm256_add_epi16(dg, sg), 1);
+          bb = _mm256_srli_epi16(_mm256_add_epi16(db, sb), 1);
+          break;
+        case 1:
+          br = _mm256_min_epi16(_mm256_add_epi16(dr, sr), ch);
+          bg = _mm256_min_epi16(_mm256_add_epi16(dg, sg), ch);
+          bb = _mm256_min_epi16(_mm256_add_epi16(db, sb), ch);
+          break;
+        case 2:
+          br = _mm256_max_epi16(_mm256_sub_epi16(dr, sr), zero);
+          bg = _mm256_max_epi16(_mm256_sub_epi16(dg, sg), zero);
+          bb = _mm256_max_epi16(_mm256_sub_epi16(db, sb), zero);
+          break;
+        default:
+          br = _mm256_min_epi16(_mm256_add_epi16(dr, _mm256_srli_epi16(sr, 2)), ch);
+          bg = _mm256_min_epi16(_mm256_add_epi16(dg, _mm256_srli_epi16(sg, 2)), ch);
+          bb = _mm256_min_epi16(_mm256_add_epi16(db, _mm256_srli_epi16(sb, 2)), ch);
+          break;
+      }
+      sr = _mm256_blendv_epi8(sr, br, blend);
+      sg = _mm256_blendv_epi8(sg, bg, blend);
+      sb = _mm256_blendv_epi8(sb, bb, blend);
+    }
+    __m256i out = _mm256_or_si256(_mm256_or_si256(sr, _mm256_slli_epi16(sg, 5)),
+                                  _mm256_or_si256(_mm256_slli_epi16(sb, 10), mask_bit));
+    out = _mm256_blendv_epi8(d, out, keep);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), out);
+  }
+  SpanWriteParams tail = params;
+  tail.x += i;
+  span_write_sse2(dst + i, src + i, cover ? cover + i : nullptr, count - i, tail);
+}
+
+__attribute__((target("avx2"))) inline __m256i span_div255_avx2(__m256i v) {
+  v = _mm256_add_epi16(v, _mm256_set1_epi16(127));
+  return _mm256_srli_epi16(
+      _mm256_add_epi16(_mm256_add_epi16(v, _mm256_set1_epi16(1)), _mm256_srli_epi16(v, 8)), 8);
+}
+
+__attribute__((target("avx2"))) inline void span_modulate_avx2(uint16_t *out,
+                                                                const uint16_t *texel,
+                                                                const uint32_t *shade,
+                                                                int count) {
+  const __m256i ch = _mm256_set1_epi16(0x1F);
+  const __m256i byte = _mm256_set1_epi32(0xFF);
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(texel + i));
+    __m256i c0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(shade + i));
+    __m256i c1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(shade + i + 8));
+    // packs works per 128-bit lane; the permute restores pixel order.
+    __m256i cr = _mm256_permute4x64_epi64(
+        _mm256_packs_epi32(_mm256_and_si256(c0, byte), _mm256_and_si256(c1, byte)), 0xD8);
+    __m256i cg = _mm256_permute4x64_epi64(
+        _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(c0, 8), byte),
+                           _mm256_and_si256(_mm256_srli_epi32(c1, 8), byte)),
+        0xD8);
+    __m256i cb = _mm256_permute4x64_epi64(
+        _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(c0, 16), byte),
+                           _mm256_and_si256(_mm256_srli_epi32(c1, 16), byte)),
+        0xD8);
+    __m256i tr = _mm256_slli_epi16(_mm256_and_si256(t, ch), 3);
+    __m256i tg = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(t, 5), ch), 3);
+    __m256i tb = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(t, 10), ch), 3);
+    __m256i r = _mm256_srli_epi16(span_div255_avx2(_mm256_mullo_epi16(tr, cr)), 3);
+    __m256i g = _mm256_srli_epi16(span_div255_avx2(_mm256_mullo_epi16(tg, cg)), 3);
+    __m256i b = _mm256_srli_epi16(span_div255_avx2(_mm256_mullo_epi16(tb, cb)), 3);
+    __m256i result =
+        _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi16(g, 5)), _mm256_slli_epi16(b, 10));
+    result = _mm256_or_si256(result,
+                             _mm256_and_si256(t, _mm256_set1_epi16(static_cast<int16_t>(0x8000))));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), result);
+  }
+  span_modulate_sse2(out + i, texel + i, shade + i, count - i);
+}
+
+#endif
+
+inline bool span_isa_supported(SpanIsa isa) {
+  switch (isa) {
+    case SpanIsa::Scalar:
+      return true;
+#ifdef PS1EMU_SPAN_X86
+    case SpanIsa::Sse2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2");
+    case SpanIsa::Avx2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+// Falls back to scalar when isa is not available on this CPU or build.
+inline SpanKernels span_kernels_for(SpanIsa isa) {
+  if (!span_isa_supported(isa)) {
+    isa = SpanIsa::Scalar;
+  }
+  switch (isa) {
+#ifdef PS1EMU_SPAN_X86
+    case SpanIsa::Avx2:
+      return {SpanIsa::Avx2, "avx2", span_write_avx2, span_modulate_avx2};
+    case SpanIsa::Sse2:
+      return {SpanIsa::Sse2, "sse2", span_write_sse2, span_modulate_sse2};
+#endif
+    default:
+      return {SpanIsa::Scalar, "scalar", span_write_scalar, span_modulate_scalar};
+  }
+}
+
+// Best kernels for this CPU, picked once. PS1EMU_GPU_SIMD=scalar|sse2|avx2
+// caps the choice.
+inline const SpanKernels &span_kernels() {
+  static const SpanKernels kernels = [] {
+    SpanIsa isa = SpanIsa::Avx2;
+    const char *env = getenv("PS1EMU_GPU_SIMD");
+    if (env && strcmp(env, "scalar") == 0) {
+      isa = SpanIsa::Scalar;
+    } else if (env && strcmp(env, "sse2") == 0) {
+      isa = SpanIsa::Sse2;
+    }
+    while (isa != SpanIsa::Scalar && !span_isa_supported(isa)) {
+      isa = static_cast<SpanIsa>(static_cast<int>(isa) - 1);
+    }
+    return span_kernels_for(isa);
+  }();
+  return kernels;
+}
+
+#endif
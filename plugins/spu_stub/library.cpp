@@ -0,0 +1,59 @@
+#include "ps1emu/plugin_api.h"
+
+#include "spu_mixer.h"
+
+#include <new>
+
+// In-process build of the SPU stub (plugin.spu_mode=library).
+
+static void *spu_create() {
+  return new (std::nothrow) SpuMixer();
+}
+
+static void spu_destroy(void *self) {
+  delete static_cast<SpuMixer *>(self);
+}
+
+static void spu_submit_pcm(void *self,
+                           uint32_t lba,
+                           uint32_t sample_rate,
+                           uint32_t channels,
+                           const int16_t *samples,
+                           uint32_t frames) {
+  (void)lba;
+  if (channels < 1 || channels > 2) {
+    return;
+  }
+  std::vector<int16_t> left(frames);
+  std::vector<int16_t> right;
+  if (channels == 2) {
+    right.resize(frames);
+  }
+  for (uint32_t i = 0; i < frames; ++i) {
+    left[i] = samples[i * channels];
+    if (channels == 2) {
+      right[i] = samples[i * 2 + 1];
+    }
+  }
+  static_cast<SpuMixer *>(self)->submit(sample_rate, std::move(left), std::move(right));
+}
+
+static void spu_set_volume(void *self, int16_t left, int16_t right) {
+  static_cast<SpuMixer *>(self)->set_volume(left, right);
+}
+
+static const ps1emu_spu_vtable_t kSpuVtable = {
+    {PS1EMU_PLUGIN_API_VERSION, PS1EMU_PLUGIN_SPU, "ps1emu SPU mixer"},
+    spu_create,
+    spu_destroy,
+    spu_submit_pcm,
+    spu_set_volume,
+};
+
+extern "C" __attribute__((visibility("default"))) const ps1emu_plugin_info_t *ps1emu_plugin_entry(
+    int host_api_version) {
+  if (host_api_version != PS1EMU_PLUGIN_API_VERSION) {
+    return nullptr;
+  }
+  return &kSpuVtable.info;
+}
@@ -1,60 +1,20 @@
 #include "plugins/ipc.h"
+#include "spu_mixer.h"
 
-#include <algorithm>
 #include <cstdlib>
-#include <fstream>
-#include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <unistd.h>
 
-#ifdef PS1EMU_SPU_SDL
-#include <SDL2/SDL.h>
-#endif
-
 int main() {
   ps1emu::IpcChannel channel(STDIN_FILENO, STDOUT_FILENO);
   if (!channel.valid()) {
     return 1;
   }
 
-  const char *mix_rate_env = std::getenv("PS1EMU_SPU_MIX_RATE");
-  uint32_t mix_rate = 44100;
-  if (mix_rate_env && *mix_rate_env) {
-    int rate = std::atoi(mix_rate_env);
-    if (rate > 0) {
-      mix_rate = static_cast<uint32_t>(rate);
-    }
-  }
-
-  bool audio_enabled = false;
-#ifdef PS1EMU_SPU_SDL
-  const char *audio_disable = std::getenv("PS1EMU_SPU_DISABLE_AUDIO");
-  SDL_AudioDeviceID audio_dev = 0;
-  bool sdl_inited = false;
-  if (!audio_disable || *audio_disable == '\0' || *audio_disable == '0') {
-    if (SDL_Init(SDL_INIT_AUDIO) == 0) {
-      sdl_inited = true;
-      SDL_AudioSpec desired {};
-      SDL_AudioSpec obtained {};
-      desired.freq = static_cast<int>(mix_rate);
-      desired.format = AUDIO_S16;
-      desired.channels = 2;
-      desired.samples = 1024;
-      desired.callback = nullptr;
-      audio_dev = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
-      if (audio_dev != 0) {
-        mix_rate = static_cast<uint32_t>(obtained.freq);
-        SDL_PauseAudioDevice(audio_dev, 0);
-        audio_enabled = true;
-      }
-    }
-  }
-#endif
-
-  const char *wav_path = std::getenv("PS1EMU_SPU_DUMP_WAV");
-  std::vector<int16_t> mix_buffer;
+  SpuMixer mixer;
 
   std::string line;
   if (!channel.recv_line(line)) {
@@ -66,78 +26,7 @@ int main() {
   }
   channel.send_line("READY SPU 1");
 
-  auto clamp_sample = [](int32_t value) -> int16_t {
-    if (value > 32767) {
-      return 32767;
-    }
-    if (value < -32768) {
-      return -32768;
-    }
-    return static_cast<int16_t>(value);
-  };
-
-  auto resample_channel = [&](const std::vector<int16_t> &in, uint32_t out_count) -> std::vector<int16_t> {
-    if (out_count == 0 || in.empty()) {
-      return {};
-    }
-    if (in.size() == 1) {
-      return std::vector<int16_t>(out_count, in[0]);
-    }
-    if (out_count == in.size()) {
-      return in;
-    }
-    std::vector<int16_t> out(out_count);
-    double scale = static_cast<double>(in.size() - 1) / static_cast<double>(out_count - 1);
-    for (uint32_t i = 0; i < out_count; ++i) {
-      double pos = static_cast<double>(i) * scale;
-      size_t idx = static_cast<size_t>(pos);
-      double frac = pos - static_cast<double>(idx);
-      int32_t a = in[idx];
-      int32_t b = in[std::min(idx + 1, in.size() - 1)];
-      int32_t interp = static_cast<int32_t>(a + (b - a) * frac);
-      out[i] = clamp_sample(interp);
-    }
-    return out;
-  };
-
-  auto write_wav = [&](const std::string &path) {
-    if (mix_buffer.empty()) {
-      return;
-    }
-    std::ofstream out(path, std::ios::binary);
-    if (!out.is_open()) {
-      return;
-    }
-    uint16_t channels = 2;
-    uint32_t sample_rate = mix_rate;
-    uint16_t bits_per_sample = 16;
-    uint32_t byte_rate = sample_rate * channels * (bits_per_sample / 8);
-    uint16_t block_align = channels * (bits_per_sample / 8);
-    uint32_t data_size = static_cast<uint32_t>(mix_buffer.size() * sizeof(int16_t));
-    uint32_t riff_size = 36 + data_size;
-
-    out.write("RIFF", 4);
-    out.write(reinterpret_cast<const char *>(&riff_size), 4);
-    out.write("WAVE", 4);
-    out.write("fmt ", 4);
-    uint32_t fmt_size = 16;
-    uint16_t audio_format = 1;
-    out.write(reinterpret_cast<const char *>(&fmt_size), 4);
-    out.write(reinterpret_cast<const char *>(&audio_format), 2);
-    out.write(reinterpret_cast<const char *>(&channels), 2);
-    out.write(reinterpret_cast<const char *>(&sample_rate), 4);
-    out.write(reinterpret_cast<const char *>(&byte_rate), 4);
-    out.write(reinterpret_cast<const char *>(&block_align), 2);
-    out.write(reinterpret_cast<const char *>(&bits_per_sample), 2);
-    out.write("data", 4);
-    out.write(reinterpret_cast<const char *>(&data_size), 4);
-    out.write(reinterpret_cast<const char *>(mix_buffer.data()),
-              static_cast<std::streamsize>(mix_buffer.size() * sizeof(int16_t)));
-  };
-
   bool frame_mode = false;
-  int16_t master_vol_l = 0x3FFF;
-  int16_t master_vol_r = 0x3FFF;
   while (true) {
     if (!frame_mode) {
       if (!channel.recv_line(line)) {
@@ -147,6 +36,17 @@ int main() {
         channel.send_line("PONG");
         continue;
       }
+      if (line.rfind("SHM_RING ", 0) == 0) {
+        auto ring = std::make_unique<ps1emu::ShmRing>();
+        std::string error;
+        if (ring->attach(std::atoi(line.c_str() + 9), error)) {
+          channel.use_ring(std::move(ring));
+          channel.send_line("SHM_RING_READY");
+        } else {
+          channel.send_line("ERROR " + error);
+        }
+        continue;
+      }
       if (line == "FRAME_MODE") {
         frame_mode = true;
         channel.send_line("FRAME_READY");
@@ -189,69 +89,15 @@ int main() {
             right.push_back(r);
           }
         }
-        if (channels == 1) {
-          right = left;
-        }
-
-        uint32_t out_count = static_cast<uint32_t>(
-            static_cast<double>(sample_count) * static_cast<double>(mix_rate) / static_cast<double>(sample_rate));
-        if (out_count == 0) {
-          continue;
-        }
-        left = resample_channel(left, out_count);
-        right = resample_channel(right, out_count);
-
-        std::vector<int16_t> interleaved(out_count * 2);
-        for (uint32_t i = 0; i < out_count; ++i) {
-          interleaved[i * 2] = left[i];
-          interleaved[i * 2 + 1] = right[i];
-        }
-
-        if (master_vol_l != 0x3FFF || master_vol_r != 0x3FFF) {
-          for (uint32_t i = 0; i < out_count; ++i) {
-            int32_t l = (static_cast<int32_t>(interleaved[i * 2]) * master_vol_l) / 0x3FFF;
-            int32_t r = (static_cast<int32_t>(interleaved[i * 2 + 1]) * master_vol_r) / 0x3FFF;
-            interleaved[i * 2] = clamp_sample(l);
-            interleaved[i * 2 + 1] = clamp_sample(r);
-          }
-        }
-
-#ifdef PS1EMU_SPU_SDL
-        if (audio_enabled && audio_dev != 0) {
-          uint32_t queued = SDL_GetQueuedAudioSize(audio_dev);
-          uint32_t max_queue = mix_rate * 2 * 2 * 2;
-          if (queued < max_queue) {
-            SDL_QueueAudio(audio_dev,
-                           interleaved.data(),
-                           static_cast<uint32_t>(interleaved.size() * sizeof(int16_t)));
-          }
-        }
-#endif
-
-        if (wav_path && *wav_path) {
-          mix_buffer.insert(mix_buffer.end(), interleaved.begin(), interleaved.end());
-        }
+        mixer.submit(sample_rate, std::move(left), std::move(right));
       }
     }
     if (type == 0x0102 && payload.size() >= 4) {
-      master_vol_l = static_cast<int16_t>(payload[0] | (payload[1] << 8));
-      master_vol_r = static_cast<int16_t>(payload[2] | (payload[3] << 8));
+      mixer.set_volume(static_cast<int16_t>(payload[0] | (payload[1] << 8)),
+                       static_cast<int16_t>(payload[2] | (payload[3] << 8)));
       continue;
     }
   }
 
-  if (wav_path && *wav_path) {
-    write_wav(wav_path);
-  }
-
-#ifdef PS1EMU_SPU_SDL
-  if (audio_enabled && audio_dev != 0) {
-    SDL_CloseAudioDevice(audio_dev);
-  }
-  if (sdl_inited) {
-    SDL_QuitSubSystem(SDL_INIT_AUDIO);
-  }
-#endif
-
   return 0;
 }
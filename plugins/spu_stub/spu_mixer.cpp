@@ -0,0 +1,175 @@
+#include "spu_mixer.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <fstream>
+
+SpuMixer::SpuMixer() {
+  const char *mix_rate_env = getenv("PS1EMU_SPU_MIX_RATE");
+  if (mix_rate_env && *mix_rate_env) {
+    int rate = atoi(mix_rate_env);
+    if (rate > 0) {
+      mix_rate_ = static_cast<uint32_t>(rate);
+    }
+  }
+#ifdef PS1EMU_SPU_SDL
+  const char *audio_disable = getenv("PS1EMU_SPU_DISABLE_AUDIO");
+  if (!audio_disable || *audio_disable == '\0' || *audio_disable == '0') {
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) == 0) {
+      sdl_inited_ = true;
+      SDL_AudioSpec desired {};
+      SDL_AudioSpec obtained {};
+      desired.freq = static_cast<int>(mix_rate_);
+      desired.format = AUDIO_S16;
+      desired.channels = 2;
+      desired.samples = 1024;
+      desired.callback = nullptr;
+      audio_dev_ = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+      if (audio_dev_ != 0) {
+        mix_rate_ = static_cast<uint32_t>(obtained.freq);
+        SDL_PauseAudioDevice(audio_dev_, 0);
+      }
+    }
+  }
+#endif
+  const char *wav_path = getenv("PS1EMU_SPU_DUMP_WAV");
+  if (wav_path) {
+    wav_path_ = wav_path;
+  }
+}
+
+SpuMixer::~SpuMixer() {
+  if (!wav_path_.empty()) {
+    write_wav(wav_path_);
+  }
+#ifdef PS1EMU_SPU_SDL
+  if (audio_dev_ != 0) {
+    SDL_CloseAudioDevice(audio_dev_);
+  }
+  if (sdl_inited_) {
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+  }
+#endif
+}
+
+void SpuMixer::set_volume(int16_t left, int16_t right) {
+  master_vol_l_ = left;
+  master_vol_r_ = right;
+}
+
+void SpuMixer::submit(uint32_t sample_rate, std::vector<int16_t> left, std::vector<int16_t> right) {
+  if (left.empty() || sample_rate == 0) {
+    return;
+  }
+  if (right.empty()) {
+    right = left;
+  }
+  uint32_t out_count = static_cast<uint32_t>(
+      static_cast<double>(left.size()) * static_cast<double>(mix_rate_) / static_cast<double>(sample_rate));
+  if (out_count == 0) {
+    return;
+  }
+  left = resample_channel(left, out_count);
+  right = resample_channel(right, out_count);
+
+  std::vector<int16_t> interleaved(out_count * 2);
+  for (uint32_t i = 0; i < out_count; ++i) {
+    interleaved[i * 2] = left[i];
+    interleaved[i * 2 + 1] = right[i];
+  }
+
+  if (master_vol_l_ != 0x3FFF || master_vol_r_ != 0x3FFF) {
+    for (uint32_t i = 0; i < out_count; ++i) {
+      int32_t l = (static_cast<int32_t>(interleaved[i * 2]) * master_vol_l_) / 0x3FFF;
+      int32_t r = (static_cast<int32_t>(interleaved[i * 2 + 1]) * master_vol_r_) / 0x3FFF;
+      interleaved[i * 2] = clamp_sample(l);
+      interleaved[i * 2 + 1] = clamp_sample(r);
+    }
+  }
+
+#ifdef PS1EMU_SPU_SDL
+  if (audio_dev_ != 0) {
+    uint32_t queued = SDL_GetQueuedAudioSize(audio_dev_);
+    uint32_t max_queue = mix_rate_ * 2 * 2 * 2;
+    if (queued < max_queue) {
+      SDL_QueueAudio(audio_dev_,
+                     interleaved.data(),
+                     static_cast<uint32_t>(interleaved.size() * sizeof(int16_t)));
+    }
+  }
+#endif
+
+  if (!wav_path_.empty()) {
+    mix_buffer_.insert(mix_buffer_.end(), interleaved.begin(), interleaved.end());
+  }
+}
+
+int16_t SpuMixer::clamp_sample(int32_t value) {
+  if (value > 32767) {
+    return 32767;
+  }
+  if (value < -32768) {
+    return -32768;
+  }
+  return static_cast<int16_t>(value);
+}
+
+std::vector<int16_t> SpuMixer::resample_channel(const std::vector<int16_t> &in, uint32_t out_count) {
+  if (out_count == 0 || in.empty()) {
+    return {};
+  }
+  if (in.size() == 1) {
+    return std::vector<int16_t>(out_count, in[0]);
+  }
+  if (out_count == in.size()) {
+    return in;
+  }
+  std::vector<int16_t> out(out_count);
+  double scale = static_cast<double>(in.size() - 1) / static_cast<double>(out_count - 1);
+  for (uint32_t i = 0; i < out_count; ++i) {
+    double pos = static_cast<double>(i) * scale;
+    size_t idx = static_cast<size_t>(pos);
+    double frac = pos - static_cast<double>(idx);
+    int32_t a = in[idx];
+    int32_t b = in[std::min(idx + 1, in.size() - 1)];
+    int32_t interp = static_cast<int32_t>(a + (b - a) * frac);
+    out[i] = clamp_sample(interp);
+  }
+  return out;
+}
+
+void SpuMixer::write_wav(const std::string &path) {
+  if (mix_buffer_.empty()) {
+    return;
+  }
+  std::ofstream out(path, std::ios::binary);
+  if (!out.is_open()) {
+    return;
+  }
+  uint16_t channels = 2;
+  uint32_t sample_rate = mix_rate_;
+  uint16_t bits_per_sample = 16;
+  uint32_t byte_rate = sample_rate * channels * (bits_per_sample / 8);
+  uint16_t block_align = channels * (bits_per_sample / 8);
+  uint32_t data_size = static_cast<uint32_t>(mix_buffer_.size() * sizeof(int16_t));
+  uint32_t riff_size = 36 + data_size;
+
+  out.write("RIFF", 4);
+  out.write(reinterpret_cast<const char *>(&riff_size), 4);
+  out.write("WAVE", 4);
+  out.write("fmt ", 4);
+  uint32_t fmt_size = 16;
+  uint16_t audio_format = 1;
+  out.write(reinterpret_cast<const char *>(&fmt_size), 4);
+  out.write(reinterpret_cast<const char *>(&audio_format), 2);
+  out.write(reinterpret_cast<const char *>(&channels), 2);
+  out.write(reinterpret_cast<const char *>(&sample_rate), 4);
+  out.write(reinterpret_cast<const char *>(&byte_rate), 4);
+  out.write(reinterpret_cast<const char *>(&block_align), 2);
+  out.write(reinterpret_cast<const char *>(&bits_per_sample), 2);
+  out.write("data", 4);
+  out.write(reinterpret_cast<const char *>(&data_size), 4);
+  out.write(reinterpret_cast<const char *>(mix_buffer_.data()),
+            static_cast<std::streamsize>(mix_buffer_.size() * sizeof(int16_t)));
+}
@@ -0,0 +1,44 @@
+#ifndef PS1EMU_SPU_MIXER_H
+#define PS1EMU_SPU_MIXER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#ifdef PS1EMU_SPU_SDL
+#include <SDL2/SDL.h>
+#endif
+
+// Resamples decoded XA audio to the mix rate, applies the master volume and
+// queues it to SDL and/or a WAV dump. Shared by the process stub (main.cpp)
+// and the in-process library (library.cpp).
+class SpuMixer {
+public:
+  // PS1EMU_SPU_MIX_RATE, PS1EMU_SPU_DISABLE_AUDIO and PS1EMU_SPU_DUMP_WAV.
+  SpuMixer();
+  ~SpuMixer();
+
+  SpuMixer(const SpuMixer &) = delete;
+  SpuMixer &operator=(const SpuMixer &) = delete;
+
+  void set_volume(int16_t left, int16_t right);
+  void submit(uint32_t sample_rate, std::vector<int16_t> left, std::vector<int16_t> right);
+
+private:
+  static int16_t clamp_sample(int32_t value);
+  static std::vector<int16_t> resample_channel(const std::vector<int16_t> &in, uint32_t out_count);
+  void write_wav(const std::string &path);
+
+  uint32_t mix_rate_ = 44100;
+  int16_t master_vol_l_ = 0x3FFF;
+  int16_t master_vol_r_ = 0x3FFF;
+  std::string wav_path_;
+  std::vector<int16_t> mix_buffer_;
+#ifdef PS1EMU_SPU_SDL
+  SDL_AudioDeviceID audio_dev_ = 0;
+  bool sdl_inited_ = false;
+#endif
+};
+
+#endif
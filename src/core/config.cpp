@@ -68,6 +68,23 @@ static bool parse_cpu_mode(const std::string &value, CpuMode &out) {
     out = CpuMode::Dynarec;
     return true;
   }
+  if (normalized == "threaded") {
+    out = CpuMode::Threaded;
+    return true;
+  }
+  return false;
+}
+
+static bool parse_plugin_mode(const std::string &value, PluginMode &out) {
+  std::string normalized = to_lower(trim(value));
+  if (normalized == "process") {
+    out = PluginMode::Process;
+    return true;
+  }
+  if (normalized == "library") {
+    out = PluginMode::Library;
+    return true;
+  }
   return false;
 }
 
@@ -132,6 +149,24 @@ bool load_config_file(const std::string &path, Config &out, std::string &error)
       out.plugin_cdrom = value;
       continue;
     }
+    if (key == "plugin.gpu_mode") {
+      PluginMode mode = PluginMode::Process;
+      if (!parse_plugin_mode(value, mode)) {
+        error = "Invalid plugin.gpu_mode value";
+        return false;
+      }
+      out.plugin_gpu_mode = mode;
+      continue;
+    }
+    if (key == "plugin.spu_mode") {
+      PluginMode mode = PluginMode::Process;
+      if (!parse_plugin_mode(value, mode)) {
+        error = "Invalid plugin.spu_mode value";
+        return false;
+      }
+      out.plugin_spu_mode = mode;
+      continue;
+    }
     if (key == "cdrom.image") {
       out.cdrom_image = value;
       continue;
@@ -145,6 +180,87 @@ bool load_config_file(const std::string &path, Config &out, std::string &error)
       out.cpu_mode = mode;
       continue;
     }
+    if (key == "cpu.fastmem") {
+      bool enabled = false;
+      if (!parse_bool(value, enabled)) {
+        error = "Invalid cpu.fastmem value";
+        return false;
+      }
+      out.cpu_fastmem = enabled;
+      continue;
+    }
+    if (key == "cpu.dynarec_block_limit") {
+      int parsed = 0;
+      if (!parse_int(value, parsed) || parsed < 1 || parsed > 256) {
+        error = "Invalid cpu.dynarec_block_limit value";
+        return false;
+      }
+      out.cpu_dynarec_block_limit = parsed;
+      continue;
+    }
+    if (key == "cpu.dynarec_hot_threshold") {
+      int parsed = 0;
+      if (!parse_int(value, parsed) || parsed < 1 || parsed > 65535) {
+        error = "Invalid cpu.dynarec_hot_threshold value";
+        return false;
+      }
+      out.cpu_dynarec_hot_threshold = parsed;
+      continue;
+    }
+    if (key == "cpu.dynarec_cache") {
+      bool enabled = false;
+      if (!parse_bool(value, enabled)) {
+        error = "Invalid cpu.dynarec_cache value";
+        return false;
+      }
+      out.cpu_dynarec_cache = enabled;
+      continue;
+    }
+    if (key == "cpu.idle_skip") {
+      bool enabled = false;
+      if (!parse_bool(value, enabled)) {
+        error = "Invalid cpu.idle_skip value";
+        return false;
+      }
+      out.cpu_idle_skip = enabled;
+      continue;
+    }
+    if (key == "core.slice_cycles") {
+      int parsed = 0;
+      if (!parse_int(value, parsed) || parsed < 1 || parsed > 1000000) {
+        error = "Invalid core.slice_cycles value";
+        return false;
+      }
+      out.core_slice_cycles = parsed;
+      continue;
+    }
+    if (key == "ipc.shm_ring") {
+      bool enabled = true;
+      if (!parse_bool(value, enabled)) {
+        error = "Invalid ipc.shm_ring value";
+        return false;
+      }
+      out.ipc_shm_ring = enabled;
+      continue;
+    }
+    if (key == "gpu.async_submit") {
+      bool enabled = true;
+      if (!parse_bool(value, enabled)) {
+        error = "Invalid gpu.async_submit value";
+        return false;
+      }
+      out.gpu_async_submit = enabled;
+      continue;
+    }
+    if (key == "gpu.shared_vram") {
+      bool enabled = true;
+      if (!parse_bool(value, enabled)) {
+        error = "Invalid gpu.shared_vram value";
+        return false;
+      }
+      out.gpu_shared_vram = enabled;
+      continue;
+    }
     if (key == "sandbox.enabled") {
       bool enabled = true;
       if (!parse_bool(value, enabled)) {
@@ -10,7 +10,15 @@ namespace ps1emu {
 enum class CpuMode {
   Auto,
   Interpreter,
-  Dynarec
+  Dynarec,
+  Threaded
+};
+
+// process: fork a sandboxed plugin executable and talk over IPC.
+// library: dlopen a trusted plugin .so and call its vtable directly.
+enum class PluginMode {
+  Process,
+  Library
 };
 
 struct Config {
@@ -19,8 +27,19 @@ struct Config {
   std::string plugin_spu;
   std::string plugin_input;
   std::string plugin_cdrom;
+  PluginMode plugin_gpu_mode = PluginMode::Process;
+  PluginMode plugin_spu_mode = PluginMode::Process;
   std::string cdrom_image;
   CpuMode cpu_mode = CpuMode::Auto;
+  bool cpu_fastmem = false;
+  int cpu_dynarec_block_limit = 64;
+  int cpu_dynarec_hot_threshold = 16;
+  bool cpu_dynarec_cache = false;
+  bool cpu_idle_skip = false;
+  int core_slice_cycles = 512;
+  bool ipc_shm_ring = false;
+  bool gpu_async_submit = false;
+  bool gpu_shared_vram = false;
   SandboxOptions sandbox;
 };
 
@@ -1,5 +1,8 @@
 #include "core/cpu.h"
 
+#include "core/dynarec_x64.h"
+
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
 #include <iomanip>
@@ -10,6 +13,17 @@
 namespace {
 constexpr uint32_t kCop0StatusBev = 1u << 22;
 constexpr uint32_t kCop0StatusIsc = 1u << 16;
+constexpr uint8_t kSpecial = 0x40;
+constexpr uint8_t kUndecoded = 0xFF;
+constexpr uint32_t kRamPhysLimit = 0x1F000000;
+constexpr uint32_t kBiosPhysBase = 0x1FC00000;
+constexpr size_t kRamDecodedPages = ps1emu::MemoryMap::kRamCodePages;
+constexpr size_t kBiosDecodedPages = ps1emu::BiosImage::kExpectedSize >> ps1emu::MemoryMap::kCodePageShift;
+// Most cycles linked dynarec blocks may run before returning to the
+// dispatcher; set_step_budget() lowers it ahead of device events.
+constexpr uint32_t kDynarecChainCycles = 256;
+// Longest loop (in instructions, delay slot included) idle detection looks at.
+constexpr uint32_t kIdleLoopMaxInstrs = 16;
 
 struct WatchRange {
   bool enabled = false;
@@ -122,8 +136,28 @@ namespace ps1emu {
 CpuCore::CpuCore(MemoryMap &memory, Scheduler &scheduler)
     : memory_(&memory),
       scheduler_(&scheduler),
-      dynarec_cache_(4096),
-      dynarec_backend_(std::make_unique<NullDynarecBackend>()) {}
+      dynarec_cache_(4096) {
+  if (X64DynarecBackend::host_supported()) {
+    DynarecRuntime runtime;
+    runtime.context = this;
+    runtime.cop2_read = &CpuCore::jit_cop2_read;
+    runtime.cop2_write = &CpuCore::jit_cop2_write;
+    runtime.raise_exception = &CpuCore::jit_raise_exception;
+    runtime.set_load_delay = &CpuCore::jit_set_load_delay;
+    runtime.lookup_link = &CpuCore::jit_lookup_link;
+    dynarec_backend_ = std::make_unique<X64DynarecBackend>(runtime);
+  } else {
+    dynarec_backend_ = std::make_unique<NullDynarecBackend>();
+  }
+  decoded_pages_.resize(kRamDecodedPages + kBiosDecodedPages);
+  memory_->set_code_write_hook(&CpuCore::on_code_write, this);
+  memory_->set_irq_line_hook(&CpuCore::on_irq_line, this);
+}
+
+CpuCore::~CpuCore() {
+  memory_->set_code_write_hook(nullptr, nullptr);
+  memory_->set_irq_line_hook(nullptr, nullptr);
+}
 
 void CpuCore::reset() {
   // TODO: reset registers and pipeline state.
@@ -140,7 +174,16 @@ void CpuCore::reset() {
   branch_pending_ = false;
   skip_next_ = false;
   exception_pending_ = false;
+  idle_loops_.clear();
+  idle_loop_pages_.clear();
+  idle_last_pc_ = 0;
+  idle_snapshot_pc_ = 0xFFFFFFFFu;
+  idle_polls_gpustat_ = false;
+  dynarec_cold_left_ = 0;
   dynarec_cache_.invalidate_all();
+  for (auto &page : decoded_pages_) {
+    page.reset();
+  }
 }
 
 void CpuCore::set_mode(Mode mode) {
@@ -151,6 +194,14 @@ CpuCore::Mode CpuCore::mode() const {
   return mode_;
 }
 
+void CpuCore::set_dynarec_block_limit(uint32_t limit) {
+  dynarec_cache_.set_block_limit(limit);
+}
+
+void CpuCore::set_dynarec_hot_threshold(uint32_t threshold) {
+  dynarec_cache_.set_hot_threshold(threshold);
+}
+
 CpuState &CpuCore::state() {
   return state_;
 }
@@ -159,6 +210,22 @@ std::vector<JitBlock> CpuCore::dynarec_blocks() const {
   return dynarec_cache_.snapshot();
 }
 
+std::vector<JitBlock> CpuCore::dynarec_cold_blocks() const {
+  return dynarec_cache_.cold_snapshot();
+}
+
+bool CpuCore::save_dynarec_profile(const std::string &path, std::string &error) const {
+  return dynarec_cache_.save_profile(path, error);
+}
+
+bool CpuCore::load_dynarec_profile(const std::string &path, std::string &error) {
+  return dynarec_cache_.load_profile(path, error);
+}
+
+const DynarecCache::Stats &CpuCore::dynarec_stats() const {
+  return dynarec_cache_.stats();
+}
+
 bool CpuCore::consume_exception(CpuExceptionInfo &out) {
   if (!exception_pending_) {
     return false;
@@ -172,15 +239,19 @@ uint32_t CpuCore::step() {
   if (mode_ == Mode::Dynarec) {
     return step_dynarec();
   }
+  if (mode_ == Mode::Threaded) {
+    return step_threaded();
+  }
   return step_interpreter();
 }
 
 bool CpuCore::dynarec_available() {
-  return true;
+  return X64DynarecBackend::host_supported();
 }
 
 void CpuCore::invalidate_code_range(uint32_t start, uint32_t size) {
   dynarec_cache_.invalidate_range(start, size);
+  drop_idle_loops(start, size);
 }
 
 uint32_t CpuCore::step_interpreter() {
@@ -221,7 +292,7 @@ uint32_t CpuCore::step_interpreter() {
   }
 
   uint32_t instr_pc = state_.pc;
-  uint32_t instr = memory_->read32(instr_pc);
+  const DecodedInstr &decoded = fetch_decoded(instr_pc);
 
   state_.pc = state_.next_pc;
   state_.next_pc = state_.pc + 4;
@@ -231,7 +302,7 @@ uint32_t CpuCore::step_interpreter() {
   bool exception = false;
   bool in_delay = branch_pending_;
 
-  uint32_t cycles = execute_instruction(instr, instr_pc, in_delay, new_load, branch_now, exception);
+  uint32_t cycles = execute_instruction(decoded, instr_pc, in_delay, new_load, branch_now, exception);
 
   branch_pending_ = branch_now && !exception;
   if (!exception && new_load.valid) {
@@ -249,28 +320,81 @@ uint32_t CpuCore::step_interpreter() {
   return cycles;
 }
 
+void CpuCore::set_step_budget(uint32_t cycles) {
+  step_budget_ = cycles;
+}
+
+bool CpuCore::dynarec_can_enter() const {
+  // Blocks start on a clean instruction boundary; pipeline leftovers and
+  // cache-isolated stores are stepped through the interpreter.
+  return !load_delay_.valid && !branch_pending_ && !skip_next_ && gte_pending_writes_.empty() &&
+         (state_.cop0.sr & kCop0StatusIsc) == 0;
+}
+
 uint32_t CpuCore::step_dynarec() {
   if (!dynarec_backend_) {
     return step_interpreter();
   }
+  if (dynarec_cold_left_ != 0 || !dynarec_can_enter()) {
+    return step_cold();
+  }
 
   JitBlock *block = dynarec_cache_.lookup(state_.pc);
   if (!block) {
+    if (!dynarec_cache_.promote(state_.pc, *memory_)) {
+      // Cold: interpret up to where the block would end and count the next head.
+      dynarec_cold_left_ = dynarec_cache_.block_limit();
+      return step_cold();
+    }
+    if (dynarec_backend_->code_space_low()) {
+      dynarec_cache_.invalidate_all();
+      dynarec_backend_->reset_code_space();
+    }
     block = dynarec_cache_.compile(state_.pc, *dynarec_backend_, *memory_);
+    if (block && block->size != 0) {
+      // Writes to these pages now reach on_code_write and drop the block.
+      memory_->mark_code_page(block->pc);
+      memory_->mark_code_page(block->pc + block->size - 4);
+    }
+  } else {
+    ++block->executions;
   }
 
   if (block && block->entry) {
-    uint32_t cycles = block->entry(&state_, memory_);
+    if (check_interrupts()) {
+      if (scheduler_) {
+        scheduler_->advance(1);
+      }
+      return 1;
+    }
+    memory_->clear_io_access_flag();
+    uint32_t budget = std::max<uint32_t>(1, std::min(kDynarecChainCycles, step_budget_));
+    uint32_t cycles = block->entry(&state_, memory_, budget);
+    state_.gpr[0] = 0;
     if (scheduler_) {
       scheduler_->advance(cycles);
     }
     return cycles;
   }
 
-  // Fallback to interpreter until a backend is available.
+  // Code the backend cannot translate runs one instruction at a time.
   return step_interpreter();
 }
 
+uint32_t CpuCore::step_cold() {
+  uint32_t pc = state_.pc;
+  bool in_delay = branch_pending_;
+  uint32_t cycles = step_interpreter();
+  if (dynarec_cold_left_ != 0) {
+    --dynarec_cold_left_;
+    // A finished delay slot, exception or interrupt starts the next block.
+    if (in_delay || state_.pc != pc + 4) {
+      dynarec_cold_left_ = 0;
+    }
+  }
+  return cycles;
+}
+
 uint32_t CpuCore::read_reg(uint32_t index) const {
   if (index == 0) {
     return 0;
@@ -296,6 +420,329 @@ static uint32_t sign_extend16(uint16_t value) {
   return static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(value)));
 }
 
+CpuCore::DecodedInstr CpuCore::decode_instruction(uint32_t instr) {
+  DecodedInstr decoded;
+  uint32_t op = instr >> 26;
+  decoded.word = instr;
+  decoded.handler = static_cast<uint8_t>(op == 0x00 ? (kSpecial | (instr & 0x3F)) : op);
+  decoded.rs = static_cast<uint8_t>((instr >> 21) & 0x1F);
+  decoded.rt = static_cast<uint8_t>((instr >> 16) & 0x1F);
+  decoded.rd = static_cast<uint8_t>((instr >> 11) & 0x1F);
+  decoded.sh = static_cast<uint8_t>((instr >> 6) & 0x1F);
+  decoded.imm = static_cast<uint16_t>(instr & 0xFFFF);
+  decoded.imm_se = sign_extend16(decoded.imm);
+  return decoded;
+}
+
+const CpuCore::DecodedInstr &CpuCore::fetch_decoded(uint32_t pc) {
+  uint32_t phys = pc & 0x1FFFFFFF;
+  size_t page_index = 0;
+  if (phys < kRamPhysLimit) {
+    page_index = (phys & (MemoryMap::kRamSize - 1)) >> MemoryMap::kCodePageShift;
+  } else if (phys >= kBiosPhysBase && phys < kBiosPhysBase + BiosImage::kExpectedSize) {
+    page_index = kRamDecodedPages + ((phys - kBiosPhysBase) >> MemoryMap::kCodePageShift);
+  } else {
+    // Scratchpad/expansion fetches are rare; decode them every time.
+    decoded_uncached_ = decode_instruction(memory_->read32(pc));
+    return decoded_uncached_;
+  }
+
+  auto &page = decoded_pages_[page_index];
+  if (!page) {
+    page = std::make_unique<DecodedPage>();
+    for (auto &entry : page->instrs) {
+      entry.handler = kUndecoded;
+    }
+    memory_->mark_code_page(pc);
+  }
+  DecodedInstr &entry = page->instrs[(phys >> 2) & (page->instrs.size() - 1)];
+  if (entry.handler == kUndecoded) {
+    entry = decode_instruction(memory_->read32(pc));
+  }
+  return entry;
+}
+
+void CpuCore::invalidate_decoded_range(uint32_t phys, uint32_t size) {
+  if (size == 0) {
+    return;
+  }
+  size_t base_index = 0;
+  uint32_t offset = 0;
+  if (phys < kRamPhysLimit) {
+    offset = phys & (MemoryMap::kRamSize - 1);
+    size = std::min<uint32_t>(size, static_cast<uint32_t>(MemoryMap::kRamSize - offset));
+  } else if (phys >= kBiosPhysBase && phys < kBiosPhysBase + BiosImage::kExpectedSize) {
+    base_index = kRamDecodedPages;
+    offset = phys - kBiosPhysBase;
+    size = std::min<uint32_t>(size, static_cast<uint32_t>(BiosImage::kExpectedSize - offset));
+  } else {
+    return;
+  }
+
+  constexpr uint32_t kPageSize = 1u << MemoryMap::kCodePageShift;
+  uint32_t end = offset + size;
+  while (offset < end) {
+    uint32_t page_start = offset & ~(kPageSize - 1);
+    uint32_t chunk_end = std::min(end, page_start + kPageSize);
+    auto &page = decoded_pages_[base_index + (offset >> MemoryMap::kCodePageShift)];
+    if (page) {
+      if (offset == page_start && chunk_end == page_start + kPageSize) {
+        page.reset();
+      } else {
+        for (uint32_t word = offset & ~3u; word < chunk_end; word += 4) {
+          page->instrs[(word & (kPageSize - 1)) >> 2].handler = kUndecoded;
+        }
+      }
+    }
+    offset = chunk_end;
+  }
+}
+
+void CpuCore::on_code_write(void *context, uint32_t phys, uint32_t size) {
+  auto *cpu = static_cast<CpuCore *>(context);
+  cpu->invalidate_decoded_range(phys, size);
+  cpu->dynarec_cache_.invalidate_range(phys, size);
+  cpu->drop_idle_loops(phys, size);
+}
+
+// RAM mirrors fold onto one range so a store through any of them finds loops
+// analysed through another.
+static uint32_t idle_code_phys(uint32_t addr) {
+  uint32_t phys = addr & 0x1FFFFFFF;
+  return phys < kRamPhysLimit ? phys & static_cast<uint32_t>(MemoryMap::kRamSize - 1) : phys;
+}
+
+// Drops the idle_loops_ entries whose analysed code overlaps the range;
+// PCs left in the page index for entries that are already gone are pruned
+// on the way.
+void CpuCore::drop_idle_loops(uint32_t phys, uint32_t size) {
+  if (size == 0 || idle_loops_.empty()) {
+    return;
+  }
+  uint32_t first = idle_code_phys(phys);
+  uint32_t last = first + (size - 1);
+  for (uint32_t page = first >> MemoryMap::kCodePageShift; page <= (last >> MemoryMap::kCodePageShift); ++page) {
+    auto indexed = idle_loop_pages_.find(page);
+    if (indexed == idle_loop_pages_.end()) {
+      continue;
+    }
+    std::vector<uint32_t> &pcs = indexed->second;
+    pcs.erase(std::remove_if(pcs.begin(),
+                             pcs.end(),
+                             [&](uint32_t pc) {
+                               auto loop = idle_loops_.find(pc);
+                               if (loop == idle_loops_.end()) {
+                                 return true;
+                               }
+                               if (loop->second.first <= last && first <= loop->second.last) {
+                                 idle_loops_.erase(loop);
+                                 return true;
+                               }
+                               return false;
+                             }),
+              pcs.end());
+    if (pcs.empty()) {
+      idle_loop_pages_.erase(indexed);
+    }
+  }
+}
+
+// Reads that return the same value until a device event changes it: RAM,
+// scratchpad, BIOS and status registers without read side effects.
+static bool idle_safe_address(uint32_t addr) {
+  if (addr >= 0xC0000000u) {
+    return false;
+  }
+  uint32_t phys = addr & 0x1FFFFFFF;
+  if (phys < 0x00800000u) {
+    return true;
+  }
+  if ((phys >= 0x1F800000u && phys < 0x1F800400u) ||
+      (phys >= kBiosPhysBase && phys < kBiosPhysBase + BiosImage::kExpectedSize)) {
+    return true;
+  }
+  return (phys >= 0x1F801044u && phys < 0x1F801048u) || // JOY_STAT
+         (phys >= 0x1F801070u && phys < 0x1F801078u) || // I_STAT/I_MASK
+         (phys >= 0x1F801080u && phys < 0x1F801100u) || // DMA registers
+         phys == 0x1F801800u ||                         // CD-ROM status
+         (phys >= 0x1F801814u && phys < 0x1F801818u) || // GPUSTAT, see idle_polls_gpustat()
+         (phys >= 0x1F801DAEu && phys < 0x1F801DB0u);   // SPUSTAT
+}
+
+static bool idle_reads_gpustat(uint32_t addr) {
+  uint32_t phys = addr & 0x1FFFFFFF;
+  return phys >= 0x1F801814u && phys < 0x1F801818u;
+}
+
+// Finds the short backward branch closing the loop around pc and checks
+// every instruction in it: loads, register ALU ops and branches without
+// link. Anything that stores, traps or touches COP0/GTE is not idle.
+const CpuCore::IdleLoop &CpuCore::idle_loop_at(uint32_t pc) {
+  auto found = idle_loops_.find(pc);
+  if (found != idle_loops_.end()) {
+    return found->second;
+  }
+  IdleLoop &loop = idle_loops_[pc];
+  // The scan below reads at most kIdleLoopMaxInstrs words either side of pc.
+  uint32_t code = idle_code_phys(pc);
+  loop.first = code >= kIdleLoopMaxInstrs * 4 ? code - kIdleLoopMaxInstrs * 4 : 0;
+  loop.last = code + kIdleLoopMaxInstrs * 4 + 3;
+  for (uint32_t page = loop.first >> MemoryMap::kCodePageShift; page <= (loop.last >> MemoryMap::kCodePageShift);
+       ++page) {
+    idle_loop_pages_[page].push_back(pc);
+  }
+  uint32_t phys = pc & 0x1FFFFFFF;
+  bool cached = phys < kRamPhysLimit ||
+                (phys >= kBiosPhysBase && phys < kBiosPhysBase + BiosImage::kExpectedSize);
+  if (!cached || (pc & 3u) != 0) {
+    return loop;
+  }
+
+  auto branch_target = [](const DecodedInstr &d, uint32_t at, uint32_t &target) {
+    switch (d.handler) {
+      case 0x01:
+        if (d.rt > 1) {
+          return false; // BLTZAL/BGEZAL link
+        }
+        target = at + 4 + (d.imm_se << 2);
+        return true;
+      case 0x02:
+        target = ((at + 4) & 0xF0000000u) | ((d.word & 0x03FFFFFFu) << 2);
+        return true;
+      case 0x04:
+      case 0x05:
+      case 0x06:
+      case 0x07:
+        target = at + 4 + (d.imm_se << 2);
+        return true;
+      default:
+        return false;
+    }
+  };
+
+  uint32_t start = 0;
+  uint32_t end = 0;
+  bool closed = false;
+  for (uint32_t i = 0; i < kIdleLoopMaxInstrs && !closed; ++i) {
+    uint32_t at = pc + i * 4;
+    uint32_t target = 0;
+    DecodedInstr d = decode_instruction(memory_->read32(at));
+    if (branch_target(d, at, target) && target <= pc && at - target < kIdleLoopMaxInstrs * 4) {
+      start = target;
+      end = at + 4;
+      closed = true;
+    }
+  }
+  if (!closed) {
+    return loop;
+  }
+
+  uint32_t written = 0;
+  std::vector<std::pair<uint8_t, uint32_t>> loads;
+  for (uint32_t at = start; at <= end; at += 4) {
+    DecodedInstr d = decode_instruction(memory_->read32(at));
+    uint32_t target = 0;
+    switch (d.handler) {
+      case kSpecial | 0x00: // SLL
+      case kSpecial | 0x02: // SRL
+      case kSpecial | 0x03: // SRA
+      case kSpecial | 0x04: // SLLV
+      case kSpecial | 0x06: // SRLV
+      case kSpecial | 0x07: // SRAV
+      case kSpecial | 0x21: // ADDU
+      case kSpecial | 0x23: // SUBU
+      case kSpecial | 0x24: // AND
+      case kSpecial | 0x25: // OR
+      case kSpecial | 0x26: // XOR
+      case kSpecial | 0x27: // NOR
+      case kSpecial | 0x2A: // SLT
+      case kSpecial | 0x2B: // SLTU
+        written |= 1u << d.rd;
+        break;
+      case 0x09: // ADDIU
+      case 0x0A: // SLTI
+      case 0x0B: // SLTIU
+      case 0x0C: // ANDI
+      case 0x0D: // ORI
+      case 0x0E: // XORI
+      case 0x0F: // LUI
+        written |= 1u << d.rt;
+        break;
+      case 0x20: // LB
+      case 0x21: // LH
+      case 0x23: // LW
+      case 0x24: // LBU
+      case 0x25: // LHU
+        written |= 1u << d.rt;
+        loads.emplace_back(d.rs, d.imm_se);
+        break;
+      default:
+        if (!branch_target(d, at, target) || at == end) {
+          return loop; // also rejects a branch in the closing delay slot
+        }
+        break;
+    }
+  }
+  for (const auto &load : loads) {
+    if (load.first != 0 && (written & (1u << load.first)) != 0) {
+      return loop; // address moves between passes
+    }
+  }
+  // A store to the loop's code has to drop this entry.
+  memory_->mark_code_page(start);
+  memory_->mark_code_page(end);
+  loop.loads = std::move(loads);
+  loop.idle = true;
+  return loop;
+}
+
+bool CpuCore::poll_idle() {
+  uint32_t pc = state_.pc;
+  uint32_t last = idle_last_pc_;
+  idle_last_pc_ = pc;
+  // Only a PC that moved back a short way (or did not move, when a whole
+  // pass fits in one step) can be a loop head.
+  if (pc > last || last - pc >= kIdleLoopMaxInstrs * 4) {
+    return false;
+  }
+  if (load_delay_.valid || branch_pending_ || skip_next_ || !gte_pending_writes_.empty() ||
+      state_.next_pc != pc + 4) {
+    return false;
+  }
+  // Matching registers alone do not show that the values the last pass read
+  // are still current: an event between a load and the branch back leaves
+  // them unchanged. The bus's activity count does.
+  uint64_t activity = memory_->device_activity();
+  if (idle_snapshot_pc_ != pc || idle_snapshot_activity_ != activity ||
+      !std::equal(std::begin(state_.gpr), std::end(state_.gpr), std::begin(idle_snapshot_gpr_))) {
+    idle_snapshot_pc_ = pc;
+    idle_snapshot_activity_ = activity;
+    std::copy(std::begin(state_.gpr), std::end(state_.gpr), std::begin(idle_snapshot_gpr_));
+    return false;
+  }
+  const IdleLoop &loop = idle_loop_at(pc);
+  if (!loop.idle) {
+    return false;
+  }
+  bool polls_gpustat = false;
+  for (const auto &load : loop.loads) {
+    uint32_t addr = state_.gpr[load.first] + load.second;
+    if (!idle_safe_address(addr)) {
+      return false;
+    }
+    polls_gpustat = polls_gpustat || idle_reads_gpustat(addr);
+  }
+  idle_polls_gpustat_ = polls_gpustat;
+  return true;
+}
+
+// GPUSTAT's ready/busy bits are derived from the GPU's busy time on read,
+// not raised by an event, so a loop polling them may only be skipped up to
+// that time.
+bool CpuCore::idle_polls_gpustat() const {
+  return idle_polls_gpustat_;
+}
+
 void CpuCore::raise_exception(uint32_t excode,
                               uint32_t badaddr,
                               bool in_delay,
@@ -331,20 +778,15 @@ void CpuCore::raise_exception(uint32_t excode,
   branch_pending_ = false;
 }
 
+void CpuCore::on_irq_line(void *context, bool asserted) {
+  static_cast<CpuCore *>(context)->irq_line_ = asserted;
+}
+
 bool CpuCore::check_interrupts() {
-  bool ie = (state_.cop0.sr & 0x1) != 0;
-  bool exl = (state_.cop0.sr & (1u << 1)) != 0;
-  if (memory_) {
-    uint32_t pending = (static_cast<uint32_t>(memory_->irq_stat()) &
-                        static_cast<uint32_t>(memory_->irq_mask())) &
-                       0x3F;
-    // PS1 routes I_STAT through a single interrupt line (IP2).
-    state_.cop0.cause &= ~(0x3F << 10);
-    if (pending) {
-      state_.cop0.cause |= (1u << 10);
-    }
-  }
-  if (ie && !exl && memory_ && memory_->irq_pending()) {
+  // PS1 routes I_STAT through a single interrupt line (IP2). It is re-applied
+  // every check so an MTC0 to CAUSE cannot clear it.
+  state_.cop0.cause = (state_.cop0.cause & ~(0x3Fu << 10)) | (irq_line_ ? (1u << 10) : 0u);
+  if (irq_line_ && (state_.cop0.sr & 0x3u) == 0x1u) { // IE set, EXL clear
     if (irq_log_enabled()) {
       std::ostringstream oss;
       oss << std::hex << std::setfill('0');
@@ -362,7 +804,7 @@ bool CpuCore::check_interrupts() {
   return false;
 }
 
-uint32_t CpuCore::execute_instruction(uint32_t instr,
+uint32_t CpuCore::execute_instruction(const DecodedInstr &decoded,
                                       uint32_t instr_pc,
                                       bool in_delay,
                                       PendingLoad &out_load,
@@ -373,167 +815,157 @@ uint32_t CpuCore::execute_instruction(uint32_t instr,
   out_exception = false;
   uint32_t cycles = 1;
 
-  uint32_t op = instr >> 26;
-  uint32_t rs = (instr >> 21) & 0x1F;
-  uint32_t rt = (instr >> 16) & 0x1F;
-  uint32_t rd = (instr >> 11) & 0x1F;
-  uint32_t sh = (instr >> 6) & 0x1F;
-  uint32_t funct = instr & 0x3F;
-  uint16_t imm = static_cast<uint16_t>(instr & 0xFFFF);
-  uint32_t imm_se = sign_extend16(imm);
+  const uint32_t instr = decoded.word;
+  const uint32_t rs = decoded.rs;
+  const uint32_t rt = decoded.rt;
+  const uint32_t rd = decoded.rd;
+  const uint32_t sh = decoded.sh;
+  const uint16_t imm = decoded.imm;
+  const uint32_t imm_se = decoded.imm_se;
   const bool cache_isolated = (state_.cop0.sr & kCop0StatusIsc) != 0;
 
-  switch (op) {
-    case 0x00: { // SPECIAL
-      switch (funct) {
-        case 0x00: // SLL
-          write_reg(rd, read_reg(rt) << sh);
-          break;
-        case 0x02: // SRL
-          write_reg(rd, read_reg(rt) >> sh);
-          break;
-        case 0x03: // SRA
-          write_reg(rd, static_cast<uint32_t>(static_cast<int32_t>(read_reg(rt)) >> sh));
-          break;
-        case 0x04: // SLLV
-          write_reg(rd, read_reg(rt) << (read_reg(rs) & 0x1F));
-          break;
-        case 0x06: // SRLV
-          write_reg(rd, read_reg(rt) >> (read_reg(rs) & 0x1F));
-          break;
-        case 0x07: // SRAV
-          write_reg(rd, static_cast<uint32_t>(static_cast<int32_t>(read_reg(rt)) >> (read_reg(rs) & 0x1F)));
-          break;
-        case 0x08: // JR
-          set_branch_target(read_reg(rs));
-          out_branch = true;
-          break;
-        case 0x09: // JALR
-          write_reg(rd ? rd : 31, instr_pc + 8);
-          set_branch_target(read_reg(rs));
-          out_branch = true;
-          break;
-        case 0x0C: // SYSCALL
-          raise_exception(8, 0, in_delay, instr_pc, in_delay ? (instr_pc - 4) : instr_pc);
-          out_exception = true;
-          break;
-        case 0x0D: // BREAK
-          raise_exception(9, 0, in_delay, instr_pc, in_delay ? (instr_pc - 4) : instr_pc);
-          out_exception = true;
-          break;
-        case 0x10: // MFHI
-          write_reg(rd, state_.hi);
-          break;
-        case 0x11: // MTHI
-          state_.hi = read_reg(rs);
-          break;
-        case 0x12: // MFLO
-          write_reg(rd, state_.lo);
-          break;
-        case 0x13: // MTLO
-          state_.lo = read_reg(rs);
-          break;
-        case 0x18: { // MULT
-          int64_t res = static_cast<int64_t>(static_cast<int32_t>(read_reg(rs))) *
-                        static_cast<int64_t>(static_cast<int32_t>(read_reg(rt)));
-          state_.lo = static_cast<uint32_t>(res & 0xFFFFFFFF);
-          state_.hi = static_cast<uint32_t>((res >> 32) & 0xFFFFFFFF);
-          break;
-        }
-        case 0x19: { // MULTU
-          uint64_t res = static_cast<uint64_t>(read_reg(rs)) * static_cast<uint64_t>(read_reg(rt));
-          state_.lo = static_cast<uint32_t>(res & 0xFFFFFFFF);
-          state_.hi = static_cast<uint32_t>((res >> 32) & 0xFFFFFFFF);
-          break;
-        }
-        case 0x1A: { // DIV
-          int32_t a = static_cast<int32_t>(read_reg(rs));
-          int32_t b = static_cast<int32_t>(read_reg(rt));
-          if (b == 0) {
-            state_.lo = (a >= 0) ? 0xFFFFFFFFu : 1u;
-            state_.hi = static_cast<uint32_t>(a);
-          } else if (a == static_cast<int32_t>(0x80000000) && b == -1) {
-            state_.lo = static_cast<uint32_t>(a);
-            state_.hi = 0;
-          } else {
-            state_.lo = static_cast<uint32_t>(a / b);
-            state_.hi = static_cast<uint32_t>(a % b);
-          }
-          break;
-        }
-        case 0x1B: { // DIVU
-          uint32_t a = read_reg(rs);
-          uint32_t b = read_reg(rt);
-          if (b == 0) {
-            state_.lo = 0xFFFFFFFFu;
-            state_.hi = a;
-          } else {
-            state_.lo = a / b;
-            state_.hi = a % b;
-          }
-          break;
-        }
-        case 0x20: { // ADD
-          int32_t a = static_cast<int32_t>(read_reg(rs));
-          int32_t b = static_cast<int32_t>(read_reg(rt));
-          int32_t res = a + b;
-          if (((a ^ res) & (b ^ res)) < 0) {
-            raise_exception(12, 0, in_delay, instr_pc, in_delay ? (instr_pc - 4) : instr_pc);
-            out_exception = true;
-          } else {
-            write_reg(rd, static_cast<uint32_t>(res));
-          }
-          break;
-        }
-        case 0x21: // ADDU
-          write_reg(rd, read_reg(rs) + read_reg(rt));
-          break;
-        case 0x22: { // SUB
-          int32_t a = static_cast<int32_t>(read_reg(rs));
-          int32_t b = static_cast<int32_t>(read_reg(rt));
-          int32_t res = a - b;
-          if (((a ^ b) & (a ^ res)) < 0) {
-            raise_exception(12, 0, in_delay, instr_pc, in_delay ? (instr_pc - 4) : instr_pc);
-            out_exception = true;
-          } else {
-            write_reg(rd, static_cast<uint32_t>(res));
-          }
-          break;
-        }
-        case 0x23: // SUBU
-          write_reg(rd, read_reg(rs) - read_reg(rt));
-          break;
-        case 0x24: // AND
-          write_reg(rd, read_reg(rs) & read_reg(rt));
-          break;
-        case 0x25: // OR
-          write_reg(rd, read_reg(rs) | read_reg(rt));
-          break;
-        case 0x26: // XOR
-          write_reg(rd, read_reg(rs) ^ read_reg(rt));
-          break;
-        case 0x27: // NOR
-          write_reg(rd, ~(read_reg(rs) | read_reg(rt)));
-          break;
-        case 0x2A: { // SLT
-          int32_t a = static_cast<int32_t>(read_reg(rs));
-          int32_t b = static_cast<int32_t>(read_reg(rt));
-          write_reg(rd, a < b ? 1 : 0);
-          break;
-        }
-        case 0x2B: { // SLTU
-          uint32_t a = read_reg(rs);
-          uint32_t b = read_reg(rt);
-          write_reg(rd, a < b ? 1 : 0);
-          break;
-        }
-        default:
-          raise_exception(10, 0, in_delay, instr_pc, in_delay ? (instr_pc - 4) : instr_pc);
-          out_exception = true;
-          break;
+  switch (decoded.handler) {
+    case kSpecial | 0x00: // SLL
+      write_reg(rd, read_reg(rt) << sh);
+      break;
+    case kSpecial | 0x02: // SRL
+      write_reg(rd, read_reg(rt) >> sh);
+      break;
+    case kSpecial | 0x03: // SRA
+      write_reg(rd, static_cast<uint32_t>(static_cast<int32_t>(read_reg(rt)) >> sh));
+      break;
+    case kSpecial | 0x04: // SLLV
+      write_reg(rd, read_reg(rt) << (read_reg(rs) & 0x1F));
+      break;
+    case kSpecial | 0x06: // SRLV
+      write_reg(rd, read_reg(rt) >> (read_reg(rs) & 0x1F));
+      break;
+    case kSpecial | 0x07: // SRAV
+      write_reg(rd, static_cast<uint32_t>(static_cast<int32_t>(read_reg(rt)) >> (read_reg(rs) & 0x1F)));
+      break;
+    case kSpecial | 0x08: // JR
+      set_branch_target(read_reg(rs));
+      out_branch = true;
+      break;
+    case kSpecial | 0x09: // JALR
+      write_reg(rd ? rd : 31, instr_pc + 8);
+      set_branch_target(read_reg(rs));
+      out_branch = true;
+      break;
+    case kSpecial | 0x0C: // SYSCALL
+      raise_exception(8, 0, in_delay, instr_pc, in_delay ? (instr_pc - 4) : instr_pc);
+      out_exception = true;
+      break;
+    case kSpecial | 0x0D: // BREAK
+      raise_exception(9, 0, in_delay, instr_pc, in_delay ? (instr_pc - 4) : instr_pc);
+      out_exception = true;
+      break;
+    case kSpecial | 0x10: // MFHI
+      write_reg(rd, state_.hi);
+      break;
+    case kSpecial | 0x11: // MTHI
+      state_.hi = read_reg(rs);
+      break;
+    case kSpecial | 0x12: // MFLO
+      write_reg(rd, state_.lo);
+      break;
+    case kSpecial | 0x13: // MTLO
+      state_.lo = read_reg(rs);
+      break;
+    case kSpecial | 0x18: { // MULT
+      int64_t res = static_cast<int64_t>(static_cast<int32_t>(read_reg(rs))) *
+                    static_cast<int64_t>(static_cast<int32_t>(read_reg(rt)));
+      state_.lo = static_cast<uint32_t>(res & 0xFFFFFFFF);
+      state_.hi = static_cast<uint32_t>((res >> 32) & 0xFFFFFFFF);
+      break;
+    }
+    case kSpecial | 0x19: { // MULTU
+      uint64_t res = static_cast<uint64_t>(read_reg(rs)) * static_cast<uint64_t>(read_reg(rt));
+      state_.lo = static_cast<uint32_t>(res & 0xFFFFFFFF);
+      state_.hi = static_cast<uint32_t>((res >> 32) & 0xFFFFFFFF);
+      break;
+    }
+    case kSpecial | 0x1A: { // DIV
+      int32_t a = static_cast<int32_t>(read_reg(rs));
+      int32_t b = static_cast<int32_t>(read_reg(rt));
+      if (b == 0) {
+        state_.lo = (a >= 0) ? 0xFFFFFFFFu : 1u;
+        state_.hi = static_cast<uint32_t>(a);
+      } else if (a == static_cast<int32_t>(0x80000000) && b == -1) {
+        state_.lo = static_cast<uint32_t>(a);
+        state_.hi = 0;
+      } else {
+        state_.lo = static_cast<uint32_t>(a / b);
+        state_.hi = static_cast<uint32_t>(a % b);
+      }
+      break;
+    }
+    case kSpecial | 0x1B: { // DIVU
+      uint32_t a = read_reg(rs);
+      uint32_t b = read_reg(rt);
+      if (b == 0) {
+        state_.lo = 0xFFFFFFFFu;
+        state_.hi = a;
+      } else {
+        state_.lo = a / b;
+        state_.hi = a % b;
       }
       break;
     }
+    case kSpecial | 0x20: { // ADD
+      int32_t a = static_cast<int32_t>(read_reg(rs));
+      int32_t b = static_cast<int32_t>(read_reg(rt));
+      int32_t res = a + b;
+      if (((a ^ res) & (b ^ res)) < 0) {
+        raise_exception(12, 0, in_delay, instr_pc, in_delay ? (instr_pc - 4) : instr_pc);
+        out_exception = true;
+      } else {
+        write_reg(rd, static_cast<uint32_t>(res));
+      }
+      break;
+    }
+    case kSpecial | 0x21: // ADDU
+      write_reg(rd, read_reg(rs) + read_reg(rt));
+      break;
+    case kSpecial | 0x22: { // SUB
+      int32_t a = static_cast<int32_t>(read_reg(rs));
+      int32_t b = static_cast<int32_t>(read_reg(rt));
+      int32_t res = a - b;
+      if (((a ^ b) & (a ^ res)) < 0) {
+        raise_exception(12, 0, in_delay, instr_pc, in_delay ? (instr_pc - 4) : instr_pc);
+        out_exception = true;
+      } else {
+        write_reg(rd, static_cast<uint32_t>(res));
+      }
+      break;
+    }
+    case kSpecial | 0x23: // SUBU
+      write_reg(rd, read_reg(rs) - read_reg(rt));
+      break;
+    case kSpecial | 0x24: // AND
+      write_reg(rd, read_reg(rs) & read_reg(rt));
+      break;
+    case kSpecial | 0x25: // OR
+      write_reg(rd, read_reg(rs) | read_reg(rt));
+      break;
+    case kSpecial | 0x26: // XOR
+      write_reg(rd, read_reg(rs) ^ read_reg(rt));
+      break;
+    case kSpecial | 0x27: // NOR
+      write_reg(rd, ~(read_reg(rs) | read_reg(rt)));
+      break;
+    case kSpecial | 0x2A: { // SLT
+      int32_t a = static_cast<int32_t>(read_reg(rs));
+      int32_t b = static_cast<int32_t>(read_reg(rt));
+      write_reg(rd, a < b ? 1 : 0);
+      break;
+    }
+    case kSpecial | 0x2B: { // SLTU
+      uint32_t a = read_reg(rs);
+      uint32_t b = read_reg(rt);
+      write_reg(rd, a < b ? 1 : 0);
+      break;
+    }
     case 0x01: { // REGIMM
       int32_t s = static_cast<int32_t>(read_reg(rs));
       uint32_t target = instr_pc + 4 + (static_cast<int32_t>(imm_se) << 2);
@@ -1098,6 +1530,39 @@ uint32_t CpuCore::execute_instruction(uint32_t instr,
   return cycles;
 }
 
+uint32_t CpuCore::jit_cop2_read(void *context, uint32_t reg) {
+  auto *cpu = static_cast<CpuCore *>(context);
+  return reg >= 32 ? cpu->gte_.read_ctrl(reg) : cpu->gte_.read_data(reg);
+}
+
+void CpuCore::jit_cop2_write(void *context, uint32_t reg, uint32_t value) {
+  auto *cpu = static_cast<CpuCore *>(context);
+  if (reg >= 32) {
+    cpu->gte_.write_ctrl(reg, value);
+  } else {
+    cpu->gte_.write_data(reg, value);
+  }
+}
+
+void CpuCore::jit_raise_exception(void *context,
+                                  uint32_t excode,
+                                  uint32_t badaddr,
+                                  uint32_t instr_pc,
+                                  uint32_t in_delay) {
+  auto *cpu = static_cast<CpuCore *>(context);
+  cpu->raise_exception(excode, badaddr, in_delay != 0, instr_pc, in_delay ? (instr_pc - 4) : instr_pc);
+}
+
+const void *CpuCore::jit_lookup_link(void *context, uint32_t pc) {
+  JitBlock *block = static_cast<CpuCore *>(context)->dynarec_cache_.lookup(pc);
+  return block && block->entry ? block->link_entry : nullptr;
+}
+
+void CpuCore::jit_set_load_delay(void *context, uint32_t reg, uint32_t value) {
+  auto *cpu = static_cast<CpuCore *>(context);
+  cpu->load_delay_ = {true, reg, value};
+}
+
 void CpuCore::enqueue_gte_write(uint32_t reg, uint32_t value, uint32_t delay, bool is_ctrl) {
   gte_pending_writes_.push_back({reg, value, delay, is_ctrl});
 }
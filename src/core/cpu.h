@@ -7,8 +7,13 @@
 #include "core/memory_map.h"
 #include "core/scheduler.h"
 
+#include <array>
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace ps1emu {
 
@@ -24,34 +29,106 @@ class CpuCore {
 public:
   enum class Mode {
     Interpreter,
-    Dynarec
+    Dynarec,
+    Threaded
   };
 
   CpuCore(MemoryMap &memory, Scheduler &scheduler);
+  ~CpuCore();
+
+  CpuCore(const CpuCore &) = delete;
+  CpuCore &operator=(const CpuCore &) = delete;
 
   void reset();
   void set_mode(Mode mode);
   Mode mode() const;
+  void set_dynarec_block_limit(uint32_t limit);
+  void set_dynarec_hot_threshold(uint32_t threshold);
   CpuState &state();
   std::vector<JitBlock> dynarec_blocks() const;
+  std::vector<JitBlock> dynarec_cold_blocks() const;
+  bool save_dynarec_profile(const std::string &path, std::string &error) const;
+  bool load_dynarec_profile(const std::string &path, std::string &error);
+  const DynarecCache::Stats &dynarec_stats() const;
   bool consume_exception(CpuExceptionInfo &out);
 
   uint32_t step();
+  // Caps how many cycles one step may run through linked dynarec blocks or
+  // one threaded-interpreter run; the core sets it to the time left before the next device event or the end of
+  // its slice so events and their IRQs are not delivered late.
+  void set_step_budget(uint32_t cycles);
+  // True when the CPU is back at the same PC of a short polling loop with
+  // the same registers as on its last pass, no device activity in between,
+  // and the loop only loads from memory or side-effect-free status
+  // registers, compares and branches. Nothing it reads can change before the
+  // next device event, or before the GPU's busy time ends if
+  // idle_polls_gpustat().
+  bool poll_idle();
+  bool idle_polls_gpustat() const;
 
   static bool dynarec_available();
   void invalidate_code_range(uint32_t start, uint32_t size);
 
 private:
+  friend struct ThreadedInterpreter;
+
   struct PendingLoad {
     bool valid = false;
     uint32_t reg = 0;
     uint32_t value = 0;
   };
 
+  // Instruction fields extracted once per RAM/BIOS word. `handler` is the
+  // primary opcode, or 0x40 | funct for SPECIAL encodings.
+  struct DecodedInstr {
+    uint32_t word = 0;
+    uint32_t imm_se = 0;
+    uint16_t imm = 0;
+    uint8_t handler = 0;
+    uint8_t rs = 0;
+    uint8_t rt = 0;
+    uint8_t rd = 0;
+    uint8_t sh = 0;
+  };
+
+  struct DecodedPage {
+    std::array<DecodedInstr, (1u << MemoryMap::kCodePageShift) / 4> instrs;
+  };
+
+  static DecodedInstr decode_instruction(uint32_t instr);
+  const DecodedInstr &fetch_decoded(uint32_t pc);
+  void invalidate_decoded_range(uint32_t phys, uint32_t size);
+  static void on_code_write(void *context, uint32_t phys, uint32_t size);
+  static void on_irq_line(void *context, bool asserted);
+
   uint32_t step_interpreter();
   uint32_t step_dynarec();
-
-  uint32_t execute_instruction(uint32_t instr,
+  uint32_t step_threaded();
+  uint32_t step_cold();
+  bool dynarec_can_enter() const;
+
+  struct IdleLoop {
+    bool idle = false;
+    // Normalized physical code range the analysis read; stores into it drop the entry.
+    uint32_t first = 0;
+    uint32_t last = 0;
+    // Base register and offset of each load; bases are never written in the loop.
+    std::vector<std::pair<uint8_t, uint32_t>> loads;
+  };
+  const IdleLoop &idle_loop_at(uint32_t pc);
+  void drop_idle_loops(uint32_t phys, uint32_t size);
+
+  static uint32_t jit_cop2_read(void *context, uint32_t reg);
+  static void jit_cop2_write(void *context, uint32_t reg, uint32_t value);
+  static void jit_raise_exception(void *context,
+                                  uint32_t excode,
+                                  uint32_t badaddr,
+                                  uint32_t instr_pc,
+                                  uint32_t in_delay);
+  static void jit_set_load_delay(void *context, uint32_t reg, uint32_t value);
+  static const void *jit_lookup_link(void *context, uint32_t pc);
+
+  uint32_t execute_instruction(const DecodedInstr &decoded,
                                uint32_t instr_pc,
                                bool in_delay,
                                PendingLoad &out_load,
@@ -74,19 +151,34 @@ private:
 
   MemoryMap *memory_ = nullptr;
   Scheduler *scheduler_ = nullptr;
+  uint32_t step_budget_ = UINT32_MAX;
   Mode mode_ = Mode::Interpreter;
   CpuState state_;
   DynarecCache dynarec_cache_;
   std::unique_ptr<DynarecBackend> dynarec_backend_;
   Gte gte_;
   std::vector<PendingGteWrite> gte_pending_writes_;
+  std::vector<std::unique_ptr<DecodedPage>> decoded_pages_;
+  DecodedInstr decoded_uncached_;
   PendingLoad load_delay_;
   bool load_delay_shadow_valid_ = false;
   uint32_t load_delay_shadow_reg_ = 0;
   uint32_t load_delay_shadow_value_ = 0;
   bool branch_pending_ = false;
   bool skip_next_ = false;
+  // I_STAT & I_MASK, pushed by the bus whenever it changes.
+  bool irq_line_ = false;
   bool exception_pending_ = false;
+  // Instructions left in the cold block being interpreted; 0 at a block head.
+  uint32_t dynarec_cold_left_ = 0;
+  std::unordered_map<uint32_t, IdleLoop> idle_loops_;
+  // Code page -> PCs of idle_loops_ entries whose range touches it.
+  std::unordered_map<uint32_t, std::vector<uint32_t>> idle_loop_pages_;
+  uint32_t idle_last_pc_ = 0;
+  uint32_t idle_snapshot_pc_ = 0xFFFFFFFFu;
+  uint32_t idle_snapshot_gpr_[32] = {};
+  uint64_t idle_snapshot_activity_ = 0;
+  bool idle_polls_gpustat_ = false;
   CpuExceptionInfo last_exception_;
 };
 
@@ -0,0 +1,798 @@
+#include "core/cpu.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+// Direct-threaded interpreter core. Each handler tail fetches the next
+// predecoded instruction and jumps straight to its handler, so dispatch
+// branches are spread across handlers instead of funnelling through one
+// switch. GCC/Clang use computed goto; other compilers walk a function table.
+#if defined(__GNUC__) || defined(__clang__)
+#define PS1EMU_THREADED_GOTO 1
+#endif
+
+namespace ps1emu {
+
+namespace {
+constexpr uint32_t kCop0StatusIsc = 1u << 16;
+constexpr uint32_t kMaxRunCycles = 64;
+constexpr size_t kHandlerCount = 0x80;
+
+static bool is_io_address(uint32_t addr) {
+  uint32_t phys = addr & 0x1FFFFFFF;
+  return phys >= 0x1F801000 && phys < 0x1F803000;
+}
+} // namespace
+
+struct ThreadedInterpreter {
+  using DecodedInstr = CpuCore::DecodedInstr;
+
+  // Pipeline state carried between instructions of one run. Mirrors what
+  // step_interpreter() keeps in CpuCore members, but stays in locals here.
+  struct Run {
+    explicit Run(CpuCore &core)
+        : cpu(core), st(core.state_), limit(std::max<uint32_t>(1, std::min(kMaxRunCycles, core.step_budget_))) {}
+
+    CpuCore &cpu;
+    CpuState &st;
+    const DecodedInstr *d = nullptr;
+    uint32_t instr_pc = 0;
+    bool in_delay = false;
+    bool branch = false;
+    bool stop = false;
+    bool shadow_valid = false;
+    uint32_t shadow_reg = 0;
+    uint32_t shadow_value = 0;
+    CpuCore::PendingLoad load;
+    uint32_t cycles = 1;
+    uint32_t total = 0;
+    uint32_t synced = 0;
+    // The run ends once total reaches this: kMaxRunCycles, or less when the
+    // next device event is closer (see CpuCore::set_step_budget).
+    uint32_t limit;
+  };
+
+  using Handler = void (*)(Run &run);
+
+  static uint32_t reg(const Run &r, uint32_t index) {
+    if (index == 0) {
+      return 0;
+    }
+    if (r.shadow_valid && index == r.shadow_reg) {
+      return r.shadow_value;
+    }
+    return r.st.gpr[index];
+  }
+
+  static void set_reg(Run &r, uint32_t index, uint32_t value) {
+    if (index != 0) {
+      r.st.gpr[index] = value;
+    }
+  }
+
+  static void raise(Run &r, uint32_t excode, uint32_t badaddr = 0) {
+    r.cpu.raise_exception(excode, badaddr, r.in_delay, r.instr_pc, r.in_delay ? (r.instr_pc - 4) : r.instr_pc);
+    r.load = {};
+    r.branch = false;
+    r.stop = true;
+  }
+
+  static void branch_to(Run &r, bool taken, uint32_t target) {
+    if (taken) {
+      r.st.next_pc = target;
+    }
+    r.branch = true;
+  }
+
+  static void branch_likely(Run &r, bool taken, uint32_t target) {
+    if (taken) {
+      r.st.next_pc = target;
+      r.branch = true;
+    } else {
+      // The annulled delay slot is handled by the switch interpreter.
+      r.cpu.skip_next_ = true;
+    }
+  }
+
+  static uint32_t branch_target(const Run &r) {
+    return r.instr_pc + 4 + (static_cast<int32_t>(r.d->imm_se) << 2);
+  }
+
+  static uint32_t address(const Run &r) {
+    return reg(r, r.d->rs) + r.d->imm_se;
+  }
+
+  // Device state only moves with the scheduler, so catch it up before an
+  // I/O access and end the run afterwards so IRQs are re-checked.
+  static void sync_io(Run &r, uint32_t addr) {
+    if (!is_io_address(addr)) {
+      return;
+    }
+    if (r.cpu.scheduler_ && r.total > r.synced) {
+      r.cpu.scheduler_->advance(r.total - r.synced);
+    }
+    r.synced = r.total;
+    r.stop = true;
+  }
+
+  static bool cache_isolated(const Run &r) {
+    return (r.st.cop0.sr & kCop0StatusIsc) != 0;
+  }
+
+  static void apply_load(Run &r) {
+    r.shadow_valid = false;
+    if (r.load.valid) {
+      if (r.load.reg != 0) {
+        r.shadow_valid = true;
+        r.shadow_reg = r.load.reg;
+        r.shadow_value = r.st.gpr[r.load.reg];
+        r.st.gpr[r.load.reg] = r.load.value;
+      }
+      r.load = {};
+    }
+  }
+
+  static void fetch(Run &r) {
+    r.instr_pc = r.st.pc;
+    r.d = &r.cpu.fetch_decoded(r.instr_pc);
+    r.st.pc = r.st.next_pc;
+    r.st.next_pc = r.st.pc + 4;
+    r.in_delay = r.branch;
+    r.branch = false;
+    r.cycles = 1;
+  }
+
+  // Retires the current instruction and fetches the next one; returns false
+  // when the run has to hand control back to CpuCore::step().
+  static bool next(Run &r) {
+    r.st.gpr[0] = 0;
+    if (!r.cpu.gte_pending_writes_.empty()) {
+      r.cpu.flush_gte_writes(r.cycles);
+    }
+    r.total += r.cycles;
+    if (r.stop || r.cpu.skip_next_ || r.total >= r.limit) {
+      return false;
+    }
+    apply_load(r);
+    fetch(r);
+    return true;
+  }
+
+  static void op_reserved(Run &r) { raise(r, 10); }
+
+  // SPECIAL
+  static void op_sll(Run &r) { set_reg(r, r.d->rd, reg(r, r.d->rt) << r.d->sh); }
+  static void op_srl(Run &r) { set_reg(r, r.d->rd, reg(r, r.d->rt) >> r.d->sh); }
+  static void op_sra(Run &r) {
+    set_reg(r, r.d->rd, static_cast<uint32_t>(static_cast<int32_t>(reg(r, r.d->rt)) >> r.d->sh));
+  }
+  static void op_sllv(Run &r) { set_reg(r, r.d->rd, reg(r, r.d->rt) << (reg(r, r.d->rs) & 0x1F)); }
+  static void op_srlv(Run &r) { set_reg(r, r.d->rd, reg(r, r.d->rt) >> (reg(r, r.d->rs) & 0x1F)); }
+  static void op_srav(Run &r) {
+    set_reg(r, r.d->rd, static_cast<uint32_t>(static_cast<int32_t>(reg(r, r.d->rt)) >> (reg(r, r.d->rs) & 0x1F)));
+  }
+  static void op_jr(Run &r) { branch_to(r, true, reg(r, r.d->rs)); }
+  static void op_jalr(Run &r) {
+    uint32_t target = reg(r, r.d->rs);
+    set_reg(r, r.d->rd ? r.d->rd : 31, r.instr_pc + 8);
+    branch_to(r, true, target);
+  }
+  static void op_syscall(Run &r) { raise(r, 8); }
+  static void op_break(Run &r) { raise(r, 9); }
+  static void op_mfhi(Run &r) { set_reg(r, r.d->rd, r.st.hi); }
+  static void op_mthi(Run &r) { r.st.hi = reg(r, r.d->rs); }
+  static void op_mflo(Run &r) { set_reg(r, r.d->rd, r.st.lo); }
+  static void op_mtlo(Run &r) { r.st.lo = reg(r, r.d->rs); }
+  static void op_mult(Run &r) {
+    int64_t res = static_cast<int64_t>(static_cast<int32_t>(reg(r, r.d->rs))) *
+                  static_cast<int64_t>(static_cast<int32_t>(reg(r, r.d->rt)));
+    r.st.lo = static_cast<uint32_t>(res & 0xFFFFFFFF);
+    r.st.hi = static_cast<uint32_t>((res >> 32) & 0xFFFFFFFF);
+  }
+  static void op_multu(Run &r) {
+    uint64_t res = static_cast<uint64_t>(reg(r, r.d->rs)) * static_cast<uint64_t>(reg(r, r.d->rt));
+    r.st.lo = static_cast<uint32_t>(res & 0xFFFFFFFF);
+    r.st.hi = static_cast<uint32_t>((res >> 32) & 0xFFFFFFFF);
+  }
+  static void op_div(Run &r) {
+    int32_t a = static_cast<int32_t>(reg(r, r.d->rs));
+    int32_t b = static_cast<int32_t>(reg(r, r.d->rt));
+    if (b == 0) {
+      r.st.lo = (a >= 0) ? 0xFFFFFFFFu : 1u;
+      r.st.hi = static_cast<uint32_t>(a);
+    } else if (a == static_cast<int32_t>(0x80000000) && b == -1) {
+      r.st.lo = static_cast<uint32_t>(a);
+      r.st.hi = 0;
+    } else {
+      r.st.lo = static_cast<uint32_t>(a / b);
+      r.st.hi = static_cast<uint32_t>(a % b);
+    }
+  }
+  static void op_divu(Run &r) {
+    uint32_t a = reg(r, r.d->rs);
+    uint32_t b = reg(r, r.d->rt);
+    if (b == 0) {
+      r.st.lo = 0xFFFFFFFFu;
+      r.st.hi = a;
+    } else {
+      r.st.lo = a / b;
+      r.st.hi = a % b;
+    }
+  }
+  static void op_add(Run &r) {
+    int32_t a = static_cast<int32_t>(reg(r, r.d->rs));
+    int32_t b = static_cast<int32_t>(reg(r, r.d->rt));
+    int32_t res = static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+    if (((a ^ res) & (b ^ res)) < 0) {
+      raise(r, 12);
+    } else {
+      set_reg(r, r.d->rd, static_cast<uint32_t>(res));
+    }
+  }
+  static void op_addu(Run &r) { set_reg(r, r.d->rd, reg(r, r.d->rs) + reg(r, r.d->rt)); }
+  static void op_sub(Run &r) {
+    int32_t a = static_cast<int32_t>(reg(r, r.d->rs));
+    int32_t b = static_cast<int32_t>(reg(r, r.d->rt));
+    int32_t res = static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b));
+    if (((a ^ b) & (a ^ res)) < 0) {
+      raise(r, 12);
+    } else {
+      set_reg(r, r.d->rd, static_cast<uint32_t>(res));
+    }
+  }
+  static void op_subu(Run &r) { set_reg(r, r.d->rd, reg(r, r.d->rs) - reg(r, r.d->rt)); }
+  static void op_and(Run &r) { set_reg(r, r.d->rd, reg(r, r.d->rs) & reg(r, r.d->rt)); }
+  static void op_or(Run &r) { set_reg(r, r.d->rd, reg(r, r.d->rs) | reg(r, r.d->rt)); }
+  static void op_xor(Run &r) { set_reg(r, r.d->rd, reg(r, r.d->rs) ^ reg(r, r.d->rt)); }
+  static void op_nor(Run &r) { set_reg(r, r.d->rd, ~(reg(r, r.d->rs) | reg(r, r.d->rt))); }
+  static void op_slt(Run &r) {
+    set_reg(r, r.d->rd, static_cast<int32_t>(reg(r, r.d->rs)) < static_cast<int32_t>(reg(r, r.d->rt)) ? 1 : 0);
+  }
+  static void op_sltu(Run &r) { set_reg(r, r.d->rd, reg(r, r.d->rs) < reg(r, r.d->rt) ? 1 : 0); }
+
+  // Branches and jumps
+  static void op_regimm(Run &r) {
+    int32_t s = static_cast<int32_t>(reg(r, r.d->rs));
+    uint32_t target = branch_target(r);
+    switch (r.d->rt) {
+      case 0x00: // BLTZ
+        branch_to(r, s < 0, target);
+        break;
+      case 0x01: // BGEZ
+        branch_to(r, s >= 0, target);
+        break;
+      case 0x10: // BLTZAL
+        set_reg(r, 31, r.instr_pc + 8);
+        branch_to(r, s < 0, target);
+        break;
+      case 0x11: // BGEZAL
+        set_reg(r, 31, r.instr_pc + 8);
+        branch_to(r, s >= 0, target);
+        break;
+      case 0x02: // BLTZL
+        branch_likely(r, s < 0, target);
+        break;
+      case 0x03: // BGEZL
+        branch_likely(r, s >= 0, target);
+        break;
+      case 0x12: // BLTZALL
+        set_reg(r, 31, r.instr_pc + 8);
+        branch_likely(r, s < 0, target);
+        break;
+      case 0x13: // BGEZALL
+        set_reg(r, 31, r.instr_pc + 8);
+        branch_likely(r, s >= 0, target);
+        break;
+      default:
+        raise(r, 10);
+        break;
+    }
+  }
+  static void op_j(Run &r) { branch_to(r, true, (r.instr_pc & 0xF0000000) | ((r.d->word & 0x03FFFFFF) << 2)); }
+  static void op_jal(Run &r) {
+    set_reg(r, 31, r.instr_pc + 8);
+    branch_to(r, true, (r.instr_pc & 0xF0000000) | ((r.d->word & 0x03FFFFFF) << 2));
+  }
+  static void op_beq(Run &r) { branch_to(r, reg(r, r.d->rs) == reg(r, r.d->rt), branch_target(r)); }
+  static void op_bne(Run &r) { branch_to(r, reg(r, r.d->rs) != reg(r, r.d->rt), branch_target(r)); }
+  static void op_blez(Run &r) { branch_to(r, static_cast<int32_t>(reg(r, r.d->rs)) <= 0, branch_target(r)); }
+  static void op_bgtz(Run &r) { branch_to(r, static_cast<int32_t>(reg(r, r.d->rs)) > 0, branch_target(r)); }
+  static void op_beql(Run &r) { branch_likely(r, reg(r, r.d->rs) == reg(r, r.d->rt), branch_target(r)); }
+  static void op_bnel(Run &r) { branch_likely(r, reg(r, r.d->rs) != reg(r, r.d->rt), branch_target(r)); }
+  static void op_blezl(Run &r) { branch_likely(r, static_cast<int32_t>(reg(r, r.d->rs)) <= 0, branch_target(r)); }
+  static void op_bgtzl(Run &r) { branch_likely(r, static_cast<int32_t>(reg(r, r.d->rs)) > 0, branch_target(r)); }
+
+  // Immediate ALU
+  static void op_addi(Run &r) {
+    int32_t a = static_cast<int32_t>(reg(r, r.d->rs));
+    int32_t b = static_cast<int32_t>(r.d->imm_se);
+    int32_t res = static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+    if (((a ^ res) & (b ^ res)) < 0) {
+      raise(r, 12);
+    } else {
+      set_reg(r, r.d->rt, static_cast<uint32_t>(res));
+    }
+  }
+  static void op_addiu(Run &r) { set_reg(r, r.d->rt, reg(r, r.d->rs) + r.d->imm_se); }
+  static void op_slti(Run &r) {
+    set_reg(r, r.d->rt, static_cast<int32_t>(reg(r, r.d->rs)) < static_cast<int32_t>(r.d->imm_se) ? 1 : 0);
+  }
+  static void op_sltiu(Run &r) { set_reg(r, r.d->rt, reg(r, r.d->rs) < r.d->imm_se ? 1 : 0); }
+  static void op_andi(Run &r) { set_reg(r, r.d->rt, reg(r, r.d->rs) & r.d->imm); }
+  static void op_ori(Run &r) { set_reg(r, r.d->rt, reg(r, r.d->rs) | r.d->imm); }
+  static void op_xori(Run &r) { set_reg(r, r.d->rt, reg(r, r.d->rs) ^ r.d->imm); }
+  static void op_lui(Run &r) { set_reg(r, r.d->rt, static_cast<uint32_t>(r.d->imm) << 16); }
+
+  // Coprocessors
+  static void op_cop0(Run &r) {
+    uint32_t cop_op = (r.d->word >> 21) & 0x1F;
+    auto &cop0 = r.st.cop0;
+    if (r.d->word == 0x42000010) { // RFE
+      uint32_t mode = cop0.sr & 0x3F;
+      cop0.sr = (cop0.sr & ~0x3Fu) | ((mode >> 2) & 0x0F);
+      r.stop = true;
+      return;
+    }
+    if (cop_op == 0x00 || cop_op == 0x02) { // MFC0/CFC0
+      uint32_t value = 0;
+      switch (r.d->rd) {
+        case 8:
+          value = cop0.badvaddr;
+          break;
+        case 12:
+          value = cop0.sr;
+          break;
+        case 13:
+          value = cop0.cause;
+          break;
+        case 14:
+          value = cop0.epc;
+          break;
+        case 15:
+          value = cop0.prid;
+          break;
+        case 16:
+          value = cop0.ebase;
+          break;
+        default:
+          break;
+      }
+      r.load = {true, r.d->rt, value};
+    } else if (cop_op == 0x04 || cop_op == 0x06) { // MTC0/CTC0
+      uint32_t value = reg(r, r.d->rt);
+      switch (r.d->rd) {
+        case 8:
+          cop0.badvaddr = value;
+          break;
+        case 12:
+          cop0.sr = value;
+          break;
+        case 13:
+          cop0.cause = value;
+          break;
+        case 14:
+          cop0.epc = value;
+          break;
+        case 16:
+          cop0.ebase = (value & 0xFFFFF000u);
+          break;
+        default:
+          break;
+      }
+      // SR/Cause writes can unmask a pending interrupt.
+      r.stop = true;
+    } else {
+      raise(r, 10);
+    }
+  }
+  static void op_cop2(Run &r) {
+    uint32_t cop_op = (r.d->word >> 21) & 0x1F;
+    Gte &gte = r.cpu.gte_;
+    if (cop_op == 0x00) { // MFC2
+      r.load = {true, r.d->rt, gte.read_data(r.d->rd)};
+    } else if (cop_op == 0x04) { // MTC2
+      r.cpu.enqueue_gte_write(r.d->rd, reg(r, r.d->rt), 1, false);
+    } else if (cop_op == 0x02) { // CFC2
+      r.load = {true, r.d->rt, gte.read_ctrl(r.d->rd + 32)};
+    } else if (cop_op == 0x06) { // CTC2
+      r.cpu.enqueue_gte_write(r.d->rd + 32, reg(r, r.d->rt), 1, true);
+    } else {
+      gte.execute(r.d->word);
+      r.cycles = gte.command_cycles(r.d->word);
+    }
+  }
+  static void op_cop3(Run &r) { raise(r, 11); }
+
+  // Loads
+  static void op_lb(Run &r) {
+    uint32_t addr = address(r);
+    sync_io(r, addr);
+    int8_t val = static_cast<int8_t>(r.cpu.memory_->read8(addr));
+    r.load = {true, r.d->rt, static_cast<uint32_t>(static_cast<int32_t>(val))};
+  }
+  static void op_lh(Run &r) {
+    uint32_t addr = address(r);
+    if (addr & 1) {
+      raise(r, 4, addr);
+      return;
+    }
+    sync_io(r, addr);
+    int16_t val = static_cast<int16_t>(r.cpu.memory_->read16(addr));
+    r.load = {true, r.d->rt, static_cast<uint32_t>(static_cast<int32_t>(val))};
+  }
+  static void op_lwl(Run &r) {
+    uint32_t addr = address(r);
+    sync_io(r, addr);
+    uint32_t word = r.cpu.memory_->read32(addr & ~3u);
+    uint32_t value = reg(r, r.d->rt);
+    switch (addr & 3u) {
+      case 0:
+        value = (value & 0x00FFFFFFu) | (word << 24);
+        break;
+      case 1:
+        value = (value & 0x0000FFFFu) | (word << 16);
+        break;
+      case 2:
+        value = (value & 0x000000FFu) | (word << 8);
+        break;
+      case 3:
+        value = word;
+        break;
+    }
+    r.load = {true, r.d->rt, value};
+  }
+  static void op_lw(Run &r) {
+    uint32_t addr = address(r);
+    if (addr & 3) {
+      raise(r, 4, addr);
+      return;
+    }
+    sync_io(r, addr);
+    r.load = {true, r.d->rt, r.cpu.memory_->read32(addr)};
+  }
+  static void op_lbu(Run &r) {
+    uint32_t addr = address(r);
+    sync_io(r, addr);
+    r.load = {true, r.d->rt, r.cpu.memory_->read8(addr)};
+  }
+  static void op_lhu(Run &r) {
+    uint32_t addr = address(r);
+    if (addr & 1) {
+      raise(r, 4, addr);
+      return;
+    }
+    sync_io(r, addr);
+    r.load = {true, r.d->rt, r.cpu.memory_->read16(addr)};
+  }
+  static void op_lwr(Run &r) {
+    uint32_t addr = address(r);
+    sync_io(r, addr);
+    uint32_t word = r.cpu.memory_->read32(addr & ~3u);
+    uint32_t value = reg(r, r.d->rt);
+    switch (addr & 3u) {
+      case 0:
+        value = word;
+        break;
+      case 1:
+        value = (value & 0xFF000000u) | (word >> 8);
+        break;
+      case 2:
+        value = (value & 0xFFFF0000u) | (word >> 16);
+        break;
+      case 3:
+        value = (value & 0xFFFFFF00u) | (word >> 24);
+        break;
+    }
+    r.load = {true, r.d->rt, value};
+  }
+
+  // Stores
+  static void op_sb(Run &r) {
+    uint32_t addr = address(r);
+    if (cache_isolated(r)) {
+      return;
+    }
+    sync_io(r, addr);
+    r.cpu.memory_->write8(addr, static_cast<uint8_t>(reg(r, r.d->rt) & 0xFF));
+  }
+  static void op_sh(Run &r) {
+    uint32_t addr = address(r);
+    if (addr & 1) {
+      raise(r, 5, addr);
+      return;
+    }
+    if (cache_isolated(r)) {
+      return;
+    }
+    sync_io(r, addr);
+    r.cpu.memory_->write16(addr, static_cast<uint16_t>(reg(r, r.d->rt) & 0xFFFF));
+  }
+  static void op_swl(Run &r) {
+    uint32_t addr = address(r);
+    if (cache_isolated(r)) {
+      return;
+    }
+    sync_io(r, addr);
+    uint32_t aligned = addr & ~3u;
+    uint32_t word = r.cpu.memory_->read32(aligned);
+    uint32_t value = reg(r, r.d->rt);
+    switch (addr & 3u) {
+      case 0:
+        word = (word & 0xFFFFFF00u) | (value >> 24);
+        break;
+      case 1:
+        word = (word & 0xFFFF0000u) | (value >> 16);
+        break;
+      case 2:
+        word = (word & 0xFF000000u) | (value >> 8);
+        break;
+      case 3:
+        word = value;
+        break;
+    }
+    r.cpu.memory_->write32(aligned, word);
+  }
+  static void op_sw(Run &r) {
+    uint32_t addr = address(r);
+    if (addr & 3) {
+      raise(r, 5, addr);
+      return;
+    }
+    if (cache_isolated(r)) {
+      return;
+    }
+    sync_io(r, addr);
+    r.cpu.memory_->write32(addr, reg(r, r.d->rt));
+  }
+  static void op_swr(Run &r) {
+    uint32_t addr = address(r);
+    if (cache_isolated(r)) {
+      return;
+    }
+    sync_io(r, addr);
+    uint32_t aligned = addr & ~3u;
+    uint32_t word = r.cpu.memory_->read32(aligned);
+    uint32_t value = reg(r, r.d->rt);
+    switch (addr & 3u) {
+      case 0:
+        word = value;
+        break;
+      case 1:
+        word = (word & 0x000000FFu) | (value << 8);
+        break;
+      case 2:
+        word = (word & 0x0000FFFFu) | (value << 16);
+        break;
+      case 3:
+        word = (word & 0x00FFFFFFu) | (value << 24);
+        break;
+    }
+    r.cpu.memory_->write32(aligned, word);
+  }
+
+  // Coprocessor loads/stores
+  static void lwc_unusable(Run &r) {
+    uint32_t addr = address(r);
+    if (addr & 3) {
+      raise(r, 4, addr);
+      return;
+    }
+    sync_io(r, addr);
+    (void)r.cpu.memory_->read32(addr);
+    raise(r, 11);
+  }
+  static void op_lwc0(Run &r) { lwc_unusable(r); }
+  static void op_lwc1(Run &r) { lwc_unusable(r); }
+  static void op_lwc3(Run &r) { lwc_unusable(r); }
+  static void op_lwc2(Run &r) {
+    uint32_t addr = address(r);
+    if (addr & 3) {
+      raise(r, 4, addr);
+      return;
+    }
+    sync_io(r, addr);
+    r.cpu.enqueue_gte_write(r.d->rt, r.cpu.memory_->read32(addr), 3, false);
+  }
+  static void swc_unusable(Run &r) {
+    uint32_t addr = address(r);
+    if (addr & 3) {
+      raise(r, 5, addr);
+      return;
+    }
+    raise(r, 11);
+  }
+  static void op_swc0(Run &r) { swc_unusable(r); }
+  static void op_swc1(Run &r) { swc_unusable(r); }
+  static void op_swc3(Run &r) { swc_unusable(r); }
+  static void op_swc2(Run &r) {
+    uint32_t addr = address(r);
+    if (addr & 3) {
+      raise(r, 5, addr);
+      return;
+    }
+    if (cache_isolated(r)) {
+      return;
+    }
+    sync_io(r, addr);
+    r.cpu.memory_->write32(addr, r.cpu.gte_.read_data(r.d->rt));
+  }
+
+  // Retires the load left by the previous step and takes a pending
+  // interrupt exactly like step_interpreter(); returns false if one was taken.
+  static bool enter(Run &r) {
+    r.load = r.cpu.load_delay_;
+    r.cpu.load_delay_ = {};
+    apply_load(r);
+    if (r.cpu.check_interrupts()) {
+      r.st.gpr[0] = 0;
+      r.total = 1;
+      return false;
+    }
+    r.branch = r.cpu.branch_pending_;
+    fetch(r);
+    return true;
+  }
+
+  static uint32_t leave(Run &r) {
+    r.cpu.branch_pending_ = r.branch;
+    r.cpu.load_delay_ = r.load;
+    if (r.cpu.scheduler_ && r.total > r.synced) {
+      r.cpu.scheduler_->advance(r.total - r.synced);
+    }
+    return r.total;
+  }
+
+  static uint32_t run(CpuCore &cpu);
+};
+
+// Handler index -> handler; indices match CpuCore::DecodedInstr::handler.
+#define PS1EMU_THREADED_HANDLERS(X) \
+  X(0x40 | 0x00, sll)               \
+  X(0x40 | 0x02, srl)               \
+  X(0x40 | 0x03, sra)               \
+  X(0x40 | 0x04, sllv)              \
+  X(0x40 | 0x06, srlv)              \
+  X(0x40 | 0x07, srav)              \
+  X(0x40 | 0x08, jr)                \
+  X(0x40 | 0x09, jalr)              \
+  X(0x40 | 0x0C, syscall)           \
+  X(0x40 | 0x0D, break)             \
+  X(0x40 | 0x10, mfhi)              \
+  X(0x40 | 0x11, mthi)              \
+  X(0x40 | 0x12, mflo)              \
+  X(0x40 | 0x13, mtlo)              \
+  X(0x40 | 0x18, mult)              \
+  X(0x40 | 0x19, multu)             \
+  X(0x40 | 0x1A, div)               \
+  X(0x40 | 0x1B, divu)              \
+  X(0x40 | 0x20, add)               \
+  X(0x40 | 0x21, addu)              \
+  X(0x40 | 0x22, sub)               \
+  X(0x40 | 0x23, subu)              \
+  X(0x40 | 0x24, and)               \
+  X(0x40 | 0x25, or)                \
+  X(0x40 | 0x26, xor)               \
+  X(0x40 | 0x27, nor)               \
+  X(0x40 | 0x2A, slt)               \
+  X(0x40 | 0x2B, sltu)              \
+  X(0x01, regimm)                   \
+  X(0x02, j)                        \
+  X(0x03, jal)                      \
+  X(0x04, beq)                      \
+  X(0x05, bne)                      \
+  X(0x06, blez)                     \
+  X(0x07, bgtz)                     \
+  X(0x08, addi)                     \
+  X(0x09, addiu)                    \
+  X(0x0A, slti)                     \
+  X(0x0B, sltiu)                    \
+  X(0x0C, andi)                     \
+  X(0x0D, ori)                      \
+  X(0x0E, xori)                     \
+  X(0x0F, lui)                      \
+  X(0x10, cop0)                     \
+  X(0x12, cop2)                     \
+  X(0x13, cop3)                     \
+  X(0x14, beql)                     \
+  X(0x15, bnel)                     \
+  X(0x16, blezl)                    \
+  X(0x17, bgtzl)                    \
+  X(0x20, lb)                       \
+  X(0x21, lh)                       \
+  X(0x22, lwl)                      \
+  X(0x23, lw)                       \
+  X(0x24, lbu)                      \
+  X(0x25, lhu)                      \
+  X(0x26, lwr)                      \
+  X(0x28, sb)                       \
+  X(0x29, sh)                       \
+  X(0x2A, swl)                      \
+  X(0x2B, sw)                       \
+  X(0x2E, swr)                      \
+  X(0x30, lwc0)                     \
+  X(0x31, lwc1)                     \
+  X(0x32, lwc2)                     \
+  X(0x33, lwc3)                     \
+  X(0x38, swc0)                     \
+  X(0x39, swc1)                     \
+  X(0x3A, swc2)                     \
+  X(0x3B, swc3)
+
+#if defined(PS1EMU_THREADED_GOTO)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+uint32_t ThreadedInterpreter::run(CpuCore &cpu) {
+  static void *labels[kHandlerCount];
+  static bool labels_ready = false;
+  if (!labels_ready) {
+    for (auto &label : labels) {
+      label = &&do_reserved;
+    }
+#define PS1EMU_THREADED_LABEL(index, name) labels[index] = &&do_##name;
+    PS1EMU_THREADED_HANDLERS(PS1EMU_THREADED_LABEL)
+#undef PS1EMU_THREADED_LABEL
+    labels_ready = true;
+  }
+
+  Run r(cpu);
+  if (!enter(r)) {
+    return leave(r);
+  }
+  goto *labels[r.d->handler];
+
+#define PS1EMU_THREADED_BODY(index, name) \
+  do_##name:                              \
+  op_##name(r);                           \
+  if (!next(r)) {                         \
+    goto done;                            \
+  }                                       \
+  goto *labels[r.d->handler];
+  PS1EMU_THREADED_HANDLERS(PS1EMU_THREADED_BODY)
+  PS1EMU_THREADED_BODY(0, reserved)
+#undef PS1EMU_THREADED_BODY
+
+done:
+  return leave(r);
+}
+
+#pragma GCC diagnostic pop
+#else
+
+static const std::array<ThreadedInterpreter::Handler, kHandlerCount> &threaded_handlers() {
+  static const std::array<ThreadedInterpreter::Handler, kHandlerCount> table = [] {
+    std::array<ThreadedInterpreter::Handler, kHandlerCount> result {};
+    result.fill(&ThreadedInterpreter::op_reserved);
+#define PS1EMU_THREADED_ENTRY(index, name) result[index] = &ThreadedInterpreter::op_##name;
+    PS1EMU_THREADED_HANDLERS(PS1EMU_THREADED_ENTRY)
+#undef PS1EMU_THREADED_ENTRY
+    return result;
+  }();
+  return table;
+}
+
+uint32_t ThreadedInterpreter::run(CpuCore &cpu) {
+  const auto &handlers = threaded_handlers();
+  Run r(cpu);
+  if (!enter(r)) {
+    return leave(r);
+  }
+  do {
+    handlers[r.d->handler](r);
+  } while (next(r));
+  return leave(r);
+}
+
+#endif
+
+uint32_t CpuCore::step_threaded() {
+  // Annulled delay slots and queued GTE writes keep their exact per-step
+  // timing in the switch interpreter.
+  if (skip_next_ || !gte_pending_writes_.empty()) {
+    return step_interpreter();
+  }
+  return ThreadedInterpreter::run(*this);
+}
+
+} // namespace ps1emu
@@ -1,15 +1,77 @@
 #include "core/dynarec.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <unistd.h>
+
 namespace ps1emu {
 
-JitFunc NullDynarecBackend::compile_block(uint32_t pc, const MemoryMap &memory, uint32_t &out_size) {
+namespace {
+constexpr uint32_t kRamPhysLimit = 0x1F000000;
+constexpr uint32_t kBiosPhysBase = 0x1FC00000;
+constexpr uint32_t kNoCodeOffset = 0xFFFFFFFFu;
+constexpr char kProfileMagic[8] = {'P', 'S', '1', 'J', 'I', 'T', 'P', '1'};
+
+struct ProfileRecord {
+  uint32_t pc = 0;
+  uint32_t size = 0;
+  uint64_t hash = 0;
+};
+
+uint64_t hash_memory(const MemoryMap &memory, uint32_t pc, uint32_t size) {
+  uint64_t hash = kFnvOffsetBasis;
+  for (uint32_t word = 0; word < size; word += 4) {
+    uint32_t opcode = memory.read32(pc + word);
+    hash = fnv1a64(&opcode, sizeof(opcode), hash);
+  }
+  return hash;
+}
+
+// Maps an address onto a linear RAM+BIOS space where mirrors coincide, so a
+// block and a write through a different mirror compare equal.
+uint32_t code_offset(uint32_t addr) {
+  uint32_t phys = addr & 0x1FFFFFFF;
+  if (phys < kRamPhysLimit) {
+    return phys & static_cast<uint32_t>(MemoryMap::kRamSize - 1);
+  }
+  if (phys >= kBiosPhysBase && phys < kBiosPhysBase + BiosImage::kExpectedSize) {
+    return static_cast<uint32_t>(MemoryMap::kRamSize) + (phys - kBiosPhysBase);
+  }
+  return kNoCodeOffset;
+}
+} // namespace
+
+uint64_t fnv1a64(const void *data, size_t size, uint64_t hash) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+
+bool NullDynarecBackend::compile_block(uint32_t pc, const MemoryMap &memory, uint32_t max_instructions, JitBlock &out) {
   (void)pc;
   (void)memory;
-  out_size = 0;
-  return nullptr;
+  (void)max_instructions;
+  (void)out;
+  return false;
 }
 
-DynarecCache::DynarecCache(size_t max_blocks) : max_blocks_(max_blocks) {}
+DynarecCache::DynarecCache(size_t max_blocks)
+    : slots_(std::max<size_t>(max_blocks, 1)),
+      live_(slots_.size(), 0),
+      table_(kCodeWords, kNoSlot),
+      heat_(kCodeWords, 0),
+      page_blocks_(kCodePages) {
+  free_slots_.reserve(slots_.size());
+  for (size_t slot = slots_.size(); slot > 0; --slot) {
+    free_slots_.push_back(static_cast<uint32_t>(slot - 1));
+  }
+}
 
 static bool is_branch_or_jump(uint32_t opcode) {
   uint32_t op = opcode >> 26;
@@ -31,11 +93,14 @@ static bool is_branch_or_jump(uint32_t opcode) {
   return false;
 }
 
-static void decode_block(uint32_t pc, const MemoryMap &memory, std::vector<uint32_t> &out_opcodes, uint32_t &out_size) {
+static void decode_block(uint32_t pc,
+                         const MemoryMap &memory,
+                         uint32_t max_instructions,
+                         std::vector<uint32_t> &out_opcodes,
+                         uint32_t &out_size) {
   out_opcodes.clear();
-  constexpr uint32_t kMaxInstructions = 16;
   uint32_t cursor = pc;
-  for (uint32_t i = 0; i < kMaxInstructions; ++i) {
+  for (uint32_t i = 0; i < max_instructions; ++i) {
     uint32_t opcode = memory.read32(cursor);
     out_opcodes.push_back(opcode);
     cursor += 4;
@@ -46,89 +111,372 @@ static void decode_block(uint32_t pc, const MemoryMap &memory, std::vector<uint3
   out_size = static_cast<uint32_t>(out_opcodes.size() * 4);
 }
 
-void DynarecCache::touch(JitBlock &block) {
-  block.last_used = ++tick_;
-}
-
 JitBlock *DynarecCache::lookup(uint32_t pc) {
-  auto it = blocks_.find(pc);
-  if (it == blocks_.end()) {
+  JitBlock *block = find(pc);
+  if (!block) {
+    ++stats_.misses;
     return nullptr;
   }
-  touch(it->second);
-  return &it->second;
+  ++stats_.hits;
+  block->referenced = true;
+  return block;
+}
+
+bool DynarecCache::promote(uint32_t pc, const MemoryMap &memory) {
+  uint32_t offset = code_offset(pc);
+  if (offset == kNoCodeOffset) {
+    return false;
+  }
+  if (!warm_.empty()) {
+    auto it = warm_.find(pc);
+    // A mismatch may be other code loaded at the same address for now; keep
+    // the entry for when the profiled code comes back.
+    if (it != warm_.end() && hash_memory(memory, pc, it->second.size) == it->second.hash) {
+      warm_.erase(it);
+      ++stats_.warm_hits;
+      return true;
+    }
+  }
+  uint16_t &heat = heat_[offset >> 2];
+  if (heat < kDynarecMaxHotThreshold) {
+    ++heat;
+  }
+  return heat >= hot_threshold_;
 }
 
 JitBlock *DynarecCache::compile(uint32_t pc, DynarecBackend &backend, const MemoryMap &memory) {
-  uint32_t size = 0;
-  JitFunc entry = backend.compile_block(pc, memory, size);
+  uint32_t offset = code_offset(pc);
+  if (offset == kNoCodeOffset) {
+    return nullptr;
+  }
+  backend_ = &backend;
+  JitBlock compiled;
+  compiled.pc = pc;
+  if (!backend.compile_block(pc, memory, block_limit_, compiled) || compiled.size == 0) {
+    compiled = JitBlock{};
+    compiled.pc = pc;
+    decode_block(pc, memory, block_limit_, compiled.opcodes, compiled.size);
+  } else {
+    compiled.opcodes.reserve(compiled.size / 4);
+    for (uint32_t word = 0; word < compiled.size; word += 4) {
+      compiled.opcodes.push_back(memory.read32(pc + word));
+    }
+  }
+  compiled.tier = compiled.entry ? JitTier::Compiled : JitTier::Interpreted;
+  compiled.executions = heat_[offset >> 2];
+  heat_[offset >> 2] = 0;
+  ++stats_.promotions;
+
+  // A block from another mirror of the same address is replaced.
+  if (table_[offset >> 2] != kNoSlot) {
+    release_slot(table_[offset >> 2]);
+  }
+  uint32_t slot = allocate_slot();
+  JitBlock &block = slots_[slot];
+  block = std::move(compiled);
+  block.referenced = true;
+  live_[slot] = 1;
+  ++live_count_;
+  table_[offset >> 2] = slot;
+  link_pages(slot);
+  link_exits(slot);
+  return &block;
+}
+
+JitBlock *DynarecCache::find(uint32_t pc) {
+  uint32_t offset = code_offset(pc);
+  uint32_t slot = offset == kNoCodeOffset ? kNoSlot : table_[offset >> 2];
+  if (slot == kNoSlot || slots_[slot].pc != pc) {
+    return nullptr;
+  }
+  return &slots_[slot];
+}
+
+// Points this block's exits at cached successors, and exits of other blocks
+// that were waiting on this PC at this block.
+void DynarecCache::link_exits(uint32_t slot) {
+  JitBlock &block = slots_[slot];
+  for (uint32_t index = 0; index < block.exits.size(); ++index) {
+    JitExit &exit = block.exits[index];
+    incoming_[exit.target_pc].push_back({slot, index});
+    JitBlock *target = find(exit.target_pc);
+    if (target && target->link_entry) {
+      backend_->link_exit(exit, target->link_entry);
+      exit.linked = true;
+    }
+  }
+  if (!block.link_entry) {
+    return;
+  }
+  auto it = incoming_.find(block.pc);
+  if (it == incoming_.end()) {
+    return;
+  }
+  for (const ExitRef &ref : it->second) {
+    JitExit &exit = slots_[ref.slot].exits[ref.index];
+    if (!exit.linked) {
+      backend_->link_exit(exit, block.link_entry);
+      exit.linked = true;
+    }
+  }
+}
+
+// Sends every jump into this block back to the dispatcher and forgets the
+// block's own exits.
+void DynarecCache::unlink_exits(uint32_t slot) {
+  JitBlock &block = slots_[slot];
+  auto it = incoming_.find(block.pc);
+  if (it != incoming_.end()) {
+    for (const ExitRef &ref : it->second) {
+      JitExit &exit = slots_[ref.slot].exits[ref.index];
+      if (exit.linked) {
+        backend_->unlink_exit(exit);
+        exit.linked = false;
+      }
+    }
+  }
+  for (uint32_t index = 0; index < block.exits.size(); ++index) {
+    JitExit &exit = block.exits[index];
+    if (exit.linked) {
+      backend_->unlink_exit(exit);
+      exit.linked = false;
+    }
+    auto refs = incoming_.find(exit.target_pc);
+    if (refs == incoming_.end()) {
+      continue;
+    }
+    auto &list = refs->second;
+    for (size_t i = 0; i < list.size(); ++i) {
+      if (list[i].slot == slot && list[i].index == index) {
+        list[i] = list.back();
+        list.pop_back();
+        break;
+      }
+    }
+    if (list.empty()) {
+      incoming_.erase(refs);
+    }
+  }
+}
 
-  std::vector<uint32_t> opcodes;
-  uint32_t decoded_size = 0;
-  decode_block(pc, memory, opcodes, decoded_size);
-  if (size == 0) {
-    size = decoded_size;
+uint32_t DynarecCache::allocate_slot() {
+  if (!free_slots_.empty()) {
+    uint32_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    return slot;
   }
+  // CLOCK: sweep the hand, giving recently used blocks a second chance.
+  for (;;) {
+    uint32_t slot = clock_hand_;
+    clock_hand_ = (clock_hand_ + 1) % static_cast<uint32_t>(slots_.size());
+    if (!live_[slot]) {
+      return slot;
+    }
+    if (slots_[slot].referenced) {
+      slots_[slot].referenced = false;
+      continue;
+    }
+    release_slot(slot);
+    ++stats_.evictions;
+    free_slots_.pop_back();
+    return slot;
+  }
+}
 
-  JitBlock block;
-  block.pc = pc;
-  block.size = size;
-  block.entry = entry;
-  block.last_used = ++tick_;
-  block.opcodes = std::move(opcodes);
+void DynarecCache::release_slot(uint32_t slot) {
+  if (!live_[slot]) {
+    return;
+  }
+  JitBlock &block = slots_[slot];
+  unlink_exits(slot);
+  unlink_pages(slot);
+  uint32_t offset = code_offset(block.pc);
+  if (offset != kNoCodeOffset && table_[offset >> 2] == slot) {
+    table_[offset >> 2] = kNoSlot;
+  }
+  block = JitBlock{};
+  live_[slot] = 0;
+  --live_count_;
+  free_slots_.push_back(slot);
+}
 
-  auto result = blocks_.emplace(pc, block);
-  if (!result.second) {
-    result.first->second = block;
+void DynarecCache::link_pages(uint32_t slot) {
+  const JitBlock &block = slots_[slot];
+  uint32_t first = code_offset(block.pc);
+  if (first == kNoCodeOffset || block.size == 0) {
+    return;
   }
+  uint32_t last = std::max(first, code_offset(block.pc + block.size - 4));
+  for (uint32_t page = first >> MemoryMap::kCodePageShift; page <= (last >> MemoryMap::kCodePageShift); ++page) {
+    if (page < page_blocks_.size()) {
+      page_blocks_[page].push_back(slot);
+    }
+  }
+}
 
-  evict_if_needed();
-  return &blocks_.find(pc)->second;
+void DynarecCache::unlink_pages(uint32_t slot) {
+  const JitBlock &block = slots_[slot];
+  uint32_t first = code_offset(block.pc);
+  if (first == kNoCodeOffset || block.size == 0) {
+    return;
+  }
+  uint32_t last = std::max(first, code_offset(block.pc + block.size - 4));
+  for (uint32_t page = first >> MemoryMap::kCodePageShift; page <= (last >> MemoryMap::kCodePageShift); ++page) {
+    if (page >= page_blocks_.size()) {
+      continue;
+    }
+    auto &list = page_blocks_[page];
+    auto it = std::find(list.begin(), list.end(), slot);
+    if (it != list.end()) {
+      *it = list.back();
+      list.pop_back();
+    }
+  }
 }
 
-void DynarecCache::invalidate_range(uint32_t start, uint32_t size) {
-  if (size == 0 || blocks_.empty()) {
+void DynarecCache::invalidate_range(uint32_t phys, uint32_t size) {
+  if (size == 0 || live_count_ == 0) {
+    return;
+  }
+  uint32_t start = code_offset(phys);
+  if (start == kNoCodeOffset) {
     return;
   }
   uint32_t end = start + size;
-  for (auto it = blocks_.begin(); it != blocks_.end();) {
-    if (it->first >= start && it->first < end) {
-      it = blocks_.erase(it);
-    } else {
-      ++it;
+  uint32_t last_page = (end - 1) >> MemoryMap::kCodePageShift;
+  std::vector<uint32_t> doomed;
+  for (uint32_t page = start >> MemoryMap::kCodePageShift; page <= last_page && page < page_blocks_.size(); ++page) {
+    for (uint32_t slot : page_blocks_[page]) {
+      const JitBlock &block = slots_[slot];
+      uint32_t block_start = code_offset(block.pc);
+      if (block_start < end && start < block_start + block.size) {
+        doomed.push_back(slot);
+      }
     }
   }
+  for (uint32_t slot : doomed) {
+    if (live_[slot]) {
+      release_slot(slot);
+      ++stats_.invalidations;
+    }
+  }
+}
+
+void DynarecCache::set_block_limit(uint32_t limit) {
+  block_limit_ = std::min(std::max<uint32_t>(limit, 1), kDynarecMaxBlockLimit);
+}
+
+void DynarecCache::set_hot_threshold(uint32_t threshold) {
+  hot_threshold_ = std::min(std::max<uint32_t>(threshold, 1), kDynarecMaxHotThreshold);
 }
 
 void DynarecCache::invalidate_all() {
-  blocks_.clear();
+  for (uint32_t slot = 0; slot < slots_.size(); ++slot) {
+    release_slot(slot);
+  }
+  clock_hand_ = 0;
+  std::fill(heat_.begin(), heat_.end(), 0);
 }
 
 std::vector<JitBlock> DynarecCache::snapshot() const {
   std::vector<JitBlock> result;
-  result.reserve(blocks_.size());
-  for (const auto &pair : blocks_) {
-    result.push_back(pair.second);
+  result.reserve(live_count_);
+  for (uint32_t slot = 0; slot < slots_.size(); ++slot) {
+    if (live_[slot]) {
+      result.push_back(slots_[slot]);
+    }
   }
   return result;
 }
 
-void DynarecCache::evict_if_needed() {
-  if (blocks_.size() <= max_blocks_) {
-    return;
+bool DynarecCache::save_profile(const std::string &path, std::string &error) const {
+  std::vector<ProfileRecord> records;
+  records.reserve(live_count_ + warm_.size());
+  // Profiled blocks this session never reached stay in the file; a block
+  // cached now at the same PC comes later and wins on load.
+  for (const auto &entry : warm_) {
+    records.push_back({entry.first, entry.second.size, entry.second.hash});
+  }
+  for (uint32_t slot = 0; slot < slots_.size(); ++slot) {
+    const JitBlock &block = slots_[slot];
+    if (!live_[slot] || block.size == 0) {
+      continue;
+    }
+    ProfileRecord record;
+    record.pc = block.pc;
+    record.size = block.size;
+    record.hash = fnv1a64(block.opcodes.data(), block.opcodes.size() * sizeof(uint32_t));
+    records.push_back(record);
   }
 
-  uint64_t oldest_tick = UINT64_MAX;
-  uint32_t oldest_pc = 0;
-  for (const auto &pair : blocks_) {
-    if (pair.second.last_used < oldest_tick) {
-      oldest_tick = pair.second.last_used;
-      oldest_pc = pair.first;
+  // Sessions sharing a profile, or one killed mid-save, must never leave a
+  // torn file behind: write a private temporary and rename it into place.
+  std::string temp = path + ".tmp." + std::to_string(getpid());
+  std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    error = "Unable to write dynarec profile: " + temp;
+    return false;
+  }
+  uint32_t count = static_cast<uint32_t>(records.size());
+  out.write(kProfileMagic, sizeof(kProfileMagic));
+  out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  out.write(reinterpret_cast<const char *>(records.data()),
+            static_cast<std::streamsize>(records.size() * sizeof(ProfileRecord)));
+  out.close();
+  if (!out) {
+    std::remove(temp.c_str());
+    error = "Failed to write dynarec profile: " + temp;
+    return false;
+  }
+  if (std::rename(temp.c_str(), path.c_str()) != 0) {
+    std::remove(temp.c_str());
+    error = "Unable to replace dynarec profile: " + path;
+    return false;
+  }
+  return true;
+}
+
+bool DynarecCache::load_profile(const std::string &path, std::string &error) {
+  warm_.clear();
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return true;
+  }
+  char magic[sizeof(kProfileMagic)] = {};
+  uint32_t count = 0;
+  if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, kProfileMagic, sizeof(magic)) != 0 ||
+      !file.read(reinterpret_cast<char *>(&count), sizeof(count))) {
+    error = "Unrecognized dynarec profile: " + path;
+    return false;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    ProfileRecord record;
+    if (!file.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+      error = "Truncated dynarec profile: " + path;
+      return false;
     }
+    if (record.size == 0 || record.size > kDynarecMaxBlockLimit * 4 + 4 || code_offset(record.pc) == kNoCodeOffset) {
+      continue;
+    }
+    warm_[record.pc] = {record.size, record.hash};
   }
-  if (oldest_tick != UINT64_MAX) {
-    blocks_.erase(oldest_pc);
+  return true;
+}
+
+std::vector<JitBlock> DynarecCache::cold_snapshot() const {
+  constexpr uint32_t kRamWords = static_cast<uint32_t>(MemoryMap::kRamSize >> 2);
+  std::vector<JitBlock> result;
+  for (uint32_t word = 0; word < heat_.size(); ++word) {
+    if (heat_[word] == 0) {
+      continue;
+    }
+    JitBlock block;
+    block.pc = word < kRamWords ? 0x80000000u + (word << 2) : 0xBFC00000u + ((word - kRamWords) << 2);
+    block.tier = JitTier::Cold;
+    block.executions = heat_[word];
+    result.push_back(std::move(block));
   }
+  return result;
 }
 
 } // namespace ps1emu
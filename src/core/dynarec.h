@@ -6,49 +6,177 @@
 
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace ps1emu {
 
-using JitFunc = uint32_t (*)(CpuState *state, MemoryMap *memory);
+// Instructions per block before the branch that ends it (cpu.dynarec_block_limit).
+constexpr uint32_t kDynarecDefaultBlockLimit = 64;
+constexpr uint32_t kDynarecMaxBlockLimit = 256;
+// Interpreted entries to a block head before it is compiled (cpu.dynarec_hot_threshold).
+constexpr uint32_t kDynarecDefaultHotThreshold = 16;
+constexpr uint32_t kDynarecMaxHotThreshold = 0xFFFF;
+
+// 64-bit FNV-1a; keys persisted blocks by their opcodes and names cache files.
+constexpr uint64_t kFnvOffsetBasis = 0xCBF29CE484222325ull;
+uint64_t fnv1a64(const void *data, size_t size, uint64_t hash = kFnvOffsetBasis);
+
+// Runs a block, and any blocks linked from it while the budget lasts;
+// returns the cycles executed.
+using JitFunc = uint32_t (*)(CpuState *state, MemoryMap *memory, uint32_t cycle_budget);
+
+// Hooks compiled code calls for CPU state that lives outside CpuState
+// (GTE registers, exception entry and the load delay slot left pending at block exit).
+struct DynarecRuntime {
+  void *context = nullptr;
+  uint32_t (*cop2_read)(void *context, uint32_t reg) = nullptr;
+  void (*cop2_write)(void *context, uint32_t reg, uint32_t value) = nullptr;
+  void (*raise_exception)(void *context, uint32_t excode, uint32_t badaddr, uint32_t instr_pc, uint32_t in_delay) = nullptr;
+  void (*set_load_delay)(void *context, uint32_t reg, uint32_t value) = nullptr;
+  // Link entry of the cached block at pc, or null; used by JR/JALR exits.
+  const void *(*lookup_link)(void *context, uint32_t pc) = nullptr;
+};
+
+// A static successor of a block (J/JAL/Bxx target, fall-through) whose exit
+// jump the backend can point straight at the successor's link entry.
+struct JitExit {
+  uint32_t target_pc = 0;
+  void *site = nullptr;           // backend-defined patch location
+  const void *unlinked = nullptr; // where the exit goes while unlinked
+  bool linked = false;
+};
+
+enum class JitTier : uint8_t {
+  Cold,        // below the hot threshold; runs in the interpreter
+  Interpreted, // hot, but the backend cannot compile its first instruction
+  Compiled
+};
 
 struct JitBlock {
   uint32_t pc = 0;
   uint32_t size = 0;
   JitFunc entry = nullptr;
-  uint64_t last_used = 0;
+  // Entered by jumps from linked blocks, skipping the prologue.
+  const void *link_entry = nullptr;
+  bool referenced = false; // CLOCK bit, set on every lookup hit
+  JitTier tier = JitTier::Compiled;
+  // Entries from the dispatcher, including the cold ones before promotion;
+  // jumps from linked blocks are not counted.
+  uint64_t executions = 0;
   std::vector<uint32_t> opcodes;
+  std::vector<JitExit> exits;
 };
 
 class DynarecBackend {
 public:
   virtual ~DynarecBackend() = default;
-  virtual JitFunc compile_block(uint32_t pc, const MemoryMap &memory, uint32_t &out_size) = 0;
+  // Fills entry, size, link_entry and exits; false if nothing was compiled.
+  virtual bool compile_block(uint32_t pc, const MemoryMap &memory, uint32_t max_instructions, JitBlock &out) = 0;
+  virtual void link_exit(JitExit &exit, const void *target) {
+    (void)exit;
+    (void)target;
+  }
+  virtual void unlink_exit(JitExit &exit) { (void)exit; }
+  virtual bool code_space_low() const { return false; }
+  virtual void reset_code_space() {}
 };
 
 class NullDynarecBackend final : public DynarecBackend {
 public:
-  JitFunc compile_block(uint32_t pc, const MemoryMap &memory, uint32_t &out_size) override;
+  bool compile_block(uint32_t pc, const MemoryMap &memory, uint32_t max_instructions, JitBlock &out) override;
 };
 
 class DynarecCache {
 public:
+  // Code pages tracked for invalidation: RAM, then the BIOS.
+  static constexpr size_t kRamCodePages = MemoryMap::kRamCodePages;
+  static constexpr size_t kCodePages = kRamCodePages + (BiosImage::kExpectedSize >> MemoryMap::kCodePageShift);
+  static constexpr size_t kCodeWords = (MemoryMap::kRamSize + BiosImage::kExpectedSize) >> 2;
+
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t invalidations = 0;
+    uint64_t promotions = 0;
+    uint64_t warm_hits = 0; // promotions taken straight from a loaded profile
+  };
+
   explicit DynarecCache(size_t max_blocks = 4096);
 
+  // Direct-mapped on the physical word address; blocks are tagged with their
+  // virtual PC, so a different mirror of the same code misses.
   JitBlock *lookup(uint32_t pc);
+  // Counts an interpreted entry to a block head; true once the head is hot
+  // enough to compile, or at once if a loaded profile lists a block there
+  // whose opcodes still match memory. PCs outside RAM/BIOS are never promoted.
+  bool promote(uint32_t pc, const MemoryMap &memory);
+  // Returns null for PCs outside RAM/BIOS, which are never cached.
   JitBlock *compile(uint32_t pc, DynarecBackend &backend, const MemoryMap &memory);
-  void invalidate_range(uint32_t start, uint32_t size);
+  // Drops blocks overlapping a physical range; only the blocks listed on the
+  // touched pages are inspected.
+  void invalidate_range(uint32_t phys, uint32_t size);
   void invalidate_all();
+  // Clamped to 1..kDynarecMaxBlockLimit; applies to blocks compiled afterwards.
+  void set_block_limit(uint32_t limit);
+  uint32_t block_limit() const { return block_limit_; }
+  // Clamped to 1..kDynarecMaxHotThreshold; 1 compiles every block on first entry.
+  void set_hot_threshold(uint32_t threshold);
+  uint32_t hot_threshold() const { return hot_threshold_; }
   std::vector<JitBlock> snapshot() const;
+  // Block heads entered but not yet promoted, as Cold blocks with their counts.
+  std::vector<JitBlock> cold_snapshot() const;
+  // Persists which blocks were hot (PC, length and opcode hash) so a later
+  // session compiles them on first entry. Host code is not saved: it embeds
+  // addresses of this process. A missing file loads as an empty profile; a
+  // damaged one fails but keeps the records read before the damage, so the
+  // next save_profile() replaces it with a good file.
+  bool save_profile(const std::string &path, std::string &error) const;
+  bool load_profile(const std::string &path, std::string &error);
+  const Stats &stats() const { return stats_; }
 
 private:
-  void touch(JitBlock &block);
-  void evict_if_needed();
+  static constexpr uint32_t kNoSlot = 0xFFFFFFFFu;
+
+  struct WarmBlock {
+    uint32_t size = 0;
+    uint64_t hash = 0;
+  };
+
+  struct ExitRef {
+    uint32_t slot = 0;
+    uint32_t index = 0;
+  };
+
+  uint32_t allocate_slot();
+  void release_slot(uint32_t slot);
+  void link_pages(uint32_t slot);
+  void unlink_pages(uint32_t slot);
+  void link_exits(uint32_t slot);
+  void unlink_exits(uint32_t slot);
+  JitBlock *find(uint32_t pc);
 
-  size_t max_blocks_;
-  uint64_t tick_ = 0;
-  std::unordered_map<uint32_t, JitBlock> blocks_;
+  std::vector<JitBlock> slots_;
+  std::vector<uint8_t> live_;
+  std::vector<uint32_t> free_slots_;
+  size_t live_count_ = 0;
+  uint32_t clock_hand_ = 0;
+  // Physical word (RAM, then BIOS) -> slot of the block starting there.
+  std::vector<uint32_t> table_;
+  // Physical word -> interpreted entries while the block there is cold.
+  std::vector<uint16_t> heat_;
+  // Code page -> slots of the blocks whose instructions lie on it.
+  std::vector<std::vector<uint32_t>> page_blocks_;
+  // Target PC -> block exits that jump (or could jump) there.
+  std::unordered_map<uint32_t, std::vector<ExitRef>> incoming_;
+  // Block PC -> profile entry loaded from disk and not yet promoted.
+  std::unordered_map<uint32_t, WarmBlock> warm_;
+  DynarecBackend *backend_ = nullptr;
+  uint32_t block_limit_ = kDynarecDefaultBlockLimit;
+  uint32_t hot_threshold_ = kDynarecDefaultHotThreshold;
+  Stats stats_;
 };
 
 } // namespace ps1emu
@@ -0,0 +1,550 @@
+#include "core/dynarec_ir.h"
+
+#include <algorithm>
+
+namespace ps1emu {
+
+namespace {
+
+bool reads_rs(const DecodedOp &d) {
+  switch (d.op) {
+    case 0x00:
+      switch (d.funct) {
+        case 0x00: case 0x02: case 0x03: // shifts by sa
+        case 0x10: case 0x12:             // MFHI/MFLO
+          return false;
+        default:
+          return true;
+      }
+    case 0x02: case 0x03: case 0x0F: case 0x10: case 0x12:
+      return false;
+    default:
+      return true;
+  }
+}
+
+bool reads_rt(const DecodedOp &d) {
+  switch (d.op) {
+    case 0x00:
+      switch (d.funct) {
+        case 0x08: case 0x09: case 0x10: case 0x11: case 0x12: case 0x13:
+          return false;
+        default:
+          return true;
+      }
+    case 0x04: case 0x05:
+      return true;
+    case 0x10: case 0x12: // MTCz/CTCz
+      return d.rs == 0x04 || d.rs == 0x06;
+    case 0x22: case 0x26: // LWL/LWR merge into the old value
+    case 0x28: case 0x29: case 0x2A: case 0x2B: case 0x2E:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Overflow (ADD/ADDI/SUB) and address error (LH/LW/SH/SW and unsigned loads) checks.
+bool may_raise(const DecodedOp &d) {
+  switch (d.op) {
+    case 0x00:
+      return d.funct == 0x20 || d.funct == 0x22;
+    case 0x08: case 0x21: case 0x23: case 0x25: case 0x29: case 0x2B:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint32_t alignment_mask(const DecodedOp &d) {
+  switch (d.op) {
+    case 0x21: case 0x25: case 0x29:
+      return 1;
+    case 0x23: case 0x2B:
+      return 3;
+    default:
+      return 0;
+  }
+}
+
+bool add_overflows(uint32_t a, uint32_t b, uint32_t sum) {
+  return ((~(a ^ b) & (a ^ sum)) >> 31) != 0;
+}
+
+bool sub_overflows(uint32_t a, uint32_t b, uint32_t diff) {
+  return (((a ^ b) & (a ^ diff)) >> 31) != 0;
+}
+
+bool known(const IrBlock &block, uint32_t value, uint32_t &out) {
+  if (value == kIrNone || !block.values[value].constant) {
+    return false;
+  }
+  out = block.values[value].imm;
+  return true;
+}
+
+// Result of a non-delayed write when enough operands are known.
+bool fold(const DecodedOp &d, bool a_known, uint32_t a, bool b_known, uint32_t b, uint32_t &out) {
+  bool both = a_known && b_known;
+  switch (d.op) {
+    case 0x00:
+      switch (d.funct) {
+        case 0x00: out = b << d.sh; return b_known;
+        case 0x02: out = b >> d.sh; return b_known;
+        case 0x03: out = static_cast<uint32_t>(static_cast<int32_t>(b) >> d.sh); return b_known;
+        case 0x04: out = b << (a & 31); return both;
+        case 0x06: out = b >> (a & 31); return both;
+        case 0x07: out = static_cast<uint32_t>(static_cast<int32_t>(b) >> (a & 31)); return both;
+        case 0x09: out = d.pc + 8; return true;
+        case 0x20: out = a + b; return both && !add_overflows(a, b, out);
+        case 0x21: out = a + b; return both;
+        case 0x22: out = a - b; return both && !sub_overflows(a, b, out);
+        case 0x23: out = a - b; return both;
+        case 0x24:
+          out = a & b;
+          return both || (a_known && a == 0) || (b_known && b == 0);
+        case 0x25: out = a | b; return both;
+        case 0x26: out = a ^ b; return both;
+        case 0x27: out = ~(a | b); return both;
+        case 0x2A: out = static_cast<int32_t>(a) < static_cast<int32_t>(b) ? 1 : 0; return both;
+        case 0x2B: out = a < b ? 1 : 0; return both;
+        default: return false;
+      }
+    case 0x01: case 0x03: // link register
+      out = d.pc + 8;
+      return true;
+    case 0x08: out = a + d.imm_se; return a_known && !add_overflows(a, d.imm_se, out);
+    case 0x09: out = a + d.imm_se; return a_known;
+    case 0x0A: out = static_cast<int32_t>(a) < static_cast<int32_t>(d.imm_se) ? 1 : 0; return a_known;
+    case 0x0B: out = a < d.imm_se ? 1 : 0; return a_known;
+    case 0x0C: out = a & d.imm; return a_known;
+    case 0x0D: out = a | d.imm; return a_known;
+    case 0x0E: out = a ^ d.imm; return a_known;
+    case 0x0F: out = d.imm << 16; return true;
+    default: return false;
+  }
+}
+
+// Register contents after an instruction, following the load delay rules the
+// backend emits: a delayed write lands after the next instruction unless that
+// instruction writes the same register itself.
+void advance(const IrBlock &block, std::array<uint32_t, 32> &current, uint32_t &pending, const IrInst &inst) {
+  if (inst.delayed) {
+    if (pending != kIrNone) {
+      current[block.values[pending].reg] = pending;
+    }
+    pending = inst.result;
+    return;
+  }
+  if (pending != kIrNone) {
+    if (inst.result == kIrNone || block.values[inst.result].reg != block.values[pending].reg) {
+      current[block.values[pending].reg] = pending;
+    }
+    pending = kIrNone;
+  }
+  if (inst.result != kIrNone) {
+    current[block.values[inst.result].reg] = inst.result;
+  }
+}
+
+std::array<uint32_t, 32> entry_values() {
+  std::array<uint32_t, 32> current{};
+  for (uint32_t reg = 0; reg < 32; ++reg) {
+    current[reg] = reg;
+  }
+  return current;
+}
+
+bool reads_register(const IrBlock &block, const IrInst &inst, uint32_t reg) {
+  return (inst.rs_value != kIrNone && block.values[inst.rs_value].reg == reg) ||
+         (inst.rt_value != kIrNone && block.values[inst.rt_value].reg == reg);
+}
+
+} // namespace
+
+DecodedOp decode_op(uint32_t word, uint32_t pc) {
+  DecodedOp d;
+  d.word = word;
+  d.pc = pc;
+  d.op = word >> 26;
+  d.rs = (word >> 21) & 0x1F;
+  d.rt = (word >> 16) & 0x1F;
+  d.rd = (word >> 11) & 0x1F;
+  d.sh = (word >> 6) & 0x1F;
+  d.funct = word & 0x3F;
+  d.imm = word & 0xFFFF;
+  d.imm_se = static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(d.imm)));
+  return d;
+}
+
+OpKind classify_op(const DecodedOp &d) {
+  switch (d.op) {
+    case 0x00:
+      switch (d.funct) {
+        case 0x00: case 0x02: case 0x03: case 0x04: case 0x06: case 0x07:
+        case 0x10: case 0x11: case 0x12: case 0x13:
+        case 0x18: case 0x19: case 0x1A: case 0x1B:
+        case 0x20: case 0x21: case 0x22: case 0x23:
+        case 0x24: case 0x25: case 0x26: case 0x27:
+        case 0x2A: case 0x2B:
+          return OpKind::Simple;
+        case 0x08: case 0x09:
+          return OpKind::Branch;
+        default:
+          return OpKind::Unsupported;
+      }
+    case 0x01:
+      if (d.rt == 0x00 || d.rt == 0x01 || d.rt == 0x10 || d.rt == 0x11) {
+        return OpKind::Branch;
+      }
+      return OpKind::Unsupported;
+    case 0x02: case 0x03: case 0x04: case 0x05: case 0x06: case 0x07:
+      return OpKind::Branch;
+    case 0x08: case 0x09: case 0x0A: case 0x0B:
+    case 0x0C: case 0x0D: case 0x0E: case 0x0F:
+      return OpKind::Simple;
+    case 0x10: {
+      uint32_t cop_op = d.rs;
+      if (d.word == 0x42000010) { // RFE
+        return OpKind::EndsBlock;
+      }
+      if (cop_op == 0x00 || cop_op == 0x02) {
+        return OpKind::Simple;
+      }
+      if (cop_op == 0x04 || cop_op == 0x06) { // MTC0 may flip IEc/IsC
+        return OpKind::EndsBlock;
+      }
+      return OpKind::Unsupported;
+    }
+    case 0x12: {
+      uint32_t cop_op = d.rs;
+      if (cop_op == 0x00 || cop_op == 0x02 || cop_op == 0x04 || cop_op == 0x06) {
+        return OpKind::Simple;
+      }
+      return OpKind::Unsupported;
+    }
+    case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x26:
+    case 0x28: case 0x29: case 0x2A: case 0x2B: case 0x2E:
+      return OpKind::Simple;
+    default:
+      return OpKind::Unsupported;
+  }
+}
+
+uint32_t direct_dest(const DecodedOp &d) {
+  switch (d.op) {
+    case 0x00:
+      if (d.funct == 0x09) {
+        return d.rd ? d.rd : 31;
+      }
+      if (d.funct == 0x08 || d.funct == 0x11 || d.funct == 0x13 || (d.funct >= 0x18 && d.funct <= 0x1B)) {
+        return 0;
+      }
+      return d.rd;
+    case 0x01:
+      return (d.rt & 0x10) ? 31 : 0;
+    case 0x03:
+      return 31;
+    case 0x08: case 0x09: case 0x0A: case 0x0B:
+    case 0x0C: case 0x0D: case 0x0E: case 0x0F:
+      return d.rt;
+    default:
+      return 0;
+  }
+}
+
+bool writes_delayed(const DecodedOp &d) {
+  switch (d.op) {
+    case 0x10: case 0x12: // MFCz/CFCz
+      return d.word != 0x42000010 && (d.rs == 0x00 || d.rs == 0x02);
+    case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x26:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool build_ir_block(uint32_t pc, const MemoryMap &memory, uint32_t max_instructions, IrBlock &block) {
+  block = IrBlock{};
+  block.pc = pc;
+  std::vector<DecodedOp> ops;
+  uint32_t cursor = pc;
+  while (ops.size() < max_instructions) {
+    DecodedOp d = decode_op(memory.read32(cursor), cursor);
+    OpKind kind = classify_op(d);
+    if (kind == OpKind::Unsupported) {
+      break;
+    }
+    if (kind == OpKind::Branch) {
+      DecodedOp slot = decode_op(memory.read32(cursor + 4), cursor + 4);
+      OpKind slot_kind = classify_op(slot);
+      if (slot_kind == OpKind::Unsupported || slot_kind == OpKind::Branch) {
+        break;
+      }
+      slot.in_delay = true;
+      ops.push_back(d);
+      ops.push_back(slot);
+      block.ends_with_branch = true;
+      break;
+    }
+    ops.push_back(d);
+    cursor += 4;
+    if (kind == OpKind::EndsBlock) {
+      break;
+    }
+  }
+  if (ops.empty()) {
+    return false;
+  }
+
+  block.values.resize(32);
+  for (uint32_t reg = 0; reg < 32; ++reg) {
+    block.values[reg].reg = reg;
+  }
+  block.values[0].constant = true;
+
+  std::array<uint32_t, 32> current = entry_values();
+  uint32_t pending = kIrNone;
+  block.insts.reserve(ops.size());
+  for (size_t i = 0; i < ops.size(); ++i) {
+    IrInst inst;
+    inst.op = ops[i];
+    inst.kind = classify_op(inst.op);
+    inst.may_except = may_raise(inst.op);
+    inst.delayed = writes_delayed(inst.op);
+    if (reads_rs(inst.op)) {
+      inst.rs_value = current[inst.op.rs];
+    }
+    if (reads_rt(inst.op)) {
+      inst.rt_value = current[inst.op.rt];
+    }
+    uint32_t dest = inst.delayed ? inst.op.rt : direct_dest(inst.op);
+    if (dest != 0) {
+      IrValue value;
+      value.reg = dest;
+      value.def = static_cast<int32_t>(i);
+      inst.result = static_cast<uint32_t>(block.values.size());
+      block.values.push_back(value);
+    }
+    advance(block, current, pending, inst);
+    block.insts.push_back(inst);
+  }
+  return true;
+}
+
+void propagate_constants(IrBlock &block) {
+  for (IrInst &inst : block.insts) {
+    uint32_t a = 0;
+    uint32_t b = 0;
+    bool a_known = known(block, inst.rs_value, a);
+    bool b_known = known(block, inst.rt_value, b);
+    if (uint32_t mask = alignment_mask(inst.op)) {
+      if (a_known && ((a + inst.op.imm_se) & mask) == 0) {
+        inst.may_except = false;
+      }
+      continue;
+    }
+    if (inst.result == kIrNone || inst.delayed) {
+      continue;
+    }
+    uint32_t out = 0;
+    if (fold(inst.op, a_known, a, b_known, b, out)) {
+      IrValue &value = block.values[inst.result];
+      value.constant = true;
+      value.imm = out;
+      // A folded ADD/ADDI/SUB is known not to overflow.
+      inst.may_except = false;
+    }
+  }
+}
+
+bool ir_is_pure(const IrInst &inst) {
+  if (inst.may_except) {
+    return false;
+  }
+  const DecodedOp &d = inst.op;
+  switch (d.op) {
+    case 0x00:
+      switch (d.funct) {
+        case 0x00: case 0x02: case 0x03: case 0x04: case 0x06: case 0x07:
+        case 0x10: case 0x12:
+        case 0x20: case 0x21: case 0x22: case 0x23:
+        case 0x24: case 0x25: case 0x26: case 0x27:
+        case 0x2A: case 0x2B:
+          return true;
+        default:
+          return false;
+      }
+    case 0x08: case 0x09: case 0x0A: case 0x0B:
+    case 0x0C: case 0x0D: case 0x0E: case 0x0F:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool ir_reads_operands(const IrBlock &block, const IrInst &inst) {
+  if (!ir_is_pure(inst)) {
+    return true;
+  }
+  if (inst.result == kIrNone) {
+    return false;
+  }
+  const IrValue &value = block.values[inst.result];
+  return value.live && !value.constant;
+}
+
+void mark_live_values(IrBlock &block) {
+  for (IrValue &value : block.values) {
+    value.live = false;
+  }
+  // Exceptions and the block exit see every register, plus a load still in
+  // its delay slot (the backend commits it first).
+  std::array<uint32_t, 32> current = entry_values();
+  uint32_t pending = kIrNone;
+  auto observe_all = [&]() {
+    for (uint32_t reg = 1; reg < 32; ++reg) {
+      block.values[current[reg]].live = true;
+    }
+    if (pending != kIrNone) {
+      block.values[pending].live = true;
+    }
+  };
+  for (const IrInst &inst : block.insts) {
+    if (inst.may_except) {
+      observe_all();
+    }
+    advance(block, current, pending, inst);
+  }
+  observe_all();
+
+  // Readers come after their definitions, so a backward walk knows whether an
+  // instruction is emitted before looking at its operands. Known operands are
+  // emitted as immediates and do not need the register.
+  for (size_t i = block.insts.size(); i-- > 0;) {
+    const IrInst &inst = block.insts[i];
+    if (!ir_reads_operands(block, inst)) {
+      continue;
+    }
+    for (uint32_t value : {inst.rs_value, inst.rt_value}) {
+      if (value != kIrNone && !block.values[value].constant) {
+        block.values[value].live = true;
+      }
+    }
+  }
+}
+
+void resolve_load_delays(IrBlock &block) {
+  for (size_t i = 0; i < block.insts.size(); ++i) {
+    IrInst &inst = block.insts[i];
+    if (!inst.delayed || inst.result == kIrNone) {
+      inst.commit = IrCommit::None;
+      continue;
+    }
+    const IrValue &value = block.values[inst.result];
+    if (!value.live) {
+      inst.commit = IrCommit::Drop;
+    } else if (i + 1 == block.insts.size()) {
+      inst.commit = IrCommit::AtExit;
+    } else {
+      const IrInst &next = block.insts[i + 1];
+      bool touched = direct_dest(next.op) == value.reg || reads_register(block, next, value.reg);
+      inst.commit = touched ? IrCommit::AfterNext : IrCommit::Immediate;
+    }
+  }
+}
+
+void optimize_ir_block(IrBlock &block) {
+  propagate_constants(block);
+  mark_live_values(block);
+  resolve_load_delays(block);
+}
+
+IrRegisterAllocation allocate_host_registers(const IrBlock &block, uint32_t host_registers) {
+  IrRegisterAllocation slots;
+  slots.fill(-1);
+
+  struct Range {
+    uint32_t reg = 0;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t uses = 0;
+  };
+  std::array<Range, 32> ranges;
+  auto touch = [&](uint32_t reg, uint32_t index) {
+    if (reg == 0) {
+      return;
+    }
+    Range &range = ranges[reg];
+    if (range.uses == 0) {
+      range.reg = reg;
+      range.first = index;
+    }
+    range.last = std::max(range.last, index);
+    ++range.uses;
+  };
+  for (uint32_t i = 0; i < block.insts.size(); ++i) {
+    const IrInst &inst = block.insts[i];
+    if (ir_reads_operands(block, inst)) {
+      for (uint32_t value : {inst.rs_value, inst.rt_value}) {
+        if (value != kIrNone && !block.values[value].constant) {
+          touch(block.values[value].reg, i);
+        }
+      }
+    }
+    if (inst.result == kIrNone) {
+      continue;
+    }
+    uint32_t reg = block.values[inst.result].reg;
+    if (!inst.delayed) {
+      if (!ir_is_pure(inst) || block.values[inst.result].live) {
+        touch(reg, i);
+      }
+    } else if (inst.commit == IrCommit::Immediate) {
+      touch(reg, i);
+    } else if (inst.commit == IrCommit::AfterNext) {
+      touch(reg, i + 1);
+    }
+  }
+
+  // A register touched once gains nothing over a memory operand.
+  std::vector<Range> order;
+  for (const Range &range : ranges) {
+    if (range.uses >= 2) {
+      order.push_back(range);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [](const Range &a, const Range &b) { return a.first < b.first; });
+
+  std::vector<const Range *> active;
+  std::vector<int8_t> free_slots;
+  for (uint32_t slot = host_registers; slot > 0; --slot) {
+    free_slots.push_back(static_cast<int8_t>(slot - 1));
+  }
+  for (const Range &range : order) {
+    for (auto it = active.begin(); it != active.end();) {
+      if ((*it)->last < range.first) {
+        free_slots.push_back(slots[(*it)->reg]);
+        it = active.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    if (!free_slots.empty()) {
+      slots[range.reg] = free_slots.back();
+      free_slots.pop_back();
+      active.push_back(&range);
+      continue;
+    }
+    auto victim = std::min_element(active.begin(), active.end(),
+                                   [](const Range *a, const Range *b) { return a->uses < b->uses; });
+    if (victim != active.end() && (*victim)->uses < range.uses) {
+      slots[range.reg] = slots[(*victim)->reg];
+      slots[(*victim)->reg] = -1;
+      *victim = &range;
+    }
+  }
+  return slots;
+}
+
+} // namespace ps1emu
@@ -0,0 +1,110 @@
+#ifndef PS1EMU_DYNAREC_IR_H
+#define PS1EMU_DYNAREC_IR_H
+
+#include "core/memory_map.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace ps1emu {
+
+struct DecodedOp {
+  uint32_t word = 0;
+  uint32_t pc = 0;
+  uint32_t op = 0;
+  uint32_t rs = 0;
+  uint32_t rt = 0;
+  uint32_t rd = 0;
+  uint32_t sh = 0;
+  uint32_t funct = 0;
+  uint32_t imm = 0;
+  uint32_t imm_se = 0;
+  bool in_delay = false;
+};
+
+enum class OpKind {
+  Unsupported,
+  Simple,
+  Branch,
+  EndsBlock
+};
+
+DecodedOp decode_op(uint32_t word, uint32_t pc);
+// Instructions outside this set (SYSCALL/BREAK, branch-likely, GTE commands,
+// LWC2/SWC2, COP1/COP3) end the block and are left to the interpreter.
+OpKind classify_op(const DecodedOp &d);
+// GPR written immediately (not through the load delay slot), or 0 if none.
+uint32_t direct_dest(const DecodedOp &d);
+// Loads and coprocessor reads, whose result lands after the next instruction.
+bool writes_delayed(const DecodedOp &d);
+
+constexpr uint32_t kIrNone = 0xFFFFFFFFu;
+
+// One definition of a guest GPR. Every write creates a new value, so value
+// ids are SSA names over the 32 GPRs of a block; ids 0..31 are the values
+// the registers hold on entry.
+struct IrValue {
+  uint32_t reg = 0;
+  int32_t def = -1;
+  bool constant = false;
+  uint32_t imm = 0;
+  // Read as a register by emitted code, visible to an exception, or live at exit.
+  bool live = false;
+};
+
+// Where a delayed write goes once the load delay slot is resolved.
+enum class IrCommit : uint8_t {
+  None,      // not a delayed write, or one to r0
+  Drop,      // never observed
+  Immediate, // the next instruction cannot tell, so write the register now
+  AfterNext, // the next instruction uses the register; hold the value across it
+  AtExit     // still in the delay slot when the block ends
+};
+
+struct IrInst {
+  DecodedOp op;
+  OpKind kind = OpKind::Simple;
+  uint32_t rs_value = kIrNone;
+  uint32_t rt_value = kIrNone;
+  uint32_t result = kIrNone;
+  bool delayed = false;
+  bool may_except = false;
+  IrCommit commit = IrCommit::None;
+};
+
+struct IrBlock {
+  uint32_t pc = 0;
+  bool ends_with_branch = false;
+  std::vector<IrInst> insts;
+  std::vector<IrValue> values;
+};
+
+// Guest GPR -> host register slot for the block, or -1 to stay in CpuState.
+using IrRegisterAllocation = std::array<int8_t, 32>;
+
+// Decodes up to max_instructions (plus a trailing delay slot) and builds SSA
+// values; false if the first instruction cannot be compiled.
+bool build_ir_block(uint32_t pc, const MemoryMap &memory, uint32_t max_instructions, IrBlock &block);
+// Folds results whose operands are known (LUI/ORI pairs, immediates off r0)
+// and drops overflow/alignment checks that can no longer fail.
+void propagate_constants(IrBlock &block);
+// Marks the values some emitted instruction, exception or block exit can
+// observe; writes of everything else are dead.
+void mark_live_values(IrBlock &block);
+// Decides per load whether the delay slot needs the value held at all.
+void resolve_load_delays(IrBlock &block);
+void optimize_ir_block(IrBlock &block);
+// Linear scan over each GPR's access range in the block, spilling the range
+// with the fewest accesses when all host registers are taken.
+IrRegisterAllocation allocate_host_registers(const IrBlock &block, uint32_t host_registers);
+
+// True if the instruction only computes its direct result (no exception,
+// memory access or control flow), so a dead or constant result needs no code.
+bool ir_is_pure(const IrInst &inst);
+// True if the instruction's register operands are read by generated code.
+bool ir_reads_operands(const IrBlock &block, const IrInst &inst);
+
+} // namespace ps1emu
+
+#endif
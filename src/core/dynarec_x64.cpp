@@ -0,0 +1,1647 @@
+#include "core/dynarec_x64.h"
+
+#include "core/dynarec_ir.h"
+#include "core/fastmem.h"
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#if defined(PS1EMU_DYNAREC_X64)
+#include <sys/mman.h>
+#include <ucontext.h>
+#endif
+
+namespace ps1emu {
+
+#if defined(PS1EMU_DYNAREC_X64)
+
+namespace {
+
+constexpr size_t kMaxBlockBytes = 128 * 1024;
+
+enum Reg : uint8_t {
+  kRax = 0,
+  kRcx = 1,
+  kRdx = 2,
+  kRbx = 3,
+  kRsp = 4,
+  kRbp = 5,
+  kRsi = 6,
+  kRdi = 7,
+  kR8 = 8,
+  kR9 = 9,
+  kR10 = 10,
+  kR11 = 11,
+  kR12 = 12,
+  kR13 = 13,
+  kR14 = 14,
+  kR15 = 15
+};
+
+// Register roles inside a compiled block.
+constexpr Reg kStateReg = kRbx;   // CpuState *
+constexpr Reg kFastmemReg = kR12; // host base of the fastmem window, when enabled
+constexpr Reg kLoadReg = kR13;    // value of the load sitting in the delay slot
+constexpr Reg kBudgetReg = kR14;  // cycles left before linked blocks must return
+constexpr Reg kBranchReg = kR15;  // resolved next PC of the block-ending branch
+
+// Host registers the allocator may give guest GPRs. rbp survives helper
+// calls; r8-r11 are written back and reloaded around them.
+constexpr Reg kHostSlots[] = {kRbp, kR8, kR9, kR10, kR11};
+constexpr size_t kHostSlotCount = sizeof(kHostSlots) / sizeof(kHostSlots[0]);
+
+// Stack frame below the saved registers; 24 bytes keeps calls 16-byte aligned.
+constexpr uint8_t kBudgetSlot = 0; // initial cycle budget
+constexpr uint8_t kMemorySlot = 8; // MemoryMap *
+constexpr int8_t kFrameBytes = 24;
+
+// Fastmem accesses are padded to the length of a jmp rel32 so a faulting site
+// can be backpatched to its slow-path stub in place.
+constexpr size_t kFastmemSiteBytes = 5;
+
+enum Cond : uint8_t {
+  kCondO = 0x0,
+  kCondB = 0x2,
+  kCondE = 0x4,
+  kCondNE = 0x5,
+  kCondS = 0x8,
+  kCondL = 0xC,
+  kCondGE = 0xD,
+  kCondLE = 0xE,
+  kCondG = 0xF
+};
+
+enum AluOp : uint8_t {
+  kAluAdd = 0x01,
+  kAluOr = 0x09,
+  kAluAnd = 0x21,
+  kAluSub = 0x29,
+  kAluXor = 0x31,
+  kAluCmp = 0x39
+};
+
+// Group-1 /digit values for the immediate forms of the ALU ops above.
+enum AluExt : uint8_t {
+  kExtAdd = 0,
+  kExtOr = 1,
+  kExtAnd = 4,
+  kExtSub = 5,
+  kExtXor = 6,
+  kExtCmp = 7
+};
+
+enum ShiftExt : uint8_t {
+  kShl = 4,
+  kShr = 5,
+  kSar = 7
+};
+
+constexpr int32_t gpr_offset(uint32_t index) {
+  return static_cast<int32_t>(offsetof(CpuState, gpr) + index * sizeof(uint32_t));
+}
+
+constexpr int32_t cop0_offset(size_t field) {
+  return static_cast<int32_t>(offsetof(CpuState, cop0) + field);
+}
+
+constexpr int32_t kPcOffset = static_cast<int32_t>(offsetof(CpuState, pc));
+constexpr int32_t kNextPcOffset = static_cast<int32_t>(offsetof(CpuState, next_pc));
+constexpr int32_t kHiOffset = static_cast<int32_t>(offsetof(CpuState, hi));
+constexpr int32_t kLoOffset = static_cast<int32_t>(offsetof(CpuState, lo));
+constexpr int32_t kSrOffset = cop0_offset(offsetof(CpuState::Cop0, sr));
+constexpr int32_t kCauseOffset = cop0_offset(offsetof(CpuState::Cop0, cause));
+constexpr int32_t kEpcOffset = cop0_offset(offsetof(CpuState::Cop0, epc));
+constexpr int32_t kBadVaddrOffset = cop0_offset(offsetof(CpuState::Cop0, badvaddr));
+constexpr int32_t kPridOffset = cop0_offset(offsetof(CpuState::Cop0, prid));
+constexpr int32_t kEbaseOffset = cop0_offset(offsetof(CpuState::Cop0, ebase));
+
+class X64Emitter {
+public:
+  const std::vector<uint8_t> &code() const { return code_; }
+  size_t size() const { return code_.size(); }
+
+  void mov(Reg dst, Reg src) {
+    rex(false, src, dst);
+    byte(0x89);
+    modrm_reg(src, dst);
+  }
+
+  void mov64(Reg dst, Reg src) {
+    rex(true, src, dst);
+    byte(0x89);
+    modrm_reg(src, dst);
+  }
+
+  // Never touches flags, so it is safe between a compare and its cmov/setcc.
+  void mov_imm(Reg dst, uint32_t imm) {
+    rex(false, kRax, dst);
+    byte(static_cast<uint8_t>(0xB8 + (dst & 7)));
+    dword(imm);
+  }
+
+  void mov_imm64(Reg dst, uint64_t imm) {
+    rex(true, kRax, dst);
+    byte(static_cast<uint8_t>(0xB8 + (dst & 7)));
+    qword(imm);
+  }
+
+  void load_state(Reg dst, int32_t disp) {
+    rex(false, dst, kStateReg);
+    byte(0x8B);
+    modrm_state(dst, disp);
+  }
+
+  void store_state(int32_t disp, Reg src) {
+    rex(false, src, kStateReg);
+    byte(0x89);
+    modrm_state(src, disp);
+  }
+
+  void store_state_imm(int32_t disp, uint32_t imm) {
+    byte(0xC7);
+    modrm_state(kRax, disp);
+    dword(imm);
+  }
+
+  void alu(AluOp op, Reg dst, Reg src) {
+    rex(false, src, dst);
+    byte(op);
+    modrm_reg(src, dst);
+  }
+
+  void alu_state(AluOp op, Reg dst, int32_t disp) {
+    rex(false, dst, kStateReg);
+    byte(static_cast<uint8_t>(op + 2));
+    modrm_state(dst, disp);
+  }
+
+  void alu_imm(AluExt ext, Reg dst, uint32_t imm) {
+    int32_t simm = static_cast<int32_t>(imm);
+    rex(false, kRax, dst);
+    if (simm >= -128 && simm <= 127) {
+      byte(0x83);
+      modrm_reg(static_cast<Reg>(ext), dst);
+      byte(static_cast<uint8_t>(simm));
+    } else {
+      byte(0x81);
+      modrm_reg(static_cast<Reg>(ext), dst);
+      dword(imm);
+    }
+  }
+
+  void shift_imm(ShiftExt ext, Reg reg, uint8_t amount) {
+    rex(false, kRax, reg);
+    byte(0xC1);
+    modrm_reg(static_cast<Reg>(ext), reg);
+    byte(amount);
+  }
+
+  void shift_cl(ShiftExt ext, Reg reg) {
+    rex(false, kRax, reg);
+    byte(0xD3);
+    modrm_reg(static_cast<Reg>(ext), reg);
+  }
+
+  void shr64_imm(Reg reg, uint8_t amount) {
+    rex(true, kRax, reg);
+    byte(0xC1);
+    modrm_reg(static_cast<Reg>(kShr), reg);
+    byte(amount);
+  }
+
+  void not_(Reg reg) {
+    rex(false, kRax, reg);
+    byte(0xF7);
+    modrm_reg(static_cast<Reg>(2), reg);
+  }
+
+  void test(Reg a, Reg b) {
+    rex(false, b, a);
+    byte(0x85);
+    modrm_reg(b, a);
+  }
+
+  void test64(Reg a, Reg b) {
+    rex(true, b, a);
+    byte(0x85);
+    modrm_reg(b, a);
+  }
+
+  void test_imm(Reg reg, uint32_t imm) {
+    rex(false, kRax, reg);
+    byte(0xF7);
+    modrm_reg(kRax, reg);
+    dword(imm);
+  }
+
+  // setcc into the low byte of rax/rcx/rdx/rbx, zero-extended to 32 bits.
+  void setcc_zx(Cond cond, Reg reg) {
+    byte(0x0F);
+    byte(static_cast<uint8_t>(0x90 | cond));
+    modrm_reg(kRax, reg);
+    movzx8(reg, reg);
+  }
+
+  void cmov(Cond cond, Reg dst, Reg src) {
+    rex(false, dst, src);
+    byte(0x0F);
+    byte(static_cast<uint8_t>(0x40 | cond));
+    modrm_reg(dst, src);
+  }
+
+  void movzx8(Reg dst, Reg src) { extend(0xB6, dst, src); }
+  void movsx8(Reg dst, Reg src) { extend(0xBE, dst, src); }
+  void movzx16(Reg dst, Reg src) { extend(0xB7, dst, src); }
+  void movsx16(Reg dst, Reg src) { extend(0xBF, dst, src); }
+
+  void movsxd64(Reg dst, Reg src) {
+    rex(true, dst, src);
+    byte(0x63);
+    modrm_reg(dst, src);
+  }
+
+  void imul64(Reg dst, Reg src) {
+    rex(true, dst, src);
+    byte(0x0F);
+    byte(0xAF);
+    modrm_reg(dst, src);
+  }
+
+  void push(Reg reg) {
+    rex(false, kRax, reg);
+    byte(static_cast<uint8_t>(0x50 + (reg & 7)));
+  }
+
+  void pop(Reg reg) {
+    rex(false, kRax, reg);
+    byte(static_cast<uint8_t>(0x58 + (reg & 7)));
+  }
+
+  void adjust_rsp(int8_t delta) {
+    byte(0x48);
+    byte(0x83);
+    byte(delta < 0 ? 0xEC : 0xC4);
+    byte(static_cast<uint8_t>(delta < 0 ? -delta : delta));
+  }
+
+  template <typename Fn>
+  void call(Fn *fn) {
+    mov_imm64(kRax, reinterpret_cast<uint64_t>(fn));
+    byte(0xFF);
+    byte(0xD0);
+  }
+
+  void ret() { byte(0xC3); }
+
+  // Forward branches return the offset of their rel32 field for bind().
+  size_t jcc(Cond cond) {
+    byte(0x0F);
+    byte(static_cast<uint8_t>(0x80 | cond));
+    size_t at = code_.size();
+    dword(0);
+    return at;
+  }
+
+  size_t jcc_not(Cond cond) { return jcc(static_cast<Cond>(cond ^ 1)); }
+
+  size_t jmp() {
+    byte(0xE9);
+    size_t at = code_.size();
+    dword(0);
+    return at;
+  }
+
+  void jmp_reg(Reg reg) {
+    rex(false, kRax, reg);
+    byte(0xFF);
+    modrm_reg(static_cast<Reg>(4), reg);
+  }
+
+  // cmp byte [reg], 0; reg must not be rsp/rbp/r12/r13.
+  void cmp_byte_zero(Reg reg) {
+    rex(false, kRax, reg);
+    byte(0x80);
+    byte(static_cast<uint8_t>(0x38 | (reg & 7)));
+    byte(0x00);
+  }
+
+  void store_stack(uint8_t disp, Reg src, bool wide = false) {
+    rex(wide, src, kRsp);
+    byte(0x89);
+    modrm_stack(src, disp);
+  }
+
+  void load_stack(Reg dst, uint8_t disp, bool wide = false) {
+    rex(wide, dst, kRsp);
+    byte(0x8B);
+    modrm_stack(dst, disp);
+  }
+
+  void jmp_to(size_t target) {
+    byte(0xE9);
+    dword(static_cast<uint32_t>(target - (code_.size() + 4)));
+  }
+
+  // <opcode> reg, [kFastmemReg + rsi]; operand16 selects the 0x66 prefix.
+  void fastmem_access(bool operand16, uint8_t opcode0, int opcode1, Reg reg) {
+    size_t start = code_.size();
+    if (operand16) {
+      byte(0x66);
+    }
+    rex(false, reg, kFastmemReg);
+    byte(opcode0);
+    if (opcode1 >= 0) {
+      byte(static_cast<uint8_t>(opcode1));
+    }
+    byte(static_cast<uint8_t>(0x04 | ((reg & 7) << 3)));
+    byte(static_cast<uint8_t>(((kRsi & 7) << 3) | (kFastmemReg & 7)));
+    while (code_.size() - start < kFastmemSiteBytes) {
+      byte(0x90);
+    }
+  }
+
+  void bind(size_t at) {
+    uint32_t rel = static_cast<uint32_t>(code_.size() - (at + 4));
+    std::memcpy(&code_[at], &rel, sizeof(rel));
+  }
+
+private:
+  void byte(uint8_t value) { code_.push_back(value); }
+
+  void dword(uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      code_.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  }
+
+  void qword(uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+      code_.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  }
+
+  void rex(bool wide, Reg reg, Reg rm) {
+    uint8_t value = static_cast<uint8_t>(0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0));
+    if (value != 0x40) {
+      byte(value);
+    }
+  }
+
+  void modrm_reg(Reg reg, Reg rm) { byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7))); }
+
+  void modrm_state(Reg reg, int32_t disp) {
+    if (disp >= -128 && disp <= 127) {
+      byte(static_cast<uint8_t>(0x40 | ((reg & 7) << 3) | (kStateReg & 7)));
+      byte(static_cast<uint8_t>(disp));
+    } else {
+      byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (kStateReg & 7)));
+      dword(static_cast<uint32_t>(disp));
+    }
+  }
+
+  void modrm_stack(Reg reg, uint8_t disp) {
+    byte(static_cast<uint8_t>(0x44 | ((reg & 7) << 3)));
+    byte(0x24);
+    byte(disp);
+  }
+
+  void extend(uint8_t opcode, Reg dst, Reg src) {
+    rex(false, dst, src);
+    byte(0x0F);
+    byte(opcode);
+    modrm_reg(dst, src);
+  }
+
+  std::vector<uint8_t> code_;
+};
+
+// Memory and arithmetic helpers called from generated code.
+uint32_t jit_read8(MemoryMap *memory, uint32_t addr) {
+  return memory->read8(addr);
+}
+
+uint32_t jit_read16(MemoryMap *memory, uint32_t addr) {
+  return memory->read16(addr);
+}
+
+uint32_t jit_read32(MemoryMap *memory, uint32_t addr) {
+  return memory->read32(addr);
+}
+
+void jit_write8(MemoryMap *memory, uint32_t addr, uint32_t value) {
+  memory->write8(addr, static_cast<uint8_t>(value & 0xFF));
+}
+
+void jit_write16(MemoryMap *memory, uint32_t addr, uint32_t value) {
+  memory->write16(addr, static_cast<uint16_t>(value & 0xFFFF));
+}
+
+void jit_write32(MemoryMap *memory, uint32_t addr, uint32_t value) {
+  memory->write32(addr, value);
+}
+
+uint32_t jit_lwl(MemoryMap *memory, uint32_t addr, uint32_t reg) {
+  uint32_t word = memory->read32(addr & ~3u);
+  switch (addr & 3u) {
+    case 0:
+      return (reg & 0x00FFFFFFu) | (word << 24);
+    case 1:
+      return (reg & 0x0000FFFFu) | (word << 16);
+    case 2:
+      return (reg & 0x000000FFu) | (word << 8);
+    default:
+      return word;
+  }
+}
+
+uint32_t jit_lwr(MemoryMap *memory, uint32_t addr, uint32_t reg) {
+  uint32_t word = memory->read32(addr & ~3u);
+  switch (addr & 3u) {
+    case 0:
+      return word;
+    case 1:
+      return (reg & 0xFF000000u) | (word >> 8);
+    case 2:
+      return (reg & 0xFFFF0000u) | (word >> 16);
+    default:
+      return (reg & 0xFFFFFF00u) | (word >> 24);
+  }
+}
+
+void jit_swl(MemoryMap *memory, uint32_t addr, uint32_t reg) {
+  uint32_t aligned = addr & ~3u;
+  uint32_t word = memory->read32(aligned);
+  switch (addr & 3u) {
+    case 0:
+      word = (word & 0xFFFFFF00u) | (reg >> 24);
+      break;
+    case 1:
+      word = (word & 0xFFFF0000u) | (reg >> 16);
+      break;
+    case 2:
+      word = (word & 0xFF000000u) | (reg >> 8);
+      break;
+    default:
+      word = reg;
+      break;
+  }
+  memory->write32(aligned, word);
+}
+
+void jit_swr(MemoryMap *memory, uint32_t addr, uint32_t reg) {
+  uint32_t aligned = addr & ~3u;
+  uint32_t word = memory->read32(aligned);
+  switch (addr & 3u) {
+    case 0:
+      word = reg;
+      break;
+    case 1:
+      word = (word & 0x000000FFu) | (reg << 8);
+      break;
+    case 2:
+      word = (word & 0x0000FFFFu) | (reg << 16);
+      break;
+    default:
+      word = (word & 0x00FFFFFFu) | (reg << 24);
+      break;
+  }
+  memory->write32(aligned, word);
+}
+
+void jit_div(CpuState *state, uint32_t rs, uint32_t rt) {
+  int32_t a = static_cast<int32_t>(rs);
+  int32_t b = static_cast<int32_t>(rt);
+  if (b == 0) {
+    state->lo = (a >= 0) ? 0xFFFFFFFFu : 1u;
+    state->hi = static_cast<uint32_t>(a);
+  } else if (a == static_cast<int32_t>(0x80000000) && b == -1) {
+    state->lo = static_cast<uint32_t>(a);
+    state->hi = 0;
+  } else {
+    state->lo = static_cast<uint32_t>(a / b);
+    state->hi = static_cast<uint32_t>(a % b);
+  }
+}
+
+void jit_divu(CpuState *state, uint32_t rs, uint32_t rt) {
+  if (rt == 0) {
+    state->lo = 0xFFFFFFFFu;
+    state->hi = rs;
+  } else {
+    state->lo = rs / rt;
+    state->hi = rs % rt;
+  }
+}
+
+AluExt alu_ext(AluOp op) {
+  switch (op) {
+    case kAluAdd: return kExtAdd;
+    case kAluOr: return kExtOr;
+    case kAluAnd: return kExtAnd;
+    case kAluSub: return kExtSub;
+    case kAluXor: return kExtXor;
+    default: return kExtCmp;
+  }
+}
+
+class BlockCompiler {
+public:
+  explicit BlockCompiler(const DynarecRuntime &runtime) : runtime_(runtime) {}
+
+  bool compile(uint32_t pc, const MemoryMap &memory, uint32_t max_instructions, uint32_t &out_size) {
+    fastmem_base_ = memory.fastmem_base();
+    io_flag_ = memory.io_access_flag();
+    if (!build_ir_block(pc, memory, max_instructions, ir_)) {
+      return false;
+    }
+    optimize_ir_block(ir_);
+    allocation_ = allocate_host_registers(ir_, kHostSlotCount);
+
+    // COP0 writes may unmask interrupts or isolate the cache, and COP2 writes
+    // leave the GTE queue busy; either way the dispatcher has to look first.
+    bool linkable = true;
+    for (const IrInst &inst : ir_.insts) {
+      const DecodedOp &d = inst.op;
+      if (inst.kind == OpKind::EndsBlock || (d.op == 0x12 && (d.rs == 0x04 || d.rs == 0x06))) {
+        linkable = false;
+      }
+    }
+
+    emit_prologue();
+    link_entry_ = e_.size();
+    for (size_t i = 0; i < ir_.insts.size(); ++i) {
+      emit_inst(ir_.insts[i], static_cast<uint32_t>(i + 1));
+    }
+
+    uint32_t count = static_cast<uint32_t>(ir_.insts.size());
+    // A load left in the delay slot is handed to the interpreter, so the
+    // next block cannot be entered directly.
+    linkable = linkable && pending_reg_ == 0;
+    flush_pending_to_runtime();
+    write_back_slots(true);
+    if (ir_.ends_with_branch) {
+      e_.store_state(kPcOffset, kBranchReg);
+      e_.mov(kRax, kBranchReg);
+      e_.alu_imm(kExtAdd, kRax, 4);
+      e_.store_state(kNextPcOffset, kRax);
+    } else {
+      uint32_t end_pc = pc + count * 4;
+      e_.store_state_imm(kPcOffset, end_pc);
+      e_.store_state_imm(kNextPcOffset, end_pc + 4);
+    }
+    if (linkable) {
+      emit_link_exits(pc + count * 4, count);
+    } else {
+      e_.mov_imm(kRax, count);
+      exit_jumps_.push_back(e_.jmp());
+    }
+    emit_epilogue();
+    emit_fastmem_stubs();
+
+    out_size = count * 4;
+    return true;
+  }
+
+  const std::vector<uint8_t> &code() const { return e_.code(); }
+
+  // Offsets of each fastmem access and the slow-path stub that replaces it.
+  struct FastmemPatch {
+    size_t site = 0;
+    size_t stub = 0;
+  };
+
+  const std::vector<FastmemPatch> &fastmem_patches() const { return fastmem_patches_; }
+
+  // Patchable rel32 fields of the block's static exits.
+  struct ExitPatch {
+    uint32_t target_pc = 0;
+    size_t site = 0;
+  };
+
+  const std::vector<ExitPatch> &exit_patches() const { return exit_patches_; }
+  size_t link_entry() const { return link_entry_; }
+  size_t unlinked_exit() const { return unlinked_exit_; }
+
+private:
+  // Guest GPR cached in a host slot; guest 0 means the slot is unused.
+  struct HostSlot {
+    uint32_t guest = 0;
+    bool valid = false;
+    bool dirty = false;
+  };
+
+  void emit_prologue() {
+    e_.push(kRbx);
+    e_.push(kRbp);
+    e_.push(kR12);
+    e_.push(kR13);
+    e_.push(kR14);
+    e_.push(kR15);
+    e_.adjust_rsp(static_cast<int8_t>(-kFrameBytes));
+    e_.mov64(kStateReg, kRdi);
+    e_.store_stack(kMemorySlot, kRsi, true);
+    e_.store_stack(kBudgetSlot, kRdx);
+    e_.mov(kBudgetReg, kRdx);
+    if (fastmem_base_) {
+      e_.mov_imm64(kFastmemReg, reinterpret_cast<uint64_t>(fastmem_base_));
+    }
+  }
+
+  // Charges the block's cycles and either continues into a successor or
+  // leaves: out of budget, after an MMIO access, or with no successor cached.
+  void emit_link_exits(uint32_t end_pc, uint32_t count) {
+    e_.alu_imm(kExtSub, kBudgetReg, count);
+    to_unlinked_exit_.push_back(e_.jcc(kCondLE));
+    e_.mov_imm64(kRax, reinterpret_cast<uint64_t>(io_flag_));
+    e_.cmp_byte_zero(kRax);
+    to_unlinked_exit_.push_back(e_.jcc(kCondNE));
+    if (!ir_.ends_with_branch) {
+      emit_exit_jump(end_pc);
+      return;
+    }
+    const DecodedOp &branch = ir_.insts[ir_.insts.size() - 2].op;
+    if (branch.op == 0x00) { // JR/JALR: look the target up without leaving
+      if (!runtime_.lookup_link) {
+        to_unlinked_exit_.push_back(e_.jmp());
+        return;
+      }
+      e_.mov_imm64(kRdi, reinterpret_cast<uint64_t>(runtime_.context));
+      e_.mov(kRsi, kBranchReg);
+      e_.call(runtime_.lookup_link);
+      e_.test64(kRax, kRax);
+      to_unlinked_exit_.push_back(e_.jcc(kCondE));
+      e_.jmp_reg(kRax);
+      return;
+    }
+    if (branch.op == 0x02 || branch.op == 0x03) {
+      emit_exit_jump(((branch.pc + 4) & 0xF0000000u) | ((branch.word & 0x03FFFFFFu) << 2));
+      return;
+    }
+    uint32_t taken = branch.pc + 4 + (branch.imm_se << 2);
+    e_.alu_imm(kExtCmp, kBranchReg, taken);
+    size_t not_taken = e_.jcc(kCondNE);
+    emit_exit_jump(taken);
+    e_.bind(not_taken);
+    emit_exit_jump(branch.pc + 8);
+  }
+
+  void emit_exit_jump(uint32_t target_pc) {
+    size_t site = e_.jmp();
+    exit_patches_.push_back({target_pc, site});
+  }
+
+  void emit_epilogue() {
+    // Exits that already charged their cycles to the budget land here.
+    unlinked_exit_ = e_.size();
+    for (size_t at : to_unlinked_exit_) {
+      e_.bind(at);
+    }
+    for (const ExitPatch &patch : exit_patches_) {
+      e_.bind(patch.site);
+    }
+    e_.alu(kAluXor, kRax, kRax);
+    // Everything else arrives with this block's cycles so far in eax.
+    for (size_t at : exit_jumps_) {
+      e_.bind(at);
+    }
+    e_.alu(kAluSub, kBudgetReg, kRax);
+    e_.load_stack(kRax, kBudgetSlot);
+    e_.alu(kAluSub, kRax, kBudgetReg);
+    e_.adjust_rsp(kFrameBytes);
+    e_.pop(kR15);
+    e_.pop(kR14);
+    e_.pop(kR13);
+    e_.pop(kR12);
+    e_.pop(kRbp);
+    e_.pop(kRbx);
+    e_.ret();
+  }
+
+  void load_memory_arg() { e_.load_stack(kRdi, kMemorySlot, true); }
+
+  // Slow paths for fastmem sites: the same helper call the non-fastmem path
+  // makes inline, entered only after the site has faulted and been patched.
+  // The site's block still expects its caller-saved slots intact.
+  void emit_fastmem_stubs() {
+    for (const FastmemSite &site : fastmem_sites_) {
+      size_t stub = e_.size();
+      load_memory_arg();
+      for (size_t slot = 1; slot < kHostSlotCount; ++slot) {
+        e_.push(kHostSlots[slot]);
+      }
+      switch (site.op) {
+        case 0x20:
+          e_.call(&jit_read8);
+          e_.movsx8(kRax, kRax);
+          break;
+        case 0x24:
+          e_.call(&jit_read8);
+          break;
+        case 0x21:
+          e_.call(&jit_read16);
+          e_.movsx16(kRax, kRax);
+          break;
+        case 0x25:
+          e_.call(&jit_read16);
+          break;
+        case 0x23:
+          e_.call(&jit_read32);
+          break;
+        case 0x28:
+          e_.call(&jit_write8);
+          break;
+        case 0x29:
+          e_.call(&jit_write16);
+          break;
+        default:
+          e_.call(&jit_write32);
+          break;
+      }
+      for (size_t slot = kHostSlotCount; slot-- > 1;) {
+        e_.pop(kHostSlots[slot]);
+      }
+      e_.jmp_to(site.site + kFastmemSiteBytes);
+      fastmem_patches_.push_back({site.site, stub});
+    }
+  }
+
+  // Emits the direct host access for a load/store whose address is in esi
+  // (and value in edx for stores); returns false for ops without a fast form.
+  bool emit_fastmem_access(uint8_t op) {
+    if (!fastmem_base_) {
+      return false;
+    }
+    size_t site = e_.size();
+    switch (op) {
+      case 0x20:
+        e_.fastmem_access(false, 0x0F, 0xBE, kRax); // movsx eax, byte
+        break;
+      case 0x24:
+        e_.fastmem_access(false, 0x0F, 0xB6, kRax); // movzx eax, byte
+        break;
+      case 0x21:
+        e_.fastmem_access(false, 0x0F, 0xBF, kRax); // movsx eax, word
+        break;
+      case 0x25:
+        e_.fastmem_access(false, 0x0F, 0xB7, kRax); // movzx eax, word
+        break;
+      case 0x23:
+        e_.fastmem_access(false, 0x8B, -1, kRax);
+        break;
+      case 0x28:
+        e_.fastmem_access(false, 0x88, -1, kRdx);
+        break;
+      case 0x29:
+        e_.fastmem_access(true, 0x89, -1, kRdx);
+        break;
+      case 0x2B:
+        e_.fastmem_access(false, 0x89, -1, kRdx);
+        break;
+      default:
+        return false;
+    }
+    fastmem_sites_.push_back({site, op});
+    return true;
+  }
+
+  // Value of a GPR operand of the current instruction, if known at compile time.
+  bool operand_constant(uint32_t index, uint32_t &imm) const {
+    for (uint32_t value : {inst_->rs_value, inst_->rt_value}) {
+      if (value != kIrNone && ir_.values[value].reg == index && ir_.values[value].constant) {
+        imm = ir_.values[value].imm;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Host register allocated to a GPR, taking the slot over from whichever
+  // GPR held it before.
+  Reg claim_slot(uint32_t index, bool need_value) {
+    size_t index_slot = static_cast<size_t>(allocation_[index]);
+    HostSlot &slot = slots_[index_slot];
+    Reg reg = kHostSlots[index_slot];
+    if (slot.guest != index) {
+      if (slot.dirty) {
+        e_.store_state(gpr_offset(slot.guest), reg);
+      }
+      slot = HostSlot{};
+      slot.guest = index;
+    }
+    if (need_value && !slot.valid) {
+      e_.load_state(reg, gpr_offset(index));
+      slot.valid = true;
+    }
+    return reg;
+  }
+
+  void load_gpr(Reg dst, uint32_t index) {
+    uint32_t imm = 0;
+    if (index == 0) {
+      e_.alu(kAluXor, dst, dst);
+    } else if (operand_constant(index, imm)) {
+      e_.mov_imm(dst, imm);
+    } else if (allocation_[index] >= 0) {
+      Reg reg = claim_slot(index, true);
+      if (reg != dst) {
+        e_.mov(dst, reg);
+      }
+    } else {
+      e_.load_state(dst, gpr_offset(index));
+    }
+  }
+
+  void store_gpr(uint32_t index, Reg src) {
+    if (index == 0) {
+      return;
+    }
+    if (allocation_[index] < 0) {
+      e_.store_state(gpr_offset(index), src);
+      return;
+    }
+    Reg reg = claim_slot(index, false);
+    if (reg != src) {
+      e_.mov(reg, src);
+    }
+    slots_[allocation_[index]].valid = true;
+    slots_[allocation_[index]].dirty = true;
+  }
+
+  void store_gpr_imm(uint32_t index, uint32_t imm) {
+    if (index == 0) {
+      return;
+    }
+    if (allocation_[index] < 0) {
+      e_.store_state_imm(gpr_offset(index), imm);
+      return;
+    }
+    e_.mov_imm(claim_slot(index, false), imm);
+    slots_[allocation_[index]].valid = true;
+    slots_[allocation_[index]].dirty = true;
+  }
+
+  // Register to compute a result in: the destination's host slot when it has
+  // one and writing it early cannot clobber the second operand, else eax.
+  Reg result_reg(uint32_t dest, uint32_t first, uint32_t second) {
+    if (dest == 0 || allocation_[dest] < 0 || (second == dest && first != dest)) {
+      return kRax;
+    }
+    uint32_t imm = 0;
+    return claim_slot(dest, first == dest && !operand_constant(first, imm));
+  }
+
+  // dst = dst <op> GPR, from an immediate, host slot or CpuState.
+  void alu_gpr(AluOp op, Reg dst, uint32_t index) {
+    uint32_t imm = 0;
+    if (operand_constant(index, imm)) {
+      e_.alu_imm(alu_ext(op), dst, imm);
+    } else if (allocation_[index] >= 0) {
+      e_.alu(op, dst, claim_slot(index, true));
+    } else {
+      e_.alu_state(op, dst, gpr_offset(index));
+    }
+  }
+
+  // Stores dirty slots to CpuState; side exits keep the compile-time state.
+  void write_back_slots(bool clean) {
+    for (size_t index = 0; index < kHostSlotCount; ++index) {
+      HostSlot &slot = slots_[index];
+      if (slot.dirty) {
+        e_.store_state(gpr_offset(slot.guest), kHostSlots[index]);
+        slot.dirty = !clean;
+      }
+    }
+  }
+
+  // Helper call on the main path: caller-saved slots are written back first
+  // and reloaded on their next use.
+  template <typename Fn>
+  void emit_call(Fn *fn) {
+    for (size_t index = 1; index < kHostSlotCount; ++index) {
+      HostSlot &slot = slots_[index];
+      if (slot.dirty) {
+        e_.store_state(gpr_offset(slot.guest), kHostSlots[index]);
+      }
+      slot.valid = false;
+      slot.dirty = false;
+    }
+    e_.call(fn);
+  }
+
+  void emit_commit_pending() {
+    if (pending_reg_ != 0) {
+      store_gpr(pending_reg_, kLoadReg);
+    }
+  }
+
+  // Retires the previous instruction's load unless this one overwrote the register.
+  void retire_pending(uint32_t dest) {
+    if (pending_reg_ != 0 && pending_reg_ != dest) {
+      emit_commit_pending();
+    }
+    pending_reg_ = 0;
+  }
+
+  // Retires the previous load, then places this one's value (in eax) where
+  // the IR resolved its delay slot to.
+  void begin_load(const IrInst &inst) {
+    if (pending_reg_ != 0) {
+      emit_commit_pending();
+    }
+    pending_reg_ = 0;
+    switch (inst.commit) {
+      case IrCommit::Immediate:
+        store_gpr(inst.op.rt, kRax);
+        break;
+      case IrCommit::AfterNext:
+      case IrCommit::AtExit:
+        e_.mov(kLoadReg, kRax);
+        pending_reg_ = inst.op.rt;
+        break;
+      default:
+        break;
+    }
+  }
+
+  void flush_pending_to_runtime() {
+    if (pending_reg_ == 0) {
+      return;
+    }
+    e_.mov_imm64(kRdi, reinterpret_cast<uint64_t>(runtime_.context));
+    e_.mov_imm(kRsi, pending_reg_);
+    e_.mov(kRdx, kLoadReg);
+    emit_call(runtime_.set_load_delay);
+    pending_reg_ = 0;
+  }
+
+  // Emits an out-of-line-style exception exit guarded by the caller's jump.
+  void emit_exception(uint32_t excode, const DecodedOp &d, uint32_t cycles, bool has_badaddr) {
+    if (has_badaddr) {
+      e_.mov(kRdx, kRax);
+    } else {
+      e_.mov_imm(kRdx, 0);
+    }
+    write_back_slots(false);
+    if (pending_reg_ != 0) {
+      e_.store_state(gpr_offset(pending_reg_), kLoadReg);
+    }
+    e_.mov_imm(kRsi, excode);
+    e_.mov_imm(kRcx, d.pc);
+    e_.mov_imm(kR8, d.in_delay ? 1u : 0u);
+    e_.mov_imm64(kRdi, reinterpret_cast<uint64_t>(runtime_.context));
+    e_.call(runtime_.raise_exception);
+    e_.mov_imm(kRax, cycles);
+    exit_jumps_.push_back(e_.jmp());
+  }
+
+  void emit_alignment_check(uint32_t mask, uint32_t excode, const DecodedOp &d, uint32_t cycles) {
+    if (!inst_->may_except) {
+      return;
+    }
+    e_.test_imm(kRax, mask);
+    size_t ok = e_.jcc(kCondE);
+    emit_exception(excode, d, cycles, true);
+    e_.bind(ok);
+  }
+
+  void emit_overflow_check(const DecodedOp &d, uint32_t cycles) {
+    size_t ok = e_.jcc_not(kCondO);
+    emit_exception(12, d, cycles, false);
+    e_.bind(ok);
+  }
+
+  void emit_address(const DecodedOp &d) {
+    uint32_t base = 0;
+    if (operand_constant(d.rs, base)) {
+      e_.mov_imm(kRax, base + d.imm_se);
+      return;
+    }
+    load_gpr(kRax, d.rs);
+    if (d.imm_se != 0) {
+      e_.alu_imm(kExtAdd, kRax, d.imm_se);
+    }
+  }
+
+  void emit_set_branch(Cond cond, uint32_t target, uint32_t fallthrough) {
+    e_.mov_imm(kBranchReg, fallthrough);
+    e_.mov_imm(kRcx, target);
+    e_.cmov(cond, kBranchReg, kRcx);
+  }
+
+  // Conditional branches whose operands are all known resolve here.
+  bool branch_known(const DecodedOp &d, bool &taken) const {
+    uint32_t a = 0;
+    uint32_t b = 0;
+    if (!operand_constant(d.rs, a)) {
+      return false;
+    }
+    int32_t sa = static_cast<int32_t>(a);
+    switch (d.op) {
+      case 0x01:
+        taken = (d.rt & 1) ? sa >= 0 : sa < 0;
+        return true;
+      case 0x04:
+      case 0x05:
+        if (!operand_constant(d.rt, b)) {
+          return false;
+        }
+        taken = (a == b) == (d.op == 0x04);
+        return true;
+      case 0x06:
+        taken = sa <= 0;
+        return true;
+      case 0x07:
+        taken = sa > 0;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Dead pure instructions emit nothing and constant ones a single move; the
+  // load delay slot bookkeeping runs for every instruction.
+  void emit_inst(const IrInst &inst, uint32_t cycles) {
+    inst_ = &inst;
+    const DecodedOp &d = inst.op;
+    if (!ir_is_pure(inst)) {
+      emit_op(d, cycles);
+    } else if (inst.result != kIrNone && ir_.values[inst.result].live) {
+      const IrValue &value = ir_.values[inst.result];
+      if (value.constant) {
+        store_gpr_imm(value.reg, value.imm);
+      } else {
+        emit_op(d, cycles);
+      }
+    }
+    if (inst.delayed) {
+      begin_load(inst);
+    } else {
+      retire_pending(direct_dest(d));
+    }
+  }
+
+  void emit_op(const DecodedOp &d, uint32_t cycles) {
+    bool taken = false;
+    switch (d.op) {
+      case 0x00:
+        emit_special(d, cycles);
+        return;
+      case 0x01: {
+        uint32_t target = d.pc + 4 + (d.imm_se << 2);
+        if (branch_known(d, taken)) {
+          e_.mov_imm(kBranchReg, taken ? target : d.pc + 8);
+        } else {
+          load_gpr(kRax, d.rs);
+          e_.mov_imm(kBranchReg, d.pc + 8);
+          e_.mov_imm(kRcx, target);
+          e_.test(kRax, kRax);
+          e_.cmov((d.rt & 1) ? kCondGE : kCondL, kBranchReg, kRcx);
+        }
+        if (d.rt & 0x10) {
+          store_gpr_imm(31, d.pc + 8);
+        }
+        return;
+      }
+      case 0x02:
+      case 0x03: {
+        uint32_t target = (d.pc & 0xF0000000u) | ((d.word & 0x03FFFFFFu) << 2);
+        e_.mov_imm(kBranchReg, target);
+        if (d.op == 0x03) {
+          store_gpr_imm(31, d.pc + 8);
+        }
+        return;
+      }
+      case 0x04:
+      case 0x05: {
+        uint32_t target = d.pc + 4 + (d.imm_se << 2);
+        if (branch_known(d, taken)) {
+          e_.mov_imm(kBranchReg, taken ? target : d.pc + 8);
+          return;
+        }
+        load_gpr(kRax, d.rs);
+        load_gpr(kRdx, d.rt);
+        e_.alu(kAluCmp, kRax, kRdx);
+        emit_set_branch(d.op == 0x04 ? kCondE : kCondNE, target, d.pc + 8);
+        return;
+      }
+      case 0x06:
+      case 0x07: {
+        uint32_t target = d.pc + 4 + (d.imm_se << 2);
+        if (branch_known(d, taken)) {
+          e_.mov_imm(kBranchReg, taken ? target : d.pc + 8);
+          return;
+        }
+        load_gpr(kRax, d.rs);
+        e_.test(kRax, kRax);
+        emit_set_branch(d.op == 0x06 ? kCondLE : kCondG, target, d.pc + 8);
+        return;
+      }
+      case 0x08: // ADDI
+        load_gpr(kRax, d.rs);
+        e_.alu_imm(kExtAdd, kRax, d.imm_se);
+        emit_overflow_check(d, cycles);
+        store_gpr(d.rt, kRax);
+        return;
+      case 0x09: // ADDIU
+        if (d.rt != 0) {
+          Reg work = result_reg(d.rt, d.rs, 0);
+          load_gpr(work, d.rs);
+          if (d.imm_se != 0) {
+            e_.alu_imm(kExtAdd, work, d.imm_se);
+          }
+          store_gpr(d.rt, work);
+        }
+        return;
+      case 0x0A: // SLTI
+      case 0x0B: // SLTIU
+        if (d.rt != 0) {
+          load_gpr(kRax, d.rs);
+          e_.alu_imm(kExtCmp, kRax, d.imm_se);
+          e_.setcc_zx(d.op == 0x0A ? kCondL : kCondB, kRax);
+          store_gpr(d.rt, kRax);
+        }
+        return;
+      case 0x0C: // ANDI
+      case 0x0D: // ORI
+      case 0x0E: // XORI
+        if (d.rt != 0) {
+          Reg work = result_reg(d.rt, d.rs, 0);
+          load_gpr(work, d.rs);
+          AluExt ext = d.op == 0x0C ? kExtAnd : (d.op == 0x0D ? kExtOr : kExtXor);
+          e_.alu_imm(ext, work, d.imm);
+          store_gpr(d.rt, work);
+        }
+        return;
+      case 0x0F: // LUI
+        store_gpr_imm(d.rt, d.imm << 16);
+        return;
+      case 0x10:
+        emit_cop0(d);
+        return;
+      case 0x12:
+        emit_cop2(d);
+        return;
+      case 0x20: // LB
+      case 0x21: // LH
+      case 0x23: // LW
+      case 0x24: // LBU
+      case 0x25: // LHU
+        emit_load(d, cycles);
+        return;
+      case 0x22: // LWL
+      case 0x26: // LWR
+        emit_address(d);
+        e_.mov(kRsi, kRax);
+        load_gpr(kRdx, d.rt);
+        load_memory_arg();
+        if (d.op == 0x22) {
+          emit_call(&jit_lwl);
+        } else {
+          emit_call(&jit_lwr);
+        }
+        return;
+      case 0x28: // SB
+      case 0x29: // SH
+      case 0x2B: // SW
+      case 0x2A: // SWL
+      case 0x2E: // SWR
+        emit_store(d, cycles);
+        return;
+      default:
+        return;
+    }
+  }
+
+  void emit_special(const DecodedOp &d, uint32_t cycles) {
+    uint32_t dest = direct_dest(d);
+    switch (d.funct) {
+      case 0x00: // SLL
+      case 0x02: // SRL
+      case 0x03: // SRA
+        if (d.rd != 0) {
+          Reg work = result_reg(d.rd, d.rt, 0);
+          load_gpr(work, d.rt);
+          if (d.sh != 0) {
+            ShiftExt ext = d.funct == 0x00 ? kShl : (d.funct == 0x02 ? kShr : kSar);
+            e_.shift_imm(ext, work, static_cast<uint8_t>(d.sh));
+          }
+          store_gpr(d.rd, work);
+        }
+        break;
+      case 0x04: // SLLV
+      case 0x06: // SRLV
+      case 0x07: // SRAV
+        if (d.rd != 0) {
+          load_gpr(kRax, d.rt);
+          load_gpr(kRcx, d.rs);
+          ShiftExt ext = d.funct == 0x04 ? kShl : (d.funct == 0x06 ? kShr : kSar);
+          e_.shift_cl(ext, kRax);
+          store_gpr(d.rd, kRax);
+        }
+        break;
+      case 0x08: // JR
+        load_gpr(kBranchReg, d.rs);
+        break;
+      case 0x09: // JALR
+        load_gpr(kBranchReg, d.rs);
+        store_gpr_imm(dest, d.pc + 8);
+        break;
+      case 0x10: // MFHI
+      case 0x12: // MFLO
+        if (d.rd != 0) {
+          e_.load_state(kRax, d.funct == 0x10 ? kHiOffset : kLoOffset);
+          store_gpr(d.rd, kRax);
+        }
+        break;
+      case 0x11: // MTHI
+      case 0x13: // MTLO
+        load_gpr(kRax, d.rs);
+        e_.store_state(d.funct == 0x11 ? kHiOffset : kLoOffset, kRax);
+        break;
+      case 0x18: // MULT
+      case 0x19: // MULTU
+        load_gpr(kRax, d.rs);
+        load_gpr(kRcx, d.rt);
+        if (d.funct == 0x18) {
+          e_.movsxd64(kRax, kRax);
+          e_.movsxd64(kRcx, kRcx);
+        }
+        e_.imul64(kRax, kRcx);
+        e_.store_state(kLoOffset, kRax);
+        e_.shr64_imm(kRax, 32);
+        e_.store_state(kHiOffset, kRax);
+        break;
+      case 0x1A: // DIV
+      case 0x1B: // DIVU
+        load_gpr(kRsi, d.rs);
+        load_gpr(kRdx, d.rt);
+        e_.mov64(kRdi, kStateReg);
+        if (d.funct == 0x1A) {
+          emit_call(&jit_div);
+        } else {
+          emit_call(&jit_divu);
+        }
+        break;
+      case 0x20: // ADD
+      case 0x22: // SUB
+        load_gpr(kRax, d.rs);
+        load_gpr(kRdx, d.rt);
+        e_.alu(d.funct == 0x20 ? kAluAdd : kAluSub, kRax, kRdx);
+        emit_overflow_check(d, cycles);
+        store_gpr(d.rd, kRax);
+        break;
+      case 0x21: // ADDU
+      case 0x23: // SUBU
+      case 0x24: // AND
+      case 0x25: // OR
+      case 0x26: // XOR
+      case 0x27: // NOR
+        if (d.rd != 0) {
+          Reg work = result_reg(d.rd, d.rs, d.rt);
+          load_gpr(work, d.rs);
+          if (d.rt != 0) {
+            AluOp op = kAluOr;
+            switch (d.funct) {
+              case 0x21: op = kAluAdd; break;
+              case 0x23: op = kAluSub; break;
+              case 0x24: op = kAluAnd; break;
+              case 0x26: op = kAluXor; break;
+              default: op = kAluOr; break;
+            }
+            alu_gpr(op, work, d.rt);
+          } else if (d.funct == 0x24) {
+            e_.mov_imm(work, 0);
+          }
+          if (d.funct == 0x27) {
+            e_.not_(work);
+          }
+          store_gpr(d.rd, work);
+        }
+        break;
+      case 0x2A: // SLT
+      case 0x2B: // SLTU
+        if (d.rd != 0) {
+          load_gpr(kRax, d.rs);
+          load_gpr(kRdx, d.rt);
+          e_.alu(kAluCmp, kRax, kRdx);
+          e_.setcc_zx(d.funct == 0x2A ? kCondL : kCondB, kRax);
+          store_gpr(d.rd, kRax);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  void emit_load(const DecodedOp &d, uint32_t cycles) {
+    emit_address(d);
+    if (d.op == 0x21 || d.op == 0x25) {
+      emit_alignment_check(1, 4, d, cycles);
+    } else if (d.op == 0x23) {
+      emit_alignment_check(3, 4, d, cycles);
+    }
+    e_.mov(kRsi, kRax);
+    if (emit_fastmem_access(d.op)) {
+      return;
+    }
+    load_memory_arg();
+    switch (d.op) {
+      case 0x20:
+        emit_call(&jit_read8);
+        e_.movsx8(kRax, kRax);
+        break;
+      case 0x24:
+        emit_call(&jit_read8);
+        break;
+      case 0x21:
+        emit_call(&jit_read16);
+        e_.movsx16(kRax, kRax);
+        break;
+      case 0x25:
+        emit_call(&jit_read16);
+        break;
+      default:
+        emit_call(&jit_read32);
+        break;
+    }
+  }
+
+  void emit_store(const DecodedOp &d, uint32_t cycles) {
+    emit_address(d);
+    if (d.op == 0x29) {
+      emit_alignment_check(1, 5, d, cycles);
+    } else if (d.op == 0x2B) {
+      emit_alignment_check(3, 5, d, cycles);
+    }
+    e_.mov(kRsi, kRax);
+    load_gpr(kRdx, d.rt);
+    if (emit_fastmem_access(d.op)) {
+      return;
+    }
+    load_memory_arg();
+    switch (d.op) {
+      case 0x28:
+        emit_call(&jit_write8);
+        break;
+      case 0x29:
+        emit_call(&jit_write16);
+        break;
+      case 0x2A:
+        emit_call(&jit_swl);
+        break;
+      case 0x2E:
+        emit_call(&jit_swr);
+        break;
+      default:
+        emit_call(&jit_write32);
+        break;
+    }
+  }
+
+  void emit_cop0(const DecodedOp &d) {
+    if (d.word == 0x42000010) { // RFE
+      e_.load_state(kRax, kSrOffset);
+      e_.mov(kRcx, kRax);
+      e_.shift_imm(kShr, kRcx, 2);
+      e_.alu_imm(kExtAnd, kRcx, 0x0F);
+      e_.alu_imm(kExtAnd, kRax, ~0x3Fu);
+      e_.alu(kAluOr, kRax, kRcx);
+      e_.store_state(kSrOffset, kRax);
+      return;
+    }
+    if (d.rs == 0x00 || d.rs == 0x02) { // MFC0/CFC0
+      int32_t field = -1;
+      switch (d.rd) {
+        case 8: field = kBadVaddrOffset; break;
+        case 12: field = kSrOffset; break;
+        case 13: field = kCauseOffset; break;
+        case 14: field = kEpcOffset; break;
+        case 15: field = kPridOffset; break;
+        case 16: field = kEbaseOffset; break;
+        default: break;
+      }
+      if (field >= 0) {
+        e_.load_state(kRax, field);
+      } else {
+        e_.mov_imm(kRax, 0);
+      }
+      return;
+    }
+    // MTC0/CTC0
+    load_gpr(kRax, d.rt);
+    switch (d.rd) {
+      case 8:
+        e_.store_state(kBadVaddrOffset, kRax);
+        break;
+      case 12:
+        e_.store_state(kSrOffset, kRax);
+        break;
+      case 13:
+        e_.store_state(kCauseOffset, kRax);
+        break;
+      case 14:
+        e_.store_state(kEpcOffset, kRax);
+        break;
+      case 16:
+        e_.alu_imm(kExtAnd, kRax, 0xFFFFF000u);
+        e_.store_state(kEbaseOffset, kRax);
+        break;
+      default:
+        break;
+    }
+  }
+
+  void emit_cop2(const DecodedOp &d) {
+    uint32_t reg = (d.rs & 0x02) ? d.rd + 32 : d.rd;
+    e_.mov_imm64(kRdi, reinterpret_cast<uint64_t>(runtime_.context));
+    e_.mov_imm(kRsi, reg);
+    if (d.rs == 0x00 || d.rs == 0x02) { // MFC2/CFC2
+      emit_call(runtime_.cop2_read);
+      return;
+    }
+    load_gpr(kRdx, d.rt); // MTC2/CTC2
+    emit_call(runtime_.cop2_write);
+  }
+
+  struct FastmemSite {
+    size_t site = 0;
+    uint8_t op = 0;
+  };
+
+  const DynarecRuntime &runtime_;
+  X64Emitter e_;
+  IrBlock ir_;
+  IrRegisterAllocation allocation_{};
+  std::array<HostSlot, kHostSlotCount> slots_{};
+  const IrInst *inst_ = nullptr;
+  uint32_t pending_reg_ = 0;
+  std::vector<size_t> exit_jumps_;
+  uint8_t *fastmem_base_ = nullptr;
+  std::vector<FastmemSite> fastmem_sites_;
+  std::vector<FastmemPatch> fastmem_patches_;
+  const uint8_t *io_flag_ = nullptr;
+  size_t link_entry_ = 0;
+  size_t unlinked_exit_ = 0;
+  std::vector<size_t> to_unlinked_exit_;
+  std::vector<ExitPatch> exit_patches_;
+};
+
+} // namespace
+
+X64DynarecBackend::X64DynarecBackend(const DynarecRuntime &runtime, size_t arena_size)
+    : runtime_(runtime), arena_size_(arena_size) {
+  Fastmem::add_fault_resolver(&X64DynarecBackend::resolve_fastmem_fault, this);
+}
+
+X64DynarecBackend::~X64DynarecBackend() {
+  Fastmem::remove_fault_resolver(&X64DynarecBackend::resolve_fastmem_fault, this);
+  if (arena_) {
+    munmap(arena_, arena_size_);
+  }
+}
+
+bool X64DynarecBackend::resolve_fastmem_fault(void *context, void *ucontext) {
+  auto *self = static_cast<X64DynarecBackend *>(context);
+  auto *uc = static_cast<ucontext_t *>(ucontext);
+  uintptr_t rip = static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RIP]);
+  if (!self->arena_ || rip < reinterpret_cast<uintptr_t>(self->arena_) ||
+      rip >= reinterpret_cast<uintptr_t>(self->arena_) + self->arena_used_) {
+    return false;
+  }
+  auto it = self->fastmem_stubs_.find(rip);
+  if (it == self->fastmem_stubs_.end()) {
+    return false;
+  }
+  // Backpatch the site so later executions go straight to the slow path.
+  uint8_t *site = reinterpret_cast<uint8_t *>(rip);
+  uint32_t rel = static_cast<uint32_t>(it->second - (rip + kFastmemSiteBytes));
+  site[0] = 0xE9;
+  std::memcpy(site + 1, &rel, sizeof(rel));
+  uc->uc_mcontext.gregs[REG_RIP] = static_cast<greg_t>(it->second);
+  // The entry stays until the arena is flushed: erasing would free a node,
+  // and the allocator is off limits inside a signal handler. The site now
+  // starts with a jmp, so it cannot fault here again.
+  ++self->fastmem_backpatches_;
+  return true;
+}
+
+bool X64DynarecBackend::host_supported() {
+  return true;
+}
+
+bool X64DynarecBackend::ensure_arena() {
+  if (arena_) {
+    return true;
+  }
+  void *mem = mmap(nullptr, arena_size_, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    return false;
+  }
+  arena_ = static_cast<uint8_t *>(mem);
+  arena_used_ = 0;
+  return true;
+}
+
+bool X64DynarecBackend::compile_block(uint32_t pc, const MemoryMap &memory, uint32_t max_instructions, JitBlock &out) {
+  if (!runtime_.context || !ensure_arena()) {
+    return false;
+  }
+  BlockCompiler compiler(runtime_);
+  uint32_t size = 0;
+  if (!compiler.compile(pc, memory, max_instructions, size)) {
+    return false;
+  }
+  const std::vector<uint8_t> &code = compiler.code();
+  size_t start = (arena_used_ + 15) & ~static_cast<size_t>(15);
+  if (start + code.size() > arena_size_) {
+    return false;
+  }
+  uint8_t *base = arena_ + start;
+  std::memcpy(base, code.data(), code.size());
+  arena_used_ = start + code.size();
+  for (const BlockCompiler::FastmemPatch &patch : compiler.fastmem_patches()) {
+    fastmem_stubs_[reinterpret_cast<uintptr_t>(base + patch.site)] = reinterpret_cast<uintptr_t>(base + patch.stub);
+  }
+  out.size = size;
+  out.entry = reinterpret_cast<JitFunc>(base);
+  out.link_entry = base + compiler.link_entry();
+  out.exits.clear();
+  for (const BlockCompiler::ExitPatch &patch : compiler.exit_patches()) {
+    JitExit exit;
+    exit.target_pc = patch.target_pc;
+    exit.site = base + patch.site;
+    exit.unlinked = base + compiler.unlinked_exit();
+    out.exits.push_back(exit);
+  }
+  return true;
+}
+
+// Exit sites are the rel32 field of a jmp; linking retargets it.
+void X64DynarecBackend::link_exit(JitExit &exit, const void *target) {
+  uint8_t *site = static_cast<uint8_t *>(exit.site);
+  uint32_t rel = static_cast<uint32_t>(static_cast<const uint8_t *>(target) - (site + 4));
+  std::memcpy(site, &rel, sizeof(rel));
+}
+
+void X64DynarecBackend::unlink_exit(JitExit &exit) {
+  link_exit(exit, exit.unlinked);
+}
+
+bool X64DynarecBackend::code_space_low() const {
+  return arena_ && arena_used_ + kMaxBlockBytes > arena_size_;
+}
+
+void X64DynarecBackend::reset_code_space() {
+  arena_used_ = 0;
+  fastmem_stubs_.clear();
+}
+
+#else
+
+X64DynarecBackend::X64DynarecBackend(const DynarecRuntime &runtime, size_t arena_size)
+    : runtime_(runtime), arena_size_(arena_size) {}
+
+X64DynarecBackend::~X64DynarecBackend() = default;
+
+bool X64DynarecBackend::resolve_fastmem_fault(void *context, void *ucontext) {
+  (void)context;
+  (void)ucontext;
+  return false;
+}
+
+bool X64DynarecBackend::host_supported() {
+  return false;
+}
+
+bool X64DynarecBackend::ensure_arena() {
+  return false;
+}
+
+bool X64DynarecBackend::compile_block(uint32_t pc, const MemoryMap &memory, uint32_t max_instructions, JitBlock &out) {
+  (void)pc;
+  (void)memory;
+  (void)max_instructions;
+  (void)out;
+  return false;
+}
+
+void X64DynarecBackend::link_exit(JitExit &exit, const void *target) {
+  (void)exit;
+  (void)target;
+}
+
+void X64DynarecBackend::unlink_exit(JitExit &exit) {
+  (void)exit;
+}
+
+bool X64DynarecBackend::code_space_low() const {
+  return false;
+}
+
+void X64DynarecBackend::reset_code_space() {}
+
+#endif
+
+} // namespace ps1emu
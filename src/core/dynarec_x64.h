@@ -0,0 +1,50 @@
+#ifndef PS1EMU_DYNAREC_X64_H
+#define PS1EMU_DYNAREC_X64_H
+
+#include "core/dynarec.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define PS1EMU_DYNAREC_X64 1
+#endif
+
+namespace ps1emu {
+
+class X64DynarecBackend final : public DynarecBackend {
+public:
+  explicit X64DynarecBackend(const DynarecRuntime &runtime, size_t arena_size = 16 * 1024 * 1024);
+  ~X64DynarecBackend() override;
+
+  X64DynarecBackend(const X64DynarecBackend &) = delete;
+  X64DynarecBackend &operator=(const X64DynarecBackend &) = delete;
+
+  static bool host_supported();
+
+  bool compile_block(uint32_t pc, const MemoryMap &memory, uint32_t max_instructions, JitBlock &out) override;
+  void link_exit(JitExit &exit, const void *target) override;
+  void unlink_exit(JitExit &exit) override;
+  bool code_space_low() const override;
+  void reset_code_space() override;
+
+  // Number of fastmem sites rewritten to their slow path after faulting.
+  uint64_t fastmem_backpatches() const { return fastmem_backpatches_; }
+
+private:
+  bool ensure_arena();
+  static bool resolve_fastmem_fault(void *context, void *ucontext);
+
+  DynarecRuntime runtime_;
+  uint8_t *arena_ = nullptr;
+  size_t arena_size_ = 0;
+  size_t arena_used_ = 0;
+  // Fastmem access site -> slow-path stub, both absolute arena addresses.
+  std::unordered_map<uintptr_t, uintptr_t> fastmem_stubs_;
+  uint64_t fastmem_backpatches_ = 0;
+};
+
+} // namespace ps1emu
+
+#endif
@@ -1,16 +1,24 @@
 #include "core/emu_core.h"
 
+#include "core/app_paths.h"
 #include "core/gpu_packets.h"
 #include "core/xa_adpcm.h"
 
 #include <algorithm>
+#include <filesystem>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 
 namespace ps1emu {
 
-EmulatorCore::EmulatorCore() : cpu_(memory_, scheduler_) {}
+// Batched GP0 traffic is flushed once it reaches this size or age.
+static constexpr size_t kGpuBatchMaxBytes = 64 * 1024;
+static constexpr uint64_t kGpuBatchMaxCycles = 16384;
+
+EmulatorCore::EmulatorCore() : cpu_(memory_, scheduler_) {
+  mmio_.attach_clock(scheduler_);
+}
 
 static int16_t clamp_sample(int32_t value) {
   if (value > 32767) {
@@ -46,16 +54,68 @@ static std::vector<int16_t> resample_linear(const std::vector<int16_t> &in, uint
   return out;
 }
 
+static std::unique_ptr<PluginLibrary> load_plugin_library(const std::string &path,
+                                                          ps1emu_plugin_type_t type,
+                                                          const char *label) {
+  auto library = std::make_unique<PluginLibrary>();
+  std::string error;
+  if (!library->load(path, type, error)) {
+    std::cerr << "Failed to load " << label << " plugin library " << path << ": " << error << "\n";
+    return nullptr;
+  }
+  return library;
+}
+
 bool EmulatorCore::initialize(const std::string &config_path) {
   if (!load_and_apply_config(config_path)) {
     return false;
   }
 
-  if (!plugin_host_.launch_plugin(PluginType::Gpu, config_.plugin_gpu, config_.sandbox)) {
-    std::cerr << "Failed to launch GPU plugin\n";
-    return false;
+  // Library-mode plugins are trusted .so files called directly; the rest are
+  // sandboxed processes behind the line/frame protocol.
+  bool gpu_in_process = config_.plugin_gpu_mode == PluginMode::Library;
+  bool spu_in_process = config_.plugin_spu_mode == PluginMode::Library;
+  gpu_library_.reset();
+  spu_library_.reset();
+  if (gpu_in_process) {
+    gpu_library_ = load_plugin_library(config_.plugin_gpu, PS1EMU_PLUGIN_GPU, "GPU");
+    if (!gpu_library_) {
+      return false;
+    }
+  }
+  if (spu_in_process) {
+    spu_library_ = load_plugin_library(config_.plugin_spu, PS1EMU_PLUGIN_SPU, "SPU");
+    if (!spu_library_) {
+      return false;
+    }
+  }
+
+  plugin_host_.set_shm_ring(config_.ipc_shm_ring);
+  gpu_vram_.reset();
+  gpu_vram_generation_ = 0;
+  gpu_vram_fenced_ = 0;
+  // Like the ring, strict seccomp leaves the plugin unable to map the VRAM.
+  if (!gpu_in_process && config_.gpu_shared_vram &&
+      !(config_.sandbox.enabled && config_.sandbox.seccomp_strict)) {
+    gpu_vram_ = std::make_unique<VramMirror>();
+    std::string error;
+    if (!gpu_vram_->create(error)) {
+      std::cerr << "Shared VRAM unavailable: " << error << "\n";
+      gpu_vram_.reset();
+    }
+  }
+  if (!gpu_in_process) {
+    bool gpu_launched = plugin_host_.launch_plugin(
+        PluginType::Gpu, config_.plugin_gpu, config_.sandbox, gpu_vram_ ? gpu_vram_->fd() : -1);
+    if (gpu_vram_) {
+      gpu_vram_->close_fd();
+    }
+    if (!gpu_launched) {
+      std::cerr << "Failed to launch GPU plugin\n";
+      return false;
+    }
   }
-  if (!plugin_host_.launch_plugin(PluginType::Spu, config_.plugin_spu, config_.sandbox)) {
+  if (!spu_in_process && !plugin_host_.launch_plugin(PluginType::Spu, config_.plugin_spu, config_.sandbox)) {
     std::cerr << "Failed to launch SPU plugin\n";
     return false;
   }
@@ -68,11 +128,11 @@ bool EmulatorCore::initialize(const std::string &config_path) {
     return false;
   }
 
-  if (!plugin_host_.handshake(PluginType::Gpu)) {
+  if (!gpu_in_process && !plugin_host_.handshake(PluginType::Gpu)) {
     std::cerr << "GPU plugin handshake failed\n";
     return false;
   }
-  if (!plugin_host_.handshake(PluginType::Spu)) {
+  if (!spu_in_process && !plugin_host_.handshake(PluginType::Spu)) {
     std::cerr << "SPU plugin handshake failed\n";
     return false;
   }
@@ -85,15 +145,18 @@ bool EmulatorCore::initialize(const std::string &config_path) {
     return false;
   }
 
-  if (!plugin_host_.enter_frame_mode(PluginType::Gpu)) {
-    std::cerr << "GPU plugin failed to enter frame mode\n";
+  gpu_batching_ = false;
+  gpu_batch_.clear();
+  gpu_present_on_vblank_ = false;
+  if (!gpu_in_process && !negotiate_gpu_plugin()) {
     return false;
   }
-  if (!plugin_host_.enter_frame_mode(PluginType::Spu)) {
+  if (!spu_in_process && !plugin_host_.enter_frame_mode(PluginType::Spu)) {
     std::cerr << "SPU plugin failed to enter frame mode (XA audio disabled)\n";
   }
 
   total_cycles_ = 0;
+  idle_skipped_cycles_ = 0;
   next_trace_cycle_ = 0;
   next_trace_pc_cycle_ = 0;
   watchdog_cycle_accum_ = 0;
@@ -104,23 +167,74 @@ bool EmulatorCore::initialize(const std::string &config_path) {
   return true;
 }
 
+// Optional GPU protocol features, offered after the handshake and before
+// FRAME_MODE. Plugins that answer anything else keep the base protocol.
+bool EmulatorCore::negotiate_gpu_plugin() {
+  if (config_.gpu_async_submit &&
+      !plugin_host_.offer_feature(PluginType::Gpu, "GPU_BATCH", "GPU_BATCH_READY", gpu_batching_)) {
+    std::cerr << "GPU plugin batch negotiation failed\n";
+    return false;
+  }
+  if (!plugin_host_.offer_feature(
+          PluginType::Gpu, "GPU_PRESENT", "GPU_PRESENT_READY", gpu_present_on_vblank_)) {
+    std::cerr << "GPU plugin present negotiation failed\n";
+    return false;
+  }
+  if (gpu_vram_) {
+    std::ostringstream offer;
+    offer << "VRAM_SHM " << VramMirror::kPluginFd;
+    bool accepted = false;
+    if (!plugin_host_.offer_feature(PluginType::Gpu, offer.str(), "VRAM_SHM_READY", accepted)) {
+      std::cerr << "GPU plugin VRAM negotiation failed\n";
+      return false;
+    }
+    if (!accepted) {
+      gpu_vram_.reset();
+    }
+  }
+
+  if (!plugin_host_.enter_frame_mode(PluginType::Gpu)) {
+    std::cerr << "GPU plugin failed to enter frame mode\n";
+    return false;
+  }
+  return true;
+}
+
 void EmulatorCore::run_for_cycles(uint32_t cycles) {
   uint32_t remaining = cycles;
   while (remaining > 0) {
-    uint32_t step_cycles = cpu_.step();
-    if (step_cycles > remaining) {
-      remaining = 0;
-    } else {
-      remaining -= step_cycles;
+    uint32_t ran = run_slice(std::min(remaining, slice_cycles_));
+    remaining -= std::min(ran, remaining);
+    service_devices();
+    if (!gpu_batch_.empty() && total_cycles_ - gpu_batch_started_ >= kGpuBatchMaxCycles) {
+      flush_gpu_batch();
     }
+  }
+  flush_gpu_batch();
+}
 
-    mmio_.tick(step_cycles);
-    process_dma();
-    flush_spu_controls();
-    flush_xa_audio();
-    flush_gpu_dma_pending();
-    flush_gpu_commands();
-    flush_gpu_control();
+void EmulatorCore::set_slice_cycles(uint32_t cycles) {
+  slice_cycles_ = std::max<uint32_t>(cycles, 1);
+}
+
+// Runs the CPU for up to budget cycles, stopping early once the bus has work
+// for the core so DMA and GPU traffic are still handled right after the
+// instruction that caused them.
+uint32_t EmulatorCore::run_slice(uint32_t budget) {
+  uint32_t ran = 0;
+  while (ran < budget) {
+    uint64_t now = scheduler_.now();
+    uint64_t next = mmio_.next_event_time();
+    uint64_t until_event = next > now ? next - now : 1;
+    cpu_.set_step_budget(static_cast<uint32_t>(std::min<uint64_t>(until_event, budget - ran)));
+    uint32_t step_cycles = cpu_.step();
+    ran += step_cycles;
+
+    // Devices catch up on their own register accesses; otherwise only
+    // wake them when the CPU clock reaches their next event.
+    if (scheduler_.now() >= mmio_.next_event_time()) {
+      mmio_.catch_up();
+    }
 
     total_cycles_ += step_cycles;
 
@@ -149,17 +263,101 @@ void EmulatorCore::run_for_cycles(uint32_t cycles) {
         watchdog_sample();
       }
     }
+
+    if (mmio_.needs_attention()) {
+      break;
+    }
+    if (idle_skip_enabled_ && ran < budget && cpu_.poll_idle()) {
+      ran += skip_idle(budget - ran);
+    }
+  }
+  return ran;
+}
+
+// The CPU is spinning in a loop that cannot exit until a device event
+// changes what it reads, so jump the clock to that event.
+uint32_t EmulatorCore::skip_idle(uint32_t limit) {
+  uint64_t now = scheduler_.now();
+  uint64_t next = mmio_.next_event_time();
+  if (cpu_.idle_polls_gpustat() && mmio_.gpu_busy_until() > now) {
+    next = std::min(next, mmio_.gpu_busy_until());
+  }
+  if (next <= now) {
+    return 0;
+  }
+  uint32_t skip = static_cast<uint32_t>(std::min<uint64_t>(next - now, limit));
+  scheduler_.advance(skip);
+  if (scheduler_.now() >= next) {
+    mmio_.catch_up();
+  }
+  total_cycles_ += skip;
+  idle_skipped_cycles_ += skip;
+  return skip;
+}
+
+void EmulatorCore::set_idle_skip_enabled(bool enabled) {
+  idle_skip_enabled_ = enabled;
+}
+
+uint64_t EmulatorCore::idle_skipped_cycles() const {
+  return idle_skipped_cycles_;
+}
+
+// GPU DMA packets held back while the GPU is busy are retried every slice;
+// everything else waits for the bus to raise attention.
+void EmulatorCore::service_devices() {
+  if (!mmio_.needs_attention() && gpu_dma_pending_packets_.empty()) {
+    return;
   }
+  mmio_.clear_attention();
+  process_dma();
+  flush_spu_controls();
+  flush_xa_audio();
+  flush_gpu_dma_pending();
+  flush_gpu_commands();
+  flush_gpu_control();
+  flush_gpu_present();
 }
 
+static void append_le32(std::vector<uint8_t> &out, uint32_t word) {
+  out.push_back(static_cast<uint8_t>(word & 0xFF));
+  out.push_back(static_cast<uint8_t>((word >> 8) & 0xFF));
+  out.push_back(static_cast<uint8_t>((word >> 16) & 0xFF));
+  out.push_back(static_cast<uint8_t>((word >> 24) & 0xFF));
+}
+
+// With batching on, packets are only queued here; flush_gpu_batch() ships
+// them as one unacknowledged 0x0006 frame. GPUSTAT busy time is modelled by
+// MmioBus either way, so batching does not change emulated timing.
 bool EmulatorCore::send_gpu_packet(const GpuPacket &packet) {
+  gpu_vram_generation_++;
+  if (gpu_library_) {
+    gpu_library_packet_.clear();
+    gpu_library_packet_.push_back(static_cast<uint32_t>(packet.words.size()));
+    gpu_library_packet_.insert(gpu_library_packet_.end(), packet.words.begin(), packet.words.end());
+    gpu_library_->gpu()->submit_gp0(gpu_library_->instance(),
+                                     gpu_library_packet_.data(),
+                                     static_cast<uint32_t>(gpu_library_packet_.size()));
+    return true;
+  }
+  if (gpu_batching_) {
+    if (gpu_batch_.empty()) {
+      gpu_batch_started_ = total_cycles_;
+    }
+    append_le32(gpu_batch_, static_cast<uint32_t>(packet.words.size()));
+    for (uint32_t word : packet.words) {
+      append_le32(gpu_batch_, word);
+    }
+    if (gpu_batch_.size() >= kGpuBatchMaxBytes) {
+      return flush_gpu_batch();
+    }
+    return true;
+  }
+
   std::vector<uint8_t> payload;
   payload.reserve(packet.words.size() * sizeof(uint32_t));
   for (uint32_t word : packet.words) {
-    payload.push_back(static_cast<uint8_t>(word & 0xFF));
-    payload.push_back(static_cast<uint8_t>((word >> 8) & 0xFF));
-    payload.push_back(static_cast<uint8_t>((word >> 16) & 0xFF));
-    payload.push_back(static_cast<uint8_t>((word >> 24) & 0xFF));
+    append_le32(payload, word);
   }
 
   if (!plugin_host_.send_frame(PluginType::Gpu, 0x0001, payload)) {
@@ -176,6 +374,19 @@ bool EmulatorCore::send_gpu_packet(const GpuPacket &packet) {
   return true;
 }
 
+bool EmulatorCore::flush_gpu_batch() {
+  if (gpu_batch_.empty()) {
+    return true;
+  }
+  bool sent = plugin_host_.send_frame(PluginType::Gpu, 0x0006, gpu_batch_);
+  gpu_batch_.clear();
+  if (!sent) {
+    std::cerr << "Failed to send GPU command batch\n";
+    return false;
+  }
+  return true;
+}
+
 void EmulatorCore::set_trace_enabled(bool enabled) {
   trace_enabled_ = enabled;
   next_trace_cycle_ = total_cycles_;
@@ -440,10 +651,12 @@ void EmulatorCore::watchdog_sample() {
   watchdog_last_pc_ = pc;
 }
 
-bool EmulatorCore::request_vram_read(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
-  uint64_t pixel_count = static_cast<uint64_t>(w) * static_cast<uint64_t>(h);
-  uint64_t word_count = (pixel_count + 1) / 2;
-
+// Plugins without shared VRAM send the pixels back in a 0x0005 frame.
+bool EmulatorCore::fetch_vram_read(uint16_t x,
+                                   uint16_t y,
+                                   uint16_t w,
+                                   uint16_t h,
+                                   std::vector<uint32_t> &words) {
   std::vector<uint8_t> payload(8);
   payload[0] = static_cast<uint8_t>(x & 0xFF);
   payload[1] = static_cast<uint8_t>((x >> 8) & 0xFF);
@@ -454,6 +667,10 @@ bool EmulatorCore::request_vram_read(uint16_t x, uint16_t y, uint16_t w, uint16_
   payload[6] = static_cast<uint8_t>(h & 0xFF);
   payload[7] = static_cast<uint8_t>((h >> 8) & 0xFF);
 
+  // The read must see every packet queued before it.
+  if (!flush_gpu_batch()) {
+    return false;
+  }
   if (!plugin_host_.send_frame(PluginType::Gpu, 0x0004, payload)) {
     std::cerr << "Failed to send GPU VRAM read request\n";
     return false;
@@ -467,7 +684,6 @@ bool EmulatorCore::request_vram_read(uint16_t x, uint16_t y, uint16_t w, uint16_
   }
 
   size_t payload_bytes = reply_payload.size() & ~static_cast<size_t>(1);
-  std::vector<uint32_t> words;
   words.reserve((payload_bytes + 3) / 4);
   uint32_t current = 0;
   bool low = true;
@@ -486,6 +702,61 @@ bool EmulatorCore::request_vram_read(uint16_t x, uint16_t y, uint16_t w, uint16_
   if (!low) {
     words.push_back(current);
   }
+  return true;
+}
+
+// Makes the shared VRAM show every GP0/GP1 frame sent so far. Skipped when
+// nothing was sent since the last fence.
+bool EmulatorCore::sync_gpu_vram() {
+  if (gpu_vram_fenced_ == gpu_vram_generation_) {
+    return true;
+  }
+  if (!flush_gpu_batch()) {
+    return false;
+  }
+  uint32_t generation = gpu_vram_generation_;
+  std::vector<uint8_t> payload;
+  append_le32(payload, generation);
+  if (!plugin_host_.send_frame(PluginType::Gpu, 0x0008, payload)) {
+    std::cerr << "Failed to send GPU VRAM fence\n";
+    return false;
+  }
+  uint16_t reply_type = 0;
+  std::vector<uint8_t> reply_payload;
+  if (!plugin_host_.recv_frame(PluginType::Gpu, reply_type, reply_payload) || reply_type != 0x0002 ||
+      gpu_vram_->fence() != generation) {
+    std::cerr << "GPU VRAM fence not acknowledged\n";
+    return false;
+  }
+  gpu_vram_fenced_ = generation;
+  return true;
+}
+
+bool EmulatorCore::request_vram_read(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+  uint64_t pixel_count = static_cast<uint64_t>(w) * static_cast<uint64_t>(h);
+  uint64_t word_count = (pixel_count + 1) / 2;
+
+  std::vector<uint32_t> words;
+  if (gpu_library_) {
+    uint32_t cols = std::min<uint32_t>(w, VramMirror::kWidth);
+    uint32_t rows = std::min<uint32_t>(h, VramMirror::kHeight);
+    std::vector<uint16_t> pixels(static_cast<size_t>(cols) * rows);
+    if (!pixels.empty()) {
+      gpu_library_->gpu()->read_vram(gpu_library_->instance(), x, y, w, h, pixels.data());
+    }
+    words.reserve((pixels.size() + 1) / 2);
+    for (size_t i = 0; i < pixels.size(); i += 2) {
+      uint32_t high = i + 1 < pixels.size() ? pixels[i + 1] : 0;
+      words.push_back(pixels[i] | (high << 16));
+    }
+  } else if (gpu_vram_) {
+    if (!sync_gpu_vram()) {
+      return false;
+    }
+    gpu_vram_->read_words(x, y, w, h, words);
+  } else if (!fetch_vram_read(x, y, w, h, words)) {
+    return false;
+  }
   uint32_t delay = static_cast<uint32_t>(std::min<uint64_t>(word_count, 100000));
   mmio_.schedule_gpu_read_data(std::move(words), delay);
   mmio_.gpu_add_busy(delay);
@@ -566,15 +837,22 @@ void EmulatorCore::flush_gpu_control() {
     return;
   }
 
+  gpu_vram_generation_++;
+  if (gpu_library_) {
+    gpu_library_->gpu()->write_gp1(
+        gpu_library_->instance(), commands.data(), static_cast<uint32_t>(commands.size()));
+    return;
+  }
+
   std::vector<uint8_t> payload;
   payload.reserve(commands.size() * sizeof(uint32_t));
   for (uint32_t word : commands) {
-    payload.push_back(static_cast<uint8_t>(word & 0xFF));
-    payload.push_back(static_cast<uint8_t>((word >> 8) & 0xFF));
-    payload.push_back(static_cast<uint8_t>((word >> 16) & 0xFF));
-    payload.push_back(static_cast<uint8_t>((word >> 24) & 0xFF));
+    append_le32(payload, word);
   }
 
+  if (!flush_gpu_batch()) {
+    return;
+  }
   if (!plugin_host_.send_frame(PluginType::Gpu, 0x0003, payload)) {
     std::cerr << "Failed to send GPU control frame\n";
     return;
@@ -588,6 +866,27 @@ void EmulatorCore::flush_gpu_control() {
   }
 }
 
+// One present per emulated field; the plugin skips it if nothing it shows
+// has changed since the last one.
+void EmulatorCore::flush_gpu_present() {
+  if (!mmio_.take_vblank()) {
+    return;
+  }
+  if (gpu_library_) {
+    gpu_library_->gpu()->present(gpu_library_->instance());
+    return;
+  }
+  if (!gpu_present_on_vblank_) {
+    return;
+  }
+  if (!flush_gpu_batch()) {
+    return;
+  }
+  if (!plugin_host_.send_frame(PluginType::Gpu, 0x0007, {})) {
+    std::cerr << "Failed to send GPU present frame\n";
+  }
+}
+
 void EmulatorCore::process_dma() {
   uint32_t channel = mmio_.consume_dma_channel();
   if (channel == 0xFFFFFFFFu) {
@@ -666,11 +965,12 @@ void EmulatorCore::process_dma() {
     mmio_.gpu_add_busy(static_cast<uint32_t>(dma_busy));
 
     if (mmio_.gpu_dma_dir() == 3) { // GPU -> CPU (VRAM read DMA)
+      std::vector<uint32_t> words(total_words);
       for (uint32_t i = 0; i < total_words; ++i) {
-        uint32_t addr = decrement ? (madr - i * 4) : (madr + i * 4);
-        uint32_t word = mmio_.gpu_read_word();
-        memory_.write32(addr, word);
+        words[decrement ? total_words - 1 - i : i] = mmio_.gpu_read_word();
       }
+      uint32_t start = decrement ? madr - (total_words - 1) * 4 : madr;
+      memory_.dma_write_words(start, words.data(), words.size());
 
       if (decrement) {
         mmio_.set_dma_madr(channel, madr - total_words * 4);
@@ -727,14 +1027,15 @@ void EmulatorCore::process_dma() {
       payload[i] = 0;
     }
 
+    std::vector<uint32_t> words(total_words);
     for (uint32_t i = 0; i < total_words; ++i) {
       size_t base = static_cast<size_t>(i) * 4;
-      uint32_t word = static_cast<uint32_t>(payload[base]) |
-                      (static_cast<uint32_t>(payload[base + 1]) << 8) |
-                      (static_cast<uint32_t>(payload[base + 2]) << 16) |
-                      (static_cast<uint32_t>(payload[base + 3]) << 24);
-      memory_.write32(madr + i * 4, word);
+      words[i] = static_cast<uint32_t>(payload[base]) |
+                 (static_cast<uint32_t>(payload[base + 1]) << 8) |
+                 (static_cast<uint32_t>(payload[base + 2]) << 16) |
+                 (static_cast<uint32_t>(payload[base + 3]) << 24);
     }
+    memory_.dma_write_words(madr, words.data(), words.size());
 
     mmio_.set_dma_madr(channel, madr + total_words * 4);
   } else if (channel == 6) { // OTC: clear ordering table
@@ -745,19 +1046,22 @@ void EmulatorCore::process_dma() {
       count = 0x10000u;
     }
 
+    // The table is written downwards from MADR; build it in address order
+    // so it lands in RAM as one block.
+    std::vector<uint32_t> table(count);
     uint32_t addr = madr;
     for (uint32_t i = 0; i < count; ++i) {
-      uint32_t value = (i + 1 == count) ? 0x00FFFFFFu : ((addr - 4) & 0x00FFFFFFu);
-      memory_.write32(addr, value);
+      table[count - 1 - i] = (i + 1 == count) ? 0x00FFFFFFu : ((addr - 4) & 0x00FFFFFFu);
       addr = (addr - 4) & 0x1FFFFC;
     }
+    memory_.dma_write_words((madr - (count - 1) * 4) & 0x1FFFFC, table.data(), table.size());
 
     mmio_.set_dma_madr(channel, addr);
   }
 }
 
 void EmulatorCore::flush_spu_controls() {
-  if (!plugin_host_.is_frame_mode(PluginType::Spu)) {
+  if (!spu_library_ && !plugin_host_.is_frame_mode(PluginType::Spu)) {
     return;
   }
   uint16_t left = mmio_.spu_main_volume_left();
@@ -767,6 +1071,11 @@ void EmulatorCore::flush_spu_controls() {
   }
   spu_main_vol_l_ = left;
   spu_main_vol_r_ = right;
+  if (spu_library_) {
+    spu_library_->spu()->set_volume(
+        spu_library_->instance(), static_cast<int16_t>(left), static_cast<int16_t>(right));
+    return;
+  }
 
   std::vector<uint8_t> payload(4);
   payload[0] = static_cast<uint8_t>(left & 0xFF);
@@ -779,7 +1088,7 @@ void EmulatorCore::flush_spu_controls() {
 void EmulatorCore::flush_xa_audio() {
   ps1emu::MmioBus::XaAudioSector sector;
   while (mmio_.pop_xa_audio(sector)) {
-    if (!plugin_host_.is_frame_mode(PluginType::Spu)) {
+    if (!spu_library_ && !plugin_host_.is_frame_mode(PluginType::Spu)) {
       continue;
     }
 
@@ -812,6 +1121,20 @@ void EmulatorCore::flush_xa_audio() {
 
     uint32_t sample_count = static_cast<uint32_t>(left.size());
 
+    if (spu_library_) {
+      std::vector<int16_t> interleaved;
+      interleaved.reserve(static_cast<size_t>(sample_count) * channels);
+      for (uint32_t i = 0; i < sample_count; ++i) {
+        interleaved.push_back(left[i]);
+        if (channels == 2) {
+          interleaved.push_back(i < right.size() ? right[i] : left[i]);
+        }
+      }
+      spu_library_->spu()->submit_pcm(
+          spu_library_->instance(), sector.lba, sample_rate, channels, interleaved.data(), sample_count);
+      continue;
+    }
+
     std::vector<uint8_t> payload;
     payload.reserve(12 + sample_count * channels * 2);
     payload.push_back(static_cast<uint8_t>(sector.lba & 0xFF));
@@ -846,9 +1169,23 @@ void EmulatorCore::flush_xa_audio() {
 
 void EmulatorCore::dump_dynarec_profile() const {
   auto blocks = cpu_.dynarec_blocks();
-  std::cout << "Dynarec blocks: " << blocks.size() << "\n";
+  auto cold = cpu_.dynarec_cold_blocks();
+  const DynarecCache::Stats &stats = cpu_.dynarec_stats();
+  std::cout << "Dynarec blocks: " << blocks.size() << " (cold heads: " << cold.size() << ")\n";
+  std::cout << "Dynarec lookups: hits=" << stats.hits << " misses=" << stats.misses
+            << " evictions=" << stats.evictions << " invalidations=" << stats.invalidations
+            << " promotions=" << stats.promotions << "\n";
+  blocks.insert(blocks.end(), cold.begin(), cold.end());
   for (const auto &block : blocks) {
+    const char *tier = "jit";
+    if (block.tier == JitTier::Cold) {
+      tier = "cold";
+    } else if (block.tier == JitTier::Interpreted) {
+      tier = "interp";
+    }
     std::cout << "PC=0x" << std::hex << block.pc << std::dec
+              << " tier=" << tier
+              << " execs=" << block.executions
               << " size=" << block.size
               << " opcodes=" << block.opcodes.size() << "\n";
     size_t count = 0;
@@ -865,7 +1202,16 @@ void EmulatorCore::dump_dynarec_profile() const {
 }
 
 void EmulatorCore::shutdown() {
+  if (!dynarec_profile_path_.empty()) {
+    std::string error;
+    if (!cpu_.save_dynarec_profile(dynarec_profile_path_, error)) {
+      std::cerr << "Dynarec cache error: " << error << "\n";
+    }
+  }
+  flush_gpu_batch();
   plugin_host_.shutdown_all();
+  gpu_library_.reset();
+  spu_library_.reset();
 }
 
 const Config &EmulatorCore::config() const {
@@ -913,17 +1259,66 @@ bool EmulatorCore::load_and_apply_config(const std::string &config_path) {
     }
   }
 
+  if (config_.cpu_fastmem) {
+    std::string fastmem_error;
+    if (!memory_.enable_fastmem(fastmem_error)) {
+      std::cerr << "Fastmem unavailable (" << fastmem_error << "), using page-table memory path\n";
+    }
+  } else {
+    memory_.disable_fastmem();
+  }
+
   cpu_.set_mode(resolve_cpu_mode());
+  cpu_.set_dynarec_block_limit(static_cast<uint32_t>(config_.cpu_dynarec_block_limit));
+  cpu_.set_dynarec_hot_threshold(static_cast<uint32_t>(config_.cpu_dynarec_hot_threshold));
+  set_slice_cycles(static_cast<uint32_t>(config_.core_slice_cycles));
+  set_idle_skip_enabled(config_.cpu_idle_skip);
   cpu_.reset();
+
+  dynarec_profile_path_.clear();
+  if (config_.cpu_dynarec_cache && cpu_.mode() == CpuCore::Mode::Dynarec) {
+    std::string cache_error;
+    std::string path = dynarec_profile_path();
+    if (!ensure_directory(std::filesystem::path(path).parent_path().string(), cache_error)) {
+      std::cerr << "Dynarec cache error: " << cache_error << "\n";
+    } else {
+      if (!cpu_.load_dynarec_profile(path, cache_error)) {
+        std::cerr << "Dynarec cache error: " << cache_error << " (rewritten at shutdown)\n";
+      }
+      // Saved even after a bad load so shutdown replaces the damaged file.
+      dynarec_profile_path_ = path;
+    }
+  }
   return true;
 }
 
+// One profile per BIOS image and disc: the BIOS is hashed by content, the
+// disc by path and size (hashing a whole image would cost more than warm-up).
+std::string EmulatorCore::dynarec_profile_path() const {
+  const std::vector<uint8_t> &bios = bios_.data();
+  uint64_t key = fnv1a64(bios.data(), bios.size());
+  if (!config_.cdrom_image.empty()) {
+    std::error_code ec;
+    uint64_t disc_size = std::filesystem::file_size(config_.cdrom_image, ec);
+    if (ec) {
+      disc_size = 0;
+    }
+    key = fnv1a64(config_.cdrom_image.data(), config_.cdrom_image.size(), key);
+    key = fnv1a64(&disc_size, sizeof(disc_size), key);
+  }
+  std::ostringstream name;
+  name << app_data_dir() << "/dynarec/" << std::hex << std::setw(16) << std::setfill('0') << key << ".jitprof";
+  return name.str();
+}
+
 CpuCore::Mode EmulatorCore::resolve_cpu_mode() const {
   switch (config_.cpu_mode) {
     case CpuMode::Interpreter:
       return CpuCore::Mode::Interpreter;
     case CpuMode::Dynarec:
       return CpuCore::Mode::Dynarec;
+    case CpuMode::Threaded:
+      return CpuCore::Mode::Threaded;
     case CpuMode::Auto:
       return CpuCore::dynarec_available() ? CpuCore::Mode::Dynarec : CpuCore::Mode::Interpreter;
   }
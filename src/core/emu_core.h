@@ -10,9 +10,12 @@
 #include "core/scheduler.h"
 #include "core/xa_adpcm.h"
 #include "plugins/plugin_host.h"
+#include "plugins/plugin_library.h"
+#include "plugins/vram_mirror.h"
 
 #include <cstdint>
 #include <deque>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
@@ -24,6 +27,10 @@ public:
 
   bool initialize(const std::string &config_path);
   void run_for_cycles(uint32_t cycles);
+  void set_slice_cycles(uint32_t cycles);
+  void set_idle_skip_enabled(bool enabled);
+  // Cycles fast-forwarded over idle polling loops since initialize().
+  uint64_t idle_skipped_cycles() const;
   void dump_dynarec_profile() const;
   void shutdown();
   const Config &config() const;
@@ -39,17 +46,26 @@ public:
 
 private:
   friend struct EmulatorCoreTestAccess;
+  uint32_t run_slice(uint32_t budget);
+  void service_devices();
+  uint32_t skip_idle(uint32_t limit);
   void flush_gpu_commands();
   void flush_gpu_control();
+  void flush_gpu_present();
   void flush_spu_controls();
   void flush_xa_audio();
   void process_dma();
   void flush_gpu_dma_pending();
   bool send_gpu_packet(const GpuPacket &packet);
+  bool negotiate_gpu_plugin();
+  bool flush_gpu_batch();
+  bool sync_gpu_vram();
   bool request_vram_read(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+  bool fetch_vram_read(uint16_t x, uint16_t y, uint16_t w, uint16_t h, std::vector<uint32_t> &words);
 
   bool load_and_apply_config(const std::string &config_path);
   CpuCore::Mode resolve_cpu_mode() const;
+  std::string dynarec_profile_path() const;
   void log_trace_state(const char *label);
   void log_exception_event(const CpuExceptionInfo &info);
   void log_trace_pc_state(uint32_t instr_pc);
@@ -64,6 +80,22 @@ private:
   CpuCore cpu_;
   std::vector<uint32_t> gpu_dma_remainder_;
   std::deque<GpuPacket> gpu_dma_pending_packets_;
+  // GP0 packets not yet sent to a plugin that accepted GPU_BATCH.
+  bool gpu_batching_ = false;
+  std::vector<uint8_t> gpu_batch_;
+  uint64_t gpu_batch_started_ = 0;
+  // The GPU plugin accepted GPU_PRESENT and waits for 0x0007 each VBlank.
+  bool gpu_present_on_vblank_ = false;
+  // Read-only view of the plugin's VRAM. gpu_vram_generation_ counts GP0/GP1
+  // traffic sent since launch; the mirror is current once the plugin has
+  // published that value as its fence.
+  std::unique_ptr<VramMirror> gpu_vram_;
+  // Set for plugin.<type>_mode=library; these bypass plugin_host_.
+  std::unique_ptr<PluginLibrary> gpu_library_;
+  std::unique_ptr<PluginLibrary> spu_library_;
+  std::vector<uint32_t> gpu_library_packet_;
+  uint32_t gpu_vram_generation_ = 0;
+  uint32_t gpu_vram_fenced_ = 0;
   std::unordered_map<uint16_t, XaDecodeState> xa_decode_states_;
   uint16_t spu_main_vol_l_ = 0x3FFF;
   uint16_t spu_main_vol_r_ = 0x3FFF;
@@ -74,6 +106,10 @@ private:
   uint32_t trace_pc_period_cycles_ = 1000000;
   uint64_t next_trace_pc_cycle_ = 0;
   uint64_t total_cycles_ = 0;
+  uint32_t slice_cycles_ = 512;
+  bool idle_skip_enabled_ = false;
+  uint64_t idle_skipped_cycles_ = 0;
+  std::string dynarec_profile_path_;
   uint64_t next_trace_cycle_ = 0;
   bool watchdog_enabled_ = false;
   uint32_t watchdog_sample_cycles_ = 2048;
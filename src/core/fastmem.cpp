@@ -0,0 +1,310 @@
+#include "core/fastmem.h"
+
+#if defined(PS1EMU_FASTMEM)
+#include <atomic>
+#include <csetjmp>
+#include <csignal>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+#endif
+
+namespace ps1emu {
+
+#if defined(PS1EMU_FASTMEM)
+
+namespace {
+constexpr uint64_t kSegments[] = {0x00000000ull, 0x80000000ull, 0xA0000000ull};
+constexpr uint32_t kRamMirrors = 4;
+constexpr uint64_t kBiosPhys = 0x1FC00000ull;
+constexpr uint64_t kScratchpadPhys = 0x1F800000ull;
+constexpr size_t kHostPage = 4096;
+
+struct ResolverEntry {
+  Fastmem::FaultResolver resolver = nullptr;
+  void *context = nullptr;
+};
+
+std::vector<ResolverEntry> &resolvers() {
+  static std::vector<ResolverEntry> entries;
+  return entries;
+}
+
+struct sigaction g_previous_segv {};
+struct sigaction g_previous_bus {};
+bool g_handler_installed = false;
+
+// Set while self_test() probes pages that are expected to fault.
+thread_local sigjmp_buf *volatile t_probe = nullptr;
+
+void chain_previous(int sig, siginfo_t *info, void *ucontext) {
+  const struct sigaction &previous = sig == SIGBUS ? g_previous_bus : g_previous_segv;
+  if ((previous.sa_flags & SA_SIGINFO) && previous.sa_sigaction) {
+    previous.sa_sigaction(sig, info, ucontext);
+    return;
+  }
+  if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+    previous.sa_handler(sig);
+    return;
+  }
+  // Restore the default action; the faulting instruction re-executes and
+  // terminates the process as it would have without fastmem.
+  sigaction(sig, &previous, nullptr);
+}
+
+void fault_handler(int sig, siginfo_t *info, void *ucontext) {
+  if (t_probe) {
+    siglongjmp(*t_probe, 1);
+  }
+  for (const ResolverEntry &entry : resolvers()) {
+    if (entry.resolver(entry.context, ucontext)) {
+      return;
+    }
+  }
+  chain_previous(sig, info, ucontext);
+}
+
+void install_fault_handler() {
+  if (g_handler_installed) {
+    return;
+  }
+  struct sigaction action {};
+  action.sa_sigaction = &fault_handler;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &g_previous_segv);
+  sigaction(SIGBUS, &action, &g_previous_bus);
+  g_handler_installed = true;
+}
+
+bool probe_faults(volatile uint8_t *addr, bool write) {
+  sigjmp_buf env;
+  if (sigsetjmp(env, 1) != 0) {
+    t_probe = nullptr;
+    return true;
+  }
+  t_probe = &env;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  if (write) {
+    *addr = 0;
+  } else {
+    (void)*addr;
+  }
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  t_probe = nullptr;
+  return false;
+}
+} // namespace
+
+Fastmem::~Fastmem() {
+  destroy();
+}
+
+bool Fastmem::host_supported() {
+  return true;
+}
+
+void Fastmem::add_fault_resolver(FaultResolver resolver, void *context) {
+  resolvers().push_back({resolver, context});
+}
+
+void Fastmem::remove_fault_resolver(FaultResolver resolver, void *context) {
+  auto &entries = resolvers();
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    if (it->resolver == resolver && it->context == context) {
+      entries.erase(it);
+      return;
+    }
+  }
+}
+
+bool Fastmem::map_alias(uint64_t guest, size_t file_offset, size_t size, bool writable) {
+  int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+  void *mapped = mmap(base_ + guest, size, prot, MAP_SHARED | MAP_FIXED, fd_, static_cast<off_t>(file_offset));
+  return mapped != MAP_FAILED;
+}
+
+bool Fastmem::create(size_t ram_size, size_t bios_size, std::string &error) {
+  destroy();
+  ram_size_ = ram_size;
+  bios_size_ = bios_size;
+
+  fd_ = memfd_create("ps1emu-fastmem", MFD_CLOEXEC);
+  if (fd_ < 0) {
+    error = "memfd_create failed";
+    return false;
+  }
+  // RAM, then BIOS, then one page for the scratchpad.
+  size_t file_size = ram_size + bios_size + kHostPage;
+  if (ftruncate(fd_, static_cast<off_t>(file_size)) != 0) {
+    error = "ftruncate failed";
+    destroy();
+    return false;
+  }
+
+  void *reserved = mmap(nullptr, kReserveSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (reserved == MAP_FAILED) {
+    error = "unable to reserve 4 GiB of address space";
+    destroy();
+    return false;
+  }
+  base_ = static_cast<uint8_t *>(reserved);
+
+  void *ram_view = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (ram_view == MAP_FAILED) {
+    error = "unable to map RAM view";
+    destroy();
+    return false;
+  }
+  ram_ = static_cast<uint8_t *>(ram_view);
+  bios_ = ram_ + ram_size;
+  scratchpad_ = bios_ + bios_size;
+
+  for (uint64_t segment : kSegments) {
+    for (uint32_t mirror = 0; mirror < kRamMirrors; ++mirror) {
+      if (!map_alias(segment + mirror * ram_size, 0, ram_size, true)) {
+        error = "unable to map RAM mirror";
+        destroy();
+        return false;
+      }
+    }
+    if (!map_alias(segment + kScratchpadPhys, ram_size + bios_size, kHostPage, true)) {
+      error = "unable to map scratchpad";
+      destroy();
+      return false;
+    }
+    if (!map_alias(segment + kBiosPhys, ram_size, bios_size, false)) {
+      error = "unable to map BIOS";
+      destroy();
+      return false;
+    }
+  }
+
+  install_fault_handler();
+  return true;
+}
+
+bool Fastmem::self_test(std::string &error) {
+  if (!base_) {
+    error = "fastmem not created";
+    return false;
+  }
+  const uint32_t pattern = 0x5A17C0DE;
+  uint32_t saved = 0;
+  std::memcpy(&saved, ram_ + 0x1000, sizeof(saved));
+  std::memcpy(ram_ + 0x1000, &pattern, sizeof(pattern));
+  bool aliased = true;
+  for (uint64_t segment : kSegments) {
+    for (uint32_t mirror = 0; mirror < kRamMirrors; ++mirror) {
+      uint32_t value = 0;
+      std::memcpy(&value, base_ + segment + mirror * ram_size_ + 0x1000, sizeof(value));
+      aliased = aliased && value == pattern;
+    }
+  }
+  std::memcpy(ram_ + 0x1000, &saved, sizeof(saved));
+  if (!aliased) {
+    error = "RAM mirrors do not alias";
+    return false;
+  }
+  std::memcpy(&saved, scratchpad_, sizeof(saved));
+  std::memcpy(scratchpad_, &pattern, sizeof(pattern));
+  for (uint64_t segment : kSegments) {
+    uint32_t value = 0;
+    std::memcpy(&value, base_ + segment + kScratchpadPhys, sizeof(value));
+    aliased = aliased && value == pattern;
+  }
+  std::memcpy(scratchpad_, &saved, sizeof(saved));
+  if (!aliased) {
+    error = "scratchpad does not alias";
+    return false;
+  }
+  if (!probe_faults(base_ + 0x1F801070ull, false)) {
+    error = "MMIO page did not fault";
+    return false;
+  }
+  if (!probe_faults(base_ + 0xBFC00000ull, true)) {
+    error = "BIOS write did not fault";
+    return false;
+  }
+  return true;
+}
+
+void Fastmem::destroy() {
+  if (base_) {
+    munmap(base_, kReserveSize);
+    base_ = nullptr;
+  }
+  if (ram_) {
+    munmap(ram_, ram_size_ + bios_size_ + kHostPage);
+    ram_ = nullptr;
+    bios_ = nullptr;
+    scratchpad_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void Fastmem::protect_ram_page(size_t ram_page, bool writable) {
+  if (!base_) {
+    return;
+  }
+  int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+  uint64_t offset = static_cast<uint64_t>(ram_page) * kHostPage;
+  for (uint64_t segment : kSegments) {
+    for (uint32_t mirror = 0; mirror < kRamMirrors; ++mirror) {
+      mprotect(base_ + segment + mirror * ram_size_ + offset, kHostPage, prot);
+    }
+  }
+}
+
+#else
+
+Fastmem::~Fastmem() = default;
+
+bool Fastmem::host_supported() {
+  return false;
+}
+
+void Fastmem::add_fault_resolver(FaultResolver resolver, void *context) {
+  (void)resolver;
+  (void)context;
+}
+
+void Fastmem::remove_fault_resolver(FaultResolver resolver, void *context) {
+  (void)resolver;
+  (void)context;
+}
+
+bool Fastmem::map_alias(uint64_t guest, size_t file_offset, size_t size, bool writable) {
+  (void)guest;
+  (void)file_offset;
+  (void)size;
+  (void)writable;
+  return false;
+}
+
+bool Fastmem::create(size_t ram_size, size_t bios_size, std::string &error) {
+  (void)ram_size;
+  (void)bios_size;
+  error = "fastmem is not supported on this host";
+  return false;
+}
+
+bool Fastmem::self_test(std::string &error) {
+  error = "fastmem is not supported on this host";
+  return false;
+}
+
+void Fastmem::destroy() {}
+
+void Fastmem::protect_ram_page(size_t ram_page, bool writable) {
+  (void)ram_page;
+  (void)writable;
+}
+
+#endif
+
+} // namespace ps1emu
@@ -0,0 +1,63 @@
+#ifndef PS1EMU_FASTMEM_H
+#define PS1EMU_FASTMEM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define PS1EMU_FASTMEM 1
+#endif
+
+namespace ps1emu {
+
+// 4 GiB host reservation laid out like the guest virtual address space.
+// RAM (the first four 2 MiB mirrors), the scratchpad page and BIOS are memfd
+// aliases in KUSEG, KSEG0 and KSEG1; everything else, including MMIO, is
+// PROT_NONE so stray accesses fault into a registered resolver. The 1 KiB
+// scratchpad shares its host page with the unused hole up to the MMIO page,
+// so that hole is mapped too (it reads 0xFF until something stores there).
+class Fastmem {
+public:
+  static constexpr uint64_t kReserveSize = 1ull << 32;
+
+  // Offered every fault inside a fastmem region; returns true once the
+  // faulting context has been redirected (e.g. to a dynarec slow path).
+  using FaultResolver = bool (*)(void *context, void *ucontext);
+
+  Fastmem() = default;
+  ~Fastmem();
+
+  Fastmem(const Fastmem &) = delete;
+  Fastmem &operator=(const Fastmem &) = delete;
+
+  static bool host_supported();
+  static void add_fault_resolver(FaultResolver resolver, void *context);
+  static void remove_fault_resolver(FaultResolver resolver, void *context);
+
+  bool create(size_t ram_size, size_t bios_size, std::string &error);
+  bool self_test(std::string &error);
+  void destroy();
+
+  uint8_t *base() const { return base_; }
+  uint8_t *ram() const { return ram_; }
+  uint8_t *bios() const { return bios_; }
+  uint8_t *scratchpad() const { return scratchpad_; }
+
+  void protect_ram_page(size_t ram_page, bool writable);
+
+private:
+  bool map_alias(uint64_t guest, size_t file_offset, size_t size, bool writable);
+
+  int fd_ = -1;
+  uint8_t *base_ = nullptr;
+  uint8_t *ram_ = nullptr;
+  uint8_t *bios_ = nullptr;
+  uint8_t *scratchpad_ = nullptr;
+  size_t ram_size_ = 0;
+  size_t bios_size_ = 0;
+};
+
+} // namespace ps1emu
+
+#endif
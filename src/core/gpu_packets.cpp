@@ -1,5 +1,7 @@
 #include "core/gpu_packets.h"
 
+#include <cstddef>
+
 namespace ps1emu {
 
 static size_t gp0_packet_length(const std::vector<uint32_t> &words, size_t index) {
@@ -1,5 +1,7 @@
 #include "core/memory_map.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
@@ -10,26 +12,133 @@ namespace ps1emu {
 
 namespace {
 constexpr uint32_t kRamMirrorLimit = 0x1F000000;
+constexpr uint32_t kScratchpadBase = 0x1F800000;
+constexpr uint32_t kBiosBase = 0x1FC00000;
+constexpr uint32_t kPageMask = MemoryMap::kPageSize - 1;
+
+struct PhysWatch {
+  bool enabled = false;
+  uint32_t start = 0;
+  uint32_t end = 0;
+};
+
+static PhysWatch load_phys_watch() {
+  PhysWatch watch;
+  const char *env = std::getenv("PS1EMU_WATCH_PHYS");
+  if (!env || !*env) {
+    return watch;
+  }
+  std::string spec(env);
+  size_t colon = spec.find(':');
+  try {
+    if (colon == std::string::npos) {
+      uint32_t addr_val = static_cast<uint32_t>(std::stoul(spec, nullptr, 0));
+      watch.start = addr_val;
+      watch.end = addr_val;
+    } else {
+      watch.start = static_cast<uint32_t>(std::stoul(spec.substr(0, colon), nullptr, 0));
+      watch.end = static_cast<uint32_t>(std::stoul(spec.substr(colon + 1), nullptr, 0));
+    }
+    watch.enabled = true;
+  } catch (...) {
+    watch.enabled = false;
+  }
+  return watch;
+}
+
+static const PhysWatch &phys_watch() {
+  static PhysWatch watch = load_phys_watch();
+  return watch;
+}
+
+static void maybe_log_phys_write(const char *op, uint32_t addr, uint32_t phys, uint32_t value, int width) {
+  const PhysWatch &watch = phys_watch();
+  if (!watch.enabled || phys < watch.start || phys > watch.end) {
+    return;
+  }
+  std::ostringstream oss;
+  oss << std::hex << std::setfill('0');
+  oss << "[watch-phys] " << op << " vaddr=0x" << std::setw(8) << addr;
+  oss << " paddr=0x" << std::setw(8) << phys;
+  oss << " value=0x" << std::setw(width) << value << "\n";
+  std::cerr << oss.str();
+}
+} // namespace
+
+MemoryMap::MemoryMap()
+    : ram_storage_(kRamSize, 0),
+      ram_(ram_storage_.data()),
+      scratchpad_(scratchpad_storage_.data()),
+      read_pages_(kPageCount, nullptr),
+      write_pages_(kPageCount, nullptr) {
+  std::memset(scratchpad_ + kScratchpadSize, 0xFF, kPageSize - kScratchpadSize);
+  map_pages();
 }
 
 void MemoryMap::reset() {
-  std::memset(ram_.data(), 0, ram_.size());
-  std::memset(scratchpad_.data(), 0, scratchpad_.size());
+  std::memset(ram_, 0, kRamSize);
+  std::memset(scratchpad_, 0, kScratchpadSize);
+  notify_code_write(0, static_cast<uint32_t>(kRamSize));
+  if (fastmem_) {
+    for (size_t page = 0; page < kRamCodePages; ++page) {
+      if (code_pages_[page]) {
+        fastmem_->protect_ram_page(page, true);
+      }
+    }
+  }
+  code_pages_.fill(0);
+  map_pages();
 }
 
 void MemoryMap::load_bios(const BiosImage &bios) {
   bios_ = bios.valid() ? &bios : nullptr;
+  copy_bios_to_fastmem();
+  map_pages();
+  notify_code_write(kBiosBase, static_cast<uint32_t>(BiosImage::kExpectedSize));
+}
+
+void MemoryMap::map_pages() {
+  std::fill(read_pages_.begin(), read_pages_.end(), nullptr);
+  std::fill(write_pages_.begin(), write_pages_.end(), nullptr);
+
+  // The watch hook logs from the slow write handlers, so leave writes unmapped.
+  const bool direct_writes = !phys_watch().enabled;
+  for (uint32_t page = 0; page < (kRamMirrorLimit >> kPageShift); ++page) {
+    size_t ram_page = page & (kRamCodePages - 1);
+    uint8_t *host = ram_ + (ram_page << kPageShift);
+    read_pages_[page] = host;
+    write_pages_[page] = (direct_writes && !code_pages_[ram_page]) ? host : nullptr;
+  }
+  // Scratchpad writes stay on the slow path so the unmapped tail of the page is never written.
+  read_pages_[kScratchpadBase >> kPageShift] = scratchpad_;
+  if (bios_) {
+    const uint8_t *bios = bios_->data().data();
+    for (uint32_t offset = 0; offset < BiosImage::kExpectedSize; offset += kPageSize) {
+      read_pages_[(kBiosBase + offset) >> kPageShift] = bios + offset;
+    }
+  }
+}
+
+void MemoryMap::map_ram_write_page(size_t ram_page, bool direct) {
+  uint8_t *host = direct && !phys_watch().enabled ? ram_ + (ram_page << kPageShift) : nullptr;
+  for (size_t page = ram_page; page < (kRamMirrorLimit >> kPageShift); page += kRamCodePages) {
+    write_pages_[page] = host;
+  }
 }
 
 void MemoryMap::attach_mmio(MmioBus &mmio) {
   mmio_ = &mmio;
+  if (irq_line_hook_) {
+    mmio_->set_irq_line_hook(irq_line_hook_, irq_line_context_);
+  }
 }
 
-bool MemoryMap::irq_pending() const {
-  if (!mmio_) {
-    return false;
+void MemoryMap::set_irq_line_hook(void (*hook)(void *context, bool asserted), void *context) {
+  irq_line_hook_ = hook;
+  irq_line_context_ = context;
+  if (mmio_) {
+    mmio_->set_irq_line_hook(hook, context);
   }
-  return mmio_->irq_pending();
 }
 
 uint16_t MemoryMap::irq_stat() const {
@@ -46,30 +155,142 @@ uint16_t MemoryMap::irq_mask() const {
   return mmio_->irq_mask();
 }
 
+uint64_t MemoryMap::device_activity() const {
+  if (!mmio_) {
+    return 0;
+  }
+  return mmio_->device_activity();
+}
+
+void MemoryMap::set_code_write_hook(CodeWriteHook hook, void *context) {
+  code_write_hook_ = hook;
+  code_write_context_ = context;
+}
+
+void MemoryMap::mark_code_page(uint32_t addr) {
+  uint32_t phys = mask_address(addr);
+  if (phys >= kRamMirrorLimit) {
+    return;
+  }
+  size_t ram_page = (phys & (kRamSize - 1)) >> kCodePageShift;
+  if (!code_pages_[ram_page]) {
+    code_pages_[ram_page] = 1;
+    // Writes to code pages go through the slow path so the hook sees them.
+    map_ram_write_page(ram_page, false);
+    if (fastmem_) {
+      fastmem_->protect_ram_page(ram_page, false);
+    }
+  }
+}
+
+bool MemoryMap::enable_fastmem(std::string &error) {
+  if (fastmem_) {
+    return true;
+  }
+  if (!Fastmem::host_supported()) {
+    error = "not supported on this host";
+    return false;
+  }
+  if (phys_watch().enabled) {
+    // Fastmem stores bypass the slow handlers that PS1EMU_WATCH_PHYS logs from.
+    error = "disabled while PS1EMU_WATCH_PHYS is set";
+    return false;
+  }
+  auto fastmem = std::make_unique<Fastmem>();
+  if (!fastmem->create(kRamSize, BiosImage::kExpectedSize, error) || !fastmem->self_test(error)) {
+    return false;
+  }
+  std::memcpy(fastmem->ram(), ram_, kRamSize);
+  std::memcpy(fastmem->scratchpad(), scratchpad_, kPageSize);
+  for (size_t page = 0; page < kRamCodePages; ++page) {
+    if (code_pages_[page]) {
+      fastmem->protect_ram_page(page, false);
+    }
+  }
+  fastmem_ = std::move(fastmem);
+  ram_ = fastmem_->ram();
+  scratchpad_ = fastmem_->scratchpad();
+  copy_bios_to_fastmem();
+  map_pages();
+  return true;
+}
+
+void MemoryMap::disable_fastmem() {
+  if (!fastmem_) {
+    return;
+  }
+  std::memcpy(ram_storage_.data(), ram_, kRamSize);
+  std::memcpy(scratchpad_storage_.data(), scratchpad_, kPageSize);
+  ram_ = ram_storage_.data();
+  scratchpad_ = scratchpad_storage_.data();
+  fastmem_.reset();
+  map_pages();
+}
+
+uint8_t *MemoryMap::fastmem_base() const {
+  return fastmem_ ? fastmem_->base() : nullptr;
+}
+
+void MemoryMap::copy_bios_to_fastmem() {
+  if (!fastmem_) {
+    return;
+  }
+  if (bios_) {
+    std::memcpy(fastmem_->bios(), bios_->data().data(), BiosImage::kExpectedSize);
+  } else {
+    std::memset(fastmem_->bios(), 0xFF, BiosImage::kExpectedSize);
+  }
+}
+
+void MemoryMap::notify_code_write(uint32_t phys, uint32_t size) {
+  if (code_write_hook_) {
+    code_write_hook_(code_write_context_, phys, size);
+  }
+}
+
 uint32_t MemoryMap::mask_address(uint32_t addr) const {
   return addr & 0x1FFFFFFF;
 }
 
 uint8_t MemoryMap::read8(uint32_t addr) const {
   uint32_t phys = mask_address(addr);
-  if (phys < kRamMirrorLimit) {
-    return ram_[phys & (kRamSize - 1)];
-  }
-  if (phys >= 0x1F800000 && phys < 0x1F800000 + kScratchpadSize) {
-    return scratchpad_[phys - 0x1F800000];
-  }
-  if (phys >= 0x1FC00000 && phys < 0x1FC00000 + BiosImage::kExpectedSize && bios_) {
-    return bios_->read8(phys - 0x1FC00000);
+  const uint8_t *page = read_pages_[phys >> kPageShift];
+  if (page) {
+    return page[phys & kPageMask];
   }
   if (phys >= 0x1F801000 && phys < 0x1F803000 && mmio_) {
+    io_accessed_ = 1;
     return mmio_->read8(phys);
   }
   return 0xFF;
 }
 
 uint16_t MemoryMap::read16(uint32_t addr) const {
+  uint32_t phys = mask_address(addr);
+  const uint8_t *page = read_pages_[phys >> kPageShift];
+  if (page && (phys & 1) == 0) {
+    uint16_t value;
+    std::memcpy(&value, page + (phys & kPageMask), sizeof(value));
+    return value;
+  }
+  return slow_read16(addr);
+}
+
+uint32_t MemoryMap::read32(uint32_t addr) const {
+  uint32_t phys = mask_address(addr);
+  const uint8_t *page = read_pages_[phys >> kPageShift];
+  if (page && (phys & 3) == 0) {
+    uint32_t value;
+    std::memcpy(&value, page + (phys & kPageMask), sizeof(value));
+    return value;
+  }
+  return slow_read32(addr);
+}
+
+uint16_t MemoryMap::slow_read16(uint32_t addr) const {
   uint32_t phys = mask_address(addr);
   if (phys >= 0x1F801000 && phys < 0x1F803000 && mmio_) {
+    io_accessed_ = 1;
     return mmio_->read16(phys);
   }
   uint16_t lo = read8(addr);
@@ -77,9 +298,10 @@ uint16_t MemoryMap::read16(uint32_t addr) const {
   return static_cast<uint16_t>(lo | (hi << 8));
 }
 
-uint32_t MemoryMap::read32(uint32_t addr) const {
+uint32_t MemoryMap::slow_read32(uint32_t addr) const {
   uint32_t phys = mask_address(addr);
   if (phys >= 0x1F801000 && phys < 0x1F803000 && mmio_) {
+    io_accessed_ = 1;
     return mmio_->read32(phys);
   }
   uint32_t b0 = read8(addr);
@@ -91,138 +313,115 @@ uint32_t MemoryMap::read32(uint32_t addr) const {
 
 void MemoryMap::write8(uint32_t addr, uint8_t value) {
   uint32_t phys = mask_address(addr);
-  static bool watch_init = false;
-  static bool watch_enabled = false;
-  static uint32_t watch_start = 0;
-  static uint32_t watch_end = 0;
-  if (!watch_init) {
-    watch_init = true;
-    const char *env = std::getenv("PS1EMU_WATCH_PHYS");
-    if (env && *env) {
-      std::string spec(env);
-      size_t colon = spec.find(':');
-      try {
-        if (colon == std::string::npos) {
-          uint32_t addr_val = static_cast<uint32_t>(std::stoul(spec, nullptr, 0));
-          watch_start = addr_val;
-          watch_end = addr_val;
-        } else {
-          watch_start = static_cast<uint32_t>(std::stoul(spec.substr(0, colon), nullptr, 0));
-          watch_end = static_cast<uint32_t>(std::stoul(spec.substr(colon + 1), nullptr, 0));
-        }
-        watch_enabled = true;
-      } catch (...) {
-        watch_enabled = false;
-      }
+  uint8_t *page = write_pages_[phys >> kPageShift];
+  if (page) {
+    page[phys & kPageMask] = value;
+    return;
+  }
+  slow_write8(addr, value);
+}
+
+void MemoryMap::write16(uint32_t addr, uint16_t value) {
+  uint32_t phys = mask_address(addr);
+  uint8_t *page = write_pages_[phys >> kPageShift];
+  if (page && (phys & 1) == 0) {
+    std::memcpy(page + (phys & kPageMask), &value, sizeof(value));
+    return;
+  }
+  slow_write16(addr, value);
+}
+
+void MemoryMap::write32(uint32_t addr, uint32_t value) {
+  uint32_t phys = mask_address(addr);
+  uint8_t *page = write_pages_[phys >> kPageShift];
+  if (page && (phys & 3) == 0) {
+    std::memcpy(page + (phys & kPageMask), &value, sizeof(value));
+    return;
+  }
+  slow_write32(addr, value);
+}
+
+void MemoryMap::dma_write_words(uint32_t addr, const uint32_t *words, size_t count) {
+  uint32_t offset = mask_address(addr) & static_cast<uint32_t>(kRamSize - 1) & ~3u;
+  if (phys_watch().enabled) {
+    for (size_t i = 0; i < count; ++i) {
+      write32(offset, words[i]);
+      offset = (offset + 4) & static_cast<uint32_t>(kRamSize - 1);
     }
+    return;
   }
-  if (watch_enabled && phys >= watch_start && phys <= watch_end) {
-    std::ostringstream oss;
-    oss << std::hex << std::setfill('0');
-    oss << "[watch-phys] SB vaddr=0x" << std::setw(8) << addr;
-    oss << " paddr=0x" << std::setw(8) << phys;
-    oss << " value=0x" << std::setw(2) << static_cast<uint32_t>(value) << "\n";
-    std::cerr << oss.str();
+  while (count > 0) {
+    uint32_t page_end = (offset | kPageMask) + 1;
+    size_t chunk = std::min<size_t>(count, (page_end - offset) / 4);
+    std::memcpy(ram_ + offset, words, chunk * 4);
+    if (code_pages_[offset >> kCodePageShift]) {
+      notify_code_write(offset, static_cast<uint32_t>(chunk * 4));
+    }
+    words += chunk;
+    count -= chunk;
+    offset = page_end & static_cast<uint32_t>(kRamSize - 1);
   }
+}
+
+void MemoryMap::slow_write8(uint32_t addr, uint8_t value) {
+  uint32_t phys = mask_address(addr);
+  maybe_log_phys_write("SB", addr, phys, value, 2);
   if (phys < kRamMirrorLimit) {
-    ram_[phys & (kRamSize - 1)] = value;
+    uint32_t offset = phys & (kRamSize - 1);
+    ram_[offset] = value;
+    if (code_pages_[offset >> kCodePageShift]) {
+      notify_code_write(offset, 1);
+    }
     return;
   }
-  if (phys >= 0x1F800000 && phys < 0x1F800000 + kScratchpadSize) {
-    scratchpad_[phys - 0x1F800000] = value;
+  if (phys >= kScratchpadBase && phys < kScratchpadBase + kScratchpadSize) {
+    scratchpad_[phys - kScratchpadBase] = value;
     return;
   }
   if (phys >= 0x1F801000 && phys < 0x1F803000 && mmio_) {
+    io_accessed_ = 1;
     mmio_->write8(phys, value);
   }
 }
 
-void MemoryMap::write16(uint32_t addr, uint16_t value) {
+void MemoryMap::slow_write16(uint32_t addr, uint16_t value) {
   uint32_t phys = mask_address(addr);
-  static bool watch_init = false;
-  static bool watch_enabled = false;
-  static uint32_t watch_start = 0;
-  static uint32_t watch_end = 0;
-  if (!watch_init) {
-    watch_init = true;
-    const char *env = std::getenv("PS1EMU_WATCH_PHYS");
-    if (env && *env) {
-      std::string spec(env);
-      size_t colon = spec.find(':');
-      try {
-        if (colon == std::string::npos) {
-          uint32_t addr_val = static_cast<uint32_t>(std::stoul(spec, nullptr, 0));
-          watch_start = addr_val;
-          watch_end = addr_val;
-        } else {
-          watch_start = static_cast<uint32_t>(std::stoul(spec.substr(0, colon), nullptr, 0));
-          watch_end = static_cast<uint32_t>(std::stoul(spec.substr(colon + 1), nullptr, 0));
-        }
-        watch_enabled = true;
-      } catch (...) {
-        watch_enabled = false;
-      }
-    }
-  }
-  if (watch_enabled && phys >= watch_start && phys <= watch_end) {
-    std::ostringstream oss;
-    oss << std::hex << std::setfill('0');
-    oss << "[watch-phys] SH vaddr=0x" << std::setw(8) << addr;
-    oss << " paddr=0x" << std::setw(8) << phys;
-    oss << " value=0x" << std::setw(4) << static_cast<uint32_t>(value) << "\n";
-    std::cerr << oss.str();
-  }
+  maybe_log_phys_write("SH", addr, phys, value, 4);
   if (phys >= 0x1F801000 && phys < 0x1F803000 && mmio_) {
+    io_accessed_ = 1;
     mmio_->write16(phys, value);
     return;
   }
-  write8(addr, static_cast<uint8_t>(value & 0xFF));
-  write8(addr + 1, static_cast<uint8_t>((value >> 8) & 0xFF));
+  slow_write8(addr, static_cast<uint8_t>(value & 0xFF));
+  slow_write8(addr + 1, static_cast<uint8_t>((value >> 8) & 0xFF));
 }
 
-void MemoryMap::write32(uint32_t addr, uint32_t value) {
+void MemoryMap::slow_write32(uint32_t addr, uint32_t value) {
   uint32_t phys = mask_address(addr);
-  static bool watch_init = false;
-  static bool watch_enabled = false;
-  static uint32_t watch_start = 0;
-  static uint32_t watch_end = 0;
-  if (!watch_init) {
-    watch_init = true;
-    const char *env = std::getenv("PS1EMU_WATCH_PHYS");
-    if (env && *env) {
-      std::string spec(env);
-      size_t colon = spec.find(':');
-      try {
-        if (colon == std::string::npos) {
-          uint32_t addr_val = static_cast<uint32_t>(std::stoul(spec, nullptr, 0));
-          watch_start = addr_val;
-          watch_end = addr_val;
-        } else {
-          watch_start = static_cast<uint32_t>(std::stoul(spec.substr(0, colon), nullptr, 0));
-          watch_end = static_cast<uint32_t>(std::stoul(spec.substr(colon + 1), nullptr, 0));
-        }
-        watch_enabled = true;
-      } catch (...) {
-        watch_enabled = false;
-      }
-    }
-  }
-  if (watch_enabled && phys >= watch_start && phys <= watch_end) {
-    std::ostringstream oss;
-    oss << std::hex << std::setfill('0');
-    oss << "[watch-phys] SW vaddr=0x" << std::setw(8) << addr;
-    oss << " paddr=0x" << std::setw(8) << phys;
-    oss << " value=0x" << std::setw(8) << value << "\n";
-    std::cerr << oss.str();
-  }
+  maybe_log_phys_write("SW", addr, phys, value, 8);
   if (phys >= 0x1F801000 && phys < 0x1F803000 && mmio_) {
+    io_accessed_ = 1;
     mmio_->write32(phys, value);
     return;
   }
-  write8(addr, static_cast<uint8_t>(value & 0xFF));
-  write8(addr + 1, static_cast<uint8_t>((value >> 8) & 0xFF));
-  write8(addr + 2, static_cast<uint8_t>((value >> 16) & 0xFF));
-  write8(addr + 3, static_cast<uint8_t>((value >> 24) & 0xFF));
+  if ((phys & 3) == 0 && !phys_watch().enabled) {
+    if (phys < kRamMirrorLimit) {
+      uint32_t offset = phys & (kRamSize - 1);
+      std::memcpy(ram_ + offset, &value, sizeof(value));
+      if (code_pages_[offset >> kCodePageShift]) {
+        notify_code_write(offset, sizeof(value));
+      }
+      return;
+    }
+    if (phys >= kScratchpadBase && phys < kScratchpadBase + kScratchpadSize) {
+      std::memcpy(scratchpad_ + (phys - kScratchpadBase), &value, sizeof(value));
+      return;
+    }
+  }
+  slow_write8(addr, static_cast<uint8_t>(value & 0xFF));
+  slow_write8(addr + 1, static_cast<uint8_t>((value >> 8) & 0xFF));
+  slow_write8(addr + 2, static_cast<uint8_t>((value >> 16) & 0xFF));
+  slow_write8(addr + 3, static_cast<uint8_t>((value >> 24) & 0xFF));
 }
 
 } // namespace ps1emu
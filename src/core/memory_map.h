@@ -2,10 +2,14 @@
 #define PS1EMU_MEMORY_MAP_H
 
 #include "core/bios.h"
+#include "core/fastmem.h"
 #include "core/mmio.h"
 
 #include <array>
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace ps1emu {
 
@@ -13,13 +17,38 @@ class MemoryMap {
 public:
   static constexpr size_t kRamSize = 2 * 1024 * 1024;
   static constexpr size_t kScratchpadSize = 1024;
+  static constexpr uint32_t kPageShift = 12;
+  static constexpr uint32_t kPageSize = 1u << kPageShift;
+  static constexpr size_t kPageCount = 0x20000000u >> kPageShift;
+  static constexpr uint32_t kCodePageShift = kPageShift;
+  static constexpr size_t kRamCodePages = kRamSize >> kCodePageShift;
+
+  // Called with a physical range whenever memory that was marked as code changes.
+  using CodeWriteHook = void (*)(void *context, uint32_t phys, uint32_t size);
+
+  MemoryMap();
+  MemoryMap(const MemoryMap &) = delete;
+  MemoryMap &operator=(const MemoryMap &) = delete;
 
   void reset();
   void load_bios(const BiosImage &bios);
   void attach_mmio(MmioBus &mmio);
-  bool irq_pending() const;
+  // Routed to the attached MmioBus, now or when one is attached later.
+  void set_irq_line_hook(void (*hook)(void *context, bool asserted), void *context);
   uint16_t irq_stat() const;
   uint16_t irq_mask() const;
+  uint64_t device_activity() const;
+  void set_code_write_hook(CodeWriteHook hook, void *context);
+  void mark_code_page(uint32_t addr);
+  // Moves RAM into a fastmem arena; false (with the reason) leaves the
+  // page-table path in place.
+  bool enable_fastmem(std::string &error);
+  void disable_fastmem();
+  // Host address of guest virtual address 0, or null without fastmem.
+  uint8_t *fastmem_base() const;
+  // Set by every MMIO access; linked dynarec blocks stop chaining once it is.
+  const uint8_t *io_access_flag() const { return &io_accessed_; }
+  void clear_io_access_flag() { io_accessed_ = 0; }
 
   uint8_t read8(uint32_t addr) const;
   uint16_t read16(uint32_t addr) const;
@@ -28,14 +57,42 @@ public:
   void write8(uint32_t addr, uint8_t value);
   void write16(uint32_t addr, uint16_t value);
   void write32(uint32_t addr, uint32_t value);
+  // DMA into RAM: stores ascending words from addr (wrapping at 2 MiB) and
+  // reports each touched code page once instead of per word.
+  void dma_write_words(uint32_t addr, const uint32_t *words, size_t count);
 
 private:
   uint32_t mask_address(uint32_t addr) const;
+  void notify_code_write(uint32_t phys, uint32_t size);
+  void map_pages();
+  void map_ram_write_page(size_t ram_page, bool direct);
+  void copy_bios_to_fastmem();
+  uint16_t slow_read16(uint32_t addr) const;
+  uint32_t slow_read32(uint32_t addr) const;
+  void slow_write8(uint32_t addr, uint8_t value);
+  void slow_write16(uint32_t addr, uint16_t value);
+  void slow_write32(uint32_t addr, uint32_t value);
 
-  std::array<uint8_t, kRamSize> ram_ {};
-  std::array<uint8_t, kScratchpadSize> scratchpad_ {};
+  // Points at ram_storage_, or at the fastmem RAM view while it is enabled.
+  std::vector<uint8_t> ram_storage_;
+  uint8_t *ram_ = nullptr;
+  std::unique_ptr<Fastmem> fastmem_;
+  // Backs the whole 4 KiB scratchpad page so it can be mapped directly for
+  // reads; bytes past kScratchpadSize stay 0xFF and writes there are dropped.
+  std::array<uint8_t, kPageSize> scratchpad_storage_ {};
+  // Points at scratchpad_storage_, or at the fastmem scratchpad page.
+  uint8_t *scratchpad_ = nullptr;
   const BiosImage *bios_ = nullptr;
   MmioBus *mmio_ = nullptr;
+  std::array<uint8_t, kRamCodePages> code_pages_ {};
+  CodeWriteHook code_write_hook_ = nullptr;
+  void *code_write_context_ = nullptr;
+  void (*irq_line_hook_)(void *context, bool asserted) = nullptr;
+  void *irq_line_context_ = nullptr;
+  // Physical 4 KiB page -> host memory; null pages take the slow handlers.
+  std::vector<const uint8_t *> read_pages_;
+  std::vector<uint8_t *> write_pages_;
+  mutable uint8_t io_accessed_ = 0;
 };
 
 } // namespace ps1emu
@@ -35,188 +35,143 @@ static constexpr uint32_t kSpuCtrlAddr = 0x1F801DAA;
 static constexpr uint32_t kSpuStatAddr = 0x1F801DAE;
 
 void MmioBus::reset() {
+  events_.reset();
+  attention_ = false;
   std::memset(raw_.data(), 0, raw_.size());
-  gpu_gp1_fifo_.clear();
+  irq_.stat = 0;
+  irq_.mask = 0;
+  dma_ = DmaController{};
+  timers_ = RootCounters{};
+  gpu_ = GpuStatus{};
   reset_gpu_state();
-  irq_stat_ = 0;
-  irq_mask_ = 0;
-  std::memset(dma_madr_, 0, sizeof(dma_madr_));
-  std::memset(dma_bcr_, 0, sizeof(dma_bcr_));
-  std::memset(dma_chcr_, 0, sizeof(dma_chcr_));
-  dma_dpcr_ = 0;
-  dma_dicr_ = 0;
-  std::memset(timer_count_, 0, sizeof(timer_count_));
-  std::memset(timer_mode_, 0, sizeof(timer_mode_));
-  std::memset(timer_target_, 0, sizeof(timer_target_));
-  std::memset(timer_cycle_accum_, 0, sizeof(timer_cycle_accum_));
-  std::memset(timer_sync_waiting_, 0, sizeof(timer_sync_waiting_));
-  gpu_line_cycle_accum_ = 0;
-  gpu_line_ = 0;
-  std::memset(spu_regs_.data(), 0, spu_regs_.size() * sizeof(uint16_t));
-  std::memset(cdrom_regs_.data(), 0, cdrom_regs_.size());
-  cdrom_param_fifo_.clear();
-  cdrom_response_fifo_.clear();
-  cdrom_data_fifo_.clear();
-  cdrom_xa_audio_queue_.clear();
-  cdrom_pending_.clear();
-  cdrom_irq_queue_.clear();
-  cdrom_index_ = 0;
-  cdrom_status_ = 0;
-  cdrom_irq_flags_ = 0;
-  cdrom_irq_enable_ = 0;
-  cdrom_request_ = 0;
-  cdrom_vol_ll_ = 0;
-  cdrom_vol_lr_ = 0;
-  cdrom_vol_rl_ = 0;
-  cdrom_vol_rr_ = 0;
-  cdrom_vol_apply_ = 0;
-  cdrom_mode_ = 0;
-  cdrom_filter_file_ = 0;
-  cdrom_filter_channel_ = 0;
-  cdrom_session_ = 1;
-  cdrom_error_ = false;
-  cdrom_reading_ = false;
-  cdrom_playing_ = false;
-  cdrom_muted_ = false;
-  cdrom_seeking_ = false;
-  cdrom_read_timer_ = 0;
-  cdrom_read_period_ = cdrom_read_period_cycles(cdrom_mode_);
-  cdrom_last_read_lba_ = 0;
-  cdrom_lba_ = 0;
-  cdrom_last_mode_ = 0;
-  cdrom_last_file_ = 0;
-  cdrom_last_channel_ = 0;
-  cdrom_last_submode_ = 0;
-  cdrom_last_coding_ = 0;
-  std::memset(timer_irq_enable_, 0, sizeof(timer_irq_enable_));
-  std::memset(timer_irq_repeat_, 0, sizeof(timer_irq_repeat_));
-  std::memset(timer_irq_on_overflow_, 0, sizeof(timer_irq_on_overflow_));
-  std::memset(timer_irq_on_target_, 0, sizeof(timer_irq_on_target_));
-  std::memset(timer_irq_toggle_, 0, sizeof(timer_irq_toggle_));
-  dma_pending_mask_ = 0;
-  joy_mode_ = 0;
-  joy_ctrl_ = 0;
-  joy_baud_ = 0;
-  joy_rx_data_ = 0xFF;
-  joy_rx_ready_ = false;
-  joy_ack_ = false;
-  joy_irq_pending_ = false;
-  joy_tx_queue_.clear();
-  joy_tx_delay_cycles_ = 0;
-  joy_rx_delay_cycles_ = 0;
-  joy_ack_cycles_ = 0;
-  joy_rx_pending_ = false;
-  joy_response_queue_.clear();
-  joy_session_active_ = false;
-  joy_phase_ = 0;
-  joy_device_ = 0;
-  sio1_mode_ = 0;
-  sio1_ctrl_ = 0;
-  sio1_baud_ = 0;
-  sio1_misc_ = 0;
-  sio1_rx_data_ = 0xFF;
-  sio1_rx_ready_ = false;
-  spu_ctrl_ = 0;
+  schedule_event(gpu_.line_event, line_period(), kEventHblank);
+  cdrom_ = CdromController{};
+  cdrom_.read_period = cdrom_read_period_cycles(cdrom_.mode);
+  joy_ = JoypadPort{};
+  sio1_ = SioPort{};
+  spu_ = SpuRegs{};
+  sync_irq_line();
+}
+
+void MmioBus::set_irq_line_hook(IrqLineHook hook, void *context) {
+  irq_.line_hook = hook;
+  irq_.line_context = context;
+  if (irq_.line_hook) {
+    irq_.line_hook(irq_.line_context, irq_.line);
+  }
+}
+
+// I_STAT and I_MASK only change inside public entry points, so each of those
+// that can touch them ends here.
+void MmioBus::sync_irq_line() {
+  bool line = (irq_.stat & irq_.mask) != 0;
+  if (line == irq_.line) {
+    return;
+  }
+  irq_.line = line;
+  if (irq_.line_hook) {
+    irq_.line_hook(irq_.line_context, line);
+  }
 }
 
 void MmioBus::reset_gpu_state() {
-  gpu_gp0_ = 0;
-  gpu_gp1_ = 0x14802000;
-  gpu_gp0_fifo_.clear();
-  gpu_read_fifo_.clear();
-  gpu_read_latch_ = 0;
-  gpu_read_pending_.clear();
-  gpu_read_pending_delay_ = 0;
-  gpu_texpage_x_ = 0;
-  gpu_texpage_y_ = 0;
-  gpu_semi_ = 0;
-  gpu_tex_depth_ = 0;
-  gpu_dither_ = false;
-  gpu_draw_to_display_ = false;
-  gpu_mask_set_ = false;
-  gpu_mask_eval_ = false;
-  gpu_display_disabled_ = true;
-  gpu_irq_ = false;
-  gpu_interlace_ = false;
-  gpu_flip_ = false;
-  gpu_hres2_ = false;
-  gpu_hres1_ = 0;
-  gpu_vres_ = false;
-  gpu_vmode_pal_ = false;
-  gpu_display_depth24_ = false;
-  gpu_dma_dir_ = 0;
-  gpu_field_ = false;
-  gpu_field_cycle_accum_ = 0;
-  gpu_busy_cycles_ = 0;
-  gpu_display_x_ = 0;
-  gpu_display_y_ = 0;
-  gpu_h_range_start_ = 0x200;
-  gpu_h_range_end_ = static_cast<uint16_t>(0x200 + 256 * 10);
-  gpu_v_range_start_ = 0x10;
-  gpu_v_range_end_ = static_cast<uint16_t>(0x10 + 240);
-  gpu_tex_window_ = 0;
-  gpu_draw_area_tl_ = 0;
-  gpu_draw_area_br_ = (0x3FFu) | (0x1FFu << 10);
-  gpu_draw_offset_ = 0;
-  irq_stat_ &= static_cast<uint16_t>(~(1u << 1));
+  gpu_.gp0 = 0;
+  gpu_.gp1 = 0x14802000;
+  gpu_.gp0_fifo.clear();
+  gpu_.read_fifo.clear();
+  gpu_.read_latch = 0;
+  gpu_.read_pending.clear();
+  cancel_event(gpu_.read_event);
+  gpu_.texpage_x = 0;
+  gpu_.texpage_y = 0;
+  gpu_.semi = 0;
+  gpu_.tex_depth = 0;
+  gpu_.dither = false;
+  gpu_.draw_to_display = false;
+  gpu_.mask_set = false;
+  gpu_.mask_eval = false;
+  gpu_.display_disabled = true;
+  gpu_.irq = false;
+  gpu_.interlace = false;
+  gpu_.flip = false;
+  gpu_.hres2 = false;
+  gpu_.hres1 = 0;
+  gpu_.vres = false;
+  gpu_.vmode_pal = false;
+  gpu_.display_depth24 = false;
+  gpu_.dma_dir = 0;
+  gpu_.field = false;
+  gpu_.busy_until = 0;
+  gpu_.display_x = 0;
+  gpu_.display_y = 0;
+  gpu_.h_range_start = 0x200;
+  gpu_.h_range_end = static_cast<uint16_t>(0x200 + 256 * 10);
+  gpu_.v_range_start = 0x10;
+  gpu_.v_range_end = static_cast<uint16_t>(0x10 + 240);
+  gpu_.tex_window = 0;
+  gpu_.draw_area_tl = 0;
+  gpu_.draw_area_br = (0x3FFu) | (0x1FFu << 10);
+  gpu_.draw_offset = 0;
+  irq_.stat &= static_cast<uint16_t>(~(1u << 1));
+  schedule_event(gpu_.field_event, frame_period(), kEventVblank);
 }
 
 uint32_t MmioBus::compute_gpustat() const {
   constexpr size_t kGpuFifoLimit = 16;
   uint32_t stat = 0;
-  stat |= (gpu_texpage_x_ & 0xFu);
-  stat |= (gpu_texpage_y_ & 0x1u) << 4;
-  stat |= (gpu_semi_ & 0x3u) << 5;
-  stat |= (gpu_tex_depth_ & 0x3u) << 7;
-  if (gpu_dither_) {
+  stat |= (gpu_.texpage_x & 0xFu);
+  stat |= (gpu_.texpage_y & 0x1u) << 4;
+  stat |= (gpu_.semi & 0x3u) << 5;
+  stat |= (gpu_.tex_depth & 0x3u) << 7;
+  if (gpu_.dither) {
     stat |= (1u << 9);
   }
-  if (gpu_draw_to_display_) {
+  if (gpu_.draw_to_display) {
     stat |= (1u << 10);
   }
-  if (gpu_mask_set_) {
+  if (gpu_.mask_set) {
     stat |= (1u << 11);
   }
-  if (gpu_mask_eval_) {
+  if (gpu_.mask_eval) {
     stat |= (1u << 12);
   }
-  uint32_t field = gpu_field_ ? 1u : 0u;
-  uint32_t interlace_field = gpu_interlace_ ? field : 1u;
+  uint32_t field = gpu_.field ? 1u : 0u;
+  uint32_t interlace_field = gpu_.interlace ? field : 1u;
   if (interlace_field) {
     stat |= (1u << 13);
   }
-  if (gpu_flip_) {
+  if (gpu_.flip) {
     stat |= (1u << 14);
   }
-  stat |= ((gpu_texpage_y_ >> 1) & 0x1u) << 15;
-  if (gpu_hres2_) {
+  stat |= ((gpu_.texpage_y >> 1) & 0x1u) << 15;
+  if (gpu_.hres2) {
     stat |= (1u << 16);
   }
-  stat |= (gpu_hres1_ & 0x3u) << 17;
-  if (gpu_vres_) {
+  stat |= (gpu_.hres1 & 0x3u) << 17;
+  if (gpu_.vres) {
     stat |= (1u << 19);
   }
-  if (gpu_vmode_pal_) {
+  if (gpu_.vmode_pal) {
     stat |= (1u << 20);
   }
-  if (gpu_display_depth24_) {
+  if (gpu_.display_depth24) {
     stat |= (1u << 21);
   }
-  if (gpu_interlace_) {
+  if (gpu_.interlace) {
     stat |= (1u << 22);
   }
-  if (gpu_display_disabled_) {
+  if (gpu_.display_disabled) {
     stat |= (1u << 23);
   }
-  if (gpu_irq_) {
+  if (gpu_.irq) {
     stat |= (1u << 24);
   }
 
-  bool fifo_space = gpu_gp0_fifo_.size() < kGpuFifoLimit;
+  bool fifo_space = gpu_.gp0_fifo.size() < kGpuFifoLimit;
   bool ready_cmd = fifo_space;
-  bool ready_vram_to_cpu = !gpu_read_fifo_.empty();
+  bool ready_vram_to_cpu = !gpu_.read_fifo.empty();
   bool ready_dma_block = true;
-  switch (gpu_dma_dir_ & 0x3u) {
+  switch (gpu_.dma_dir & 0x3u) {
     case 1:
       ready_dma_block = fifo_space;
       break;
@@ -240,13 +195,13 @@ uint32_t MmioBus::compute_gpustat() const {
   if (ready_dma_block) {
     stat |= (1u << 28);
   }
-  stat |= (gpu_dma_dir_ & 0x3u) << 29;
+  stat |= (gpu_.dma_dir & 0x3u) << 29;
   if (field) {
     stat |= (1u << 31);
   }
 
   uint32_t dma_req = 0;
-  switch (gpu_dma_dir_ & 0x3u) {
+  switch (gpu_.dma_dir & 0x3u) {
     case 0:
       dma_req = 0;
       break;
@@ -425,11 +380,11 @@ static constexpr uint32_t kJoyRxDelayCycles = 64;
 static constexpr uint32_t kJoyAckPulseCycles = 96;
 
 void MmioBus::cdrom_push_response(uint8_t value) {
-  cdrom_response_fifo_.push_back(value);
+  cdrom_.response_fifo.push_back(value);
 }
 
 void MmioBus::cdrom_push_response_block(const std::vector<uint8_t> &values) {
-  cdrom_response_fifo_.insert(cdrom_response_fifo_.end(), values.begin(), values.end());
+  cdrom_.response_fifo.insert(cdrom_.response_fifo.end(), values.begin(), values.end());
 }
 
 void MmioBus::cdrom_queue_response(uint32_t delay_cycles,
@@ -441,7 +396,11 @@ void MmioBus::cdrom_queue_response(uint32_t delay_cycles,
   pending.irq_flags = irq_flags;
   pending.response = std::move(response);
   pending.clear_seeking = clear_seeking;
-  cdrom_pending_.push_back(std::move(pending));
+  bool idle = cdrom_.pending.empty();
+  cdrom_.pending.push_back(std::move(pending));
+  if (idle) {
+    schedule_event(cdrom_.response_event, delay_cycles, kEventCdromResponse);
+  }
 }
 
 void MmioBus::cdrom_raise_irq(uint8_t flags) {
@@ -449,24 +408,24 @@ void MmioBus::cdrom_raise_irq(uint8_t flags) {
   if (masked == 0) {
     return;
   }
-  if (cdrom_irq_flags_ != 0) {
-    cdrom_irq_queue_.push_back(masked);
+  if (cdrom_.irq_flags != 0) {
+    cdrom_.irq_queue.push_back(masked);
     return;
   }
-  cdrom_irq_flags_ = masked;
+  cdrom_.irq_flags = masked;
   cdrom_update_irq_line();
 }
 
 void MmioBus::cdrom_update_irq_line() {
-  if ((cdrom_irq_flags_ & cdrom_irq_enable_) != 0) {
-    irq_stat_ |= (1u << 2);
+  if ((cdrom_.irq_flags & cdrom_.irq_enable) != 0) {
+    irq_.stat |= (1u << 2);
   } else {
-    irq_stat_ &= static_cast<uint16_t>(~(1u << 2));
+    irq_.stat &= static_cast<uint16_t>(~(1u << 2));
   }
 }
 
 void MmioBus::cdrom_set_irq_enable(uint8_t enable) {
-  cdrom_irq_enable_ = static_cast<uint8_t>(enable & 0x1Fu);
+  cdrom_.irq_enable = static_cast<uint8_t>(enable & 0x1Fu);
   cdrom_update_irq_line();
 }
 
@@ -544,44 +503,44 @@ static std::vector<uint8_t> cdrom_build_whole_sector(const std::vector<uint8_t>
 
 
 void MmioBus::cdrom_maybe_fill_data() {
-  if (!cdrom_reading_ || cdrom_error_ || !cdrom_image_.loaded()) {
+  if (!cdrom_.reading || cdrom_.error || !cdrom_image_.loaded()) {
     return;
   }
-  if (!cdrom_data_fifo_.empty()) {
+  if (!cdrom_.data_fifo.empty()) {
     return;
   }
-  if (cdrom_read_timer_ > 0) {
+  if (cdrom_.read_timer > 0) {
     return;
   }
   CdromFillResult result = cdrom_fill_data_fifo();
   if (result == CdromFillResult::Delivered) {
-    cdrom_read_timer_ = std::max(1u, cdrom_read_period_);
+    cdrom_.read_timer = std::max(1u, cdrom_.read_period);
     cdrom_raise_irq(0x02);
   } else if (result == CdromFillResult::Skipped) {
-    cdrom_read_timer_ = std::max(1u, cdrom_read_period_);
+    cdrom_.read_timer = std::max(1u, cdrom_.read_period);
   }
 }
 
 MmioBus::CdromFillResult MmioBus::cdrom_fill_data_fifo() {
   constexpr size_t kMaxXaQueue = 64;
   std::vector<uint8_t> raw;
-  if (!cdrom_image_.read_sector_raw(cdrom_lba_, raw)) {
-    cdrom_error_ = true;
+  if (!cdrom_image_.read_sector_raw(cdrom_.lba, raw)) {
+    cdrom_.error = true;
     return CdromFillResult::Error;
   }
 
   CdromSectorMeta meta = cdrom_parse_sector(raw);
-  cdrom_last_read_lba_ = cdrom_lba_;
-  cdrom_last_mode_ = meta.mode;
-  cdrom_last_file_ = meta.file;
-  cdrom_last_channel_ = meta.channel;
-  cdrom_last_submode_ = meta.submode;
-  cdrom_last_coding_ = meta.coding;
-
-  bool filter_enabled = (cdrom_mode_ & 0x08u) != 0;
-  bool adpcm_enabled = (cdrom_mode_ & 0x40u) != 0;
-  bool whole_sector = (cdrom_mode_ & 0x20u) != 0;
-  bool filter_match = (meta.file == cdrom_filter_file_) && (meta.channel == cdrom_filter_channel_);
+  cdrom_.last_read_lba = cdrom_.lba;
+  cdrom_.last_mode = meta.mode;
+  cdrom_.last_file = meta.file;
+  cdrom_.last_channel = meta.channel;
+  cdrom_.last_submode = meta.submode;
+  cdrom_.last_coding = meta.coding;
+
+  bool filter_enabled = (cdrom_.mode & 0x08u) != 0;
+  bool adpcm_enabled = (cdrom_.mode & 0x40u) != 0;
+  bool whole_sector = (cdrom_.mode & 0x20u) != 0;
+  bool filter_match = (meta.file == cdrom_.filter_file) && (meta.channel == cdrom_.filter_channel);
 
   if (meta.is_xa && meta.xa_audio) {
     bool queue_audio = adpcm_enabled && (!filter_enabled || filter_match);
@@ -595,7 +554,7 @@ MmioBus::CdromFillResult MmioBus::cdrom_fill_data_fifo() {
         data_size = static_cast<uint32_t>(raw.size() - data_offset);
       }
       XaAudioSector sector;
-      sector.lba = cdrom_lba_;
+      sector.lba = cdrom_.lba;
       sector.mode = meta.mode;
       sector.file = meta.file;
       sector.channel = meta.channel;
@@ -603,31 +562,32 @@ MmioBus::CdromFillResult MmioBus::cdrom_fill_data_fifo() {
       sector.coding = meta.coding;
       sector.data.assign(raw.begin() + static_cast<long>(data_offset),
                          raw.begin() + static_cast<long>(data_offset + data_size));
-      if (cdrom_xa_audio_queue_.size() >= kMaxXaQueue) {
-        cdrom_xa_audio_queue_.pop_front();
+      if (cdrom_.xa_audio_queue.size() >= kMaxXaQueue) {
+        cdrom_.xa_audio_queue.pop_front();
       }
-      cdrom_xa_audio_queue_.push_back(std::move(sector));
-      cdrom_lba_ += 1;
+      cdrom_.xa_audio_queue.push_back(std::move(sector));
+      attention_ = true;
+      cdrom_.lba += 1;
       return CdromFillResult::Skipped;
     }
     if (filter_enabled) {
-      cdrom_lba_ += 1;
+      cdrom_.lba += 1;
       return CdromFillResult::Skipped;
     }
   }
   if (filter_enabled && meta.is_xa && !filter_match) {
-    cdrom_lba_ += 1;
+    cdrom_.lba += 1;
     return CdromFillResult::Skipped;
   }
 
   if (whole_sector) {
     if (raw.size() >= 12) {
-      cdrom_data_fifo_.assign(raw.begin() + 12, raw.end());
+      cdrom_.data_fifo.assign(raw.begin() + 12, raw.end());
     } else {
-      cdrom_data_fifo_ = cdrom_build_whole_sector(raw, cdrom_lba_, meta.mode, meta.mode == 2);
+      cdrom_.data_fifo = cdrom_build_whole_sector(raw, cdrom_.lba, meta.mode, meta.mode == 2);
     }
     if (raw.size() == 2048) {
-      cdrom_data_fifo_ = cdrom_build_whole_sector(raw, cdrom_lba_, meta.mode, meta.mode == 2);
+      cdrom_.data_fifo = cdrom_build_whole_sector(raw, cdrom_.lba, meta.mode, meta.mode == 2);
     }
   } else {
     uint32_t data_offset = meta.data_offset;
@@ -638,32 +598,32 @@ MmioBus::CdromFillResult MmioBus::cdrom_fill_data_fifo() {
     if (raw.size() < data_offset + data_size) {
       data_size = static_cast<uint32_t>(raw.size() - data_offset);
     }
-    cdrom_data_fifo_.assign(raw.begin() + static_cast<long>(data_offset),
+    cdrom_.data_fifo.assign(raw.begin() + static_cast<long>(data_offset),
                             raw.begin() + static_cast<long>(data_offset + data_size));
   }
 
-  cdrom_lba_ += 1;
-  return cdrom_data_fifo_.empty() ? CdromFillResult::Skipped : CdromFillResult::Delivered;
+  cdrom_.lba += 1;
+  return cdrom_.data_fifo.empty() ? CdromFillResult::Skipped : CdromFillResult::Delivered;
 }
 
 uint8_t MmioBus::cdrom_status() const {
-  bool data_ready = !cdrom_data_fifo_.empty() && (cdrom_request_ & 0x01u);
-  bool response_ready = !cdrom_response_fifo_.empty();
+  bool data_ready = !cdrom_.data_fifo.empty() && (cdrom_.request & 0x01u);
+  bool response_ready = !cdrom_.response_fifo.empty();
   bool ready = data_ready || response_ready;
   return cdrom_status_byte(cdrom_image_.loaded(),
-                           cdrom_reading_,
+                           cdrom_.reading,
                            ready,
-                           cdrom_error_,
-                           cdrom_playing_,
-                           cdrom_seeking_);
+                           cdrom_.error,
+                           cdrom_.playing,
+                           cdrom_.seeking);
 }
 
 uint16_t MmioBus::joy_status() const {
   uint16_t status = static_cast<uint16_t>(kJoyStatTxReady | kJoyStatTxEmpty);
-  if (joy_rx_ready_) {
+  if (joy_.rx_ready) {
     status |= kJoyStatRxReady;
   }
-  if ((joy_rx_ready_ || joy_ack_) && (joy_ctrl_ & kJoyCtrlDtr)) {
+  if ((joy_.rx_ready || joy_.ack) && (joy_.ctrl & kJoyCtrlDtr)) {
     status |= kJoyStatDsr;
   }
   return status;
@@ -671,7 +631,7 @@ uint16_t MmioBus::joy_status() const {
 
 uint16_t MmioBus::sio1_status() const {
   uint16_t status = static_cast<uint16_t>(kJoyStatTxReady | kJoyStatTxEmpty);
-  if (sio1_rx_ready_) {
+  if (sio1_.rx_ready) {
     status |= kJoyStatRxReady;
   }
   status |= static_cast<uint16_t>(1u << 7); // DSR/CTS high
@@ -680,7 +640,7 @@ uint16_t MmioBus::sio1_status() const {
 }
 
 uint16_t MmioBus::spu_status() const {
-  uint16_t ctrl = spu_ctrl_;
+  uint16_t ctrl = spu_.ctrl;
   uint16_t status = static_cast<uint16_t>(ctrl & 0x3Fu);
   if (ctrl & (1u << 5)) {
     status |= static_cast<uint16_t>(1u << 7);
@@ -706,11 +666,11 @@ static uint32_t cdrom_read_period_cycles(uint8_t mode) {
 }
 
 void MmioBus::cdrom_execute_command(uint8_t cmd) {
-  std::vector<uint8_t> params = cdrom_param_fifo_;
-  cdrom_param_fifo_.clear();
+  std::vector<uint8_t> params = cdrom_.param_fifo;
+  cdrom_.param_fifo.clear();
 
-  cdrom_error_ = false;
-  cdrom_response_fifo_.clear();
+  cdrom_.error = false;
+  cdrom_.response_fifo.clear();
 
   if (cdrom_log_enabled()) {
     std::ostringstream oss;
@@ -750,16 +710,16 @@ void MmioBus::cdrom_execute_command(uint8_t cmd) {
     }
     case 0x02: { // Setloc
       if (params.size() >= 3) {
-        cdrom_lba_ = bcd_to_lba(params[0], params[1], params[2]);
+        cdrom_.lba = bcd_to_lba(params[0], params[1], params[2]);
       } else {
-        cdrom_error_ = true;
+        cdrom_.error = true;
       }
       queue_status(0x01);
       break;
     }
     case 0x03: { // Play
-      cdrom_playing_ = true;
-      cdrom_reading_ = false;
+      cdrom_.playing = true;
+      cdrom_.reading = false;
       queue_status(0x01);
       break;
     }
@@ -770,15 +730,15 @@ void MmioBus::cdrom_execute_command(uint8_t cmd) {
     }
     case 0x06: // ReadN
     case 0x1B: { // ReadS
-      cdrom_reading_ = true;
-      cdrom_playing_ = false;
-      cdrom_seeking_ = false;
-      cdrom_request_ |= 0x01u;
-      cdrom_read_period_ = cdrom_read_period_cycles(cdrom_mode_);
-      cdrom_read_timer_ = std::max(1u, cdrom_read_period_);
-      cdrom_data_fifo_.clear();
+      cdrom_.reading = true;
+      cdrom_.playing = false;
+      cdrom_.seeking = false;
+      cdrom_.request |= 0x01u;
+      cdrom_.read_period = cdrom_read_period_cycles(cdrom_.mode);
+      cdrom_.read_timer = std::max(1u, cdrom_.read_period);
+      cdrom_.data_fifo.clear();
       if (!cdrom_image_.loaded()) {
-        cdrom_error_ = true;
+        cdrom_.error = true;
       }
       queue_status(0x04);
       break;
@@ -788,94 +748,94 @@ void MmioBus::cdrom_execute_command(uint8_t cmd) {
       break;
     }
     case 0x08: { // Stop
-      cdrom_reading_ = false;
-      cdrom_playing_ = false;
-      cdrom_read_timer_ = 0;
-      cdrom_request_ &= static_cast<uint8_t>(~0x01u);
+      cdrom_.reading = false;
+      cdrom_.playing = false;
+      cdrom_.read_timer = 0;
+      cdrom_.request &= static_cast<uint8_t>(~0x01u);
       queue_status(0x01);
       break;
     }
     case 0x09: { // Pause
-      cdrom_reading_ = false;
-      cdrom_playing_ = false;
-      cdrom_read_timer_ = 0;
-      cdrom_request_ &= static_cast<uint8_t>(~0x01u);
+      cdrom_.reading = false;
+      cdrom_.playing = false;
+      cdrom_.read_timer = 0;
+      cdrom_.request &= static_cast<uint8_t>(~0x01u);
       queue_status(0x01);
       break;
     }
     case 0x0A: { // Init
-      cdrom_mode_ = 0;
-      cdrom_reading_ = false;
-      cdrom_playing_ = false;
-      cdrom_muted_ = false;
-      cdrom_seeking_ = false;
-      cdrom_request_ = 0;
-      cdrom_filter_file_ = 0;
-      cdrom_filter_channel_ = 0;
-      cdrom_session_ = 1;
-      cdrom_read_timer_ = 0;
-      cdrom_read_period_ = cdrom_read_period_cycles(cdrom_mode_);
-      cdrom_pending_.clear();
+      cdrom_.mode = 0;
+      cdrom_.reading = false;
+      cdrom_.playing = false;
+      cdrom_.muted = false;
+      cdrom_.seeking = false;
+      cdrom_.request = 0;
+      cdrom_.filter_file = 0;
+      cdrom_.filter_channel = 0;
+      cdrom_.session = 1;
+      cdrom_.read_timer = 0;
+      cdrom_.read_period = cdrom_read_period_cycles(cdrom_.mode);
+      cdrom_clear_pending();
       queue_status(0x01);
       break;
     }
     case 0x0B: { // Mute
-      cdrom_muted_ = true;
+      cdrom_.muted = true;
       queue_status(0x01);
       break;
     }
     case 0x0C: { // Demute
-      cdrom_muted_ = false;
+      cdrom_.muted = false;
       queue_status(0x01);
       break;
     }
     case 0x0D: { // Setfilter
       if (params.size() >= 2) {
-        cdrom_filter_file_ = params[0];
-        cdrom_filter_channel_ = params[1];
+        cdrom_.filter_file = params[0];
+        cdrom_.filter_channel = params[1];
       }
       queue_status(0x01);
       break;
     }
     case 0x0E: { // Setmode
       if (!params.empty()) {
-        cdrom_mode_ = params[0];
+        cdrom_.mode = params[0];
       }
-      cdrom_read_period_ = cdrom_read_period_cycles(cdrom_mode_);
+      cdrom_.read_period = cdrom_read_period_cycles(cdrom_.mode);
       queue_status(0x01);
       break;
     }
     case 0x0F: { // Getparam
       std::vector<uint8_t> response = {
           cdrom_status(),
-          cdrom_mode_,
+          cdrom_.mode,
           0x00,
-          cdrom_filter_file_,
-          cdrom_filter_channel_,
+          cdrom_.filter_file,
+          cdrom_.filter_channel,
       };
       queue_response(0x01, std::move(response));
       break;
     }
     case 0x10: { // GetlocL
       uint8_t mm = 0, ss = 0, ff = 0;
-      lba_to_bcd(cdrom_last_read_lba_, mm, ss, ff);
+      lba_to_bcd(cdrom_.last_read_lba, mm, ss, ff);
       std::vector<uint8_t> response = {
           cdrom_status(),
           mm,
           ss,
           ff,
-          cdrom_last_mode_,
-          cdrom_last_file_,
-          cdrom_last_channel_,
-          cdrom_last_submode_,
-          cdrom_last_coding_,
+          cdrom_.last_mode,
+          cdrom_.last_file,
+          cdrom_.last_channel,
+          cdrom_.last_submode,
+          cdrom_.last_coding,
       };
       queue_response(0x01, std::move(response));
       break;
     }
     case 0x11: { // GetlocP
       uint8_t mm = 0, ss = 0, ff = 0;
-      lba_to_bcd(cdrom_last_read_lba_, mm, ss, ff);
+      lba_to_bcd(cdrom_.last_read_lba, mm, ss, ff);
       std::vector<uint8_t> response = {
           cdrom_status(),
           0x01,
@@ -892,7 +852,7 @@ void MmioBus::cdrom_execute_command(uint8_t cmd) {
     }
     case 0x12: { // SetSession
       if (!params.empty()) {
-        cdrom_session_ = params[0];
+        cdrom_.session = params[0];
       }
       queue_status(0x01);
       break;
@@ -928,10 +888,10 @@ void MmioBus::cdrom_execute_command(uint8_t cmd) {
     }
     case 0x15: // SeekL
     case 0x16: { // SeekP
-      cdrom_reading_ = false;
-      cdrom_playing_ = false;
-      cdrom_read_timer_ = 0;
-      cdrom_seeking_ = true;
+      cdrom_.reading = false;
+      cdrom_.playing = false;
+      cdrom_.read_timer = 0;
+      cdrom_.seeking = true;
       queue_status(0x04);
       uint32_t delay = (kCdromSeekDelayCycles > kCdromCmdDelayCycles)
                            ? (kCdromSeekDelayCycles - kCdromCmdDelayCycles)
@@ -992,17 +952,17 @@ void MmioBus::cdrom_execute_command(uint8_t cmd) {
       break;
     }
     case 0x1C: { // Reset
-      cdrom_mode_ = 0;
-      cdrom_reading_ = false;
-      cdrom_playing_ = false;
-      cdrom_muted_ = false;
-      cdrom_seeking_ = false;
-      cdrom_request_ = 0;
-      cdrom_filter_file_ = 0;
-      cdrom_filter_channel_ = 0;
-      cdrom_read_timer_ = 0;
-      cdrom_read_period_ = cdrom_read_period_cycles(cdrom_mode_);
-      cdrom_pending_.clear();
+      cdrom_.mode = 0;
+      cdrom_.reading = false;
+      cdrom_.playing = false;
+      cdrom_.muted = false;
+      cdrom_.seeking = false;
+      cdrom_.request = 0;
+      cdrom_.filter_file = 0;
+      cdrom_.filter_channel = 0;
+      cdrom_.read_timer = 0;
+      cdrom_.read_period = cdrom_read_period_cycles(cdrom_.mode);
+      cdrom_clear_pending();
       queue_status(0x01);
       break;
     }
@@ -1018,7 +978,7 @@ void MmioBus::cdrom_execute_command(uint8_t cmd) {
       break;
     }
     case 0x1E: { // ReadTOC
-      cdrom_seeking_ = true;
+      cdrom_.seeking = true;
       queue_status(0x04);
       uint8_t first_track = cdrom_image_.first_track();
       uint8_t last_track = cdrom_image_.last_track();
@@ -1039,7 +999,7 @@ void MmioBus::cdrom_execute_command(uint8_t cmd) {
       break;
     }
     default: {
-      cdrom_error_ = true;
+      cdrom_.error = true;
       queue_response(0x10, {cdrom_status()});
       break;
     }
@@ -1050,1484 +1010,1622 @@ uint32_t MmioBus::offset(uint32_t addr) const {
   return addr - kBase;
 }
 
-uint8_t MmioBus::read8(uint32_t addr) {
-  if (addr == 0x1F801070 || addr == 0x1F801071) { // I_STAT
-    return (addr & 1) ? static_cast<uint8_t>((irq_stat_ >> 8) & 0xFFu)
-                      : static_cast<uint8_t>(irq_stat_ & 0xFFu);
-  }
-  if (addr == 0x1F801074 || addr == 0x1F801075) { // I_MASK
-    return (addr & 1) ? static_cast<uint8_t>((irq_mask_ >> 8) & 0xFFu)
-                      : static_cast<uint8_t>(irq_mask_ & 0xFFu);
-  }
-  if (addr == kJoyData) {
-    uint8_t value = 0xFF;
-    if (!joy_response_queue_.empty()) {
-      value = joy_response_queue_.front();
-      joy_response_queue_.pop_front();
-    } else if (joy_rx_ready_) {
-      value = joy_rx_data_;
-    }
-    joy_rx_ready_ = !joy_response_queue_.empty();
-    if (!joy_rx_ready_ && joy_tx_queue_.empty() && joy_tx_delay_cycles_ == 0) {
-      joy_session_active_ = false;
-      joy_phase_ = 0;
-      joy_device_ = 0;
-    }
-    return value;
-  }
-  if (addr == kJoyStat || addr == kJoyStat + 1) {
-    uint16_t status = joy_status();
-    return (addr == kJoyStat) ? static_cast<uint8_t>(status & 0xFFu)
-                              : static_cast<uint8_t>((status >> 8) & 0xFFu);
-  }
-  if (addr == kJoyMode || addr == kJoyMode + 1) {
-    return (addr == kJoyMode) ? static_cast<uint8_t>(joy_mode_ & 0xFFu)
-                              : static_cast<uint8_t>((joy_mode_ >> 8) & 0xFFu);
-  }
-  if (addr == kJoyCtrl || addr == kJoyCtrl + 1) {
-    return (addr == kJoyCtrl) ? static_cast<uint8_t>(joy_ctrl_ & 0xFFu)
-                              : static_cast<uint8_t>((joy_ctrl_ >> 8) & 0xFFu);
+// Register decode for the I/O window. Every halfword slot names the register
+// it belongs to (32-bit registers own their low slot), so each access width
+// resolves its handler with one table lookup instead of a chain of compares.
+// Slots left at kRegNone, and registers a width does not decode, go straight
+// to the raw backing store.
+enum MmioReg : uint8_t {
+  kRegNone,
+  kRegIStat,
+  kRegIMask,
+  kRegJoyData,
+  kRegJoyStat,
+  kRegJoyMode,
+  kRegJoyCtrl,
+  kRegJoyBaud,
+  kRegSio1Data,
+  kRegSio1Stat,
+  kRegSio1Mode,
+  kRegSio1Ctrl,
+  kRegSio1Misc,
+  kRegSio1Baud,
+  kRegDmaMadr,
+  kRegDmaBcr,
+  kRegDmaChcr,
+  kRegDmaDpcr,
+  kRegDmaDicr,
+  kRegTimerCount,
+  kRegTimerMode,
+  kRegTimerTarget,
+  kRegCdrom,
+  kRegGpuData,
+  kRegGpuStat,
+  kRegSpu,
+  kRegSpuCtrl,
+  kRegSpuStat,
+};
+
+struct MmioSlot {
+  uint8_t reg = kRegNone;
+  uint8_t unit = 0; // DMA channel or timer index
+};
+
+static constexpr uint32_t kMmioWindowBase = 0x1F801000;
+static constexpr uint32_t kMmioWindowSize = 0x2000;
+using MmioSlotTable = std::array<MmioSlot, kMmioWindowSize / 2>;
+
+static constexpr MmioSlotTable build_mmio_slots() {
+  MmioSlotTable table {};
+  auto map = [&table](uint32_t addr, MmioReg reg, uint32_t unit) {
+    MmioSlot &slot = table[(addr - kMmioWindowBase) / 2];
+    slot.reg = reg;
+    slot.unit = static_cast<uint8_t>(unit);
+  };
+  map(0x1F801070, kRegIStat, 0);
+  map(0x1F801074, kRegIMask, 0);
+  map(kJoyData, kRegJoyData, 0);
+  map(kJoyStat, kRegJoyStat, 0);
+  map(kJoyMode, kRegJoyMode, 0);
+  map(kJoyCtrl, kRegJoyCtrl, 0);
+  map(kJoyBaud, kRegJoyBaud, 0);
+  map(kSio1Data, kRegSio1Data, 0);
+  map(kSio1Stat, kRegSio1Stat, 0);
+  map(kSio1Mode, kRegSio1Mode, 0);
+  map(kSio1Ctrl, kRegSio1Ctrl, 0);
+  map(kSio1Misc, kRegSio1Misc, 0);
+  map(kSio1Baud, kRegSio1Baud, 0);
+  for (uint32_t ch = 0; ch < 7; ++ch) {
+    uint32_t base = 0x1F801080 + ch * 0x10;
+    map(base + 0x0, kRegDmaMadr, ch);
+    map(base + 0x4, kRegDmaBcr, ch);
+    map(base + 0x8, kRegDmaChcr, ch);
+  }
+  map(0x1F8010F0, kRegDmaDpcr, 0);
+  map(0x1F8010F4, kRegDmaDicr, 0);
+  for (uint32_t timer = 0; timer < 3; ++timer) {
+    uint32_t base = 0x1F801100 + timer * 0x10;
+    map(base + 0x0, kRegTimerCount, timer);
+    map(base + 0x4, kRegTimerMode, timer);
+    map(base + 0x8, kRegTimerTarget, timer);
+  }
+  map(0x1F801800, kRegCdrom, 0);
+  map(0x1F801802, kRegCdrom, 0);
+  map(0x1F801810, kRegGpuData, 0);
+  map(0x1F801814, kRegGpuStat, 0);
+  for (uint32_t addr = 0x1F801C00; addr < 0x1F801E00; addr += 2) {
+    map(addr, kRegSpu, 0);
+  }
+  map(kSpuCtrlAddr, kRegSpuCtrl, 0);
+  map(kSpuStatAddr, kRegSpuStat, 0);
+  return table;
+}
+
+static constexpr MmioSlotTable kMmioSlots = build_mmio_slots();
+
+static const MmioSlot &mmio_slot(uint32_t off) {
+  return kMmioSlots[off / 2];
+}
+
+static uint8_t reg_byte(uint16_t value, uint32_t addr) {
+  return (addr & 1) ? static_cast<uint8_t>((value >> 8) & 0xFFu)
+                    : static_cast<uint8_t>(value & 0xFFu);
+}
+
+static uint16_t set_reg_byte(uint16_t reg, uint32_t addr, uint8_t value) {
+  return (addr & 1) ? static_cast<uint16_t>((reg & 0x00FFu) | (static_cast<uint16_t>(value) << 8))
+                    : static_cast<uint16_t>((reg & 0xFF00u) | value);
+}
+
+uint8_t MmioBus::read8_register(uint32_t addr) {
+  uint32_t off = offset(addr);
+  if (off >= kSize) {
+    return 0xFF;
+  }
+  switch (mmio_slot(off).reg) {
+    case kRegIStat:
+      return reg_byte(irq_.stat, addr);
+    case kRegIMask:
+      return reg_byte(irq_.mask, addr);
+    case kRegJoyData:
+      if (addr == kJoyData) {
+        return joy_read_data();
+      }
+      break;
+    case kRegJoyStat:
+      return reg_byte(joy_status(), addr);
+    case kRegJoyMode:
+      return reg_byte(joy_.mode, addr);
+    case kRegJoyCtrl:
+      return reg_byte(joy_.ctrl, addr);
+    case kRegJoyBaud:
+      return reg_byte(joy_.baud, addr);
+    case kRegSio1Data:
+      if (addr == kSio1Data) {
+        uint8_t value = sio1_.rx_ready ? sio1_.rx_data : 0xFF;
+        sio1_.rx_ready = false;
+        return value;
+      }
+      break;
+    case kRegSio1Stat:
+      return reg_byte(sio1_status(), addr);
+    case kRegSio1Mode:
+      return reg_byte(sio1_.mode, addr);
+    case kRegSio1Ctrl:
+      return reg_byte(sio1_.ctrl, addr);
+    case kRegSio1Misc:
+      return reg_byte(sio1_.misc, addr);
+    case kRegSio1Baud:
+      return reg_byte(sio1_.baud, addr);
+    case kRegSpuStat:
+      return reg_byte(spu_status(), addr);
+    case kRegSpuCtrl:
+      return reg_byte(spu_.ctrl, addr);
+    case kRegCdrom:
+      return cdrom_read_register(addr & 0x3u);
+    default:
+      break;
   }
-  if (addr == kJoyBaud || addr == kJoyBaud + 1) {
-    return (addr == kJoyBaud) ? static_cast<uint8_t>(joy_baud_ & 0xFFu)
-                              : static_cast<uint8_t>((joy_baud_ >> 8) & 0xFFu);
+  return raw_[off];
+}
+
+uint16_t MmioBus::read16_register(uint32_t addr) {
+  uint32_t off = offset(addr);
+  if (off + 1 >= kSize) {
+    return 0xFFFF;
+  }
+  const MmioSlot &slot = mmio_slot(off);
+  switch (slot.reg) {
+    case kRegIStat:
+      return irq_.stat;
+    case kRegIMask:
+      return irq_.mask;
+    case kRegJoyStat:
+      return joy_status();
+    case kRegJoyMode:
+      return joy_.mode;
+    case kRegJoyCtrl:
+      return joy_.ctrl;
+    case kRegJoyBaud:
+      return joy_.baud;
+    case kRegSio1Stat:
+      return sio1_status();
+    case kRegSio1Mode:
+      return sio1_.mode;
+    case kRegSio1Ctrl:
+      return sio1_.ctrl;
+    case kRegSio1Misc:
+      return sio1_.misc;
+    case kRegSio1Baud:
+      return sio1_.baud;
+    case kRegSpuStat:
+      return spu_status();
+    case kRegSpuCtrl:
+      return spu_.ctrl;
+    case kRegTimerCount:
+      return timer_read_count(slot.unit);
+    case kRegTimerMode:
+      return timer_read_mode(slot.unit);
+    case kRegTimerTarget:
+      return timers_.target[slot.unit];
+    case kRegCdrom: {
+      uint16_t lo = read8_register(addr);
+      uint16_t hi = read8_register(addr + 1);
+      return static_cast<uint16_t>(lo | (hi << 8));
+    }
+    default:
+      break;
   }
-  if (addr == kSio1Data) {
-    uint8_t value = sio1_rx_ready_ ? sio1_rx_data_ : 0xFF;
-    sio1_rx_ready_ = false;
-    return value;
+  return static_cast<uint16_t>(raw_[off] | (raw_[off + 1] << 8));
+}
+
+uint32_t MmioBus::read32_register(uint32_t addr) {
+  uint32_t off = offset(addr);
+  if (off + 3 >= kSize) {
+    return 0xFFFFFFFF;
   }
-  if (addr == kSio1Stat || addr == kSio1Stat + 1) {
-    uint16_t status = sio1_status();
-    return (addr == kSio1Stat) ? static_cast<uint8_t>(status & 0xFFu)
-                               : static_cast<uint8_t>((status >> 8) & 0xFFu);
-  }
-  if (addr == kSio1Mode || addr == kSio1Mode + 1) {
-    return (addr == kSio1Mode) ? static_cast<uint8_t>(sio1_mode_ & 0xFFu)
-                               : static_cast<uint8_t>((sio1_mode_ >> 8) & 0xFFu);
-  }
-  if (addr == kSio1Ctrl || addr == kSio1Ctrl + 1) {
-    return (addr == kSio1Ctrl) ? static_cast<uint8_t>(sio1_ctrl_ & 0xFFu)
-                               : static_cast<uint8_t>((sio1_ctrl_ >> 8) & 0xFFu);
-  }
-  if (addr == kSio1Misc || addr == kSio1Misc + 1) {
-    return (addr == kSio1Misc) ? static_cast<uint8_t>(sio1_misc_ & 0xFFu)
-                               : static_cast<uint8_t>((sio1_misc_ >> 8) & 0xFFu);
-  }
-  if (addr == kSio1Baud || addr == kSio1Baud + 1) {
-    return (addr == kSio1Baud) ? static_cast<uint8_t>(sio1_baud_ & 0xFFu)
-                               : static_cast<uint8_t>((sio1_baud_ >> 8) & 0xFFu);
-  }
-  if (addr == kSpuStatAddr || addr == kSpuStatAddr + 1) {
-    uint16_t status = spu_status();
-    return (addr == kSpuStatAddr) ? static_cast<uint8_t>(status & 0xFFu)
-                                  : static_cast<uint8_t>((status >> 8) & 0xFFu);
-  }
-  if (addr == kSpuCtrlAddr || addr == kSpuCtrlAddr + 1) {
-    return (addr == kSpuCtrlAddr) ? static_cast<uint8_t>(spu_ctrl_ & 0xFFu)
-                                  : static_cast<uint8_t>((spu_ctrl_ >> 8) & 0xFFu);
-  }
-  if (addr >= 0x1F801800 && addr < 0x1F801804) {
-    uint32_t reg = addr - 0x1F801800;
-    if (reg == 0) {
-      cdrom_status_ = cdrom_status();
-      uint8_t value = static_cast<uint8_t>((cdrom_status_ & 0xFCu) | (cdrom_index_ & 0x03u));
-      if (cdrom_log_enabled()) {
-        std::cerr << "[cdrom] read reg0 value=0x" << std::hex << std::setw(2) << std::setfill('0')
-                  << static_cast<int>(value) << "\n";
-      }
-      return value;
-    }
-    if (reg == 1) {
-      uint8_t value = 0;
-      switch (cdrom_index_ & 0x3u) {
-        case 0: {
-          if (!cdrom_response_fifo_.empty()) {
-            value = cdrom_response_fifo_.front();
-            cdrom_response_fifo_.erase(cdrom_response_fifo_.begin());
-          }
-          break;
+  const MmioSlot &slot = mmio_slot(off);
+  switch (slot.reg) {
+    case kRegIStat:
+      return irq_.stat;
+    case kRegIMask:
+      return irq_.mask;
+    case kRegJoyStat:
+      return joy_status();
+    case kRegJoyMode:
+      return joy_.mode;
+    case kRegJoyCtrl:
+      return joy_.ctrl;
+    case kRegJoyBaud:
+      return joy_.baud;
+    case kRegSio1Stat:
+      return sio1_status();
+    case kRegSio1Mode:
+      return sio1_.mode;
+    case kRegSio1Ctrl:
+      return sio1_.ctrl;
+    case kRegSio1Misc:
+      return sio1_.misc;
+    case kRegSio1Baud:
+      return sio1_.baud;
+    case kRegSpuStat:
+      return spu_status();
+    case kRegSpuCtrl:
+      return spu_.ctrl;
+    case kRegSpu:
+      return spu_.regs[(addr - 0x1F801C00) / 2];
+    case kRegTimerCount:
+      return timer_read_count(slot.unit);
+    case kRegTimerMode:
+      return timer_read_mode(slot.unit);
+    case kRegTimerTarget:
+      return timers_.target[slot.unit];
+    case kRegCdrom: {
+      uint32_t b0 = read8_register(addr);
+      uint32_t b1 = read8_register(addr + 1);
+      uint32_t b2 = read8_register(addr + 2);
+      uint32_t b3 = read8_register(addr + 3);
+      return b0 | (b1 << 8) | (b2 << 16) | (b3 << 24);
+    }
+    case kRegGpuData: {
+      if (!gpu_.read_fifo.empty()) {
+        gpu_.read_latch = gpu_.read_fifo.front();
+        gpu_.read_fifo.erase(gpu_.read_fifo.begin());
+      }
+      if (gpu_read_log_enabled()) {
+        std::cerr << "[gpu] GPUREAD=0x" << std::hex << std::setw(8) << std::setfill('0')
+                  << gpu_.read_latch << "\n";
+      }
+      return gpu_.read_latch;
+    }
+    case kRegGpuStat: {
+      uint32_t stat = compute_gpustat();
+      if (gpustat_log_enabled()) {
+        static uint32_t last_stat = 0xFFFFFFFFu;
+        if (stat != last_stat) {
+          last_stat = stat;
+          std::cerr << "[gpu] GPUSTAT=0x" << std::hex << std::setw(8) << std::setfill('0')
+                    << stat << " dma_ready=" << ((stat & (1u << 28)) ? 1 : 0) << "\n";
         }
-        case 1:
-          value = cdrom_irq_enable_;
-          break;
-        case 2:
-          value = cdrom_vol_ll_;
-          break;
-        case 3:
-          value = cdrom_vol_rr_;
-          break;
       }
-      if (cdrom_log_enabled()) {
-        std::cerr << "[cdrom] read reg1 idx=" << std::dec << static_cast<int>(cdrom_index_ & 0x3u)
-                  << " value=0x" << std::hex << std::setw(2) << std::setfill('0')
-                  << static_cast<int>(value) << "\n";
+      return stat;
+    }
+    case kRegDmaMadr:
+      return dma_.madr[slot.unit];
+    case kRegDmaBcr:
+      return dma_.bcr[slot.unit];
+    case kRegDmaChcr: {
+      uint32_t value = dma_.chcr[slot.unit];
+      if (dma_log_enabled()) {
+        static uint32_t last_chcr[7] = {0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu,
+                                        0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu};
+        if (value != last_chcr[slot.unit]) {
+          last_chcr[slot.unit] = value;
+          std::cerr << "[dma] CHCR" << std::dec << static_cast<int>(slot.unit) << "=0x" << std::hex
+                    << std::setw(8) << std::setfill('0') << value << "\n";
+        }
       }
       return value;
     }
-    if (reg == 2) {
-      uint8_t value = 0;
-      switch (cdrom_index_ & 0x3u) {
-        case 0: {
-          if ((cdrom_request_ & 0x01u) != 0) {
-            cdrom_maybe_fill_data();
-          }
-          if ((cdrom_request_ & 0x01u) != 0 && !cdrom_data_fifo_.empty()) {
-            value = cdrom_data_fifo_.front();
-            cdrom_data_fifo_.erase(cdrom_data_fifo_.begin());
-          }
-          break;
+    case kRegDmaDpcr: {
+      if (dma_log_enabled()) {
+        static uint32_t last_dpcr = 0xFFFFFFFFu;
+        if (dma_.dpcr != last_dpcr) {
+          last_dpcr = dma_.dpcr;
+          std::cerr << "[dma] DPCR=0x" << std::hex << std::setw(8) << std::setfill('0')
+                    << dma_.dpcr << "\n";
         }
-        case 1:
-          value = cdrom_irq_flags_;
-          break;
-        case 2:
-          value = cdrom_vol_lr_;
-          break;
-        case 3:
-          value = cdrom_vol_rl_;
-          break;
       }
-      if (cdrom_log_enabled()) {
-        std::cerr << "[cdrom] read reg2 idx=" << std::dec << static_cast<int>(cdrom_index_ & 0x3u)
-                  << " value=0x" << std::hex << std::setw(2) << std::setfill('0')
-                  << static_cast<int>(value) << "\n";
-      }
-      return value;
+      return dma_.dpcr;
     }
-    if (reg == 3) {
-      uint8_t value = (cdrom_index_ & 0x3u) < 2 ? cdrom_irq_flags_ : cdrom_vol_apply_;
-      if (cdrom_log_enabled()) {
-        std::cerr << "[cdrom] read reg3 idx=" << std::dec << static_cast<int>(cdrom_index_ & 0x3u)
-                  << " value=0x" << std::hex << std::setw(2) << std::setfill('0')
-                  << static_cast<int>(value) << "\n";
+    case kRegDmaDicr: {
+      if (dma_log_enabled()) {
+        static uint32_t last_dicr = 0xFFFFFFFFu;
+        if (dma_.dicr != last_dicr) {
+          last_dicr = dma_.dicr;
+          std::cerr << "[dma] DICR=0x" << std::hex << std::setw(8) << std::setfill('0')
+                    << dma_.dicr << "\n";
+        }
       }
-      return value;
+      return dma_.dicr;
     }
+    default:
+      break;
   }
-
-  uint32_t off = offset(addr);
-  if (off < kSize) {
-    return raw_[off];
-  }
-  return 0xFF;
+  return static_cast<uint32_t>(raw_[off]) |
+         (static_cast<uint32_t>(raw_[off + 1]) << 8) |
+         (static_cast<uint32_t>(raw_[off + 2]) << 16) |
+         (static_cast<uint32_t>(raw_[off + 3]) << 24);
 }
 
-uint16_t MmioBus::read16(uint32_t addr) {
-  if (addr >= 0x1F801800 && addr < 0x1F801804) {
-    uint16_t lo = read8(addr);
-    uint16_t hi = read8(addr + 1);
-    return static_cast<uint16_t>(lo | (hi << 8));
-  }
-  if (addr == 0x1F801070) { // I_STAT
-    return irq_stat_;
-  }
-  if (addr == 0x1F801074) { // I_MASK
-    return irq_mask_;
-  }
-  if (addr == kJoyStat) {
-    return joy_status();
-  }
-  if (addr == kJoyMode) {
-    return joy_mode_;
-  }
-  if (addr == kJoyCtrl) {
-    return joy_ctrl_;
-  }
-  if (addr == kJoyBaud) {
-    return joy_baud_;
-  }
-  if (addr == kSio1Stat) {
-    return sio1_status();
-  }
-  if (addr == kSio1Mode) {
-    return sio1_mode_;
-  }
-  if (addr == kSio1Ctrl) {
-    return sio1_ctrl_;
-  }
-  if (addr == kSio1Misc) {
-    return sio1_misc_;
-  }
-  if (addr == kSio1Baud) {
-    return sio1_baud_;
-  }
-  if (addr == kSpuStatAddr) {
-    return spu_status();
-  }
-  if (addr == kSpuCtrlAddr) {
-    return spu_ctrl_;
+void MmioBus::write8_register(uint32_t addr, uint8_t value) {
+  uint32_t off = offset(addr);
+  if (off >= kSize) {
+    return;
   }
-  if (addr >= 0x1F801100 && addr < 0x1F801130) {
-    uint32_t timer = (addr - 0x1F801100) / 0x10;
-    uint32_t reg = (addr - 0x1F801100) % 0x10;
-    if (timer < 3) {
-      if (reg == 0x0) {
-        uint16_t value = timer_count_[timer];
-        if (irq_log_enabled()) {
-          static uint16_t last_count[3] = {0xFFFFu, 0xFFFFu, 0xFFFFu};
-          if (value != last_count[timer]) {
-            last_count[timer] = value;
-            std::cerr << "[timer] T" << timer << " count=0x" << std::hex << std::setw(4)
-                      << std::setfill('0') << value << "\n";
-          }
-        }
-        return value;
-      }
-      if (reg == 0x4) {
-        uint16_t value = timer_mode_[timer];
-        timer_mode_[timer] &= static_cast<uint16_t>(~((1u << 11) | (1u << 12)));
-        return value;
+  switch (mmio_slot(off).reg) {
+    case kRegIStat:
+      irq_acknowledge((addr & 1) ? static_cast<uint16_t>(value << 8) : value);
+      break;
+    case kRegIMask:
+      irq_.mask = set_reg_byte(irq_.mask, addr, value);
+      break;
+    case kRegJoyData:
+      if (addr == kJoyData) {
+        joy_write_data(value);
+        return;
       }
-      if (reg == 0x8) {
-        return timer_target_[timer];
+      break;
+    case kRegJoyMode:
+      joy_.mode = set_reg_byte(joy_.mode, addr, value);
+      break;
+    case kRegJoyCtrl:
+      joy_write_ctrl(set_reg_byte(joy_.ctrl, addr, value));
+      break;
+    case kRegJoyBaud:
+      joy_.baud = set_reg_byte(joy_.baud, addr, value);
+      break;
+    case kRegSio1Data:
+      if (addr == kSio1Data) {
+        sio1_.rx_data = 0xFF;
+        sio1_.rx_ready = true;
+        return;
       }
-    }
-  }
-  if (addr >= 0x1F801800 && addr < 0x1F801804) {
-    uint16_t lo = read8(addr);
-    uint16_t hi = read8(addr + 1);
-    return static_cast<uint16_t>(lo | (hi << 8));
-  }
-
-  uint32_t off = offset(addr);
-  if (off + 1 < kSize) {
-    return static_cast<uint16_t>(raw_[off] | (raw_[off + 1] << 8));
+      break;
+    case kRegSio1Mode:
+      sio1_.mode = set_reg_byte(sio1_.mode, addr, value);
+      break;
+    case kRegSio1Ctrl:
+      sio1_.ctrl = set_reg_byte(sio1_.ctrl, addr, value);
+      break;
+    case kRegSio1Misc:
+      sio1_.misc = set_reg_byte(sio1_.misc, addr, value);
+      break;
+    case kRegSio1Baud:
+      sio1_.baud = set_reg_byte(sio1_.baud, addr, value);
+      break;
+    case kRegCdrom:
+      cdrom_write_register(addr & 0x3u, value);
+      cdrom_.regs[addr & 0x3u] = value;
+      break;
+    default:
+      break;
   }
-  return 0xFFFF;
+  raw_[off] = value;
 }
 
-uint32_t MmioBus::read32(uint32_t addr) {
+void MmioBus::write16_register(uint32_t addr, uint16_t value) {
   uint32_t off = offset(addr);
-  if (off + 3 >= kSize) {
-    return 0xFFFFFFFF;
+  if (off + 1 >= kSize) {
+    return;
   }
-
-  if (addr >= 0x1F801100 && addr < 0x1F801130) {
-    uint32_t timer = (addr - 0x1F801100) / 0x10;
-    uint32_t reg = (addr - 0x1F801100) % 0x10;
-    if (timer < 3) {
-      if (reg == 0x0) {
-        uint16_t value = timer_count_[timer];
-        if (irq_log_enabled()) {
-          static uint16_t last_count32[3] = {0xFFFFu, 0xFFFFu, 0xFFFFu};
-          if (value != last_count32[timer]) {
-            last_count32[timer] = value;
-            std::cerr << "[timer] T" << timer << " count=0x" << std::hex << std::setw(4)
-                      << std::setfill('0') << value << "\n";
-          }
-        }
-        return value;
-      }
-      if (reg == 0x4) {
-        uint16_t value = timer_mode_[timer];
-        timer_mode_[timer] &= static_cast<uint16_t>(~((1u << 11) | (1u << 12)));
-        return value;
+  const MmioSlot &slot = mmio_slot(off);
+  switch (slot.reg) {
+    case kRegIStat:
+      irq_acknowledge(value);
+      break;
+    case kRegIMask:
+      if (irq_log_enabled()) {
+        std::cerr << "[irq] I_MASK=0x" << std::hex << std::setw(4) << std::setfill('0')
+                  << value << "\n";
       }
-      if (reg == 0x8) {
-        return timer_target_[timer];
+      irq_.mask = value;
+      break;
+    case kRegJoyMode:
+      joy_.mode = value;
+      break;
+    case kRegJoyCtrl:
+      joy_write_ctrl(value);
+      break;
+    case kRegJoyBaud:
+      joy_.baud = value;
+      break;
+    case kRegSio1Mode:
+      sio1_.mode = value;
+      break;
+    case kRegSio1Ctrl:
+      sio1_.ctrl = value;
+      break;
+    case kRegSio1Misc:
+      sio1_.misc = value;
+      break;
+    case kRegSio1Baud:
+      sio1_.baud = value;
+      break;
+    case kRegSpuCtrl:
+      spu_.ctrl = value;
+      spu_.regs[(addr - 0x1F801C00) / 2] = value;
+      break;
+    case kRegSpu:
+    case kRegSpuStat:
+      spu_.regs[(addr - 0x1F801C00) / 2] = value;
+      if (addr == 0x1F801D80 || addr == 0x1F801D82) { // main volume
+        attention_ = true;
       }
-    }
+      break;
+    case kRegTimerCount:
+      timer_write_count(slot.unit, value);
+      break;
+    case kRegTimerMode:
+      timer_write_mode(slot.unit, value);
+      break;
+    case kRegTimerTarget:
+      timer_write_target(slot.unit, value);
+      break;
+    case kRegCdrom:
+      write8_register(addr, static_cast<uint8_t>(value & 0xFFu));
+      write8_register(addr + 1, static_cast<uint8_t>((value >> 8) & 0xFFu));
+      return;
+    default:
+      break;
   }
+  raw_[off] = static_cast<uint8_t>(value & 0xFF);
+  raw_[off + 1] = static_cast<uint8_t>((value >> 8) & 0xFF);
+}
 
-  if (addr == kJoyStat) {
-    return joy_status();
-  }
-  if (addr == kJoyMode) {
-    return joy_mode_;
-  }
-  if (addr == kJoyCtrl) {
-    return joy_ctrl_;
-  }
-  if (addr == kJoyBaud) {
-    return joy_baud_;
+void MmioBus::write32_register(uint32_t addr, uint32_t value) {
+  uint32_t off = offset(addr);
+  if (off + 3 >= kSize) {
+    return;
   }
-  if (addr == kSio1Stat) {
-    return sio1_status();
+  const MmioSlot &slot = mmio_slot(off);
+  switch (slot.reg) {
+    case kRegIStat:
+      irq_acknowledge(static_cast<uint16_t>(value));
+      break;
+    case kRegIMask:
+      irq_.mask = static_cast<uint16_t>(value);
+      break;
+    case kRegTimerCount:
+    case kRegTimerMode:
+    case kRegTimerTarget:
+      write16_register(addr, static_cast<uint16_t>(value & 0xFFFFu));
+      return;
+    case kRegCdrom:
+      write8_register(addr, static_cast<uint8_t>(value & 0xFFu));
+      write8_register(addr + 1, static_cast<uint8_t>((value >> 8) & 0xFFu));
+      write8_register(addr + 2, static_cast<uint8_t>((value >> 16) & 0xFFu));
+      write8_register(addr + 3, static_cast<uint8_t>((value >> 24) & 0xFFu));
+      return;
+    case kRegGpuData:
+      gpu_.gp0 = value;
+      gpu_.gp0_fifo.push_back(value);
+      attention_ = true;
+      apply_gp0_state(value);
+      gpu_extend_busy(1);
+      break;
+    case kRegGpuStat:
+      gpu_write_gp1(value);
+      break;
+    case kRegDmaMadr:
+      dma_.madr[slot.unit] = value;
+      break;
+    case kRegDmaBcr:
+      dma_.bcr[slot.unit] = value;
+      break;
+    case kRegDmaChcr:
+      dma_write_chcr(slot.unit, value);
+      break;
+    case kRegDmaDpcr:
+      dma_.dpcr = value;
+      break;
+    case kRegDmaDicr:
+      dma_write_dicr(value);
+      break;
+    case kRegSpuCtrl:
+      spu_.ctrl = static_cast<uint16_t>(value);
+      spu_.regs[(addr - 0x1F801C00) / 2] = static_cast<uint16_t>(value);
+      break;
+    case kRegSpu:
+    case kRegSpuStat:
+      spu_.regs[(addr - 0x1F801C00) / 2] = static_cast<uint16_t>(value);
+      break;
+    default:
+      break;
   }
-  if (addr == kSio1Mode) {
-    return sio1_mode_;
+  raw_[off] = static_cast<uint8_t>(value & 0xFF);
+  raw_[off + 1] = static_cast<uint8_t>((value >> 8) & 0xFF);
+  raw_[off + 2] = static_cast<uint8_t>((value >> 16) & 0xFF);
+  raw_[off + 3] = static_cast<uint8_t>((value >> 24) & 0xFF);
+}
+
+void MmioBus::irq_acknowledge(uint16_t bits) {
+  if (irq_log_enabled() && bits != 0) {
+    std::cerr << "[irq] I_STAT clear=0x" << std::hex << std::setw(4) << std::setfill('0')
+              << bits << "\n";
   }
-  if (addr == kSio1Ctrl) {
-    return sio1_ctrl_;
+  irq_.stat &= static_cast<uint16_t>(~bits);
+  if (bits & (1u << 7)) {
+    joy_.irq_pending = false;
   }
-  if (addr == kSio1Misc) {
-    return sio1_misc_;
+}
+
+uint8_t MmioBus::joy_read_data() {
+  uint8_t value = 0xFF;
+  if (!joy_.response_queue.empty()) {
+    value = joy_.response_queue.front();
+    joy_.response_queue.pop_front();
+  } else if (joy_.rx_ready) {
+    value = joy_.rx_data;
   }
-  if (addr == kSio1Baud) {
-    return sio1_baud_;
+  joy_.rx_ready = !joy_.response_queue.empty();
+  if (!joy_.rx_ready && joy_.tx_queue.empty() && joy_.tx_delay_cycles == 0) {
+    joy_.session_active = false;
+    joy_.phase = 0;
+    joy_.device = 0;
   }
-  if (addr == kSpuStatAddr) {
-    return spu_status();
+  return value;
+}
+
+void MmioBus::joy_write_data(uint8_t value) {
+  if ((joy_.ctrl & kJoyCtrlDtr) == 0 || (joy_.ctrl & kJoyCtrlTxEnable) == 0) {
+    return;
   }
-  if (addr == kSpuCtrlAddr) {
-    return spu_ctrl_;
+  if (!joy_.session_active) {
+    if (value == 0x01) {
+      joy_.device = 1; // pad
+    } else if (value == 0x81) {
+      joy_.device = 2; // memory card
+    } else {
+      joy_.device = 0;
+    }
+    joy_.session_active = true;
+    joy_.phase = 0;
   }
 
-  if (addr >= 0x1F801800 && addr < 0x1F801804) {
-    uint32_t b0 = read8(addr);
-    uint32_t b1 = read8(addr + 1);
-    uint32_t b2 = read8(addr + 2);
-    uint32_t b3 = read8(addr + 3);
-    return b0 | (b1 << 8) | (b2 << 16) | (b3 << 24);
+  uint8_t response = 0xFF;
+  if (joy_.device == 1) {
+    switch (joy_.phase) {
+      case 1:
+        response = 0x41;
+        break;
+      case 2:
+        response = 0x5A;
+        break;
+      default:
+        response = 0xFF;
+        break;
+    }
+  } else if (joy_.device == 2) {
+    if (joy_.phase == 0) {
+      response = 0xFF;
+    } else if (joy_.phase == 1) {
+      response = 0x5A;
+    } else {
+      response = 0x00;
+    }
   }
 
-  if (addr == 0x1F801070) { // I_STAT
-    return irq_stat_;
+  joy_.tx_queue.push_back(response);
+  joy_.phase = static_cast<uint8_t>(joy_.phase + 1);
+  if (joy_.tx_delay_cycles == 0) {
+    joy_.tx_delay_cycles = joy_byte_delay_cycles(joy_.baud);
   }
-  if (addr == 0x1F801074) { // I_MASK
-    return irq_mask_;
+}
+
+void MmioBus::joy_write_ctrl(uint16_t value) {
+  joy_.ctrl = value;
+  if (joy_.ctrl & kJoyCtrlAckReset) {
+    joy_.irq_pending = false;
+    irq_.stat &= static_cast<uint16_t>(~(1u << 7));
+    joy_.ack = false;
+    joy_.ack_cycles = 0;
   }
-  if (addr == 0x1F801810) { // GPU GP0
-    if (!gpu_read_fifo_.empty()) {
-      gpu_read_latch_ = gpu_read_fifo_.front();
-      gpu_read_fifo_.erase(gpu_read_fifo_.begin());
-    }
-    if (gpu_read_log_enabled()) {
-      std::cerr << "[gpu] GPUREAD=0x" << std::hex << std::setw(8) << std::setfill('0')
-                << gpu_read_latch_ << "\n";
-    }
-    return gpu_read_latch_;
+  if ((joy_.ctrl & kJoyCtrlReset) || (joy_.ctrl & kJoyCtrlDtr) == 0) {
+    joy_.rx_ready = false;
+    joy_.ack = false;
+    joy_.tx_queue.clear();
+    joy_.tx_delay_cycles = 0;
+    joy_.rx_delay_cycles = 0;
+    joy_.ack_cycles = 0;
+    joy_.rx_pending = false;
+    joy_.response_queue.clear();
+    joy_.session_active = false;
+    joy_.phase = 0;
+    joy_.device = 0;
   }
-  if (addr == 0x1F801814) { // GPU GP1
-    uint32_t stat = compute_gpustat();
-    if (gpustat_log_enabled()) {
-      static uint32_t last_stat = 0xFFFFFFFFu;
-      if (stat != last_stat) {
-        last_stat = stat;
-        std::cerr << "[gpu] GPUSTAT=0x" << std::hex << std::setw(8) << std::setfill('0')
-                  << stat << " dma_ready=" << ((stat & (1u << 28)) ? 1 : 0) << "\n";
-      }
+  if ((joy_.ctrl & kJoyCtrlDtr) && !joy_.rx_ready && !joy_.response_queue.empty()) {
+    joy_.rx_ready = true;
+    joy_.ack = true;
+    joy_.ack_cycles = kJoyAckPulseCycles;
+    if ((joy_.ctrl & kJoyCtrlIrqEnable) && !joy_.irq_pending) {
+      joy_.irq_pending = true;
+      irq_.stat |= static_cast<uint16_t>(1u << 7);
     }
-    return stat;
   }
+}
 
-  if (addr >= 0x1F801080 && addr < 0x1F8010F0) { // DMA channels
-    uint32_t index = (addr - 0x1F801080) / 0x10;
-    uint32_t reg = (addr - 0x1F801080) % 0x10;
-    if (index < 7) {
-      if (reg == 0x0) {
-        return dma_madr_[index];
-      }
-      if (reg == 0x4) {
-        return dma_bcr_[index];
-      }
-      if (reg == 0x8) {
-        uint32_t value = dma_chcr_[index];
-        if (dma_log_enabled()) {
-          static uint32_t last_chcr[7] = {0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu,
-                                          0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu};
-          if (value != last_chcr[index]) {
-            last_chcr[index] = value;
-            std::cerr << "[dma] CHCR" << std::dec << index << "=0x" << std::hex << std::setw(8)
-                      << std::setfill('0') << value << "\n";
-          }
-        }
-        return value;
-      }
+uint16_t MmioBus::timer_read_count(int i) {
+  uint16_t value = timers_.count[i];
+  if (irq_log_enabled()) {
+    static uint16_t last_count[3] = {0xFFFFu, 0xFFFFu, 0xFFFFu};
+    if (value != last_count[i]) {
+      last_count[i] = value;
+      std::cerr << "[timer] T" << i << " count=0x" << std::hex << std::setw(4)
+                << std::setfill('0') << value << "\n";
     }
   }
-  if (addr == 0x1F8010F0) { // DPCR
-    if (dma_log_enabled()) {
-      static uint32_t last_dpcr = 0xFFFFFFFFu;
-      if (dma_dpcr_ != last_dpcr) {
-        last_dpcr = dma_dpcr_;
-        std::cerr << "[dma] DPCR=0x" << std::hex << std::setw(8) << std::setfill('0')
-                  << dma_dpcr_ << "\n";
-      }
-    }
-    return dma_dpcr_;
+  return value;
+}
+
+uint16_t MmioBus::timer_read_mode(int i) {
+  uint16_t value = timers_.mode[i];
+  timers_.mode[i] &= static_cast<uint16_t>(~((1u << 11) | (1u << 12)));
+  return value;
+}
+
+void MmioBus::timer_write_count(int i, uint16_t value) {
+  timers_.count[i] = value;
+  timers_.cycle_accum[i] = 0;
+  if (irq_log_enabled()) {
+    std::cerr << "[timer] T" << i << " count=0x" << std::hex << std::setw(4)
+              << std::setfill('0') << value << "\n";
   }
-  if (addr == 0x1F8010F4) { // DICR
-    if (dma_log_enabled()) {
-      static uint32_t last_dicr = 0xFFFFFFFFu;
-      if (dma_dicr_ != last_dicr) {
-        last_dicr = dma_dicr_;
-        std::cerr << "[dma] DICR=0x" << std::hex << std::setw(8) << std::setfill('0')
-                  << dma_dicr_ << "\n";
-      }
-    }
-    return dma_dicr_;
+}
+
+void MmioBus::timer_write_mode(int i, uint16_t value) {
+  timers_.irq_on_target[i] = (value & (1u << 4)) != 0;
+  timers_.irq_on_overflow[i] = (value & (1u << 5)) != 0;
+  timers_.irq_repeat[i] = (value & (1u << 6)) != 0;
+  timers_.irq_toggle[i] = (value & (1u << 7)) != 0;
+  timers_.irq_enable[i] = timers_.irq_on_target[i] || timers_.irq_on_overflow[i];
+  timers_.mode[i] = static_cast<uint16_t>(value & 0x03FFu);
+  timers_.mode[i] |= static_cast<uint16_t>(1u << 10);
+  timers_.mode[i] &= static_cast<uint16_t>(~((1u << 11) | (1u << 12)));
+  timers_.count[i] = 0;
+  timers_.cycle_accum[i] = 0;
+  irq_.stat &= static_cast<uint16_t>(~(1u << (4 + i)));
+  timers_.sync_waiting[i] = ((timers_.mode[i] & 0x1u) && (((timers_.mode[i] >> 1) & 0x3u) == 3u));
+  if (irq_log_enabled()) {
+    std::cerr << "[timer] T" << i << " mode=0x" << std::hex << std::setw(4)
+              << std::setfill('0') << timers_.mode[i] << "\n";
   }
+}
 
-  if (addr >= 0x1F801100 && addr < 0x1F801130) { // Timers
-    uint32_t timer = (addr - 0x1F801100) / 0x10;
-    uint32_t reg = (addr - 0x1F801100) % 0x10;
-    if (timer < 3) {
-      if (reg == 0x0) {
-        return timer_count_[timer];
-      }
-      if (reg == 0x4) {
-        uint16_t value = timer_mode_[timer];
-        timer_mode_[timer] &= static_cast<uint16_t>(~((1u << 11) | (1u << 12)));
-        return value;
-      }
-      if (reg == 0x8) {
-        return timer_target_[timer];
-      }
-    }
+void MmioBus::timer_write_target(int i, uint16_t value) {
+  timers_.target[i] = value;
+  if (irq_log_enabled()) {
+    std::cerr << "[timer] T" << i << " target=0x" << std::hex << std::setw(4)
+              << std::setfill('0') << value << "\n";
   }
+}
 
-  if (addr >= 0x1F801C00 && addr < 0x1F801E00) { // SPU
-    uint32_t index = (addr - 0x1F801C00) / 2;
-    if (index < spu_regs_.size()) {
-      return spu_regs_[index];
+void MmioBus::dma_write_chcr(int ch, uint32_t value) {
+  dma_.chcr[ch] = value;
+  if (value & (1u << 24)) {
+    dma_.pending_mask |= (1u << ch);
+    attention_ = true;
+    if (irq_log_enabled()) {
+      std::cerr << "[irq] DMA start ch=" << std::dec << ch
+                << " madr=0x" << std::hex << std::setw(8) << std::setfill('0')
+                << dma_.madr[ch]
+                << " bcr=0x" << std::setw(8) << dma_.bcr[ch]
+                << " chcr=0x" << std::setw(8) << dma_.chcr[ch] << "\n";
     }
   }
+}
 
-  if (addr >= 0x1F801800 && addr < 0x1F801804) { // CD-ROM
-    uint32_t index = addr - 0x1F801800;
-    return cdrom_regs_[index];
+void MmioBus::dma_write_dicr(uint32_t value) {
+  uint32_t clear = (value >> 24) & 0x7F;
+  dma_.dicr &= ~(clear << 24);
+  dma_.dicr = (dma_.dicr & 0xFF000000u) | (value & 0x00FFFFFFu);
+  dma_.dicr = recompute_dma_master(dma_.dicr);
+  if (dma_.dicr & (1u << 31)) {
+    irq_.stat |= (1u << 3);
+  } else {
+    irq_.stat &= static_cast<uint16_t>(~(1u << 3));
+  }
+  if (irq_log_enabled()) {
+    std::cerr << "[irq] DICR=0x" << std::hex << std::setw(8) << std::setfill('0')
+              << dma_.dicr << "\n";
   }
-
-  return static_cast<uint32_t>(raw_[off]) |
-         (static_cast<uint32_t>(raw_[off + 1]) << 8) |
-         (static_cast<uint32_t>(raw_[off + 2]) << 16) |
-         (static_cast<uint32_t>(raw_[off + 3]) << 24);
 }
 
-void MmioBus::write8(uint32_t addr, uint8_t value) {
-  if (addr == 0x1F801070 || addr == 0x1F801071) { // I_STAT
-    uint16_t mask = (addr & 1) ? static_cast<uint16_t>(value) << 8
-                               : static_cast<uint16_t>(value);
-    irq_stat_ &= static_cast<uint16_t>(~mask);
-    if (mask & (1u << 7)) {
-      joy_irq_pending_ = false;
-    }
-    return;
+void MmioBus::gpu_write_gp1(uint32_t value) {
+  gpu_.gp1 = value;
+  gpu_.gp1_fifo.push_back(value);
+  attention_ = true;
+  gpu_extend_busy(1);
+  uint8_t cmd = static_cast<uint8_t>(value >> 24);
+  if (gpu_cmd_log_enabled()) {
+    std::cerr << "[gpu] GP1=0x" << std::hex << std::setw(8) << std::setfill('0') << value
+              << " cmd=0x" << std::setw(2) << static_cast<uint32_t>(cmd) << "\n";
   }
-  if (addr == 0x1F801074 || addr == 0x1F801075) { // I_MASK
-    if (addr & 1) {
-      irq_mask_ = static_cast<uint16_t>((irq_mask_ & 0x00FFu) | (static_cast<uint16_t>(value) << 8));
-    } else {
-      irq_mask_ = static_cast<uint16_t>((irq_mask_ & 0xFF00u) | value);
+  switch (cmd) {
+    case 0x00: { // Reset GPU
+      reset_gpu_state();
+      break;
     }
-    return;
-  }
-  if (addr == kJoyData) {
-    if ((joy_ctrl_ & kJoyCtrlDtr) == 0 || (joy_ctrl_ & kJoyCtrlTxEnable) == 0) {
-      return;
+    case 0x01: { // Reset command buffer
+      gpu_.gp0_fifo.clear();
+      gpu_.read_fifo.clear();
+      gpu_.read_pending.clear();
+      cancel_event(gpu_.read_event);
+      gpu_.read_latch = 0;
+      gpu_.busy_until = 0;
+      break;
     }
-    if (!joy_session_active_) {
-      if (value == 0x01) {
-        joy_device_ = 1; // pad
-      } else if (value == 0x81) {
-        joy_device_ = 2; // memory card
-      } else {
-        joy_device_ = 0;
-      }
-      joy_session_active_ = true;
-      joy_phase_ = 0;
+    case 0x02: { // Ack GPU IRQ
+      gpu_.irq = false;
+      irq_.stat &= static_cast<uint16_t>(~(1u << 1));
+      break;
     }
-
-    uint8_t response = 0xFF;
-    if (joy_device_ == 1) {
-      switch (joy_phase_) {
-        case 0:
-          response = 0xFF;
+    case 0x03: { // Display enable (0=on,1=off)
+      gpu_.display_disabled = (value & 0x1u) != 0;
+      break;
+    }
+    case 0x04: { // DMA direction
+      gpu_.dma_dir = value & 0x3u;
+      break;
+    }
+    case 0x05: { // Display start (VRAM)
+      gpu_.display_x = static_cast<uint16_t>(value & 0x3FFu);
+      gpu_.display_y = static_cast<uint16_t>((value >> 10) & 0x1FFu);
+      break;
+    }
+    case 0x06: { // Horizontal display range
+      gpu_.h_range_start = static_cast<uint16_t>(value & 0xFFFu);
+      gpu_.h_range_end = static_cast<uint16_t>((value >> 12) & 0xFFFu);
+      break;
+    }
+    case 0x07: { // Vertical display range
+      gpu_.v_range_start = static_cast<uint16_t>(value & 0x3FFu);
+      gpu_.v_range_end = static_cast<uint16_t>((value >> 10) & 0x3FFu);
+      break;
+    }
+    case 0x08: { // Display mode
+      gpu_.hres1 = value & 0x3u;
+      gpu_.vres = (value & (1u << 2)) != 0;
+      gpu_.vmode_pal = (value & (1u << 3)) != 0;
+      gpu_.display_depth24 = (value & (1u << 4)) != 0;
+      gpu_.interlace = (value & (1u << 5)) != 0;
+      gpu_.hres2 = (value & (1u << 6)) != 0;
+      gpu_.flip = (value & (1u << 7)) != 0;
+      break;
+    }
+    case 0x10:
+    case 0x11:
+    case 0x12:
+    case 0x13:
+    case 0x14:
+    case 0x15:
+    case 0x16:
+    case 0x17:
+    case 0x18:
+    case 0x19:
+    case 0x1A:
+    case 0x1B:
+    case 0x1C:
+    case 0x1D:
+    case 0x1E:
+    case 0x1F: { // Get GPU info
+      uint32_t index = value & 0x0Fu;
+      uint32_t response = 0;
+      bool has_response = true;
+      switch (index) {
+        case 0x02:
+          response = gpu_.tex_window & 0x00FFFFFFu;
           break;
-        case 1:
-          response = 0x41;
+        case 0x03:
+          response = gpu_.draw_area_tl & 0x00FFFFFFu;
           break;
-        case 2:
-          response = 0x5A;
+        case 0x04:
+          response = gpu_.draw_area_br & 0x00FFFFFFu;
           break;
-        case 3:
-          response = 0xFF;
+        case 0x05:
+          response = gpu_.draw_offset & 0x00FFFFFFu;
           break;
-        case 4:
-          response = 0xFF;
+        case 0x07:
+          response = 2;
           break;
         default:
-          response = 0xFF;
+          has_response = false;
           break;
       }
-    } else if (joy_device_ == 2) {
-      if (joy_phase_ == 0) {
-        response = 0xFF;
-      } else if (joy_phase_ == 1) {
-        response = 0x5A;
-      } else {
-        response = 0x00;
+      if (has_response) {
+        queue_gpu_read_data({response});
       }
-    } else {
-      response = 0xFF;
-    }
-
-    joy_tx_queue_.push_back(response);
-    joy_phase_ = static_cast<uint8_t>(joy_phase_ + 1);
-    if (joy_tx_delay_cycles_ == 0) {
-      joy_tx_delay_cycles_ = joy_byte_delay_cycles(joy_baud_);
+      break;
     }
-    return;
+    default:
+      break;
   }
-  if (addr == kJoyMode) {
-    joy_mode_ = static_cast<uint16_t>((joy_mode_ & 0xFF00u) | value);
-  } else if (addr == kJoyMode + 1) {
-    joy_mode_ = static_cast<uint16_t>((joy_mode_ & 0x00FFu) | (static_cast<uint16_t>(value) << 8));
-  } else if (addr == kJoyCtrl) {
-    joy_ctrl_ = static_cast<uint16_t>((joy_ctrl_ & 0xFF00u) | value);
-    if (joy_ctrl_ & kJoyCtrlAckReset) {
-      joy_irq_pending_ = false;
-      irq_stat_ &= static_cast<uint16_t>(~(1u << 7));
-      joy_ack_ = false;
-      joy_ack_cycles_ = 0;
-    }
-    if (joy_ctrl_ & kJoyCtrlReset) {
-      joy_rx_ready_ = false;
-      joy_ack_ = false;
-      joy_tx_queue_.clear();
-      joy_tx_delay_cycles_ = 0;
-      joy_rx_delay_cycles_ = 0;
-      joy_ack_cycles_ = 0;
-      joy_rx_pending_ = false;
-      joy_response_queue_.clear();
-      joy_session_active_ = false;
-      joy_phase_ = 0;
-      joy_device_ = 0;
-    }
-    if ((joy_ctrl_ & kJoyCtrlDtr) == 0) {
-      joy_rx_ready_ = false;
-      joy_ack_ = false;
-      joy_tx_queue_.clear();
-      joy_tx_delay_cycles_ = 0;
-      joy_rx_delay_cycles_ = 0;
-      joy_ack_cycles_ = 0;
-      joy_rx_pending_ = false;
-      joy_response_queue_.clear();
-      joy_session_active_ = false;
-      joy_phase_ = 0;
-      joy_device_ = 0;
-    }
-    if ((joy_ctrl_ & kJoyCtrlDtr) && !joy_rx_ready_ && !joy_response_queue_.empty()) {
-      joy_rx_ready_ = true;
-      joy_ack_ = true;
-      joy_ack_cycles_ = kJoyAckPulseCycles;
-      if ((joy_ctrl_ & kJoyCtrlIrqEnable) && !joy_irq_pending_) {
-        joy_irq_pending_ = true;
-        irq_stat_ |= static_cast<uint16_t>(1u << 7);
-      }
-    }
-  } else if (addr == kJoyCtrl + 1) {
-    joy_ctrl_ = static_cast<uint16_t>((joy_ctrl_ & 0x00FFu) | (static_cast<uint16_t>(value) << 8));
-    if (joy_ctrl_ & kJoyCtrlAckReset) {
-      joy_irq_pending_ = false;
-      irq_stat_ &= static_cast<uint16_t>(~(1u << 7));
-      joy_ack_ = false;
-      joy_ack_cycles_ = 0;
-    }
-    if (joy_ctrl_ & kJoyCtrlReset) {
-      joy_rx_ready_ = false;
-      joy_ack_ = false;
-      joy_tx_queue_.clear();
-      joy_tx_delay_cycles_ = 0;
-      joy_rx_delay_cycles_ = 0;
-      joy_ack_cycles_ = 0;
-      joy_rx_pending_ = false;
-      joy_response_queue_.clear();
-      joy_session_active_ = false;
-      joy_phase_ = 0;
-      joy_device_ = 0;
-    }
-    if ((joy_ctrl_ & kJoyCtrlDtr) == 0) {
-      joy_rx_ready_ = false;
-      joy_ack_ = false;
-      joy_tx_queue_.clear();
-      joy_tx_delay_cycles_ = 0;
-      joy_rx_delay_cycles_ = 0;
-      joy_ack_cycles_ = 0;
-      joy_rx_pending_ = false;
-      joy_response_queue_.clear();
-      joy_session_active_ = false;
-      joy_phase_ = 0;
-      joy_device_ = 0;
-    }
-    if ((joy_ctrl_ & kJoyCtrlDtr) && !joy_rx_ready_ && !joy_response_queue_.empty()) {
-      joy_rx_ready_ = true;
-      joy_ack_ = true;
-      joy_ack_cycles_ = kJoyAckPulseCycles;
-      if ((joy_ctrl_ & kJoyCtrlIrqEnable) && !joy_irq_pending_) {
-        joy_irq_pending_ = true;
-        irq_stat_ |= static_cast<uint16_t>(1u << 7);
-      }
-    }
-  } else if (addr == kJoyBaud) {
-    joy_baud_ = static_cast<uint16_t>((joy_baud_ & 0xFF00u) | value);
-  } else if (addr == kJoyBaud + 1) {
-    joy_baud_ = static_cast<uint16_t>((joy_baud_ & 0x00FFu) | (static_cast<uint16_t>(value) << 8));
-  } else if (addr == kSio1Data) {
-    sio1_rx_data_ = 0xFF;
-    sio1_rx_ready_ = true;
-    return;
-  } else if (addr == kSio1Mode) {
-    sio1_mode_ = static_cast<uint16_t>((sio1_mode_ & 0xFF00u) | value);
-  } else if (addr == kSio1Mode + 1) {
-    sio1_mode_ = static_cast<uint16_t>((sio1_mode_ & 0x00FFu) | (static_cast<uint16_t>(value) << 8));
-  } else if (addr == kSio1Ctrl) {
-    sio1_ctrl_ = static_cast<uint16_t>((sio1_ctrl_ & 0xFF00u) | value);
-  } else if (addr == kSio1Ctrl + 1) {
-    sio1_ctrl_ = static_cast<uint16_t>((sio1_ctrl_ & 0x00FFu) | (static_cast<uint16_t>(value) << 8));
-  } else if (addr == kSio1Misc) {
-    sio1_misc_ = static_cast<uint16_t>((sio1_misc_ & 0xFF00u) | value);
-  } else if (addr == kSio1Misc + 1) {
-    sio1_misc_ = static_cast<uint16_t>((sio1_misc_ & 0x00FFu) | (static_cast<uint16_t>(value) << 8));
-  } else if (addr == kSio1Baud) {
-    sio1_baud_ = static_cast<uint16_t>((sio1_baud_ & 0xFF00u) | value);
-  } else if (addr == kSio1Baud + 1) {
-    sio1_baud_ = static_cast<uint16_t>((sio1_baud_ & 0x00FFu) | (static_cast<uint16_t>(value) << 8));
-  }
-  if (addr >= 0x1F801800 && addr < 0x1F801804) {
-    uint32_t reg = addr - 0x1F801800;
+}
+
+uint8_t MmioBus::cdrom_read_register(uint32_t reg) {
+  uint8_t value = 0;
+  if (reg == 0) {
+    cdrom_.status = cdrom_status();
+    value = static_cast<uint8_t>((cdrom_.status & 0xFCu) | (cdrom_.index & 0x03u));
     if (cdrom_log_enabled()) {
-      std::cerr << "[cdrom] write reg" << reg
-                << " value=0x" << std::hex << std::setw(2) << std::setfill('0')
+      std::cerr << "[cdrom] read reg0 value=0x" << std::hex << std::setw(2) << std::setfill('0')
                 << static_cast<int>(value) << "\n";
     }
-    if (reg == 0) {
-      cdrom_index_ = value & 0x03u;
-    } else if (reg == 1) {
-      switch (cdrom_index_ & 0x3u) {
-        case 0:
-          cdrom_execute_command(value);
-          break;
-        case 1:
-          cdrom_set_irq_enable(value);
-          break;
-        case 2:
-          cdrom_vol_ll_ = value;
-          break;
-        case 3:
-          cdrom_vol_rr_ = value;
-          break;
-      }
-    } else if (reg == 2) {
-      switch (cdrom_index_ & 0x3u) {
-        case 0:
-          cdrom_param_fifo_.push_back(value);
-          break;
-        case 1:
-          if (value) {
-            cdrom_irq_flags_ &= static_cast<uint8_t>(~(value & 0x1Fu));
-            if (cdrom_irq_flags_ == 0 && !cdrom_irq_queue_.empty()) {
-              cdrom_irq_flags_ = cdrom_irq_queue_.front();
-              cdrom_irq_queue_.pop_front();
-            }
-            cdrom_update_irq_line();
-          }
-          break;
-        case 2:
-          cdrom_vol_lr_ = value;
-          break;
-        case 3:
-          cdrom_vol_rl_ = value;
-          break;
+    return value;
+  }
+  if (reg == 1) {
+    switch (cdrom_.index & 0x3u) {
+      case 0: {
+        if (!cdrom_.response_fifo.empty()) {
+          value = cdrom_.response_fifo.front();
+          cdrom_.response_fifo.erase(cdrom_.response_fifo.begin());
+        }
+        break;
       }
-    } else if (reg == 3) {
-      uint8_t bits = static_cast<uint8_t>(value & 0x1Fu);
-      if ((value & 0x80u) == 0) {
-        if ((cdrom_index_ & 0x3u) == 0) {
-          cdrom_request_ = value;
-          if (cdrom_request_ & 0x01u) {
-            cdrom_maybe_fill_data();
-          }
-        } else if ((cdrom_index_ & 0x3u) >= 2) {
-          cdrom_vol_apply_ = value;
+      case 1:
+        value = cdrom_.irq_enable;
+        break;
+      case 2:
+        value = cdrom_.vol_ll;
+        break;
+      case 3:
+        value = cdrom_.vol_rr;
+        break;
+    }
+  } else if (reg == 2) {
+    switch (cdrom_.index & 0x3u) {
+      case 0: {
+        if ((cdrom_.request & 0x01u) != 0) {
+          cdrom_maybe_fill_data();
         }
-      } else {
-        uint8_t ack = bits;
-        if (ack) {
-          cdrom_irq_flags_ &= static_cast<uint8_t>(~ack);
-          if (cdrom_irq_flags_ == 0 && !cdrom_irq_queue_.empty()) {
-            cdrom_irq_flags_ = cdrom_irq_queue_.front();
-            cdrom_irq_queue_.pop_front();
+        if ((cdrom_.request & 0x01u) != 0 && !cdrom_.data_fifo.empty()) {
+          value = cdrom_.data_fifo.front();
+          cdrom_.data_fifo.erase(cdrom_.data_fifo.begin());
+        }
+        break;
+      }
+      case 1:
+        value = cdrom_.irq_flags;
+        break;
+      case 2:
+        value = cdrom_.vol_lr;
+        break;
+      case 3:
+        value = cdrom_.vol_rl;
+        break;
+    }
+  } else {
+    value = (cdrom_.index & 0x3u) < 2 ? cdrom_.irq_flags : cdrom_.vol_apply;
+  }
+  if (cdrom_log_enabled()) {
+    std::cerr << "[cdrom] read reg" << reg << " idx=" << std::dec
+              << static_cast<int>(cdrom_.index & 0x3u) << " value=0x" << std::hex << std::setw(2)
+              << std::setfill('0') << static_cast<int>(value) << "\n";
+  }
+  return value;
+}
+
+void MmioBus::cdrom_write_register(uint32_t reg, uint8_t value) {
+  if (cdrom_log_enabled()) {
+    std::cerr << "[cdrom] write reg" << reg
+              << " value=0x" << std::hex << std::setw(2) << std::setfill('0')
+              << static_cast<int>(value) << "\n";
+  }
+  if (reg == 0) {
+    cdrom_.index = value & 0x03u;
+  } else if (reg == 1) {
+    switch (cdrom_.index & 0x3u) {
+      case 0:
+        cdrom_execute_command(value);
+        break;
+      case 1:
+        cdrom_set_irq_enable(value);
+        break;
+      case 2:
+        cdrom_.vol_ll = value;
+        break;
+      case 3:
+        cdrom_.vol_rr = value;
+        break;
+    }
+  } else if (reg == 2) {
+    switch (cdrom_.index & 0x3u) {
+      case 0:
+        cdrom_.param_fifo.push_back(value);
+        break;
+      case 1:
+        if (value) {
+          cdrom_.irq_flags &= static_cast<uint8_t>(~(value & 0x1Fu));
+          if (cdrom_.irq_flags == 0 && !cdrom_.irq_queue.empty()) {
+            cdrom_.irq_flags = cdrom_.irq_queue.front();
+            cdrom_.irq_queue.pop_front();
           }
           cdrom_update_irq_line();
         }
+        break;
+      case 2:
+        cdrom_.vol_lr = value;
+        break;
+      case 3:
+        cdrom_.vol_rl = value;
+        break;
+    }
+  } else {
+    uint8_t bits = static_cast<uint8_t>(value & 0x1Fu);
+    if ((value & 0x80u) == 0) {
+      if ((cdrom_.index & 0x3u) == 0) {
+        cdrom_.request = value;
+        if (cdrom_.request & 0x01u) {
+          cdrom_maybe_fill_data();
+        }
+      } else if ((cdrom_.index & 0x3u) >= 2) {
+        cdrom_.vol_apply = value;
+      }
+    } else if (bits) {
+      cdrom_.irq_flags &= static_cast<uint8_t>(~bits);
+      if (cdrom_.irq_flags == 0 && !cdrom_.irq_queue.empty()) {
+        cdrom_.irq_flags = cdrom_.irq_queue.front();
+        cdrom_.irq_queue.pop_front();
       }
+      cdrom_update_irq_line();
     }
   }
+}
 
-  uint32_t off = offset(addr);
-  if (off < kSize) {
-    raw_[off] = value;
-  }
+bool MmioBus::irq_pending() const {
+  return (irq_.stat & irq_.mask) != 0;
+}
 
-  if (addr >= 0x1F801800 && addr < 0x1F801804) {
-    cdrom_regs_[addr - 0x1F801800] = value;
-  }
+uint16_t MmioBus::irq_stat() const {
+  return irq_.stat;
+}
+
+uint16_t MmioBus::irq_mask() const {
+  return irq_.mask;
+}
+
+uint8_t MmioBus::read8(uint32_t addr) {
+  begin_access(addr);
+  uint8_t value = read8_register(addr);
+  end_access(addr);
+  sync_irq_line();
+  return value;
+}
+
+uint16_t MmioBus::read16(uint32_t addr) {
+  begin_access(addr);
+  uint16_t value = read16_register(addr);
+  end_access(addr);
+  sync_irq_line();
+  return value;
+}
+
+uint32_t MmioBus::read32(uint32_t addr) {
+  begin_access(addr);
+  uint32_t value = read32_register(addr);
+  end_access(addr);
+  sync_irq_line();
+  return value;
+}
+
+void MmioBus::write8(uint32_t addr, uint8_t value) {
+  begin_access(addr);
+  write8_register(addr, value);
+  end_access(addr);
+  sync_irq_line();
 }
 
 void MmioBus::write16(uint32_t addr, uint16_t value) {
-  if (addr == 0x1F801070) { // I_STAT
-    if (irq_log_enabled() && value != 0) {
-      std::cerr << "[irq] I_STAT clear=0x" << std::hex << std::setw(4) << std::setfill('0')
-                << value << "\n";
-    }
-    irq_stat_ &= static_cast<uint16_t>(~value);
-    if (value & (1u << 7)) {
-      joy_irq_pending_ = false;
-    }
+  begin_access(addr);
+  write16_register(addr, value);
+  end_access(addr);
+  sync_irq_line();
+}
+
+void MmioBus::write32(uint32_t addr, uint32_t value) {
+  begin_access(addr);
+  write32_register(addr, value);
+  end_access(addr);
+  sync_irq_line();
+}
+
+// Only the device behind the slot is synced; the rest stay lazy until their
+// own registers or events come up.
+void MmioBus::begin_access(uint32_t addr) {
+  catch_up();
+  uint32_t off = offset(addr);
+  if (off >= kSize) {
     return;
   }
-  if (addr == 0x1F801074) { // I_MASK
-    if (irq_log_enabled()) {
-      std::cerr << "[irq] I_MASK=0x" << std::hex << std::setw(4) << std::setfill('0')
-                << value << "\n";
-    }
-    irq_mask_ = value;
-    return;
+  const MmioSlot &slot = mmio_slot(off);
+  switch (slot.reg) {
+    case kRegJoyData:
+    case kRegJoyStat:
+    case kRegJoyMode:
+    case kRegJoyCtrl:
+    case kRegJoyBaud:
+      joy_sync();
+      break;
+    case kRegTimerCount:
+    case kRegTimerMode:
+    case kRegTimerTarget:
+      timer_catch_up(slot.unit);
+      break;
+    case kRegCdrom:
+      cdrom_sync_read_timer();
+      break;
+    default:
+      break;
   }
-  if (addr >= 0x1F801800 && addr < 0x1F801804) {
-    write8(addr, static_cast<uint8_t>(value & 0xFFu));
-    write8(addr + 1, static_cast<uint8_t>((value >> 8) & 0xFFu));
+}
+
+void MmioBus::end_access(uint32_t addr) {
+  uint32_t off = offset(addr);
+  if (off >= kSize) {
     return;
   }
-  if (addr == kJoyMode) {
-    joy_mode_ = value;
-  } else if (addr == kJoyCtrl) {
-    joy_ctrl_ = value;
-    if (joy_ctrl_ & kJoyCtrlAckReset) {
-      joy_irq_pending_ = false;
-      irq_stat_ &= static_cast<uint16_t>(~(1u << 7));
-      joy_ack_ = false;
-      joy_ack_cycles_ = 0;
-    }
-    if (joy_ctrl_ & kJoyCtrlReset) {
-      joy_rx_ready_ = false;
-      joy_ack_ = false;
-      joy_tx_queue_.clear();
-      joy_tx_delay_cycles_ = 0;
-      joy_rx_delay_cycles_ = 0;
-      joy_ack_cycles_ = 0;
-      joy_rx_pending_ = false;
-      joy_response_queue_.clear();
-      joy_session_active_ = false;
-      joy_phase_ = 0;
-      joy_device_ = 0;
-    }
-    if ((joy_ctrl_ & kJoyCtrlDtr) == 0) {
-      joy_rx_ready_ = false;
-      joy_ack_ = false;
-      joy_tx_queue_.clear();
-      joy_tx_delay_cycles_ = 0;
-      joy_rx_delay_cycles_ = 0;
-      joy_ack_cycles_ = 0;
-      joy_rx_pending_ = false;
-      joy_response_queue_.clear();
-      joy_session_active_ = false;
-      joy_phase_ = 0;
-      joy_device_ = 0;
-    }
-    if ((joy_ctrl_ & kJoyCtrlDtr) && !joy_rx_ready_ && !joy_response_queue_.empty()) {
-      joy_rx_ready_ = true;
-      joy_ack_ = true;
-      joy_ack_cycles_ = kJoyAckPulseCycles;
-      if ((joy_ctrl_ & kJoyCtrlIrqEnable) && !joy_irq_pending_) {
-        joy_irq_pending_ = true;
-        irq_stat_ |= static_cast<uint16_t>(1u << 7);
-      }
-    }
-  } else if (addr == kJoyBaud) {
-    joy_baud_ = value;
-  } else if (addr == kSio1Mode) {
-    sio1_mode_ = value;
-  } else if (addr == kSio1Ctrl) {
-    sio1_ctrl_ = value;
-  } else if (addr == kSio1Misc) {
-    sio1_misc_ = value;
-  } else if (addr == kSio1Baud) {
-    sio1_baud_ = value;
-  } else if (addr == kSpuCtrlAddr) {
-    spu_ctrl_ = value;
-  }
-  uint32_t off = offset(addr);
-  if (off + 1 < kSize) {
-    raw_[off] = static_cast<uint8_t>(value & 0xFF);
-    raw_[off + 1] = static_cast<uint8_t>((value >> 8) & 0xFF);
+  const MmioSlot &slot = mmio_slot(off);
+  switch (slot.reg) {
+    case kRegJoyData:
+    case kRegJoyStat:
+    case kRegJoyMode:
+    case kRegJoyCtrl:
+    case kRegJoyBaud:
+      joy_schedule();
+      break;
+    case kRegTimerCount:
+    case kRegTimerMode:
+    case kRegTimerTarget:
+      timer_schedule(slot.unit);
+      break;
+    case kRegCdrom:
+      cdrom_schedule_read();
+      break;
+    default:
+      break;
   }
+}
 
-  if (addr >= 0x1F801C00 && addr < 0x1F801E00) {
-    uint32_t index = (addr - 0x1F801C00) / 2;
-    if (index < spu_regs_.size()) {
-      spu_regs_[index] = value;
-    }
+void MmioBus::tick(uint32_t cycles) {
+  uint64_t target = events_.now() + cycles;
+  ScheduledEvent event;
+  while (events_.next_event_time() <= target && events_.pop_next(event)) {
+    events_.advance(static_cast<uint32_t>(event.when - events_.now()));
+    run_event(event);
   }
+  events_.advance(static_cast<uint32_t>(target - events_.now()));
+  sync_irq_line();
 
-  if (addr >= 0x1F801100 && addr < 0x1F801130) {
-    uint32_t timer = (addr - 0x1F801100) / 0x10;
-    uint32_t reg = (addr - 0x1F801100) % 0x10;
-    if (timer < 3) {
-      if (reg == 0x0) {
-        timer_count_[timer] = value;
-        timer_cycle_accum_[timer] = 0;
-        if (irq_log_enabled()) {
-          std::cerr << "[timer] T" << timer << " count=0x" << std::hex << std::setw(4)
-                    << std::setfill('0') << value << "\n";
-        }
-      } else if (reg == 0x4) {
-        timer_irq_on_target_[timer] = (value & (1u << 4)) != 0;
-        timer_irq_on_overflow_[timer] = (value & (1u << 5)) != 0;
-        timer_irq_repeat_[timer] = (value & (1u << 6)) != 0;
-        timer_irq_toggle_[timer] = (value & (1u << 7)) != 0;
-        timer_irq_enable_[timer] = timer_irq_on_target_[timer] || timer_irq_on_overflow_[timer];
-        timer_mode_[timer] = static_cast<uint16_t>(value & 0x03FFu);
-        timer_mode_[timer] |= static_cast<uint16_t>(1u << 10);
-        timer_mode_[timer] &= static_cast<uint16_t>(~((1u << 11) | (1u << 12)));
-        timer_count_[timer] = 0;
-        timer_cycle_accum_[timer] = 0;
-        irq_stat_ &= static_cast<uint16_t>(~(1u << (4 + timer)));
-        timer_sync_waiting_[timer] =
-            ((timer_mode_[timer] & 0x1u) && (((timer_mode_[timer] >> 1) & 0x3u) == 3u));
-        if (irq_log_enabled()) {
-          std::cerr << "[timer] T" << timer << " mode=0x" << std::hex << std::setw(4)
-                    << std::setfill('0') << timer_mode_[timer] << "\n";
-        }
-      } else if (reg == 0x8) {
-        timer_target_[timer] = value;
-        if (irq_log_enabled()) {
-          std::cerr << "[timer] T" << timer << " target=0x" << std::hex << std::setw(4)
-                    << std::setfill('0') << value << "\n";
-        }
+  if (timer_log_enabled()) {
+    static uint32_t timer_log_accum = 0;
+    timer_log_accum += cycles;
+    constexpr uint32_t kTimerLogPeriod = 200000;
+    if (timer_log_accum >= kTimerLogPeriod) {
+      timer_log_accum %= kTimerLogPeriod;
+      for (int i = 0; i < 3; ++i) {
+        timer_catch_up(i);
       }
+      std::cerr << "[timer] counts T0=0x" << std::hex << std::setw(4) << std::setfill('0')
+                << timers_.count[0]
+                << " T1=0x" << std::setw(4) << timers_.count[1]
+                << " T2=0x" << std::setw(4) << timers_.count[2] << "\n";
     }
   }
+}
 
-  if (addr == 0x1F801070) { // I_STAT
-    if (irq_log_enabled() && value != 0) {
-      std::cerr << "[irq] I_STAT clear=0x" << std::hex << std::setw(4) << std::setfill('0')
-                << value << "\n";
-    }
-    irq_stat_ &= static_cast<uint16_t>(~value);
-    if (value & (1u << 7)) {
-      joy_irq_pending_ = false;
-    }
-  } else if (addr == 0x1F801074) { // I_MASK
-    if (irq_log_enabled()) {
-      std::cerr << "[irq] I_MASK=0x" << std::hex << std::setw(4) << std::setfill('0')
-                << value << "\n";
-    }
-    irq_mask_ = value;
-  }
+void MmioBus::attach_clock(const Scheduler &clock) {
+  clock_ = &clock;
 }
 
-void MmioBus::write32(uint32_t addr, uint32_t value) {
-  uint32_t off = offset(addr);
-  if (off + 3 >= kSize) {
+void MmioBus::catch_up() {
+  if (!clock_) {
     return;
   }
+  uint64_t now = clock_->now();
+  while (now > events_.now()) {
+    tick(static_cast<uint32_t>(std::min<uint64_t>(now - events_.now(), UINT32_MAX)));
+  }
+}
 
-  if (addr >= 0x1F801100 && addr < 0x1F801130) {
-    write16(addr, static_cast<uint16_t>(value & 0xFFFFu));
-    return;
+uint64_t MmioBus::next_event_time() const {
+  return events_.next_event_time();
+}
+
+bool MmioBus::needs_attention() const {
+  return attention_;
+}
+
+void MmioBus::clear_attention() {
+  attention_ = false;
+  ++device_activity_;
+}
+
+uint64_t MmioBus::device_activity() const {
+  return device_activity_;
+}
+
+uint64_t MmioBus::gpu_busy_until() const {
+  return gpu_.busy_until;
+}
+
+bool MmioBus::take_vblank() {
+  bool pending = gpu_.vblank_pending;
+  gpu_.vblank_pending = false;
+  return pending;
+}
+
+void MmioBus::schedule_event(EventHandle &handle, uint64_t cycles_from_now, EventId id) {
+  if (!events_.reschedule(handle, cycles_from_now)) {
+    handle = events_.schedule(cycles_from_now, id);
   }
+}
 
-  if (addr >= 0x1F801800 && addr < 0x1F801804) {
-    write8(addr, static_cast<uint8_t>(value & 0xFFu));
-    write8(addr + 1, static_cast<uint8_t>((value >> 8) & 0xFFu));
-    write8(addr + 2, static_cast<uint8_t>((value >> 16) & 0xFFu));
-    write8(addr + 3, static_cast<uint8_t>((value >> 24) & 0xFFu));
-    return;
+void MmioBus::cancel_event(EventHandle &handle) {
+  events_.cancel(handle);
+  handle = kInvalidEvent;
+}
+
+void MmioBus::run_event(const ScheduledEvent &event) {
+  ++device_activity_;
+  switch (event.id) {
+    case kEventHblank:
+      gpu_hblank();
+      break;
+    case kEventVblank:
+      gpu_vblank();
+      break;
+    case kEventTimer0:
+    case kEventTimer1:
+    case kEventTimer2: {
+      int i = event.id - kEventTimer0;
+      timer_catch_up(i);
+      timer_schedule(i);
+      break;
+    }
+    case kEventGpuRead:
+      queue_gpu_read_data(std::move(gpu_.read_pending));
+      gpu_.read_pending.clear();
+      break;
+    case kEventCdromResponse:
+      cdrom_deliver_response();
+      break;
+    case kEventCdromRead:
+      cdrom_sync_read_timer();
+      cdrom_maybe_fill_data();
+      cdrom_schedule_read();
+      break;
+    case kEventJoy:
+      joy_sync();
+      joy_schedule();
+      break;
+    default:
+      break;
+  }
+}
+
+uint32_t MmioBus::frame_period() const {
+  constexpr uint32_t kCpuCyclesPerFrameNtsc = 33868800 / 60;
+  constexpr uint32_t kCpuCyclesPerFramePal = 33868800 / 50;
+  return gpu_.vmode_pal ? kCpuCyclesPerFramePal : kCpuCyclesPerFrameNtsc;
+}
+
+uint32_t MmioBus::line_period() const {
+  uint32_t lines_per_frame = gpu_.vmode_pal ? 314u : 262u;
+  return std::max(1u, frame_period() / lines_per_frame);
+}
+
+bool MmioBus::gpu_in_vblank() const {
+  return gpu_.line >= (gpu_.vmode_pal ? 256u : 240u);
+}
+
+void MmioBus::gpu_hblank() {
+  uint32_t lines_per_frame = gpu_.vmode_pal ? 314u : 262u;
+  uint32_t vblank_start_line = gpu_.vmode_pal ? 256u : 240u;
+  // Settle the cycle-clocked span of the line under the old blank state.
+  timer_catch_up(0);
+  timer_catch_up(1);
+  gpu_.line++;
+  if (gpu_.line >= lines_per_frame) {
+    gpu_.line = 0;
   }
+  bool vblank_start_pulse = gpu_.line == vblank_start_line;
+  timer_advance(0, 0, 1, true, true);
+  timer_advance(1, 0, 1, gpu_in_vblank(), vblank_start_pulse);
+  timer_schedule(0);
+  timer_schedule(1);
+  schedule_event(gpu_.line_event, line_period(), kEventHblank);
+}
+
+void MmioBus::gpu_vblank() {
+  gpu_.field = gpu_.interlace ? !gpu_.field : false;
+  gpu_.vblank_pending = true;
+  attention_ = true;
+  irq_.stat |= 1u << 0;
+  if (irq_log_enabled()) {
+    std::cerr << "[irq] VBLANK irq_stat=0x" << std::hex << std::setw(4) << std::setfill('0')
+              << irq_.stat << "\n";
+  }
+  uint32_t period = frame_period();
+  uint32_t field_period = gpu_.interlace ? std::max(1u, period / 2) : period;
+  schedule_event(gpu_.field_event, field_period, kEventVblank);
+}
+
+void MmioBus::gpu_extend_busy(uint32_t cycles) {
+  uint64_t now = events_.now();
+  gpu_.busy_until = std::min<uint64_t>(std::max(gpu_.busy_until, now) + cycles, now + 100000);
+}
 
-  if (addr == 0x1F801070) { // I_STAT
-    irq_stat_ &= static_cast<uint16_t>(~value);
-    if (value & (1u << 7)) {
-      joy_irq_pending_ = false;
-    }
-  } else if (addr == 0x1F801074) { // I_MASK
-    irq_mask_ = static_cast<uint16_t>(value);
-  }
-
-  if (addr == 0x1F801810) { // GPU GP0
-    gpu_gp0_ = value;
-    gpu_gp0_fifo_.push_back(value);
-    apply_gp0_state(value);
-    uint32_t penalty = 1;
-    gpu_busy_cycles_ = std::min<uint32_t>(gpu_busy_cycles_ + penalty, 100000);
-  } else if (addr == 0x1F801814) { // GPU GP1
-    gpu_gp1_ = value;
-    gpu_gp1_fifo_.push_back(value);
-    uint32_t penalty = 1;
-    gpu_busy_cycles_ = std::min<uint32_t>(gpu_busy_cycles_ + penalty, 100000);
-    uint8_t cmd = static_cast<uint8_t>(value >> 24);
-    if (gpu_cmd_log_enabled()) {
-      std::cerr << "[gpu] GP1=0x" << std::hex << std::setw(8) << std::setfill('0') << value
-                << " cmd=0x" << std::setw(2) << static_cast<uint32_t>(cmd) << "\n";
-    }
-    switch (cmd) {
-      case 0x00: { // Reset GPU
-        reset_gpu_state();
+void MmioBus::timer_advance(int i, uint32_t cycles, uint32_t hblank_pulses, bool blank, bool blank_start) {
+  auto div_ticks = [&](uint32_t add, uint32_t div) -> uint32_t {
+    if (div == 0) {
+      return 0;
+    }
+    timers_.cycle_accum[i] += add;
+    uint32_t ticks = timers_.cycle_accum[i] / div;
+    timers_.cycle_accum[i] %= div;
+    return ticks;
+  };
+
+  uint32_t before = timers_.count[i];
+  uint16_t mode = timers_.mode[i];
+  uint32_t clock = (mode >> 8) & 0x3u;
+  uint32_t ticks = 0;
+  if (i == 2) {
+    switch (clock) {
+      case 0:
+        ticks = cycles;
         break;
-      }
-      case 0x01: { // Reset command buffer
-        gpu_gp0_fifo_.clear();
-        gpu_read_fifo_.clear();
-        gpu_read_pending_.clear();
-        gpu_read_pending_delay_ = 0;
-        gpu_read_latch_ = 0;
-        gpu_busy_cycles_ = 0;
+      case 1:
+        ticks = div_ticks(cycles, 8);
         break;
-      }
-      case 0x02: { // Ack GPU IRQ
-        gpu_irq_ = false;
-        irq_stat_ &= static_cast<uint16_t>(~(1u << 1));
+      case 2:
+        ticks = div_ticks(cycles, 32);
         break;
-      }
-      case 0x03: { // Display enable (0=on,1=off)
-        gpu_display_disabled_ = (value & 0x1u) != 0;
+      case 3:
+        ticks = div_ticks(cycles, 128);
         break;
-      }
-      case 0x04: { // DMA direction
-        gpu_dma_dir_ = value & 0x3u;
+      default:
+        ticks = cycles;
         break;
-      }
-      case 0x05: { // Display start (VRAM)
-        gpu_display_x_ = static_cast<uint16_t>(value & 0x3FFu);
-        gpu_display_y_ = static_cast<uint16_t>((value >> 10) & 0x1FFu);
+    }
+  } else if (i == 1) {
+    switch (clock) {
+      case 0:
+        ticks = cycles;
         break;
-      }
-      case 0x06: { // Horizontal display range
-        gpu_h_range_start_ = static_cast<uint16_t>(value & 0xFFFu);
-        gpu_h_range_end_ = static_cast<uint16_t>((value >> 12) & 0xFFFu);
+      case 1:
+        ticks = hblank_pulses;
         break;
-      }
-      case 0x07: { // Vertical display range
-        gpu_v_range_start_ = static_cast<uint16_t>(value & 0x3FFu);
-        gpu_v_range_end_ = static_cast<uint16_t>((value >> 10) & 0x3FFu);
+      case 2:
+        ticks = div_ticks(cycles, 8);
         break;
-      }
-      case 0x08: { // Display mode
-        gpu_hres1_ = value & 0x3u;
-        gpu_vres_ = (value & (1u << 2)) != 0;
-        gpu_vmode_pal_ = (value & (1u << 3)) != 0;
-        gpu_display_depth24_ = (value & (1u << 4)) != 0;
-        gpu_interlace_ = (value & (1u << 5)) != 0;
-        gpu_hres2_ = (value & (1u << 6)) != 0;
-        gpu_flip_ = (value & (1u << 7)) != 0;
+      case 3:
+        ticks = div_ticks(hblank_pulses, 8);
         break;
-      }
-      case 0x10:
-      case 0x11:
-      case 0x12:
-      case 0x13:
-      case 0x14:
-      case 0x15:
-      case 0x16:
-      case 0x17:
-      case 0x18:
-      case 0x19:
-      case 0x1A:
-      case 0x1B:
-      case 0x1C:
-      case 0x1D:
-      case 0x1E:
-      case 0x1F: { // Get GPU info
-        uint32_t index = value & 0x0Fu;
-        uint32_t response = 0;
-        bool has_response = true;
-        switch (index) {
-          case 0x02:
-            response = gpu_tex_window_ & 0x00FFFFFFu;
-            break;
-          case 0x03:
-            response = gpu_draw_area_tl_ & 0x00FFFFFFu;
-            break;
-          case 0x04:
-            response = gpu_draw_area_br_ & 0x00FFFFFFu;
-            break;
-          case 0x05:
-            response = gpu_draw_offset_ & 0x00FFFFFFu;
-            break;
-          case 0x07:
-            response = 2;
-            break;
-          default:
-            has_response = false;
-            break;
-        }
-        if (has_response) {
-          queue_gpu_read_data({response});
-        }
+      default:
+        ticks = cycles;
+        break;
+    }
+  } else { // i == 0
+    switch (clock) {
+      case 0:
+        ticks = cycles;
+        break;
+      case 1:
+        ticks = cycles;
+        break;
+      case 2:
+        ticks = div_ticks(cycles, 8);
+        break;
+      case 3:
+        ticks = div_ticks(cycles, 8);
         break;
-      }
       default:
+        ticks = cycles;
         break;
     }
   }
 
-  if (addr >= 0x1F801080 && addr < 0x1F8010F0) {
-    uint32_t index = (addr - 0x1F801080) / 0x10;
-    uint32_t reg = (addr - 0x1F801080) % 0x10;
-    if (index < 7) {
-      if (reg == 0x0) {
-        dma_madr_[index] = value;
-      } else if (reg == 0x4) {
-        dma_bcr_[index] = value;
-      } else if (reg == 0x8) {
-        dma_chcr_[index] = value;
-        if (value & (1u << 24)) {
-          dma_pending_mask_ |= (1u << index);
-          if (irq_log_enabled()) {
-            std::cerr << "[irq] DMA start ch=" << std::dec << index
-                      << " madr=0x" << std::hex << std::setw(8) << std::setfill('0')
-                      << dma_madr_[index]
-                      << " bcr=0x" << std::setw(8) << dma_bcr_[index]
-                      << " chcr=0x" << std::setw(8) << dma_chcr_[index] << "\n";
-          }
+  bool sync_enable = (mode & 0x1u) != 0;
+  uint32_t sync_mode = (mode >> 1) & 0x3u;
+  if (sync_enable) {
+    if (sync_mode == 3) {
+      if (timers_.sync_waiting[i]) {
+        if (blank_start) {
+          timers_.sync_waiting[i] = false;
+          timers_.count[i] = 0;
+          timers_.cycle_accum[i] = 0;
+          ticks = 0;
+        } else {
+          ticks = 0;
         }
       }
     }
-  } else if (addr == 0x1F8010F0) {
-    dma_dpcr_ = value;
-  } else if (addr == 0x1F8010F4) {
-    uint32_t clear = (value >> 24) & 0x7F;
-    dma_dicr_ &= ~(clear << 24);
-    dma_dicr_ = (dma_dicr_ & 0xFF000000u) | (value & 0x00FFFFFFu);
-    dma_dicr_ = recompute_dma_master(dma_dicr_);
-    if (dma_dicr_ & (1u << 31)) {
-      irq_stat_ |= (1u << 3);
-    } else {
-      irq_stat_ &= static_cast<uint16_t>(~(1u << 3));
-    }
-    if (irq_log_enabled()) {
-      std::cerr << "[irq] DICR=0x" << std::hex << std::setw(8) << std::setfill('0')
-                << dma_dicr_ << "\n";
+    if (sync_mode == 0) {
+      if (blank) {
+        ticks = 0;
+      }
+    } else if (sync_mode == 1) {
+      if (blank_start) {
+        before = 0;
+        timers_.count[i] = 0;
+        timers_.cycle_accum[i] = 0;
+        ticks = 0;
+      }
+    } else if (sync_mode == 2) {
+      if (blank_start) {
+        before = 0;
+        timers_.count[i] = 0;
+        timers_.cycle_accum[i] = 0;
+        ticks = 0;
+      }
+      if (!blank) {
+        ticks = 0;
+      }
     }
   }
 
-  if (addr >= 0x1F801100 && addr < 0x1F801130) {
-    uint32_t timer = (addr - 0x1F801100) / 0x10;
-    uint32_t reg = (addr - 0x1F801100) % 0x10;
-    if (timer < 3) {
-      if (reg == 0x0) {
-        timer_count_[timer] = static_cast<uint16_t>(value);
-        timer_cycle_accum_[timer] = 0;
-        if (irq_log_enabled()) {
-          std::cerr << "[timer] T" << timer << " count=0x" << std::hex << std::setw(4)
-                    << std::setfill('0') << timer_count_[timer] << "\n";
-        }
-      } else if (reg == 0x4) {
-        uint16_t mode = static_cast<uint16_t>(value);
-        timer_irq_on_target_[timer] = (mode & (1u << 4)) != 0;
-        timer_irq_on_overflow_[timer] = (mode & (1u << 5)) != 0;
-        timer_irq_repeat_[timer] = (mode & (1u << 6)) != 0;
-        timer_irq_toggle_[timer] = (mode & (1u << 7)) != 0;
-        timer_irq_enable_[timer] = timer_irq_on_target_[timer] || timer_irq_on_overflow_[timer];
-        timer_mode_[timer] = static_cast<uint16_t>(mode & 0x03FFu);
-        timer_mode_[timer] |= static_cast<uint16_t>(1u << 10);
-        timer_mode_[timer] &= static_cast<uint16_t>(~((1u << 11) | (1u << 12)));
-        timer_count_[timer] = 0;
-        timer_cycle_accum_[timer] = 0;
-        irq_stat_ &= static_cast<uint16_t>(~(1u << (4 + timer)));
-        timer_sync_waiting_[timer] =
-            ((timer_mode_[timer] & 0x1u) && (((timer_mode_[timer] >> 1) & 0x3u) == 3u));
-        if (irq_log_enabled()) {
-          std::cerr << "[timer] T" << timer << " mode=0x" << std::hex << std::setw(4)
-                    << std::setfill('0') << timer_mode_[timer] << "\n";
-        }
-      } else if (reg == 0x8) {
-        timer_target_[timer] = static_cast<uint16_t>(value);
-        if (irq_log_enabled()) {
-          std::cerr << "[timer] T" << timer << " target=0x" << std::hex << std::setw(4)
-                    << std::setfill('0') << timer_target_[timer] << "\n";
-        }
+  uint32_t full = before + ticks;
+  uint32_t after = full & 0xFFFFu;
+  timers_.count[i] = static_cast<uint16_t>(after);
+  uint16_t target = timers_.target[i];
+  if (ticks > 0 && target != 0 && before < target && full >= target && full <= 0x1FFFFu) {
+    timers_.mode[i] |= static_cast<uint16_t>(1u << 11);
+    if (timers_.irq_enable[i] && timers_.irq_on_target[i]) {
+      bool fire = true;
+      if (timers_.irq_toggle[i]) {
+        timers_.mode[i] ^= static_cast<uint16_t>(1u << 10);
+        fire = (timers_.mode[i] & (1u << 10)) == 0;
+      } else {
+        timers_.mode[i] &= static_cast<uint16_t>(~(1u << 10));
+      }
+      if (fire) {
+        irq_.stat |= static_cast<uint16_t>(1u << (4 + i));
+      }
+      if (!timers_.irq_repeat[i]) {
+        timers_.irq_enable[i] = false;
       }
     }
-  }
-
-  if (addr >= 0x1F801C00 && addr < 0x1F801E00) {
-    uint32_t index = (addr - 0x1F801C00) / 2;
-    if (index < spu_regs_.size()) {
-      spu_regs_[index] = static_cast<uint16_t>(value);
+    if (mode & (1u << 3)) { // reset on target
+      timers_.count[i] = 0;
+      timers_.cycle_accum[i] = 0;
     }
-    if (addr == kSpuCtrlAddr) {
-      spu_ctrl_ = static_cast<uint16_t>(value);
+  }
+  if (full > 0xFFFFu) {
+    timers_.mode[i] |= static_cast<uint16_t>(1u << 12);
+    if (timers_.irq_on_overflow[i] && timers_.irq_enable[i]) {
+      bool fire = true;
+      if (timers_.irq_toggle[i]) {
+        timers_.mode[i] ^= static_cast<uint16_t>(1u << 10);
+        fire = (timers_.mode[i] & (1u << 10)) == 0;
+      } else {
+        timers_.mode[i] &= static_cast<uint16_t>(~(1u << 10));
+      }
+      if (fire) {
+        irq_.stat |= static_cast<uint16_t>(1u << (4 + i));
+      }
+      if (!timers_.irq_repeat[i]) {
+        timers_.irq_enable[i] = false;
+      }
     }
   }
+}
 
-  if (addr >= 0x1F801800 && addr < 0x1F801804) {
-    cdrom_regs_[addr - 0x1F801800] = static_cast<uint8_t>(value & 0xFF);
+// Counters only move when read or when they reach a target/overflow
+// event; blank pulses are applied by the line event.
+void MmioBus::timer_catch_up(int i) {
+  uint64_t now = events_.now();
+  uint64_t elapsed = now - timers_.synced_at[i];
+  timers_.synced_at[i] = now;
+  if (elapsed == 0) {
+    return;
   }
-
-  raw_[off] = static_cast<uint8_t>(value & 0xFF);
-  raw_[off + 1] = static_cast<uint8_t>((value >> 8) & 0xFF);
-  raw_[off + 2] = static_cast<uint8_t>((value >> 16) & 0xFF);
-  raw_[off + 3] = static_cast<uint8_t>((value >> 24) & 0xFF);
+  bool blank = i == 1 && gpu_in_vblank();
+  timer_advance(i, static_cast<uint32_t>(std::min<uint64_t>(elapsed, UINT32_MAX)), 0, blank, false);
 }
 
-bool MmioBus::irq_pending() const {
-  return (irq_stat_ & irq_mask_) != 0;
+bool MmioBus::timer_counts_cycles(int i) const {
+  uint16_t mode = timers_.mode[i];
+  uint32_t clock = (mode >> 8) & 0x3u;
+  if (i == 1 && (clock & 0x1u)) {
+    return false; // counts hblanks
+  }
+  if ((mode & 0x1u) == 0) {
+    return true;
+  }
+  uint32_t sync_mode = (mode >> 1) & 0x3u;
+  if (sync_mode == 3 && timers_.sync_waiting[i]) {
+    return false;
+  }
+  if (i == 1) {
+    if (sync_mode == 0) {
+      return !gpu_in_vblank();
+    }
+    if (sync_mode == 2) {
+      return gpu_in_vblank();
+    }
+    return true;
+  }
+  return sync_mode != 2;
 }
 
-uint16_t MmioBus::irq_stat() const {
-  return irq_stat_;
+uint32_t MmioBus::timer_divider(int i) const {
+  uint32_t clock = (timers_.mode[i] >> 8) & 0x3u;
+  if (i == 2) {
+    static constexpr uint32_t kDividers[4] = {1, 8, 32, 128};
+    return kDividers[clock];
+  }
+  if (i == 1) {
+    return clock == 2 ? 8u : 1u;
+  }
+  return clock >= 2 ? 8u : 1u;
 }
 
-uint16_t MmioBus::irq_mask() const {
-  return irq_mask_;
+void MmioBus::timer_schedule(int i) {
+  if (!timer_counts_cycles(i)) {
+    cancel_event(timers_.event[i]);
+    return;
+  }
+  uint32_t count = timers_.count[i];
+  uint32_t target = timers_.target[i];
+  uint32_t ticks = (target != 0 && count < target) ? target - count : 0x10000u - count;
+  uint32_t div = timer_divider(i);
+  uint64_t cycles = static_cast<uint64_t>(ticks) * div;
+  if (div > 1) {
+    cycles -= std::min<uint64_t>(timers_.cycle_accum[i], cycles - 1);
+  }
+  schedule_event(timers_.event[i], cycles, static_cast<EventId>(kEventTimer0 + i));
 }
 
-void MmioBus::tick(uint32_t cycles) {
-  constexpr uint32_t kCpuCyclesPerFrameNtsc = 33868800 / 60;
-  constexpr uint32_t kCpuCyclesPerFramePal = 33868800 / 50;
-  bool vblank_pulse = false;
-  uint32_t hblank_pulses = 0;
-  bool vblank_start_pulse = false;
-
-  if (gpu_busy_cycles_ > 0) {
-    if (gpu_busy_cycles_ > cycles) {
-      gpu_busy_cycles_ -= cycles;
-    } else {
-      gpu_busy_cycles_ = 0;
-    }
+void MmioBus::cdrom_deliver_response() {
+  if (cdrom_.pending.empty()) {
+    return;
   }
-
-  if (!gpu_read_pending_.empty()) {
-    if (gpu_read_pending_delay_ > cycles) {
-      gpu_read_pending_delay_ -= cycles;
-    } else {
-      gpu_read_pending_delay_ = 0;
-      queue_gpu_read_data(std::move(gpu_read_pending_));
-      gpu_read_pending_.clear();
-    }
-  }
-
-  gpu_field_cycle_accum_ += cycles;
-  uint32_t period = gpu_vmode_pal_ ? kCpuCyclesPerFramePal : kCpuCyclesPerFrameNtsc;
-  if (period == 0) {
-    period = kCpuCyclesPerFrameNtsc;
-  }
-  uint32_t lines_per_frame = gpu_vmode_pal_ ? 314u : 262u;
-  uint32_t vblank_start_line = gpu_vmode_pal_ ? 256u : 240u;
-  uint32_t line_period = period / std::max(1u, lines_per_frame);
-  if (line_period == 0) {
-    line_period = 1;
-  }
-  gpu_line_cycle_accum_ += cycles;
-  while (gpu_line_cycle_accum_ >= line_period) {
-    gpu_line_cycle_accum_ -= line_period;
-    hblank_pulses++;
-    gpu_line_++;
-    if (gpu_line_ >= lines_per_frame) {
-      gpu_line_ = 0;
-    }
-    if (gpu_line_ == vblank_start_line) {
-      vblank_start_pulse = true;
-    }
-  }
-  bool in_vblank = gpu_line_ >= vblank_start_line;
-  bool in_hblank = hblank_pulses > 0;
-  uint32_t field_period = gpu_interlace_ ? std::max(1u, period / 2) : period;
-  if (gpu_field_cycle_accum_ >= field_period) {
-    if (gpu_interlace_) {
-      while (gpu_field_cycle_accum_ >= field_period) {
-        gpu_field_cycle_accum_ -= field_period;
-        gpu_field_ = !gpu_field_;
-        vblank_pulse = true;
-      }
-    } else {
-      gpu_field_cycle_accum_ %= field_period;
-      gpu_field_ = false;
-      vblank_pulse = true;
-    }
+  CdromPendingResponse pending = std::move(cdrom_.pending.front());
+  cdrom_.pending.pop_front();
+  if (pending.clear_seeking) {
+    cdrom_.seeking = false;
   }
-
-  if (cdrom_reading_ && !cdrom_error_ && cdrom_image_.loaded()) {
-    if (cdrom_data_fifo_.empty()) {
-      if (cdrom_read_timer_ > cycles) {
-        cdrom_read_timer_ -= cycles;
-      } else {
-        cdrom_read_timer_ = 0;
-      }
-      cdrom_maybe_fill_data();
-    }
+  if (!pending.response.empty()) {
+    pending.response[0] = cdrom_status();
   }
+  cdrom_push_response_block(pending.response);
+  cdrom_raise_irq(pending.irq_flags);
+  if (!cdrom_.pending.empty() && !events_.pending(cdrom_.response_event)) {
+    schedule_event(cdrom_.response_event, cdrom_.pending.front().delay_cycles, kEventCdromResponse);
+  }
+}
 
-  auto div_ticks = [&](int idx, uint32_t add, uint32_t div) -> uint32_t {
-    if (div == 0) {
-      return 0;
-    }
-    timer_cycle_accum_[idx] += add;
-    uint32_t ticks = timer_cycle_accum_[idx] / div;
-    timer_cycle_accum_[idx] %= div;
-    return ticks;
-  };
-
-  for (int i = 0; i < 3; ++i) {
-    uint32_t before = timer_count_[i];
-    uint16_t mode = timer_mode_[i];
-    uint32_t clock = (mode >> 8) & 0x3u;
-    uint32_t ticks = 0;
-    if (i == 2) {
-      switch (clock) {
-        case 0:
-          ticks = cycles;
-          break;
-        case 1:
-          ticks = div_ticks(i, cycles, 8);
-          break;
-        case 2:
-          ticks = div_ticks(i, cycles, 32);
-          break;
-        case 3:
-          ticks = div_ticks(i, cycles, 128);
-          break;
-        default:
-          ticks = cycles;
-          break;
-      }
-    } else if (i == 1) {
-      switch (clock) {
-        case 0:
-          ticks = cycles;
-          break;
-        case 1:
-          ticks = hblank_pulses;
-          break;
-        case 2:
-          ticks = div_ticks(i, cycles, 8);
-          break;
-        case 3:
-          ticks = div_ticks(i, hblank_pulses, 8);
-          break;
-        default:
-          ticks = cycles;
-          break;
-      }
-    } else { // i == 0
-      switch (clock) {
-        case 0:
-          ticks = cycles;
-          break;
-        case 1:
-          ticks = cycles;
-          break;
-        case 2:
-          ticks = div_ticks(i, cycles, 8);
-          break;
-        case 3:
-          ticks = div_ticks(i, cycles, 8);
-          break;
-        default:
-          ticks = cycles;
-          break;
-      }
-    }
+void MmioBus::cdrom_clear_pending() {
+  cdrom_.pending.clear();
+  cancel_event(cdrom_.response_event);
+}
 
-    bool sync_enable = (mode & 0x1u) != 0;
-    uint32_t sync_mode = (mode >> 1) & 0x3u;
-    bool blank = (i == 0) ? in_hblank : (i == 1 ? in_vblank : false);
-    bool blank_start = (i == 0) ? in_hblank : (i == 1 ? vblank_start_pulse : false);
-    if (sync_enable) {
-      if (sync_mode == 3) {
-        if (timer_sync_waiting_[i]) {
-          if (blank_start) {
-            timer_sync_waiting_[i] = false;
-            timer_count_[i] = 0;
-            timer_cycle_accum_[i] = 0;
-            ticks = 0;
-          } else {
-            ticks = 0;
-          }
-        }
-      }
-      if (sync_mode == 0) {
-        if (blank) {
-          ticks = 0;
-        }
-      } else if (sync_mode == 1) {
-        if (blank_start) {
-          before = 0;
-          timer_count_[i] = 0;
-          timer_cycle_accum_[i] = 0;
-          ticks = 0;
-        }
-      } else if (sync_mode == 2) {
-        if (blank_start) {
-          before = 0;
-          timer_count_[i] = 0;
-          timer_cycle_accum_[i] = 0;
-          ticks = 0;
-        }
-        if (!blank) {
-          ticks = 0;
-        }
-      }
-    }
+// The sector timer only runs while a read is waiting on an empty data FIFO.
+bool MmioBus::cdrom_read_timer_running() const {
+  return cdrom_.reading && !cdrom_.error && cdrom_image_.loaded() && cdrom_.data_fifo.empty();
+}
 
-    uint32_t full = before + ticks;
-    uint32_t after = full & 0xFFFFu;
-    timer_count_[i] = static_cast<uint16_t>(after);
-    uint16_t target = timer_target_[i];
-    if (ticks > 0 && target != 0 && before < target && full >= target && full <= 0x1FFFFu) {
-      timer_mode_[i] |= static_cast<uint16_t>(1u << 11);
-      if (timer_irq_enable_[i] && timer_irq_on_target_[i]) {
-        bool fire = true;
-        if (timer_irq_toggle_[i]) {
-          timer_mode_[i] ^= static_cast<uint16_t>(1u << 10);
-          fire = (timer_mode_[i] & (1u << 10)) == 0;
-        } else {
-          timer_mode_[i] &= static_cast<uint16_t>(~(1u << 10));
-        }
-        if (fire) {
-          irq_stat_ |= static_cast<uint16_t>(1u << (4 + i));
-        }
-        if (!timer_irq_repeat_[i]) {
-          timer_irq_enable_[i] = false;
-        }
-      }
-      if (mode & (1u << 3)) { // reset on target
-        timer_count_[i] = 0;
-        timer_cycle_accum_[i] = 0;
-      }
-    }
-    if (full > 0xFFFFu) {
-      timer_mode_[i] |= static_cast<uint16_t>(1u << 12);
-      if (timer_irq_on_overflow_[i] && timer_irq_enable_[i]) {
-        bool fire = true;
-        if (timer_irq_toggle_[i]) {
-          timer_mode_[i] ^= static_cast<uint16_t>(1u << 10);
-          fire = (timer_mode_[i] & (1u << 10)) == 0;
-        } else {
-          timer_mode_[i] &= static_cast<uint16_t>(~(1u << 10));
-        }
-        if (fire) {
-          irq_stat_ |= static_cast<uint16_t>(1u << (4 + i));
-        }
-        if (!timer_irq_repeat_[i]) {
-          timer_irq_enable_[i] = false;
-        }
-      }
-    }
+void MmioBus::cdrom_sync_read_timer() {
+  uint64_t now = events_.now();
+  if (cdrom_.read_running) {
+    uint64_t elapsed = now - cdrom_.read_synced_at;
+    cdrom_.read_timer = elapsed >= cdrom_.read_timer
+                            ? 0
+                            : static_cast<uint32_t>(cdrom_.read_timer - elapsed);
   }
+  cdrom_.read_synced_at = now;
+}
 
-  if (!cdrom_pending_.empty()) {
-    uint32_t remaining = cycles;
-    while (!cdrom_pending_.empty() && remaining > 0) {
-      auto &pending = cdrom_pending_.front();
-      if (pending.delay_cycles > remaining) {
-        pending.delay_cycles -= remaining;
-        break;
-      }
-      remaining -= pending.delay_cycles;
-      pending.delay_cycles = 0;
-      if (pending.clear_seeking) {
-        cdrom_seeking_ = false;
-      }
-      if (!pending.response.empty()) {
-        pending.response[0] = cdrom_status();
-      }
-      cdrom_push_response_block(pending.response);
-      cdrom_raise_irq(pending.irq_flags);
-      cdrom_pending_.pop_front();
-    }
+void MmioBus::cdrom_schedule_read() {
+  cdrom_.read_synced_at = events_.now();
+  cdrom_.read_running = cdrom_read_timer_running();
+  if (cdrom_.read_running) {
+    schedule_event(cdrom_.read_event, cdrom_.read_timer, kEventCdromRead);
+  } else {
+    cancel_event(cdrom_.read_event);
   }
+}
+
+void MmioBus::joy_sync() {
+  uint64_t now = events_.now();
+  uint32_t cycles = static_cast<uint32_t>(std::min<uint64_t>(now - joy_.synced_at, UINT32_MAX));
+  joy_.synced_at = now;
 
-  if (joy_ack_cycles_ > 0) {
-    if (joy_ack_cycles_ > cycles) {
-      joy_ack_cycles_ -= cycles;
+  if (joy_.ack_cycles > 0) {
+    if (joy_.ack_cycles > cycles) {
+      joy_.ack_cycles -= cycles;
     } else {
-      joy_ack_cycles_ = 0;
-      joy_ack_ = false;
+      joy_.ack_cycles = 0;
+      joy_.ack = false;
     }
   }
 
   auto deliver_joy_response = [&]() {
-    uint8_t response = joy_tx_queue_.front();
-    joy_tx_queue_.pop_front();
-    joy_response_queue_.push_back(response);
-    if (joy_ctrl_ & kJoyCtrlDtr) {
-      joy_rx_ready_ = true;
-      joy_ack_ = true;
-      joy_ack_cycles_ = kJoyAckPulseCycles;
-      if ((joy_ctrl_ & kJoyCtrlIrqEnable) && !joy_irq_pending_) {
-        joy_irq_pending_ = true;
-        irq_stat_ |= static_cast<uint16_t>(1u << 7);
-      }
-    }
-    joy_rx_pending_ = false;
+    uint8_t response = joy_.tx_queue.front();
+    joy_.tx_queue.pop_front();
+    joy_.response_queue.push_back(response);
+    if (joy_.ctrl & kJoyCtrlDtr) {
+      joy_.rx_ready = true;
+      joy_.ack = true;
+      joy_.ack_cycles = kJoyAckPulseCycles;
+      if ((joy_.ctrl & kJoyCtrlIrqEnable) && !joy_.irq_pending) {
+        joy_.irq_pending = true;
+        irq_.stat |= static_cast<uint16_t>(1u << 7);
+      }
+    }
+    joy_.rx_pending = false;
   };
 
+  // Runs even with no elapsed time so a byte whose transmit just finished
+  // starts its receive delay at the right cycle.
   uint32_t joy_remaining = cycles;
-  while (joy_remaining > 0) {
-    if (joy_tx_delay_cycles_ > 0) {
-      uint32_t delta = std::min(joy_tx_delay_cycles_, joy_remaining);
-      joy_tx_delay_cycles_ -= delta;
+  for (;;) {
+    if (joy_.tx_delay_cycles > 0) {
+      uint32_t delta = std::min(joy_.tx_delay_cycles, joy_remaining);
+      joy_.tx_delay_cycles -= delta;
       joy_remaining -= delta;
-      if (joy_tx_delay_cycles_ > 0) {
+      if (joy_.tx_delay_cycles > 0) {
         break;
       }
     }
-    if (!joy_rx_pending_ && !joy_tx_queue_.empty()) {
-      joy_rx_pending_ = true;
-      joy_rx_delay_cycles_ = kJoyRxDelayCycles;
+    if (!joy_.rx_pending && !joy_.tx_queue.empty()) {
+      joy_.rx_pending = true;
+      joy_.rx_delay_cycles = kJoyRxDelayCycles;
     }
-    if (joy_rx_pending_ && joy_rx_delay_cycles_ > 0) {
-      uint32_t delta = std::min(joy_rx_delay_cycles_, joy_remaining);
-      joy_rx_delay_cycles_ -= delta;
+    if (joy_.rx_pending && joy_.rx_delay_cycles > 0) {
+      uint32_t delta = std::min(joy_.rx_delay_cycles, joy_remaining);
+      joy_.rx_delay_cycles -= delta;
       joy_remaining -= delta;
-      if (joy_rx_delay_cycles_ > 0) {
+      if (joy_.rx_delay_cycles > 0) {
         break;
       }
     }
-    if (joy_rx_pending_ && joy_rx_delay_cycles_ == 0 && !joy_tx_queue_.empty()) {
+    if (joy_.rx_pending && joy_.rx_delay_cycles == 0 && !joy_.tx_queue.empty()) {
       deliver_joy_response();
-      if (!joy_tx_queue_.empty()) {
-        joy_tx_delay_cycles_ = joy_byte_delay_cycles(joy_baud_);
+      if (!joy_.tx_queue.empty()) {
+        joy_.tx_delay_cycles = joy_byte_delay_cycles(joy_.baud);
         continue;
       }
     }
     break;
   }
+}
 
-  if (vblank_pulse) {
-    irq_stat_ |= 1u << 0;
-    if (irq_log_enabled()) {
-      std::cerr << "[irq] VBLANK irq_stat=0x" << std::hex << std::setw(4) << std::setfill('0')
-                << irq_stat_ << "\n";
-    }
+void MmioBus::joy_schedule() {
+  uint64_t next = kNoEvent;
+  if (joy_.ack_cycles > 0) {
+    next = joy_.ack_cycles;
   }
-
-  if (timer_log_enabled()) {
-    static uint32_t timer_log_accum = 0;
-    timer_log_accum += cycles;
-    constexpr uint32_t kTimerLogPeriod = 200000;
-    if (timer_log_accum >= kTimerLogPeriod) {
-      timer_log_accum %= kTimerLogPeriod;
-      std::cerr << "[timer] counts T0=0x" << std::hex << std::setw(4) << std::setfill('0')
-                << timer_count_[0]
-                << " T1=0x" << std::setw(4) << timer_count_[1]
-                << " T2=0x" << std::setw(4) << timer_count_[2] << "\n";
-    }
+  if (joy_.tx_delay_cycles > 0) {
+    next = std::min<uint64_t>(next, joy_.tx_delay_cycles);
+  } else if (!joy_.tx_queue.empty()) {
+    next = std::min<uint64_t>(next, joy_.rx_pending ? joy_.rx_delay_cycles : 0);
+  }
+  if (next == kNoEvent) {
+    cancel_event(joy_.event);
+  } else {
+    schedule_event(joy_.event, next, kEventJoy);
   }
 }
 
 uint32_t MmioBus::consume_dma_channel() {
-  if (dma_pending_mask_ == 0) {
+  if (dma_.pending_mask == 0) {
     return 0xFFFFFFFFu;
   }
   for (uint32_t channel = 0; channel < 7; ++channel) {
-    if ((dma_pending_mask_ & (1u << channel)) == 0) {
+    if ((dma_.pending_mask & (1u << channel)) == 0) {
       continue;
     }
-    if (dma_dpcr_ != 0 && (dma_dpcr_ & (1u << (3 + channel * 4))) == 0) {
+    if (dma_.dpcr != 0 && (dma_.dpcr & (1u << (3 + channel * 4))) == 0) {
       continue;
     }
     if (channel == 2 && (compute_gpustat() & (1u << 28)) == 0) {
       continue;
     }
-    if (channel == 3 && ((cdrom_request_ & 0x01u) == 0 || cdrom_data_fifo_.empty())) {
+    if (channel == 3 && ((cdrom_.request & 0x01u) == 0 || cdrom_.data_fifo.empty())) {
       continue;
     }
-    dma_pending_mask_ &= ~(1u << channel);
-    bool master = (dma_dicr_ & (1u << 23)) != 0;
-    bool enable = (dma_dicr_ & (1u << (16 + channel))) != 0;
+    dma_.pending_mask &= ~(1u << channel);
+    bool master = (dma_.dicr & (1u << 23)) != 0;
+    bool enable = (dma_.dicr & (1u << (16 + channel))) != 0;
     if (master && enable) {
-      dma_dicr_ |= (1u << (24 + channel));
-      dma_dicr_ = recompute_dma_master(dma_dicr_);
-      irq_stat_ |= (1u << 3); // DMA IRQ
+      dma_.dicr |= (1u << (24 + channel));
+      dma_.dicr = recompute_dma_master(dma_.dicr);
+      irq_.stat |= (1u << 3); // DMA IRQ
     }
-    dma_chcr_[channel] &= ~(1u << 24);
+    dma_.chcr[channel] &= ~(1u << 24);
+    sync_irq_line();
     return channel;
   }
   return 0xFFFFFFFFu;
@@ -2537,92 +2635,100 @@ uint32_t MmioBus::dma_madr(uint32_t channel) const {
   if (channel >= 7) {
     return 0;
   }
-  return dma_madr_[channel];
+  return dma_.madr[channel];
 }
 
 uint32_t MmioBus::dma_bcr(uint32_t channel) const {
   if (channel >= 7) {
     return 0;
   }
-  return dma_bcr_[channel];
+  return dma_.bcr[channel];
 }
 
 uint32_t MmioBus::dma_chcr(uint32_t channel) const {
   if (channel >= 7) {
     return 0;
   }
-  return dma_chcr_[channel];
+  return dma_.chcr[channel];
 }
 
 void MmioBus::set_dma_madr(uint32_t channel, uint32_t value) {
   if (channel >= 7) {
     return;
   }
-  dma_madr_[channel] = value;
+  dma_.madr[channel] = value;
 }
 
 bool MmioBus::load_cdrom_image(const std::string &path, std::string &error) {
-  return cdrom_image_.load(path, error);
+  catch_up();
+  cdrom_sync_read_timer();
+  bool ok = cdrom_image_.load(path, error);
+  cdrom_schedule_read();
+  return ok;
 }
 
 size_t MmioBus::read_cdrom_data(uint8_t *dst, size_t len) {
-  if ((cdrom_request_ & 0x01u) == 0) {
+  if ((cdrom_.request & 0x01u) == 0) {
     return 0;
   }
+  catch_up();
+  cdrom_sync_read_timer();
   size_t read = 0;
   while (read < len) {
     cdrom_maybe_fill_data();
-    if (cdrom_data_fifo_.empty()) {
+    if (cdrom_.data_fifo.empty()) {
       break;
     }
-    dst[read++] = cdrom_data_fifo_.front();
-    cdrom_data_fifo_.erase(cdrom_data_fifo_.begin());
+    dst[read++] = cdrom_.data_fifo.front();
+    cdrom_.data_fifo.erase(cdrom_.data_fifo.begin());
   }
+  cdrom_schedule_read();
+  sync_irq_line();
   return read;
 }
 
 bool MmioBus::pop_xa_audio(XaAudioSector &out) {
-  if (cdrom_xa_audio_queue_.empty()) {
+  if (cdrom_.xa_audio_queue.empty()) {
     return false;
   }
-  out = std::move(cdrom_xa_audio_queue_.front());
-  cdrom_xa_audio_queue_.pop_front();
+  out = std::move(cdrom_.xa_audio_queue.front());
+  cdrom_.xa_audio_queue.pop_front();
   return true;
 }
 
 uint16_t MmioBus::spu_main_volume_left() const {
   constexpr uint32_t kSpuMainVolLeft = 0x1F801D80;
   uint32_t index = (kSpuMainVolLeft - 0x1F801C00) / 2;
-  return index < spu_regs_.size() ? spu_regs_[index] : 0;
+  return index < spu_.regs.size() ? spu_.regs[index] : 0;
 }
 
 uint16_t MmioBus::spu_main_volume_right() const {
   constexpr uint32_t kSpuMainVolRight = 0x1F801D82;
   uint32_t index = (kSpuMainVolRight - 0x1F801C00) / 2;
-  return index < spu_regs_.size() ? spu_regs_[index] : 0;
+  return index < spu_.regs.size() ? spu_.regs[index] : 0;
 }
 
 bool MmioBus::has_gpu_commands() const {
-  return !gpu_gp0_fifo_.empty();
+  return !gpu_.gp0_fifo.empty();
 }
 
 std::vector<uint32_t> MmioBus::take_gpu_commands() {
   std::vector<uint32_t> out;
-  out.swap(gpu_gp0_fifo_);
+  out.swap(gpu_.gp0_fifo);
   return out;
 }
 
 void MmioBus::restore_gpu_commands(std::vector<uint32_t> remainder) {
-  gpu_gp0_fifo_ = std::move(remainder);
+  gpu_.gp0_fifo = std::move(remainder);
 }
 
 bool MmioBus::has_gpu_control() const {
-  return !gpu_gp1_fifo_.empty();
+  return !gpu_.gp1_fifo.empty();
 }
 
 std::vector<uint32_t> MmioBus::take_gpu_control() {
   std::vector<uint32_t> out;
-  out.swap(gpu_gp1_fifo_);
+  out.swap(gpu_.gp1_fifo);
   return out;
 }
 
@@ -2631,40 +2737,41 @@ void MmioBus::apply_gp0_state(uint32_t word) {
   switch (cmd) {
     case 0xE1: { // Draw mode
       uint32_t mode = word & 0x00FFFFFFu;
-      gpu_texpage_x_ = mode & 0xFu;
-      gpu_texpage_y_ = ((mode >> 4) & 0x1u) | (((mode >> 11) & 0x1u) << 1);
-      gpu_semi_ = (mode >> 5) & 0x3u;
-      gpu_tex_depth_ = (mode >> 7) & 0x3u;
-      gpu_dither_ = (mode & (1u << 9)) != 0;
-      gpu_draw_to_display_ = (mode & (1u << 10)) != 0;
-      gpu_mask_set_ = (mode & (1u << 11)) != 0;
-      gpu_mask_eval_ = (mode & (1u << 12)) != 0;
+      gpu_.texpage_x = mode & 0xFu;
+      gpu_.texpage_y = ((mode >> 4) & 0x1u) | (((mode >> 11) & 0x1u) << 1);
+      gpu_.semi = (mode >> 5) & 0x3u;
+      gpu_.tex_depth = (mode >> 7) & 0x3u;
+      gpu_.dither = (mode & (1u << 9)) != 0;
+      gpu_.draw_to_display = (mode & (1u << 10)) != 0;
+      gpu_.mask_set = (mode & (1u << 11)) != 0;
+      gpu_.mask_eval = (mode & (1u << 12)) != 0;
       break;
     }
     case 0xE2: { // Texture window
-      gpu_tex_window_ = word & 0x00FFFFFFu;
+      gpu_.tex_window = word & 0x00FFFFFFu;
       break;
     }
     case 0xE3: { // Draw area top-left
-      gpu_draw_area_tl_ = word & 0x00FFFFFFu;
+      gpu_.draw_area_tl = word & 0x00FFFFFFu;
       break;
     }
     case 0xE4: { // Draw area bottom-right
-      gpu_draw_area_br_ = word & 0x00FFFFFFu;
+      gpu_.draw_area_br = word & 0x00FFFFFFu;
       break;
     }
     case 0xE5: { // Draw offset
-      gpu_draw_offset_ = word & 0x00FFFFFFu;
+      gpu_.draw_offset = word & 0x00FFFFFFu;
       break;
     }
     case 0xE6: { // Mask bit
-      gpu_mask_set_ = (word & 0x1u) != 0;
-      gpu_mask_eval_ = (word & 0x2u) != 0;
+      gpu_.mask_set = (word & 0x1u) != 0;
+      gpu_.mask_eval = (word & 0x2u) != 0;
       break;
     }
     case 0x1F: { // Interrupt request
-      gpu_irq_ = true;
-      irq_stat_ |= (1u << 1);
+      gpu_.irq = true;
+      irq_.stat |= (1u << 1);
+      sync_irq_line();
       break;
     }
     default:
@@ -2676,11 +2783,11 @@ void MmioBus::queue_gpu_read_data(std::vector<uint32_t> words) {
   if (words.empty()) {
     return;
   }
-  if (gpu_read_fifo_.empty()) {
-    gpu_read_latch_ = words.front();
+  if (gpu_.read_fifo.empty()) {
+    gpu_.read_latch = words.front();
   }
   for (uint32_t word : words) {
-    gpu_read_fifo_.push_back(word);
+    gpu_.read_fifo.push_back(word);
   }
 }
 
@@ -2688,15 +2795,16 @@ void MmioBus::schedule_gpu_read_data(std::vector<uint32_t> words, uint32_t delay
   if (words.empty()) {
     return;
   }
-  if (delay_cycles == 0 && gpu_read_pending_.empty()) {
+  catch_up();
+  if (delay_cycles == 0 && gpu_.read_pending.empty()) {
     queue_gpu_read_data(std::move(words));
     return;
   }
-  if (!gpu_read_pending_.empty()) {
-    gpu_read_pending_.insert(gpu_read_pending_.end(), words.begin(), words.end());
+  if (!gpu_.read_pending.empty()) {
+    gpu_.read_pending.insert(gpu_.read_pending.end(), words.begin(), words.end());
   } else {
-    gpu_read_pending_ = std::move(words);
-    gpu_read_pending_delay_ = delay_cycles;
+    gpu_.read_pending = std::move(words);
+    schedule_event(gpu_.read_event, delay_cycles, kEventGpuRead);
   }
 }
 
@@ -2704,8 +2812,7 @@ void MmioBus::gpu_add_busy(uint32_t cycles) {
   if (cycles == 0) {
     return;
   }
-  uint32_t scaled = std::max(1u, cycles / 32u);
-  gpu_busy_cycles_ = std::min<uint32_t>(gpu_busy_cycles_ + scaled, 100000);
+  gpu_extend_busy(std::max(1u, cycles / 32u));
 }
 
 bool MmioBus::gpu_ready_for_commands() const {
@@ -2713,15 +2820,16 @@ bool MmioBus::gpu_ready_for_commands() const {
 }
 
 uint32_t MmioBus::gpu_dma_dir() const {
-  return gpu_dma_dir_ & 0x3u;
+  return gpu_.dma_dir & 0x3u;
 }
 
 uint32_t MmioBus::gpu_read_word() {
-  if (!gpu_read_fifo_.empty()) {
-    gpu_read_latch_ = gpu_read_fifo_.front();
-    gpu_read_fifo_.erase(gpu_read_fifo_.begin());
+  catch_up();
+  if (!gpu_.read_fifo.empty()) {
+    gpu_.read_latch = gpu_.read_fifo.front();
+    gpu_.read_fifo.erase(gpu_.read_fifo.begin());
   }
-  return gpu_read_latch_;
+  return gpu_.read_latch;
 }
 
 } // namespace ps1emu
@@ -2,6 +2,7 @@
 #define PS1EMU_MMIO_H
 
 #include "core/cdrom_image.h"
+#include "core/scheduler.h"
 
 #include <array>
 #include <cstdint>
@@ -23,7 +24,12 @@ public:
     uint8_t coding = 0;
   };
 
+  // Called whenever (I_STAT & I_MASK) != 0 changes, and once with the
+  // current state when installed.
+  using IrqLineHook = void (*)(void *context, bool asserted);
+
   void reset();
+  void set_irq_line_hook(IrqLineHook hook, void *context);
 
   uint8_t read8(uint32_t addr);
   uint16_t read16(uint32_t addr);
@@ -35,7 +41,25 @@ public:
   bool irq_pending() const;
   uint16_t irq_stat() const;
   uint16_t irq_mask() const;
+  // Advances device time by cycles, firing every event that falls due.
   void tick(uint32_t cycles);
+  // Device time follows the attached clock: it is caught up before each
+  // register access and whenever the clock passes next_event_time().
+  void attach_clock(const Scheduler &clock);
+  void catch_up();
+  uint64_t next_event_time() const;
+  // Raised when the core has work to pick up: GP0/GP1 words, a DMA start,
+  // an XA sector, an SPU main volume change or a VBlank.
+  bool needs_attention() const;
+  void clear_attention();
+  // True once per VBlank since the last call; the core presents on it.
+  bool take_vblank();
+  // Bumped by every fired device event and every attention the core
+  // services; equal counts mean no device changed state in between.
+  uint64_t device_activity() const;
+  // Bus time at which GPUSTAT's busy/ready bits next change on their own;
+  // they are derived from it on read rather than by a scheduled event.
+  uint64_t gpu_busy_until() const;
   bool has_gpu_commands() const;
   std::vector<uint32_t> take_gpu_commands();
   void restore_gpu_commands(std::vector<uint32_t> remainder);
@@ -60,6 +84,18 @@ public:
   uint16_t spu_main_volume_right() const;
 
 private:
+  enum EventId {
+    kEventHblank,
+    kEventVblank,
+    kEventTimer0,
+    kEventTimer1,
+    kEventTimer2,
+    kEventGpuRead,
+    kEventCdromResponse,
+    kEventCdromRead,
+    kEventJoy,
+  };
+
   enum class CdromFillResult {
     Error,
     Skipped,
@@ -70,6 +106,49 @@ private:
   static constexpr uint32_t kSize = 0x2000;
 
   uint32_t offset(uint32_t addr) const;
+  void sync_irq_line();
+  uint8_t read8_register(uint32_t addr);
+  uint16_t read16_register(uint32_t addr);
+  uint32_t read32_register(uint32_t addr);
+  void write8_register(uint32_t addr, uint8_t value);
+  void write16_register(uint32_t addr, uint16_t value);
+  void write32_register(uint32_t addr, uint32_t value);
+  void irq_acknowledge(uint16_t bits);
+  uint8_t joy_read_data();
+  void joy_write_data(uint8_t value);
+  void joy_write_ctrl(uint16_t value);
+  uint16_t timer_read_count(int i);
+  uint16_t timer_read_mode(int i);
+  void timer_write_count(int i, uint16_t value);
+  void timer_write_mode(int i, uint16_t value);
+  void timer_write_target(int i, uint16_t value);
+  void dma_write_chcr(int ch, uint32_t value);
+  void dma_write_dicr(uint32_t value);
+  void gpu_write_gp1(uint32_t value);
+  uint8_t cdrom_read_register(uint32_t reg);
+  void cdrom_write_register(uint32_t reg, uint8_t value);
+  // Bring lazily counted devices up to date before a register access and
+  // re-arm their events after it.
+  void begin_access(uint32_t addr);
+  void end_access(uint32_t addr);
+
+  void schedule_event(EventHandle &handle, uint64_t cycles_from_now, EventId id);
+  void cancel_event(EventHandle &handle);
+  void run_event(const ScheduledEvent &event);
+  uint32_t frame_period() const;
+  uint32_t line_period() const;
+  bool gpu_in_vblank() const;
+  void gpu_hblank();
+  void gpu_vblank();
+  void gpu_extend_busy(uint32_t cycles);
+
+  // Runs timer i over cycles of its source clock plus hblank_pulses, with
+  // blank/blank_start describing the sync signal over that span.
+  void timer_advance(int i, uint32_t cycles, uint32_t hblank_pulses, bool blank, bool blank_start);
+  void timer_catch_up(int i);
+  bool timer_counts_cycles(int i) const;
+  uint32_t timer_divider(int i) const;
+  void timer_schedule(int i);
   void reset_gpu_state();
   uint32_t compute_gpustat() const;
   struct CdromPendingResponse {
@@ -94,137 +173,184 @@ private:
   void cdrom_set_irq_enable(uint8_t enable);
   void cdrom_execute_command(uint8_t cmd);
   void cdrom_maybe_fill_data();
+  void cdrom_deliver_response();
+  void cdrom_clear_pending();
+  bool cdrom_read_timer_running() const;
+  void cdrom_sync_read_timer();
+  void cdrom_schedule_read();
+  void joy_sync();
+  void joy_schedule();
   CdromFillResult cdrom_fill_data_fifo();
 
-  std::array<uint8_t, kSize> raw_ {};
+  // Per-device state. Each component keeps what events and register polls
+  // touch at the front and its queues and buffers at the back; the bus only
+  // reaches into the device a table slot or a fired event names.
+  struct IrqController {
+    uint16_t stat = 0;
+    uint16_t mask = 0;
+    bool line = false;
+    IrqLineHook line_hook = nullptr;
+    void *line_context = nullptr;
+  };
+
+  struct RootCounters {
+    uint16_t count[3] = {};
+    uint16_t mode[3] = {};
+    uint16_t target[3] = {};
+    bool sync_waiting[3] = {};
+    bool irq_enable[3] = {};
+    bool irq_repeat[3] = {};
+    bool irq_on_overflow[3] = {};
+    bool irq_on_target[3] = {};
+    bool irq_toggle[3] = {};
+    uint32_t cycle_accum[3] = {};
+    uint64_t synced_at[3] = {};
+    EventHandle event[3] = {};
+  };
+
+  struct GpuStatus {
+    uint64_t busy_until = 0;
+    uint32_t line = 0;
+    bool field = false;
+    bool vblank_pending = false;
+    bool irq = false;
+    bool display_disabled = true;
+    bool interlace = false;
+    bool vres = false;
+    bool vmode_pal = false;
+    bool display_depth24 = false;
+    bool hres2 = false;
+    uint32_t hres1 = 0;
+    uint32_t dma_dir = 0;
+    EventHandle line_event = kInvalidEvent;
+    EventHandle field_event = kInvalidEvent;
+    EventHandle read_event = kInvalidEvent;
+    uint32_t texpage_x = 0;
+    uint32_t texpage_y = 0;
+    uint32_t semi = 0;
+    uint32_t tex_depth = 0;
+    bool dither = false;
+    bool draw_to_display = false;
+    bool mask_set = false;
+    bool mask_eval = false;
+    bool flip = false;
+    uint16_t display_x = 0;
+    uint16_t display_y = 0;
+    uint16_t h_range_start = 0;
+    uint16_t h_range_end = 0;
+    uint16_t v_range_start = 0;
+    uint16_t v_range_end = 0;
+    uint32_t tex_window = 0;
+    uint32_t draw_area_tl = 0;
+    uint32_t draw_area_br = 0;
+    uint32_t draw_offset = 0;
+    uint32_t gp0 = 0;
+    uint32_t gp1 = 0;
+    uint32_t read_latch = 0;
+    std::vector<uint32_t> gp0_fifo;
+    std::vector<uint32_t> gp1_fifo;
+    std::vector<uint32_t> read_fifo;
+    std::vector<uint32_t> read_pending;
+  };
+
+  struct DmaController {
+    uint32_t madr[7] = {};
+    uint32_t bcr[7] = {};
+    uint32_t chcr[7] = {};
+    uint32_t dpcr = 0;
+    uint32_t dicr = 0;
+    uint32_t pending_mask = 0;
+  };
+
+  struct CdromController {
+    uint8_t index = 0;
+    uint8_t status = 0;
+    uint8_t irq_flags = 0;
+    uint8_t irq_enable = 0;
+    uint8_t request = 0;
+    uint8_t mode = 0;
+    bool error = false;
+    bool reading = false;
+    bool playing = false;
+    bool muted = false;
+    bool seeking = false;
+    bool read_running = false;
+    uint32_t read_timer = 0;
+    uint32_t read_period = 0;
+    uint64_t read_synced_at = 0;
+    uint32_t lba = 0;
+    EventHandle response_event = kInvalidEvent;
+    EventHandle read_event = kInvalidEvent;
+    uint8_t vol_ll = 0;
+    uint8_t vol_lr = 0;
+    uint8_t vol_rl = 0;
+    uint8_t vol_rr = 0;
+    uint8_t vol_apply = 0;
+    uint8_t filter_file = 0;
+    uint8_t filter_channel = 0;
+    uint8_t session = 1;
+    uint32_t last_read_lba = 0;
+    uint8_t last_mode = 0;
+    uint8_t last_file = 0;
+    uint8_t last_channel = 0;
+    uint8_t last_submode = 0;
+    uint8_t last_coding = 0;
+    std::array<uint8_t, 4> regs {};
+    std::vector<uint8_t> param_fifo;
+    std::vector<uint8_t> response_fifo;
+    std::vector<uint8_t> data_fifo;
+    std::deque<CdromPendingResponse> pending;
+    std::deque<uint8_t> irq_queue;
+    std::deque<XaAudioSector> xa_audio_queue;
+  };
+
+  struct SioPort {
+    uint16_t mode = 0;
+    uint16_t ctrl = 0;
+    uint16_t baud = 0;
+    uint16_t misc = 0;
+    uint8_t rx_data = 0xFF;
+    bool rx_ready = false;
+  };
+
+  // SIO0 adds the pad/memory-card exchange on top of the UART registers.
+  struct JoypadPort : SioPort {
+    bool ack = false;
+    bool irq_pending = false;
+    bool rx_pending = false;
+    bool session_active = false;
+    uint8_t phase = 0;
+    uint8_t device = 0;
+    uint32_t tx_delay_cycles = 0;
+    uint32_t rx_delay_cycles = 0;
+    uint32_t ack_cycles = 0;
+    uint64_t synced_at = 0;
+    EventHandle event = kInvalidEvent;
+    std::deque<uint8_t> tx_queue;
+    std::deque<uint8_t> response_queue;
+  };
+
+  struct SpuRegs {
+    uint16_t ctrl = 0;
+    std::array<uint16_t, 0x200 / 2> regs {};
+  };
+
+  Scheduler events_;
+  const Scheduler *clock_ = nullptr;
+  bool attention_ = false;
+  uint64_t device_activity_ = 0;
+
+  IrqController irq_;
+  RootCounters timers_;
+  GpuStatus gpu_;
+  DmaController dma_;
+  JoypadPort joy_;
+  SioPort sio1_;
+  SpuRegs spu_;
+  CdromController cdrom_;
 
-  uint32_t gpu_gp0_ = 0;
-  uint32_t gpu_gp1_ = 0;
-  std::vector<uint32_t> gpu_gp0_fifo_;
-  std::vector<uint32_t> gpu_gp1_fifo_;
-  std::vector<uint32_t> gpu_read_fifo_;
-  uint32_t gpu_read_latch_ = 0;
-  std::vector<uint32_t> gpu_read_pending_;
-  uint32_t gpu_read_pending_delay_ = 0;
-  uint32_t gpu_texpage_x_ = 0;
-  uint32_t gpu_texpage_y_ = 0;
-  uint32_t gpu_semi_ = 0;
-  uint32_t gpu_tex_depth_ = 0;
-  bool gpu_dither_ = false;
-  bool gpu_draw_to_display_ = false;
-  bool gpu_mask_set_ = false;
-  bool gpu_mask_eval_ = false;
-  bool gpu_display_disabled_ = true;
-  bool gpu_irq_ = false;
-  bool gpu_interlace_ = false;
-  bool gpu_flip_ = false;
-  bool gpu_hres2_ = false;
-  uint32_t gpu_hres1_ = 0;
-  bool gpu_vres_ = false;
-  bool gpu_vmode_pal_ = false;
-  bool gpu_display_depth24_ = false;
-  uint32_t gpu_dma_dir_ = 0;
-  bool gpu_field_ = false;
-  uint16_t gpu_display_x_ = 0;
-  uint16_t gpu_display_y_ = 0;
-  uint16_t gpu_h_range_start_ = 0;
-  uint16_t gpu_h_range_end_ = 0;
-  uint16_t gpu_v_range_start_ = 0;
-  uint16_t gpu_v_range_end_ = 0;
-  uint64_t gpu_field_cycle_accum_ = 0;
-  uint32_t gpu_busy_cycles_ = 0;
-  uint32_t gpu_tex_window_ = 0;
-  uint32_t gpu_draw_area_tl_ = 0;
-  uint32_t gpu_draw_area_br_ = 0;
-  uint32_t gpu_draw_offset_ = 0;
-  uint32_t gpu_line_cycle_accum_ = 0;
-  uint32_t gpu_line_ = 0;
-  uint32_t dma_pending_mask_ = 0;
-
-  uint16_t irq_stat_ = 0;
-  uint16_t irq_mask_ = 0;
-
-  uint32_t dma_madr_[7] = {};
-  uint32_t dma_bcr_[7] = {};
-  uint32_t dma_chcr_[7] = {};
-  uint32_t dma_dpcr_ = 0;
-  uint32_t dma_dicr_ = 0;
-
-  uint16_t timer_count_[3] = {};
-  uint16_t timer_mode_[3] = {};
-  uint16_t timer_target_[3] = {};
-  uint32_t timer_cycle_accum_[3] = {};
-  bool timer_sync_waiting_[3] = {};
-
-  std::array<uint16_t, 0x200 / 2> spu_regs_ {};
-  std::array<uint8_t, 4> cdrom_regs_ {};
   CdromImage cdrom_image_;
-  std::vector<uint8_t> cdrom_param_fifo_;
-  std::vector<uint8_t> cdrom_response_fifo_;
-  std::vector<uint8_t> cdrom_data_fifo_;
-  std::deque<XaAudioSector> cdrom_xa_audio_queue_;
-  uint8_t cdrom_index_ = 0;
-  uint8_t cdrom_status_ = 0;
-  uint8_t cdrom_irq_flags_ = 0;
-  uint8_t cdrom_irq_enable_ = 0;
-  uint8_t cdrom_request_ = 0;
-  uint8_t cdrom_vol_ll_ = 0;
-  uint8_t cdrom_vol_lr_ = 0;
-  uint8_t cdrom_vol_rl_ = 0;
-  uint8_t cdrom_vol_rr_ = 0;
-  uint8_t cdrom_vol_apply_ = 0;
-  uint8_t cdrom_mode_ = 0;
-  uint8_t cdrom_filter_file_ = 0;
-  uint8_t cdrom_filter_channel_ = 0;
-  uint8_t cdrom_session_ = 1;
-  bool cdrom_error_ = false;
-  bool cdrom_reading_ = false;
-  bool cdrom_playing_ = false;
-  bool cdrom_muted_ = false;
-  bool cdrom_seeking_ = false;
-  uint32_t cdrom_read_timer_ = 0;
-  uint32_t cdrom_read_period_ = 0;
-  uint32_t cdrom_last_read_lba_ = 0;
-  uint32_t cdrom_lba_ = 0;
-  uint8_t cdrom_last_mode_ = 0;
-  uint8_t cdrom_last_file_ = 0;
-  uint8_t cdrom_last_channel_ = 0;
-  uint8_t cdrom_last_submode_ = 0;
-  uint8_t cdrom_last_coding_ = 0;
-  std::deque<CdromPendingResponse> cdrom_pending_;
-  std::deque<uint8_t> cdrom_irq_queue_;
-
-  bool timer_irq_enable_[3] = {};
-  bool timer_irq_repeat_[3] = {};
-  bool timer_irq_on_overflow_[3] = {};
-  bool timer_irq_on_target_[3] = {};
-  bool timer_irq_toggle_[3] = {};
-
-  uint16_t joy_mode_ = 0;
-  uint16_t joy_ctrl_ = 0;
-  uint16_t joy_baud_ = 0;
-  uint8_t joy_rx_data_ = 0xFF;
-  bool joy_rx_ready_ = false;
-  bool joy_ack_ = false;
-  bool joy_irq_pending_ = false;
-  std::deque<uint8_t> joy_tx_queue_;
-  uint32_t joy_tx_delay_cycles_ = 0;
-  uint32_t joy_rx_delay_cycles_ = 0;
-  uint32_t joy_ack_cycles_ = 0;
-  bool joy_rx_pending_ = false;
-  std::deque<uint8_t> joy_response_queue_;
-  bool joy_session_active_ = false;
-  uint8_t joy_phase_ = 0;
-  uint8_t joy_device_ = 0;
-
-  uint16_t sio1_mode_ = 0;
-  uint16_t sio1_ctrl_ = 0;
-  uint16_t sio1_baud_ = 0;
-  uint16_t sio1_misc_ = 0;
-  uint8_t sio1_rx_data_ = 0xFF;
-  bool sio1_rx_ready_ = false;
-
-  uint16_t spu_ctrl_ = 0;
+  std::array<uint8_t, kSize> raw_ {};
 };
 
 } // namespace ps1emu
@@ -1,33 +1,99 @@
 #include "core/scheduler.h"
 
-#include <algorithm>
-
 namespace ps1emu {
 
+namespace {
+EventHandle make_handle(uint32_t slot, uint32_t generation) {
+  return (static_cast<uint64_t>(generation) << 32) | (static_cast<uint64_t>(slot) + 1);
+}
+} // namespace
+
 void Scheduler::reset() {
   now_ = 0;
-  events_.clear();
+  next_order_ = 0;
+  heap_.clear();
+  // Slots keep their generations so handles from before the reset stay stale.
+  free_slots_.clear();
+  for (uint32_t slot = static_cast<uint32_t>(slots_.size()); slot > 0; --slot) {
+    Slot &entry = slots_[slot - 1];
+    if (entry.heap_index != kNotQueued) {
+      entry.heap_index = kNotQueued;
+      ++entry.generation;
+    }
+    free_slots_.push_back(slot - 1);
+  }
 }
 
 void Scheduler::advance(uint32_t cycles) {
   now_ += cycles;
 }
 
-void Scheduler::schedule(uint64_t cycles_from_now, int id) {
-  ScheduledEvent evt;
-  evt.when = now_ + cycles_from_now;
-  evt.id = id;
-  events_.push_back(evt);
-  std::sort(events_.begin(), events_.end(),
-            [](const ScheduledEvent &a, const ScheduledEvent &b) { return a.when < b.when; });
+EventHandle Scheduler::schedule(uint64_t cycles_from_now, int id) {
+  return schedule_at(now_ + cycles_from_now, id);
+}
+
+EventHandle Scheduler::schedule_at(uint64_t when, int id) {
+  uint32_t slot = 0;
+  if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  } else {
+    slot = static_cast<uint32_t>(slots_.size());
+    slots_.emplace_back();
+  }
+  Slot &entry = slots_[slot];
+  entry.when = when;
+  entry.order = next_order_++;
+  entry.id = id;
+  heap_.push_back(slot);
+  entry.heap_index = static_cast<uint32_t>(heap_.size() - 1);
+  sift_up(entry.heap_index);
+  return make_handle(slot, entry.generation);
+}
+
+bool Scheduler::cancel(EventHandle handle) {
+  Slot *entry = resolve(handle);
+  if (!entry) {
+    return false;
+  }
+  uint32_t slot = static_cast<uint32_t>(entry - slots_.data());
+  remove_at(entry->heap_index);
+  entry->heap_index = kNotQueued;
+  ++entry->generation;
+  free_slots_.push_back(slot);
+  return true;
+}
+
+bool Scheduler::reschedule(EventHandle handle, uint64_t cycles_from_now) {
+  Slot *entry = resolve(handle);
+  if (!entry) {
+    return false;
+  }
+  entry->when = now_ + cycles_from_now;
+  entry->order = next_order_++;
+  uint32_t index = entry->heap_index;
+  sift_up(index);
+  sift_down(entry->heap_index);
+  return true;
+}
+
+bool Scheduler::pending(EventHandle handle) const {
+  return resolve(handle) != nullptr;
 }
 
 bool Scheduler::pop_next(ScheduledEvent &out) {
-  if (events_.empty()) {
+  if (heap_.empty()) {
+    return false;
+  }
+  take(heap_.front(), out);
+  return true;
+}
+
+bool Scheduler::pop_due(ScheduledEvent &out) {
+  if (heap_.empty() || slots_[heap_.front()].when > now_) {
     return false;
   }
-  out = events_.front();
-  events_.erase(events_.begin());
+  take(heap_.front(), out);
   return true;
 }
 
@@ -35,4 +101,90 @@ uint64_t Scheduler::now() const {
   return now_;
 }
 
+uint64_t Scheduler::next_event_time() const {
+  return heap_.empty() ? kNoEvent : slots_[heap_.front()].when;
+}
+
+Scheduler::Slot *Scheduler::resolve(EventHandle handle) {
+  return const_cast<Slot *>(static_cast<const Scheduler *>(this)->resolve(handle));
+}
+
+const Scheduler::Slot *Scheduler::resolve(EventHandle handle) const {
+  uint32_t low = static_cast<uint32_t>(handle);
+  if (low == 0 || low > slots_.size()) {
+    return nullptr;
+  }
+  const Slot &entry = slots_[low - 1];
+  if (entry.heap_index == kNotQueued || entry.generation != static_cast<uint32_t>(handle >> 32)) {
+    return nullptr;
+  }
+  return &entry;
+}
+
+bool Scheduler::before(uint32_t a, uint32_t b) const {
+  const Slot &lhs = slots_[a];
+  const Slot &rhs = slots_[b];
+  return lhs.when != rhs.when ? lhs.when < rhs.when : lhs.order < rhs.order;
+}
+
+void Scheduler::place(uint32_t index, uint32_t slot) {
+  heap_[index] = slot;
+  slots_[slot].heap_index = index;
+}
+
+void Scheduler::sift_up(uint32_t index) {
+  uint32_t slot = heap_[index];
+  while (index > 0) {
+    uint32_t parent = (index - 1) / 2;
+    if (!before(slot, heap_[parent])) {
+      break;
+    }
+    place(index, heap_[parent]);
+    index = parent;
+  }
+  place(index, slot);
+}
+
+void Scheduler::sift_down(uint32_t index) {
+  uint32_t slot = heap_[index];
+  uint32_t size = static_cast<uint32_t>(heap_.size());
+  for (;;) {
+    uint32_t child = index * 2 + 1;
+    if (child >= size) {
+      break;
+    }
+    if (child + 1 < size && before(heap_[child + 1], heap_[child])) {
+      ++child;
+    }
+    if (!before(heap_[child], slot)) {
+      break;
+    }
+    place(index, heap_[child]);
+    index = child;
+  }
+  place(index, slot);
+}
+
+void Scheduler::remove_at(uint32_t index) {
+  uint32_t last = heap_.back();
+  heap_.pop_back();
+  if (index == heap_.size()) {
+    return;
+  }
+  place(index, last);
+  sift_up(index);
+  sift_down(slots_[last].heap_index);
+}
+
+void Scheduler::take(uint32_t slot, ScheduledEvent &out) {
+  Slot &entry = slots_[slot];
+  out.when = entry.when;
+  out.id = entry.id;
+  out.handle = make_handle(slot, entry.generation);
+  remove_at(entry.heap_index);
+  entry.heap_index = kNotQueued;
+  ++entry.generation;
+  free_slots_.push_back(slot);
+}
+
 } // namespace ps1emu
@@ -6,23 +6,64 @@
 
 namespace ps1emu {
 
+// Names one scheduled event; stays unique after the event fires or is
+// cancelled, so stale handles are rejected rather than hitting a reused slot.
+using EventHandle = uint64_t;
+constexpr EventHandle kInvalidEvent = 0;
+constexpr uint64_t kNoEvent = UINT64_MAX;
+
 struct ScheduledEvent {
   uint64_t when = 0;
   int id = 0;
+  EventHandle handle = kInvalidEvent;
 };
 
+// Binary min-heap keyed on (deadline, insertion order); each slot records its
+// heap position so cancel and reschedule are O(log n).
 class Scheduler {
 public:
   void reset();
   void advance(uint32_t cycles);
-  void schedule(uint64_t cycles_from_now, int id);
+  EventHandle schedule(uint64_t cycles_from_now, int id);
+  EventHandle schedule_at(uint64_t when, int id);
+  // False if the event already fired or was cancelled.
+  bool cancel(EventHandle handle);
+  bool reschedule(EventHandle handle, uint64_t cycles_from_now);
+  bool pending(EventHandle handle) const;
+  // Earliest event, whether or not it is due yet.
   bool pop_next(ScheduledEvent &out);
+  // Earliest event if its deadline has been reached.
+  bool pop_due(ScheduledEvent &out);
 
   uint64_t now() const;
+  // Deadline of the earliest event, or kNoEvent.
+  uint64_t next_event_time() const;
 
 private:
+  static constexpr uint32_t kNotQueued = UINT32_MAX;
+
+  struct Slot {
+    uint64_t when = 0;
+    uint64_t order = 0;
+    int id = 0;
+    uint32_t generation = 0;
+    uint32_t heap_index = kNotQueued;
+  };
+
+  Slot *resolve(EventHandle handle);
+  const Slot *resolve(EventHandle handle) const;
+  bool before(uint32_t a, uint32_t b) const;
+  void place(uint32_t index, uint32_t slot);
+  void sift_up(uint32_t index);
+  void sift_down(uint32_t index);
+  void remove_at(uint32_t index);
+  void take(uint32_t slot, ScheduledEvent &out);
+
   uint64_t now_ = 0;
-  std::vector<ScheduledEvent> events_;
+  uint64_t next_order_ = 0;
+  std::vector<uint32_t> heap_;
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> free_slots_;
 };
 
 } // namespace ps1emu
@@ -1,6 +1,7 @@
 #ifndef PS1EMU_XA_ADPCM_H
 #define PS1EMU_XA_ADPCM_H
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
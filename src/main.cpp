@@ -110,6 +110,9 @@ int main(int argc, char **argv) {
       core.dump_dynarec_profile();
     }
   }
+  if (core.config().cpu_idle_skip && (run_cycles > 0 || run_frames > 0)) {
+    std::cout << "Idle skip fast-forwarded " << core.idle_skipped_cycles() << " cycles.\n";
+  }
   if (dump_ram) {
     core.dump_memory_words(dump_ram_addr, dump_ram_words);
   }
@@ -31,6 +31,7 @@ IpcChannel::IpcChannel(IpcChannel &&other) noexcept {
   read_fd_ = other.read_fd_;
   write_fd_ = other.write_fd_;
   read_buffer_ = std::move(other.read_buffer_);
+  ring_ = std::move(other.ring_);
   other.read_fd_ = -1;
   other.write_fd_ = -1;
 }
@@ -46,6 +47,7 @@ IpcChannel &IpcChannel::operator=(IpcChannel &&other) noexcept {
     read_fd_ = other.read_fd_;
     write_fd_ = other.write_fd_;
     read_buffer_ = std::move(other.read_buffer_);
+    ring_ = std::move(other.ring_);
     other.read_fd_ = -1;
     other.write_fd_ = -1;
   }
@@ -147,13 +149,13 @@ bool IpcChannel::send_frame(uint16_t type, const std::vector<uint8_t> &payload)
   header[6] = static_cast<uint8_t>(flags & 0xFF);
   header[7] = static_cast<uint8_t>((flags >> 8) & 0xFF);
 
-  if (!write_all(write_fd_, reinterpret_cast<const char *>(header), sizeof(header))) {
+  if (!write_bytes(header, sizeof(header))) {
     return false;
   }
   if (payload.empty()) {
     return true;
   }
-  return write_all(write_fd_, reinterpret_cast<const char *>(payload.data()), payload.size());
+  return write_bytes(payload.data(), payload.size());
 }
 
 bool IpcChannel::recv_frame(uint16_t &out_type, std::vector<uint8_t> &out_payload) {
@@ -162,7 +164,7 @@ bool IpcChannel::recv_frame(uint16_t &out_type, std::vector<uint8_t> &out_payloa
   }
 
   uint8_t header[8];
-  if (!read_exact(read_fd_, reinterpret_cast<char *>(header), sizeof(header))) {
+  if (!read_bytes(header, sizeof(header))) {
     return false;
   }
 
@@ -182,7 +184,32 @@ bool IpcChannel::recv_frame(uint16_t &out_type, std::vector<uint8_t> &out_payloa
   if (length == 0) {
     return true;
   }
-  return read_exact(read_fd_, reinterpret_cast<char *>(out_payload.data()), length);
+  return read_bytes(out_payload.data(), length);
+}
+
+void IpcChannel::use_ring(std::unique_ptr<ShmRing> ring) {
+  ring_ = std::move(ring);
+  if (ring_) {
+    ring_->set_hangup_fd(read_fd_);
+  }
+}
+
+bool IpcChannel::uses_ring() const {
+  return ring_ != nullptr;
+}
+
+bool IpcChannel::write_bytes(const void *data, size_t size) {
+  if (ring_) {
+    return ring_->write(data, size);
+  }
+  return write_all(write_fd_, static_cast<const char *>(data), size);
+}
+
+bool IpcChannel::read_bytes(void *data, size_t size) {
+  if (ring_) {
+    return ring_->read(data, size);
+  }
+  return read_exact(read_fd_, static_cast<char *>(data), size);
 }
 
 static void set_cloexec(int fd) {
@@ -238,7 +265,8 @@ static void apply_linux_sandbox(const SandboxOptions &sandbox) {
 
 SpawnResult spawn_plugin_process(const std::string &path,
                                  const std::vector<std::string> &args,
-                                 const SandboxOptions &sandbox) {
+                                 const SandboxOptions &sandbox,
+                                 const std::vector<int> &inherit_fds) {
   int to_child[2] = {-1, -1};
   int from_child[2] = {-1, -1};
 
@@ -256,6 +284,19 @@ SpawnResult spawn_plugin_process(const std::string &path,
   set_cloexec(from_child[0]);
   set_cloexec(from_child[1]);
 
+  // The child may only make async-signal-safe calls between fork() and
+  // execv() (another host thread can hold the malloc lock at fork time), so
+  // everything it needs is allocated here.
+  std::vector<char *> argv;
+  argv.reserve(args.size() + 2);
+  argv.push_back(const_cast<char *>(path.c_str()));
+  for (const auto &arg : args) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+  int first_free = 3 + static_cast<int>(inherit_fds.size());
+  std::vector<int> staged(inherit_fds.size(), -1);
+
   pid_t pid = fork();
   if (pid < 0) {
     close(to_child[0]);
@@ -274,17 +315,22 @@ SpawnResult spawn_plugin_process(const std::string &path,
     close(from_child[0]);
     close(from_child[1]);
 
+    // Stage every fd above the target range first so no dup2 clobbers a
+    // source that is still to be moved; dup2 also clears FD_CLOEXEC.
+    for (size_t i = 0; i < inherit_fds.size(); ++i) {
+      if (inherit_fds[i] >= 0) {
+        staged[i] = fcntl(inherit_fds[i], F_DUPFD_CLOEXEC, first_free);
+      }
+    }
+    for (size_t i = 0; i < staged.size(); ++i) {
+      if (staged[i] >= 0) {
+        dup2(staged[i], 3 + static_cast<int>(i));
+      }
+    }
+
     apply_resource_limits(sandbox);
     apply_linux_sandbox(sandbox);
 
-    std::vector<char *> argv;
-    argv.reserve(args.size() + 2);
-    argv.push_back(const_cast<char *>(path.c_str()));
-    for (const auto &arg : args) {
-      argv.push_back(const_cast<char *>(arg.c_str()));
-    }
-    argv.push_back(nullptr);
-
     execv(path.c_str(), argv.data());
     _exit(127);
   }
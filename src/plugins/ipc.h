@@ -1,9 +1,11 @@
 #ifndef PS1EMU_IPC_H
 #define PS1EMU_IPC_H
 
+#include "plugins/shm_ring.h"
 #include "ps1emu/sandbox.h"
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -25,11 +27,19 @@ public:
   bool recv_line(std::string &out_line);
   bool send_frame(uint16_t type, const std::vector<uint8_t> &payload);
   bool recv_frame(uint16_t &out_type, std::vector<uint8_t> &out_payload);
+  // Moves frames onto a negotiated shared-memory ring; lines stay on the
+  // pipes, whose hangup also ends any wait on the ring.
+  void use_ring(std::unique_ptr<ShmRing> ring);
+  bool uses_ring() const;
 
 private:
+  bool write_bytes(const void *data, size_t size);
+  bool read_bytes(void *data, size_t size);
+
   int read_fd_ = -1;
   int write_fd_ = -1;
   std::string read_buffer_;
+  std::unique_ptr<ShmRing> ring_;
 };
 
 struct SpawnResult {
@@ -37,9 +47,12 @@ struct SpawnResult {
   IpcChannel channel;
 };
 
+// inherit_fds[i], if not -1, is handed to the plugin as fd 3 + i
+// (ShmRing::kPluginFd, then VramMirror::kPluginFd).
 SpawnResult spawn_plugin_process(const std::string &path,
                                  const std::vector<std::string> &args,
-                                 const SandboxOptions &sandbox);
+                                 const SandboxOptions &sandbox,
+                                 const std::vector<int> &inherit_fds);
 
 } // namespace ps1emu
 
@@ -20,13 +20,33 @@ const char *PluginHost::type_to_string(PluginType type) const {
   return "UNKNOWN";
 }
 
-bool PluginHost::launch_plugin(PluginType type, const std::string &path, const SandboxOptions &sandbox) {
+bool PluginHost::launch_plugin(PluginType type,
+                               const std::string &path,
+                               const SandboxOptions &sandbox,
+                               int shared_fd) {
   std::vector<std::string> args;
-  SpawnResult result = spawn_plugin_process(path, args, sandbox);
+  // Strict seccomp leaves the plugin without mmap/futex, so it keeps the pipes.
+  std::unique_ptr<ShmRing> ring;
+  if (shm_ring_ && !(sandbox.enabled && sandbox.seccomp_strict)) {
+    ring = std::make_unique<ShmRing>();
+    std::string error;
+    if (!ring->create(ShmRing::kDefaultCapacity, error)) {
+      ring.reset();
+    }
+  }
+  SpawnResult result =
+      spawn_plugin_process(path, args, sandbox, {ring ? ring->fd() : -1, shared_fd});
+  if (ring) {
+    ring->close_fd();
+  }
   if (result.pid <= 0 || !result.channel.valid()) {
     return false;
   }
-  plugins_[type] = PluginProcess{result.pid, std::move(result.channel)};
+  PluginProcess &process = plugins_[type];
+  process = PluginProcess{};
+  process.pid = result.pid;
+  process.channel = std::move(result.channel);
+  process.offered_ring = std::move(ring);
   return true;
 }
 
@@ -49,7 +69,41 @@ bool PluginHost::handshake(PluginType type) {
 
   std::ostringstream expected;
   expected << "READY " << type_to_string(type) << " 1";
-  return reply == expected.str();
+  if (reply != expected.str()) {
+    return false;
+  }
+
+  // Plugins that do not know SHM_RING answer ERROR and stay on the pipes.
+  PluginProcess &process = it->second;
+  if (process.offered_ring) {
+    std::ostringstream offer;
+    offer << "SHM_RING " << ShmRing::kPluginFd;
+    if (!process.channel.send_line(offer.str()) || !process.channel.recv_line(reply)) {
+      return false;
+    }
+    if (reply == "SHM_RING_READY") {
+      process.channel.use_ring(std::move(process.offered_ring));
+    }
+    process.offered_ring.reset();
+  }
+  return true;
+}
+
+bool PluginHost::offer_feature(PluginType type,
+                               const std::string &offer,
+                               const std::string &accept,
+                               bool &out_accepted) {
+  out_accepted = false;
+  auto it = plugins_.find(type);
+  if (it == plugins_.end()) {
+    return false;
+  }
+  std::string reply;
+  if (!it->second.channel.send_line(offer) || !it->second.channel.recv_line(reply)) {
+    return false;
+  }
+  out_accepted = reply == accept;
+  return true;
 }
 
 bool PluginHost::enter_frame_mode(PluginType type) {
@@ -98,6 +152,18 @@ bool PluginHost::is_frame_mode(PluginType type) const {
   return it->second.frame_mode;
 }
 
+bool PluginHost::uses_shm_ring(PluginType type) const {
+  auto it = plugins_.find(type);
+  if (it == plugins_.end()) {
+    return false;
+  }
+  return it->second.channel.uses_ring();
+}
+
+void PluginHost::set_shm_ring(bool enabled) {
+  shm_ring_ = enabled;
+}
+
 void PluginHost::shutdown_all() {
   std::vector<int> pids;
   pids.reserve(plugins_.size());
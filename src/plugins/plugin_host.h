@@ -4,6 +4,7 @@
 #include "plugins/ipc.h"
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -21,20 +22,36 @@ struct PluginProcess {
   int pid = -1;
   IpcChannel channel;
   bool frame_mode = false;
+  // Offered during the handshake; moved into the channel if the plugin accepts.
+  std::unique_ptr<ShmRing> offered_ring;
 };
 
 class PluginHost {
 public:
-  bool launch_plugin(PluginType type, const std::string &path, const SandboxOptions &sandbox);
+  // shared_fd, if not -1, is inherited by the plugin as VramMirror::kPluginFd.
+  bool launch_plugin(PluginType type,
+                     const std::string &path,
+                     const SandboxOptions &sandbox,
+                     int shared_fd = -1);
   bool handshake(PluginType type);
+  // Sends offer as a line; out_accepted is set when the plugin answers
+  // accept. Any other reply leaves the plugin on the base protocol.
+  bool offer_feature(PluginType type,
+                     const std::string &offer,
+                     const std::string &accept,
+                     bool &out_accepted);
   bool enter_frame_mode(PluginType type);
   bool send_frame(PluginType type, uint16_t message_type, const std::vector<uint8_t> &payload);
   bool recv_frame(PluginType type, uint16_t &out_type, std::vector<uint8_t> &out_payload);
   bool is_frame_mode(PluginType type) const;
+  bool uses_shm_ring(PluginType type) const;
+  // Offer a shared-memory ring to plugins launched from now on (default on).
+  void set_shm_ring(bool enabled);
   void shutdown_all();
 
 private:
   std::unordered_map<PluginType, PluginProcess> plugins_;
+  bool shm_ring_ = false;
   const char *type_to_string(PluginType type) const;
 };
 
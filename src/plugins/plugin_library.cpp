@@ -0,0 +1,96 @@
+#include "plugins/plugin_library.h"
+
+#include <dlfcn.h>
+
+namespace ps1emu {
+
+PluginLibrary::~PluginLibrary() {
+  unload();
+}
+
+bool PluginLibrary::load(const std::string &path, ps1emu_plugin_type_t type, std::string &error) {
+  unload();
+  // RTLD_LOCAL keeps the plugin's symbols (its own copy of any helpers) from
+  // resolving against the host or other plugins.
+  handle_ = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle_) {
+    const char *reason = dlerror();
+    error = reason ? reason : "dlopen failed";
+    return false;
+  }
+  auto entry = reinterpret_cast<ps1emu_plugin_entry_fn>(dlsym(handle_, PS1EMU_PLUGIN_ENTRY_SYMBOL));
+  if (!entry) {
+    error = std::string("missing ") + PS1EMU_PLUGIN_ENTRY_SYMBOL;
+    unload();
+    return false;
+  }
+  const ps1emu_plugin_info_t *info = entry(PS1EMU_PLUGIN_API_VERSION);
+  if (!info || info->api_version != PS1EMU_PLUGIN_API_VERSION) {
+    error = "unsupported plugin API version";
+    unload();
+    return false;
+  }
+  if (info->type != type) {
+    error = "plugin type mismatch";
+    unload();
+    return false;
+  }
+  if (type == PS1EMU_PLUGIN_GPU) {
+    const auto *gpu_table = reinterpret_cast<const ps1emu_gpu_vtable_t *>(info);
+    instance_ = gpu_table->create ? gpu_table->create() : nullptr;
+  } else if (type == PS1EMU_PLUGIN_SPU) {
+    const auto *spu_table = reinterpret_cast<const ps1emu_spu_vtable_t *>(info);
+    instance_ = spu_table->create ? spu_table->create() : nullptr;
+  } else {
+    error = "only GPU and SPU plugins can run in-process";
+    unload();
+    return false;
+  }
+  if (!instance_) {
+    error = "plugin create failed";
+    unload();
+    return false;
+  }
+  info_ = info;
+  return true;
+}
+
+const ps1emu_gpu_vtable_t *PluginLibrary::gpu() const {
+  if (!info_ || info_->type != PS1EMU_PLUGIN_GPU) {
+    return nullptr;
+  }
+  return reinterpret_cast<const ps1emu_gpu_vtable_t *>(info_);
+}
+
+const ps1emu_spu_vtable_t *PluginLibrary::spu() const {
+  if (!info_ || info_->type != PS1EMU_PLUGIN_SPU) {
+    return nullptr;
+  }
+  return reinterpret_cast<const ps1emu_spu_vtable_t *>(info_);
+}
+
+void *PluginLibrary::instance() const {
+  return instance_;
+}
+
+const char *PluginLibrary::name() const {
+  return info_ && info_->name ? info_->name : "";
+}
+
+void PluginLibrary::unload() {
+  if (instance_ && info_) {
+    if (const auto *gpu_table = gpu()) {
+      gpu_table->destroy(instance_);
+    } else if (const auto *spu_table = spu()) {
+      spu_table->destroy(instance_);
+    }
+  }
+  instance_ = nullptr;
+  info_ = nullptr;
+  if (handle_) {
+    dlclose(handle_);
+    handle_ = nullptr;
+  }
+}
+
+} // namespace ps1emu
@@ -0,0 +1,37 @@
+#ifndef PS1EMU_PLUGIN_LIBRARY_H
+#define PS1EMU_PLUGIN_LIBRARY_H
+
+#include "ps1emu/plugin_api.h"
+
+#include <string>
+
+namespace ps1emu {
+
+// A trusted plugin loaded into the emulator process through plugin_api.h.
+// Owns the dlopen handle and the plugin instance made by the vtable's create.
+class PluginLibrary {
+public:
+  PluginLibrary() = default;
+  ~PluginLibrary();
+
+  PluginLibrary(const PluginLibrary &) = delete;
+  PluginLibrary &operator=(const PluginLibrary &) = delete;
+
+  bool load(const std::string &path, ps1emu_plugin_type_t type, std::string &error);
+  // Null unless a plugin of that type is loaded.
+  const ps1emu_gpu_vtable_t *gpu() const;
+  const ps1emu_spu_vtable_t *spu() const;
+  void *instance() const;
+  const char *name() const;
+
+private:
+  void unload();
+
+  void *handle_ = nullptr;
+  const ps1emu_plugin_info_t *info_ = nullptr;
+  void *instance_ = nullptr;
+};
+
+} // namespace ps1emu
+
+#endif
@@ -0,0 +1,329 @@
+#include "plugins/shm_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+
+namespace ps1emu {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring indices must be lock-free");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "futex words must be lock-free");
+
+static constexpr uint32_t kShmRingMagic = 0x31525350; // "PSR1"
+static constexpr int kWaitSliceMs = 50;
+static constexpr int kSpinChecks = 256;
+
+// One direction. head/tail count bytes ever consumed/produced; the sequence
+// words are bumped on every publish so a sleeper's futex wait cannot miss one.
+// Both indices live in memory the (sandboxed) peer can write, so a side
+// treats tail - head > capacity as a broken peer rather than trusting it.
+struct ShmRingState {
+  alignas(64) std::atomic<uint64_t> head {0};
+  alignas(64) std::atomic<uint64_t> tail {0};
+  alignas(64) std::atomic<uint32_t> data_seq {0};
+  std::atomic<uint32_t> reader_waiting {0};
+  std::atomic<uint32_t> space_seq {0};
+  std::atomic<uint32_t> writer_waiting {0};
+};
+
+struct ShmRingShared {
+  uint32_t magic = kShmRingMagic;
+  uint32_t capacity = 0;
+  ShmRingState rings[2]; // [0] host->plugin, [1] plugin->host
+};
+
+static size_t shm_ring_map_size(uint32_t capacity) {
+  return sizeof(ShmRingShared) + static_cast<size_t>(capacity) * 2;
+}
+
+static bool valid_capacity(uint32_t capacity) {
+  return capacity >= 64 && (capacity & (capacity - 1)) == 0;
+}
+
+static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static void futex_wait(std::atomic<uint32_t> &word, uint32_t expected, int timeout_ms) {
+#ifdef __linux__
+  struct timespec ts {};
+  ts.tv_sec = timeout_ms / 1000;
+  ts.tv_nsec = static_cast<long>(timeout_ms % 1000) * 1000000L;
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+#else
+  (void)word;
+  (void)expected;
+  usleep(static_cast<useconds_t>(timeout_ms) * 1000);
+#endif
+}
+
+static void futex_wake(std::atomic<uint32_t> &word) {
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+  (void)word;
+#endif
+}
+
+static void notify(std::atomic<uint32_t> &seq, std::atomic<uint32_t> &waiting) {
+  seq.fetch_add(1);
+  if (waiting.load() != 0) {
+    futex_wake(seq);
+  }
+}
+
+enum class WaitResult {
+  Ready,
+  TimedOut,
+  Closed,
+};
+
+// Spins briefly, then sleeps on seq until ready() holds. Sleeps are cut into
+// slices so a peer that died without waking us is noticed through peer_gone.
+template <typename Ready, typename Gone>
+static WaitResult wait_until(std::atomic<uint32_t> &seq,
+                             std::atomic<uint32_t> &waiting,
+                             int timeout_ms,
+                             Ready ready,
+                             Gone peer_gone) {
+  for (int i = 0; i < kSpinChecks; ++i) {
+    if (ready()) {
+      return WaitResult::Ready;
+    }
+    cpu_relax();
+  }
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  for (;;) {
+    int slice = kWaitSliceMs;
+    if (timeout_ms >= 0) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0) {
+        return ready() ? WaitResult::Ready : WaitResult::TimedOut;
+      }
+      slice = std::min<int>(slice, static_cast<int>(left.count()));
+    }
+    uint32_t seen = seq.load();
+    waiting.store(1);
+    if (ready()) {
+      waiting.store(0);
+      return WaitResult::Ready;
+    }
+    futex_wait(seq, seen, slice);
+    waiting.store(0);
+    if (ready()) {
+      return WaitResult::Ready;
+    }
+    if (peer_gone()) {
+      return WaitResult::Closed;
+    }
+  }
+}
+
+ShmRing::~ShmRing() {
+  if (shared_) {
+    munmap(shared_, map_size_);
+  }
+  close_fd();
+}
+
+bool ShmRing::create(uint32_t capacity, std::string &error) {
+#ifdef __linux__
+  if (!valid_capacity(capacity)) {
+    error = "ring capacity must be a power of two";
+    return false;
+  }
+  int fd = memfd_create("ps1emu-ipc", MFD_CLOEXEC);
+  if (fd < 0) {
+    error = std::string("memfd_create failed: ") + strerror(errno);
+    return false;
+  }
+  size_t size = shm_ring_map_size(capacity);
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    error = std::string("ftruncate failed: ") + strerror(errno);
+    close(fd);
+    return false;
+  }
+  void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    error = std::string("mmap failed: ") + strerror(errno);
+    close(fd);
+    return false;
+  }
+  shared_ = new (mem) ShmRingShared();
+  shared_->capacity = capacity;
+  map_size_ = size;
+  capacity_ = capacity;
+  fd_ = fd;
+  host_ = true;
+  uint8_t *data = static_cast<uint8_t *>(mem) + sizeof(ShmRingShared);
+  tx_data_ = data;
+  rx_data_ = data + capacity;
+  return true;
+#else
+  (void)capacity;
+  error = "shared-memory rings need Linux";
+  return false;
+#endif
+}
+
+bool ShmRing::attach(int fd, std::string &error) {
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(ShmRingShared))) {
+    error = "ring fd is not a shared mapping";
+    return false;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    error = std::string("mmap failed: ") + strerror(errno);
+    return false;
+  }
+  auto *shared = static_cast<ShmRingShared *>(mem);
+  if (shared->magic != kShmRingMagic || !valid_capacity(shared->capacity) ||
+      shm_ring_map_size(shared->capacity) != size) {
+    munmap(mem, size);
+    error = "ring header mismatch";
+    return false;
+  }
+  shared_ = shared;
+  map_size_ = size;
+  capacity_ = shared->capacity;
+  fd_ = fd;
+  host_ = false;
+  uint8_t *data = static_cast<uint8_t *>(mem) + sizeof(ShmRingShared);
+  tx_data_ = data + capacity_;
+  rx_data_ = data;
+  return true;
+}
+
+int ShmRing::fd() const {
+  return fd_;
+}
+
+void ShmRing::close_fd() {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void ShmRing::set_hangup_fd(int fd) {
+  hangup_fd_ = fd;
+}
+
+bool ShmRing::peer_gone() const {
+  if (hangup_fd_ < 0) {
+    return false;
+  }
+  struct pollfd pfd {
+    hangup_fd_, 0, 0
+  };
+  if (poll(&pfd, 1, 0) < 0) {
+    return errno != EINTR;
+  }
+  return (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) != 0;
+}
+
+bool ShmRing::write(const void *data, size_t size) {
+  if (!shared_) {
+    return false;
+  }
+  ShmRingState &ring = shared_->rings[host_ ? 0 : 1];
+  const uint8_t *src = static_cast<const uint8_t *>(data);
+  while (size > 0) {
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t used = tail - ring.head.load();
+    if (used > capacity_) {
+      return false; // indices the peer cannot have produced
+    }
+    uint64_t space = capacity_ - used;
+    if (space == 0) {
+      WaitResult result = wait_until(
+          ring.space_seq, ring.writer_waiting, -1,
+          [&]() { return ring.head.load() != tail - capacity_; },
+          [this]() { return peer_gone(); });
+      if (result != WaitResult::Ready) {
+        return false;
+      }
+      continue;
+    }
+    size_t chunk = static_cast<size_t>(std::min<uint64_t>({space, size, capacity_}));
+    size_t pos = static_cast<size_t>(tail & (capacity_ - 1));
+    size_t first = std::min(chunk, capacity_ - pos);
+    std::memcpy(tx_data_ + pos, src, first);
+    std::memcpy(tx_data_, src + first, chunk - first);
+    ring.tail.store(tail + chunk);
+    notify(ring.data_seq, ring.reader_waiting);
+    src += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+bool ShmRing::read(void *data, size_t size) {
+  if (!shared_) {
+    return false;
+  }
+  ShmRingState &ring = shared_->rings[host_ ? 1 : 0];
+  uint8_t *dst = static_cast<uint8_t *>(data);
+  while (size > 0) {
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    uint64_t avail = ring.tail.load() - head;
+    if (avail > capacity_) {
+      return false; // indices the peer cannot have produced
+    }
+    if (avail == 0) {
+      WaitResult result = wait_until(
+          ring.data_seq, ring.reader_waiting, -1,
+          [&]() { return ring.tail.load() != head; },
+          [this]() { return peer_gone(); });
+      if (result != WaitResult::Ready) {
+        return false;
+      }
+      continue;
+    }
+    size_t chunk = static_cast<size_t>(std::min<uint64_t>({avail, size, capacity_}));
+    size_t pos = static_cast<size_t>(head & (capacity_ - 1));
+    size_t first = std::min(chunk, capacity_ - pos);
+    std::memcpy(dst, rx_data_ + pos, first);
+    std::memcpy(dst + first, rx_data_, chunk - first);
+    ring.head.store(head + chunk);
+    notify(ring.space_seq, ring.writer_waiting);
+    dst += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+bool ShmRing::wait_readable(int timeout_ms, bool &out_timed_out) {
+  out_timed_out = false;
+  if (!shared_) {
+    return false;
+  }
+  ShmRingState &ring = shared_->rings[host_ ? 1 : 0];
+  uint64_t head = ring.head.load(std::memory_order_relaxed);
+  WaitResult result = wait_until(
+      ring.data_seq, ring.reader_waiting, timeout_ms,
+      [&]() { return ring.tail.load() != head; },
+      [this]() { return peer_gone(); });
+  out_timed_out = result == WaitResult::TimedOut;
+  return result == WaitResult::Ready;
+}
+
+} // namespace ps1emu
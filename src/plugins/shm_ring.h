@@ -0,0 +1,59 @@
+#ifndef PS1EMU_SHM_RING_H
+#define PS1EMU_SHM_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ps1emu {
+
+struct ShmRingShared;
+
+// Byte stream between host and plugin over one memfd holding two
+// single-producer/single-consumer rings (host->plugin and plugin->host).
+// Carries the same framed messages as the pipes; a side only enters the
+// kernel to sleep on an empty/full ring or to wake a peer that is asleep.
+class ShmRing {
+public:
+  // The plugin finds the mapping at this fd after exec.
+  static constexpr int kPluginFd = 3;
+  static constexpr uint32_t kDefaultCapacity = 1u << 20;
+
+  ShmRing() = default;
+  ~ShmRing();
+
+  ShmRing(const ShmRing &) = delete;
+  ShmRing &operator=(const ShmRing &) = delete;
+
+  // Host side: allocates the memfd. fd() stays open until close_fd() so it
+  // can be handed to the plugin process.
+  bool create(uint32_t capacity, std::string &error);
+  // Plugin side: maps a memfd created by the host and takes ownership of fd.
+  bool attach(int fd, std::string &error);
+  int fd() const;
+  void close_fd();
+
+  // Waits are abandoned once this fd reports a hangup (the peer's pipe).
+  void set_hangup_fd(int fd);
+
+  bool write(const void *data, size_t size);
+  bool read(void *data, size_t size);
+  // True once at least one byte is readable; timeout_ms < 0 waits forever.
+  bool wait_readable(int timeout_ms, bool &out_timed_out);
+
+private:
+  bool peer_gone() const;
+
+  ShmRingShared *shared_ = nullptr;
+  uint8_t *tx_data_ = nullptr;
+  uint8_t *rx_data_ = nullptr;
+  size_t map_size_ = 0;
+  uint32_t capacity_ = 0;
+  bool host_ = false;
+  int fd_ = -1;
+  int hangup_fd_ = -1;
+};
+
+} // namespace ps1emu
+
+#endif
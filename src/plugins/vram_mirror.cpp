@@ -0,0 +1,141 @@
+#include "plugins/vram_mirror.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace ps1emu {
+
+struct VramMirrorHeader {
+  alignas(64) std::atomic<uint32_t> fence {0};
+};
+
+static_assert(sizeof(VramMirrorHeader) == 64, "pixels start on their own cache line");
+
+static constexpr size_t kVramMirrorSize =
+    sizeof(VramMirrorHeader) + static_cast<size_t>(VramMirror::kWidth) * VramMirror::kHeight * 2;
+
+VramMirror::~VramMirror() {
+  if (header_) {
+    munmap(header_, map_size_);
+  }
+  close_fd();
+}
+
+bool VramMirror::create(std::string &error) {
+#ifdef __linux__
+  int fd = memfd_create("ps1emu-vram", MFD_CLOEXEC);
+  if (fd < 0) {
+    error = std::string("memfd_create failed: ") + strerror(errno);
+    return false;
+  }
+  // A fresh memfd reads as zeros, which is both an empty VRAM and fence 0.
+  if (ftruncate(fd, static_cast<off_t>(kVramMirrorSize)) != 0) {
+    error = std::string("ftruncate failed: ") + strerror(errno);
+    close(fd);
+    return false;
+  }
+  void *mem = mmap(nullptr, kVramMirrorSize, PROT_READ, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    error = std::string("mmap failed: ") + strerror(errno);
+    close(fd);
+    return false;
+  }
+  header_ = static_cast<VramMirrorHeader *>(mem);
+  pixels_ = reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(mem) + sizeof(VramMirrorHeader));
+  map_size_ = kVramMirrorSize;
+  fd_ = fd;
+  return true;
+#else
+  error = "shared VRAM needs Linux";
+  return false;
+#endif
+}
+
+bool VramMirror::attach(int fd, std::string &error) {
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != kVramMirrorSize) {
+    error = "VRAM fd has the wrong size";
+    return false;
+  }
+  void *mem = mmap(nullptr, kVramMirrorSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    error = std::string("mmap failed: ") + strerror(errno);
+    return false;
+  }
+  header_ = static_cast<VramMirrorHeader *>(mem);
+  pixels_ = reinterpret_cast<uint16_t *>(static_cast<uint8_t *>(mem) + sizeof(VramMirrorHeader));
+  map_size_ = kVramMirrorSize;
+  fd_ = fd;
+  return true;
+}
+
+bool VramMirror::mapped() const {
+  return header_ != nullptr;
+}
+
+int VramMirror::fd() const {
+  return fd_;
+}
+
+void VramMirror::close_fd() {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+uint16_t *VramMirror::pixels() {
+  return pixels_;
+}
+
+void VramMirror::publish_fence(uint32_t value) {
+  header_->fence.store(value, std::memory_order_release);
+}
+
+uint32_t VramMirror::fence() const {
+  return header_->fence.load(std::memory_order_acquire);
+}
+
+void VramMirror::read_words(uint16_t x,
+                            uint16_t y,
+                            uint16_t w,
+                            uint16_t h,
+                            std::vector<uint32_t> &out) const {
+  out.clear();
+  int cols = std::min<int>(w, kWidth);
+  int rows = std::min<int>(h, kHeight);
+  if (cols <= 0 || rows <= 0) {
+    return;
+  }
+  size_t pixel_count = static_cast<size_t>(cols) * rows;
+  out.reserve((pixel_count + 1) / 2);
+  uint32_t current = 0;
+  bool low = true;
+  for (int yy = 0; yy < rows; ++yy) {
+    int sy = y + yy;
+    const uint16_t *row = sy < kHeight ? pixels_ + static_cast<size_t>(sy) * kWidth : nullptr;
+    for (int xx = 0; xx < cols; ++xx) {
+      int sx = x + xx;
+      uint16_t pix = (row && sx < kWidth) ? row[sx] : 0;
+      if (low) {
+        current = pix;
+        low = false;
+      } else {
+        current |= static_cast<uint32_t>(pix) << 16;
+        out.push_back(current);
+        low = true;
+      }
+    }
+  }
+  if (!low) {
+    out.push_back(current);
+  }
+}
+
+} // namespace ps1emu
@@ -0,0 +1,58 @@
+#ifndef PS1EMU_VRAM_MIRROR_H
+#define PS1EMU_VRAM_MIRROR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ps1emu {
+
+struct VramMirrorHeader;
+
+// The GPU plugin's 1024x512 16-bit VRAM, kept in a memfd the plugin maps
+// read/write and the host maps read-only. The plugin publishes a fence value
+// once every frame sent before the matching fence request has been drawn, so
+// the host can copy VRAM reads straight out of the mapping.
+class VramMirror {
+public:
+  // Second inherited fd slot, after ShmRing::kPluginFd.
+  static constexpr int kPluginFd = 4;
+  static constexpr int kWidth = 1024;
+  static constexpr int kHeight = 512;
+
+  VramMirror() = default;
+  ~VramMirror();
+
+  VramMirror(const VramMirror &) = delete;
+  VramMirror &operator=(const VramMirror &) = delete;
+
+  // Host side: allocates the memfd and maps it read-only. fd() stays open
+  // until close_fd() so it can be handed to the plugin process.
+  bool create(std::string &error);
+  // Plugin side: maps a memfd created by the host and takes ownership of fd.
+  bool attach(int fd, std::string &error);
+  bool mapped() const;
+  int fd() const;
+  void close_fd();
+
+  // Plugin side.
+  uint16_t *pixels();
+  void publish_fence(uint32_t value);
+
+  // Host side.
+  uint32_t fence() const;
+  // Packs a w x h rectangle into GPUREAD words, two pixels per word. Pixels
+  // outside VRAM read as 0 and w/h are clamped, matching the 0x0004 reply.
+  void read_words(uint16_t x, uint16_t y, uint16_t w, uint16_t h, std::vector<uint32_t> &out) const;
+
+private:
+  VramMirrorHeader *header_ = nullptr;
+  uint16_t *pixels_ = nullptr;
+  size_t map_size_ = 0;
+  int fd_ = -1;
+};
+
+} // namespace ps1emu
+
+#endif
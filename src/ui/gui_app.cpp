@@ -493,6 +493,8 @@ void GuiApp::draw_settings_view() {
     mode_text = "Interpreter";
   } else if (cfg.cpu_mode == CpuMode::Dynarec) {
     mode_text = "Dynarec";
+  } else if (cfg.cpu_mode == CpuMode::Threaded) {
+    mode_text = "Threaded";
   }
   draw_text(panel.x + 120, panel.y + 410, mode_text, rgb(47, 110, 122), 14, true);
 }
@@ -1,4 +1,5 @@
 #include "core/cpu.h"
+#include "core/dynarec_ir.h"
 #include "core/emu_core.h"
 #include "core/gte.h"
 #include "core/gpu_packets.h"
@@ -7,14 +8,22 @@
 #include "core/scheduler.h"
 #include "core/xa_adpcm.h"
 #include "plugins/ipc.h"
+#include "plugins/plugin_host.h"
+#include "plugins/plugin_library.h"
+
+#include "../plugins/gpu_stub/span_kernels.h"
 
 #include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <sys/mman.h>
 #include <sys/wait.h>
+#include <unistd.h>
 #include <string>
 #include <vector>
 
@@ -25,6 +34,18 @@ static uint32_t encode_i(uint8_t op, uint8_t rs, uint8_t rt, uint16_t imm) {
          static_cast<uint32_t>(imm);
 }
 
+static uint32_t encode_r(uint8_t rs, uint8_t rt, uint8_t rd, uint8_t sh, uint8_t funct) {
+  return (static_cast<uint32_t>(rs) << 21) |
+         (static_cast<uint32_t>(rt) << 16) |
+         (static_cast<uint32_t>(rd) << 11) |
+         (static_cast<uint32_t>(sh) << 6) |
+         static_cast<uint32_t>(funct);
+}
+
+static uint32_t encode_j(uint8_t op, uint32_t target) {
+  return (static_cast<uint32_t>(op) << 26) | ((target >> 2) & 0x03FFFFFFu);
+}
+
 static uint32_t gte_cmd(uint32_t op, bool sf = false, bool lm = false) {
   return op | (sf ? (1u << 19) : 0u) | (lm ? (1u << 10) : 0u);
 }
@@ -60,6 +81,13 @@ struct EmulatorCoreTestAccess {
   static MmioBus &mmio(EmulatorCore &core) { return core.mmio_; }
   static void flush_gpu(EmulatorCore &core) { core.flush_gpu_commands(); }
   static void process_dma(EmulatorCore &core) { core.process_dma(); }
+  static bool gpu_batching(EmulatorCore &core) { return core.gpu_batching_; }
+  static size_t gpu_batch_bytes(EmulatorCore &core) { return core.gpu_batch_.size(); }
+  static bool gpu_present_on_vblank(EmulatorCore &core) { return core.gpu_present_on_vblank_; }
+  static bool gpu_shared_vram(EmulatorCore &core) { return core.gpu_vram_ != nullptr; }
+  static bool gpu_vram_synced(EmulatorCore &core) {
+    return core.gpu_vram_fenced_ == core.gpu_vram_generation_;
+  }
 };
 } // namespace ps1emu
 
@@ -214,7 +242,7 @@ static bool run_stub_handshake(const std::string &path, const std::string &name)
   sandbox.rlimit_as_mb = 0;
   sandbox.rlimit_nofile = 0;
 
-  auto result = ps1emu::spawn_plugin_process(path, {}, sandbox);
+  auto result = ps1emu::spawn_plugin_process(path, {}, sandbox, {});
   CHECK(result.pid > 0);
   CHECK(result.channel.valid());
 
@@ -265,6 +293,57 @@ static bool test_load_delay() {
   return true;
 }
 
+static bool test_interpreter_sees_code_writes() {
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+
+  auto &st = cpu.state();
+  st.pc = 0x00000000;
+  st.next_pc = st.pc + 4;
+  st.gpr[9] = 0x80000010;
+  st.gpr[8] = encode_i(0x09, 0, 3, 7);                    // addiu r3, r0, 7
+  mem.write32(0x00000000, encode_i(0x2B, 9, 8, 0));       // sw r8, 0(r9) via the KSEG0 mirror
+  mem.write32(0x00000004, 0x00000000);
+  mem.write32(0x00000008, 0x00000000);
+  mem.write32(0x0000000C, 0x00000000);
+  mem.write32(0x00000010, encode_i(0x09, 0, 3, 1));       // addiu r3, r0, 1
+
+  // Decode the target word first so the store has to invalidate it.
+  st.pc = 0x00000010;
+  st.next_pc = st.pc + 4;
+  cpu.step();
+  CHECK(st.gpr[3] == 1);
+
+  st.pc = 0x00000000;
+  st.next_pc = st.pc + 4;
+  for (int i = 0; i < 5; ++i) {
+    cpu.step();
+  }
+  CHECK(st.gpr[3] == 7);
+
+  mem.write32(0x00000010, encode_i(0x09, 0, 3, 9));
+  st.pc = 0x00000010;
+  st.next_pc = st.pc + 4;
+  cpu.step();
+  CHECK(st.gpr[3] == 9);
+
+  mem.reset();
+  st.gpr[3] = 5;
+  st.pc = 0x00000010;
+  st.next_pc = st.pc + 4;
+  cpu.step();
+  CHECK(st.gpr[3] == 5);
+  return true;
+}
+
 static bool test_cpu_reset_state() {
   ps1emu::MemoryMap mem;
   ps1emu::MmioBus mmio;
@@ -408,6 +487,44 @@ static bool test_cpu_exception_sr_shift() {
   return true;
 }
 
+static bool test_cpu_irq_line_pushed_by_bus() {
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+
+  // The bus is attached after the CPU registers for IRQ line changes.
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  mem.attach_mmio(mmio);
+
+  auto &st = cpu.state();
+  st.cop0.sr = 0x00000401u; // IE + IM2
+  st.pc = 0x00000000;
+  st.next_pc = st.pc + 4;
+  for (uint32_t i = 0; i < 4; ++i) {
+    mem.write32(i * 4, 0x00000000); // nop
+  }
+
+  mem.write32(0x1F801074, 1u); // I_MASK: VBlank
+  cpu.step();
+  CHECK(st.pc == 0x00000004);
+
+  mmio.tick(33868800 / 60);
+  st.cop0.cause = 0; // as if software cleared CAUSE with MTC0
+  cpu.step();
+  CHECK(st.pc == 0x80000080);
+  CHECK((st.cop0.cause & (1u << 10)) != 0);
+  CHECK((st.cop0.cause & (0x1Fu << 2)) == 0);
+
+  mem.write32(0x1F801070, 1u); // acknowledge VBlank
+  cpu.step();
+  CHECK((st.cop0.cause & (1u << 10)) == 0);
+  return true;
+}
+
 static bool test_branch_likely_not_taken() {
   ps1emu::MemoryMap mem;
   ps1emu::MmioBus mmio;
@@ -506,6 +623,28 @@ static bool test_vblank_irq() {
   return true;
 }
 
+static bool test_vblank_requests_present() {
+  ps1emu::MmioBus mmio;
+  mmio.reset();
+  CHECK(!mmio.take_vblank());
+
+  constexpr uint32_t kCyclesPerFrame = 33868800 / 60;
+  mmio.tick(kCyclesPerFrame);
+  CHECK(mmio.needs_attention());
+  CHECK(mmio.take_vblank());
+  CHECK(!mmio.take_vblank());
+
+  ScopedConfigFile config("ps1emu_tests_present.conf");
+  CHECK(write_test_config(config.path));
+  ScopedCore scoped;
+  CHECK(scoped.core.initialize(config.path));
+  scoped.active = true;
+  CHECK(ps1emu::EmulatorCoreTestAccess::gpu_present_on_vblank(scoped.core));
+  scoped.core.run_for_cycles(kCyclesPerFrame * 2);
+  CHECK(!ps1emu::EmulatorCoreTestAccess::mmio(scoped.core).take_vblank());
+  return true;
+}
+
 static bool test_gpu_status_bits() {
   ps1emu::MmioBus mmio;
   mmio.reset();
@@ -862,6 +1001,732 @@ static bool test_gte_lwc2_delay() {
   return true;
 }
 
+static bool test_scheduler_heap_cancel_reschedule() {
+  ps1emu::Scheduler sched;
+  sched.reset();
+  CHECK(sched.next_event_time() == ps1emu::kNoEvent);
+  ps1emu::EventHandle late = sched.schedule(300, 3);
+  ps1emu::EventHandle early = sched.schedule(100, 1);
+  ps1emu::EventHandle tie = sched.schedule(100, 2);
+  ps1emu::EventHandle doomed = sched.schedule(50, 4);
+  CHECK(sched.next_event_time() == 50);
+  CHECK(sched.cancel(doomed));
+  CHECK(!sched.cancel(doomed));
+  CHECK(sched.next_event_time() == 100);
+
+  // Moving an event puts it behind others due at the same cycle.
+  CHECK(sched.reschedule(early, 100));
+  ps1emu::ScheduledEvent evt;
+  CHECK(!sched.pop_due(evt));
+  sched.advance(100);
+  CHECK(sched.pop_due(evt));
+  CHECK(evt.id == 2 && evt.handle == tie);
+  CHECK(sched.pop_due(evt));
+  CHECK(evt.id == 1 && evt.when == 100);
+  CHECK(!sched.pop_due(evt));
+  CHECK(!sched.pending(early));
+  CHECK(sched.pending(late));
+
+  // A fired handle stays stale after its slot is reused.
+  ps1emu::EventHandle reused = sched.schedule(10, 5);
+  CHECK(!sched.reschedule(tie, 1));
+  CHECK(sched.next_event_time() == 110);
+  CHECK(sched.pop_next(evt));
+  CHECK(evt.handle == reused);
+  CHECK(sched.pop_next(evt));
+  CHECK(evt.id == 3 && evt.when == 300);
+  CHECK(!sched.pop_next(evt));
+  return true;
+}
+
+static bool test_cpu_idle_loop_detection() {
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  const uint32_t program[] = {
+      encode_i(0x0F, 0, 8, 0x1F80),      // 0x100 lui r8, 0x1F80
+      encode_i(0x23, 8, 9, 0x1070),      // 0x104 lw r9, I_STAT(r8)
+      0x00000000,                        // 0x108 nop
+      encode_i(0x0C, 9, 9, 0x0001),      // 0x10C andi r9, r9, 1
+      encode_i(0x04, 9, 0, 0xFFFC),      // 0x110 beq r9, r0, 0x104
+      0x00000000,                        // 0x114 nop
+      encode_i(0x23, 8, 9, 0x1070),      // 0x118 lw r9, I_STAT(r8)
+      encode_i(0x2B, 0, 9, 0x0000),      // 0x11C sw r9, 0(r0)
+      encode_i(0x05, 9, 0, 0xFFFD),      // 0x120 bne r9, r0, 0x118
+      0x00000000,                        // 0x124 nop
+  };
+  for (size_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+    mem.write32(0x100 + static_cast<uint32_t>(i * 4), program[i]);
+  }
+
+  auto &st = cpu.state();
+  st.pc = 0x100;
+  st.next_pc = st.pc + 4;
+  bool idle = false;
+  for (int guard = 0; guard < 64 && !idle; ++guard) {
+    cpu.step();
+    idle = cpu.poll_idle();
+  }
+  CHECK(idle);
+  CHECK(st.pc >= 0x104 && st.pc <= 0x114);
+  CHECK(!cpu.idle_polls_gpustat());
+
+  // Any device activity since the last pass retakes the snapshot.
+  CHECK(cpu.poll_idle());
+  mmio.clear_attention();
+  CHECK(!cpu.poll_idle());
+  CHECK(cpu.poll_idle());
+
+  // Code writes elsewhere keep the analysis; a write inside the loop (through
+  // a mirror) drops it, and the store it adds makes the loop non-idle.
+  cpu.invalidate_code_range(0x3000, 4);
+  CHECK(cpu.poll_idle());
+  mem.write32(0x80000108, encode_i(0x2B, 0, 9, 0x0000)); // sw r9, 0(r0)
+  CHECK(!cpu.poll_idle());
+  mem.write32(0x80000108, 0x00000000);
+  idle = false;
+  for (int guard = 0; guard < 64 && !idle; ++guard) {
+    cpu.step();
+    idle = cpu.poll_idle();
+  }
+  CHECK(idle);
+
+  // VBlank changes what the loop reads, so it exits.
+  mmio.tick(33868800 / 60);
+  for (int guard = 0; guard < 16 && st.pc != 0x118; ++guard) {
+    cpu.step();
+    CHECK(!cpu.poll_idle() || st.pc != 0x118);
+  }
+  CHECK(st.pc == 0x118);
+
+  // The second loop stores to RAM on every pass and is never idle.
+  for (int guard = 0; guard < 64; ++guard) {
+    cpu.step();
+    CHECK(!cpu.poll_idle());
+  }
+  return true;
+}
+
+static void write_dynarec_program(ps1emu::MemoryMap &mem) {
+  const uint32_t program[] = {
+      encode_i(0x09, 0, 1, 10),          // 0x00 addiu r1, r0, 10
+      encode_i(0x0F, 0, 2, 0x0000),      // 0x04 lui r2, 0
+      encode_i(0x0D, 2, 2, 0x1000),      // 0x08 ori r2, r2, 0x1000
+      encode_i(0x09, 0, 3, 0),           // 0x0C addiu r3, r0, 0
+      encode_i(0x2B, 2, 1, 0),           // 0x10 sw r1, 0(r2)
+      encode_i(0x23, 2, 4, 0),           // 0x14 lw r4, 0(r2)
+      encode_r(3, 4, 3, 0, 0x21),        // 0x18 addu r3, r3, r4 (old r4)
+      encode_i(0x09, 1, 1, 0xFFFF),      // 0x1C addiu r1, r1, -1
+      encode_i(0x05, 1, 0, 0xFFFB),      // 0x20 bne r1, r0, 0x10
+      encode_i(0x09, 2, 2, 4),           // 0x24 addiu r2, r2, 4 (delay slot)
+      encode_j(0x03, 0x40),              // 0x28 jal 0x40
+      encode_r(0, 3, 5, 2, 0x00),        // 0x2C sll r5, r3, 2 (delay slot)
+      0x00000000,                        // 0x30 nop (end)
+      0x00000000,
+      0x00000000,
+      0x00000000,
+      encode_r(3, 5, 0, 0, 0x19),        // 0x40 multu r3, r5
+      encode_r(0, 0, 6, 0, 0x12),        // 0x44 mflo r6
+      encode_i(0x20, 2, 7, 0xFFFC),      // 0x48 lb r7, -4(r2)
+      encode_r(6, 7, 8, 0, 0x2A),        // 0x4C slt r8, r6, r7 (old r7)
+      encode_i(0x0A, 7, 9, 5),           // 0x50 slti r9, r7, 5
+      encode_r(31, 0, 0, 0, 0x08),       // 0x54 jr r31
+      encode_r(0, 6, 10, 1, 0x03),       // 0x58 sra r10, r6, 1 (delay slot)
+  };
+  for (size_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+    mem.write32(static_cast<uint32_t>(i * 4), program[i]);
+  }
+}
+
+static bool run_dynarec_program(ps1emu::CpuCore::Mode mode, ps1emu::CpuState &out, uint32_t &out_mem) {
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  cpu.set_mode(mode);
+  cpu.set_dynarec_hot_threshold(1);
+  write_dynarec_program(mem);
+
+  auto &st = cpu.state();
+  st.pc = 0x00000000;
+  st.next_pc = st.pc + 4;
+  uint32_t cycles = 0;
+  for (int guard = 0; guard < 1000 && st.pc != 0x30; ++guard) {
+    cycles += cpu.step();
+  }
+  CHECK(st.pc == 0x30);
+  CHECK(cycles == sched.now());
+  out = st;
+  out_mem = mem.read32(0x00001000) + mem.read32(0x00001024);
+  return true;
+}
+
+static bool test_dynarec_matches_interpreter() {
+  ps1emu::CpuState interp;
+  ps1emu::CpuState jit;
+  uint32_t interp_mem = 0;
+  uint32_t jit_mem = 0;
+  CHECK(run_dynarec_program(ps1emu::CpuCore::Mode::Interpreter, interp, interp_mem));
+  CHECK(run_dynarec_program(ps1emu::CpuCore::Mode::Dynarec, jit, jit_mem));
+
+  CHECK(interp.gpr[3] == 54);
+  for (int i = 0; i < 32; ++i) {
+    CHECK(interp.gpr[i] == jit.gpr[i]);
+  }
+  CHECK(interp.hi == jit.hi);
+  CHECK(interp.lo == jit.lo);
+  CHECK(interp.next_pc == jit.next_pc);
+  CHECK(interp_mem == jit_mem);
+  return true;
+}
+
+static bool run_until_syscall(ps1emu::CpuCore::Mode mode, ps1emu::CpuState &out, uint32_t &out_cycles) {
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  cpu.set_mode(mode);
+  cpu.set_dynarec_hot_threshold(1);
+  write_dynarec_program(mem);
+  mem.write32(0x00000030, 0x0000000C); // syscall
+
+  auto &st = cpu.state();
+  st.pc = 0x00000000;
+  st.next_pc = st.pc + 4;
+  ps1emu::CpuExceptionInfo info;
+  bool trapped = false;
+  for (int guard = 0; guard < 1000 && !trapped; ++guard) {
+    cpu.step();
+    trapped = cpu.consume_exception(info);
+  }
+  CHECK(trapped);
+  CHECK(info.code == 8);
+  CHECK(info.pc == 0x30);
+  out = st;
+  out_cycles = static_cast<uint32_t>(sched.now());
+  return true;
+}
+
+static bool test_threaded_matches_interpreter() {
+  ps1emu::CpuState interp;
+  ps1emu::CpuState threaded;
+  uint32_t interp_cycles = 0;
+  uint32_t threaded_cycles = 0;
+  CHECK(run_until_syscall(ps1emu::CpuCore::Mode::Interpreter, interp, interp_cycles));
+  CHECK(run_until_syscall(ps1emu::CpuCore::Mode::Threaded, threaded, threaded_cycles));
+
+  CHECK(interp.gpr[3] == 54);
+  for (int i = 0; i < 32; ++i) {
+    CHECK(interp.gpr[i] == threaded.gpr[i]);
+  }
+  CHECK(interp.hi == threaded.hi);
+  CHECK(interp.lo == threaded.lo);
+  CHECK(interp.pc == threaded.pc);
+  CHECK(interp.cop0.epc == threaded.cop0.epc);
+  CHECK(interp_cycles == threaded_cycles);
+  return true;
+}
+
+static bool test_dynarec_compiles_blocks() {
+  if (!ps1emu::CpuCore::dynarec_available()) {
+    return true;
+  }
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  cpu.set_mode(ps1emu::CpuCore::Mode::Dynarec);
+  cpu.set_dynarec_hot_threshold(1);
+  write_dynarec_program(mem);
+
+  auto &st = cpu.state();
+  st.pc = 0x00000000;
+  st.next_pc = st.pc + 4;
+  uint32_t cycles = cpu.step();
+
+  // The first block runs through the loop branch and its delay slot in one call.
+  CHECK(cycles == 10);
+  CHECK(st.pc == 0x10);
+  CHECK(st.gpr[2] == 0x1004);
+  auto blocks = cpu.dynarec_blocks();
+  CHECK(blocks.size() == 1);
+  CHECK(blocks[0].entry != nullptr);
+  CHECK(blocks[0].size == 40);
+  return true;
+}
+
+static bool test_dynarec_sees_code_writes() {
+  if (!ps1emu::CpuCore::dynarec_available()) {
+    return true;
+  }
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  cpu.set_mode(ps1emu::CpuCore::Mode::Dynarec);
+  cpu.set_dynarec_hot_threshold(1);
+  mem.write32(0x00001000, encode_i(0x09, 0, 3, 1)); // addiu r3, r0, 1
+  mem.write32(0x00001004, encode_i(0x09, 4, 4, 1)); // addiu r4, r4, 1
+  mem.write32(0x00001008, 0x0000000C);              // syscall ends the block
+
+  auto &st = cpu.state();
+  auto run_block = [&]() {
+    st.pc = 0x00001000;
+    st.next_pc = st.pc + 4;
+    cpu.step();
+  };
+
+  run_block();
+  CHECK(st.gpr[3] == 1);
+  CHECK(cpu.dynarec_blocks().size() == 1);
+
+  // Data writes elsewhere on the page leave the block alone.
+  mem.write32(0x00001800, 0x12345678);
+  CHECK(cpu.dynarec_blocks().size() == 1);
+
+  // A store through another mirror drops the block.
+  mem.write32(0x80001000, encode_i(0x09, 0, 3, 2));
+  CHECK(cpu.dynarec_blocks().empty());
+  run_block();
+  CHECK(st.gpr[3] == 2);
+
+  // So does DMA into the page.
+  uint32_t patched = encode_i(0x09, 0, 3, 3);
+  mem.dma_write_words(0x00001000, &patched, 1);
+  CHECK(cpu.dynarec_blocks().empty());
+  run_block();
+  CHECK(st.gpr[3] == 3);
+  return true;
+}
+
+static bool test_dynarec_links_blocks() {
+  if (!ps1emu::CpuCore::dynarec_available()) {
+    return true;
+  }
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  cpu.set_mode(ps1emu::CpuCore::Mode::Dynarec);
+  cpu.set_dynarec_hot_threshold(1);
+  mem.write32(0x00002000, encode_i(0x09, 4, 4, 1));     // addiu r4, r4, 1
+  mem.write32(0x00002004, encode_j(0x02, 0x00002100));  // j 0x2100
+  mem.write32(0x00002008, 0x00000000);                  // nop
+  mem.write32(0x00002100, encode_i(0x09, 5, 5, 1));     // addiu r5, r5, 1
+  mem.write32(0x00002104, encode_i(0x05, 4, 6, -0x42)); // bne r4, r6, 0x2000
+  mem.write32(0x00002108, 0x00000000);                  // nop
+  mem.write32(0x0000210C, 0x0000000C);                  // syscall
+
+  auto &st = cpu.state();
+  auto run_loop = [&](uint32_t &steps) {
+    st.gpr[4] = 0;
+    st.gpr[5] = 0;
+    st.gpr[6] = 4;
+    st.pc = 0x00002000;
+    st.next_pc = st.pc + 4;
+    steps = 0;
+    while (st.pc != 0x0000210C && steps < 64) {
+      cpu.step();
+      ++steps;
+    }
+  };
+
+  uint32_t steps = 0;
+  run_loop(steps);
+  CHECK(st.pc == 0x0000210C);
+  CHECK(st.gpr[4] == 4);
+  CHECK(st.gpr[5] == 4);
+  // Once both blocks exist the remaining iterations chain without returning.
+  CHECK(steps == 2);
+  run_loop(steps);
+  CHECK(steps == 1);
+  CHECK(st.gpr[5] == 4);
+
+  // Dropping the jump target unlinks the exits that pointed at it.
+  mem.write32(0x00002000, encode_i(0x09, 4, 4, 2)); // addiu r4, r4, 2
+  run_loop(steps);
+  CHECK(st.pc == 0x0000210C);
+  CHECK(st.gpr[4] == 4);
+  CHECK(st.gpr[5] == 2);
+  return true;
+}
+
+static bool test_dynarec_promotes_hot_blocks() {
+  if (!ps1emu::CpuCore::dynarec_available()) {
+    return true;
+  }
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  cpu.set_mode(ps1emu::CpuCore::Mode::Dynarec);
+  cpu.set_dynarec_hot_threshold(3);
+  mem.write32(0x00003000, encode_i(0x09, 4, 4, 1));  // addiu r4, r4, 1
+  mem.write32(0x00003004, encode_i(0x05, 4, 6, -2)); // bne r4, r6, 0x80003000
+  mem.write32(0x00003008, 0x00000000);               // nop
+  mem.write32(0x0000300C, 0x0000000C);               // syscall
+
+  auto &st = cpu.state();
+  st.gpr[6] = 10;
+  st.pc = 0x80003000;
+  st.next_pc = st.pc + 4;
+
+  // The first two passes are cold and run one instruction per step.
+  for (int i = 0; i < 6; ++i) {
+    cpu.step();
+  }
+  CHECK(st.pc == 0x80003000);
+  CHECK(st.gpr[4] == 2);
+  CHECK(cpu.dynarec_blocks().empty());
+  auto cold = cpu.dynarec_cold_blocks();
+  CHECK(cold.size() == 1);
+  CHECK(cold[0].pc == 0x80003000);
+  CHECK(cold[0].tier == ps1emu::JitTier::Cold);
+  CHECK(cold[0].executions == 2);
+
+  // The third entry compiles the loop, which then chains into itself.
+  cpu.step();
+  CHECK(st.pc == 0x8000300C);
+  CHECK(st.gpr[4] == 10);
+  auto blocks = cpu.dynarec_blocks();
+  CHECK(blocks.size() == 1);
+  CHECK(blocks[0].tier == ps1emu::JitTier::Compiled);
+  CHECK(blocks[0].executions == 3);
+  CHECK(cpu.dynarec_cold_blocks().empty());
+  CHECK(cpu.dynarec_stats().promotions == 1);
+  return true;
+}
+
+static bool test_dynarec_chain_stops_at_step_budget() {
+  if (!ps1emu::CpuCore::dynarec_available()) {
+    return true;
+  }
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  cpu.set_mode(ps1emu::CpuCore::Mode::Dynarec);
+  cpu.set_dynarec_hot_threshold(1);
+  mem.write32(0x00003000, encode_i(0x09, 4, 4, 1));  // addiu r4, r4, 1
+  mem.write32(0x00003004, encode_i(0x05, 4, 6, -2)); // bne r4, r6, 0x80003000
+  mem.write32(0x00003008, 0x00000000);               // nop
+  mem.write32(0x0000300C, 0x0000000C);               // syscall
+
+  auto &st = cpu.state();
+  st.gpr[6] = 1000;
+  st.pc = 0x80003000;
+  st.next_pc = st.pc + 4;
+
+  // An event 8 cycles away ends the chain after the block that reaches it.
+  cpu.set_step_budget(8);
+  uint32_t cycles = cpu.step();
+  CHECK(cycles >= 8);
+  CHECK(cycles < 16);
+  CHECK(st.pc == 0x80003000);
+  CHECK(st.gpr[4] < 8);
+
+  cpu.set_step_budget(UINT32_MAX);
+  cycles = cpu.step();
+  CHECK(cycles >= 256);
+  CHECK(st.gpr[4] > 8);
+  return true;
+}
+
+static bool test_threaded_run_stops_at_step_budget() {
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  cpu.set_mode(ps1emu::CpuCore::Mode::Threaded);
+  mem.write32(0x00003000, encode_i(0x09, 4, 4, 1));  // addiu r4, r4, 1
+  mem.write32(0x00003004, encode_i(0x05, 4, 6, -2)); // bne r4, r6, 0x80003000
+  mem.write32(0x00003008, 0x00000000);               // nop
+  mem.write32(0x0000300C, 0x0000000C);               // syscall
+
+  auto &st = cpu.state();
+  st.gpr[6] = 1000;
+  st.pc = 0x80003000;
+  st.next_pc = st.pc + 4;
+
+  // An event 8 cycles away ends the run there instead of after 64 cycles.
+  cpu.set_step_budget(8);
+  uint32_t cycles = cpu.step();
+  CHECK(cycles >= 8);
+  CHECK(cycles < 12);
+  CHECK(st.gpr[4] < 8);
+
+  // A budget of zero still retires one instruction.
+  cpu.set_step_budget(0);
+  CHECK(cpu.step() >= 1);
+
+  cpu.set_step_budget(UINT32_MAX);
+  uint32_t before = st.gpr[4];
+  cycles = cpu.step();
+  CHECK(cycles >= 64);
+  CHECK(st.gpr[4] > before + 8);
+  return true;
+}
+
+static bool test_dynarec_profile_round_trip() {
+  ScopedTempFile profile("/tmp/ps1emu_test.jitprof");
+  ps1emu::MemoryMap mem;
+  mem.reset();
+  mem.write32(0x00004000, encode_i(0x09, 4, 4, 1)); // addiu r4, r4, 1
+  mem.write32(0x00004004, encode_j(0x02, 0x4000));  // j 0x4000
+  mem.write32(0x00004008, 0x00000000);              // nop
+  ps1emu::NullDynarecBackend backend;
+  std::string error;
+
+  ps1emu::DynarecCache first;
+  CHECK(first.load_profile(profile.path, error)); // no file yet
+  CHECK(first.compile(0x80004000, backend, mem) != nullptr);
+  CHECK(first.save_profile(profile.path, error));
+
+  // A warm session promotes the profiled head on its first entry only.
+  ps1emu::DynarecCache warm;
+  CHECK(warm.load_profile(profile.path, error));
+  CHECK(!warm.promote(0x80004010, mem));
+  CHECK(warm.promote(0x80004000, mem));
+  CHECK(warm.stats().warm_hits == 1);
+
+  // Different code at the same address has to warm up normally.
+  mem.write32(0x00004000, encode_i(0x09, 4, 4, 2));
+  ps1emu::DynarecCache stale;
+  CHECK(stale.load_profile(profile.path, error));
+  CHECK(!stale.promote(0x80004000, mem));
+  CHECK(stale.stats().warm_hits == 0);
+
+  // A torn file fails to load but keeps its whole records, and the next save
+  // replaces it through a temporary that does not outlive the rename.
+  mem.write32(0x00004000, encode_i(0x09, 4, 4, 1));
+  CHECK(first.compile(0x80004100, backend, mem) != nullptr);
+  CHECK(first.save_profile(profile.path, error));
+  std::filesystem::resize_file(profile.path, std::filesystem::file_size(profile.path) - 4);
+  ps1emu::DynarecCache torn;
+  CHECK(!torn.load_profile(profile.path, error));
+  CHECK(torn.save_profile(profile.path, error));
+  CHECK(!std::filesystem::exists(profile.path + ".tmp." + std::to_string(getpid())));
+  ps1emu::DynarecCache repaired;
+  CHECK(repaired.load_profile(profile.path, error));
+  bool kept_first = repaired.promote(0x80004000, mem);
+  bool kept_second = repaired.promote(0x80004100, mem);
+  CHECK(kept_first != kept_second);
+  return true;
+}
+
+static bool test_dynarec_ir_optimizes_block() {
+  ps1emu::MemoryMap mem;
+  mem.reset();
+  const uint32_t program[] = {
+      encode_i(0x0F, 0, 1, 0x1234),   // lui r1, 0x1234
+      encode_i(0x0D, 1, 1, 0x5678),   // ori r1, r1, 0x5678
+      encode_i(0x09, 0, 2, 5),        // addiu r2, r0, 5
+      encode_i(0x09, 0, 2, 7),        // addiu r2, r0, 7
+      encode_i(0x23, 4, 3, 0),        // lw r3, 0(r4)
+      encode_i(0x23, 1, 5, 0),        // lw r5, 0(r1)
+      encode_r(5, 3, 6, 0, 0x21),     // addu r6, r5, r3
+      encode_r(31, 0, 0, 0, 0x08),    // jr r31
+      0x00000000,                     // nop
+  };
+  for (uint32_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+    mem.write32(0x00003000 + i * 4, program[i]);
+  }
+
+  ps1emu::IrBlock block;
+  CHECK(ps1emu::build_ir_block(0x00003000, mem, ps1emu::kDynarecDefaultBlockLimit, block));
+  ps1emu::optimize_ir_block(block);
+  CHECK(block.insts.size() == 9);
+  CHECK(block.ends_with_branch);
+  const auto &insts = block.insts;
+  const auto &values = block.values;
+
+  // LUI/ORI folds to one constant and the LUI write is dead.
+  CHECK(values[insts[1].result].constant);
+  CHECK(values[insts[1].result].imm == 0x12345678);
+  CHECK(!values[insts[0].result].live);
+  // The first r2 write is overwritten before anything can see it.
+  CHECK(!values[insts[2].result].live);
+  CHECK(values[insts[3].result].live);
+
+  // An unknown base keeps the alignment check; a known aligned one drops it.
+  CHECK(insts[4].may_except);
+  CHECK(!insts[5].may_except);
+  // r3 is not touched by the next instruction, r5 is read by it.
+  CHECK(insts[4].commit == ps1emu::IrCommit::Immediate);
+  CHECK(insts[5].commit == ps1emu::IrCommit::AfterNext);
+
+  ps1emu::IrRegisterAllocation allocation = ps1emu::allocate_host_registers(block, 4);
+  CHECK(allocation[5] >= 0);
+  CHECK(allocation[6] == -1);
+  allocation = ps1emu::allocate_host_registers(block, 0);
+  CHECK(allocation[5] == -1);
+  return true;
+}
+
+static bool test_dynarec_cache_clock_eviction() {
+  ps1emu::MemoryMap mem;
+  mem.reset();
+  for (uint32_t addr = 0; addr < 0x100; addr += 0x10) {
+    mem.write32(addr, encode_j(0x02, addr)); // j self ends each block
+  }
+  ps1emu::NullDynarecBackend backend;
+  ps1emu::DynarecCache cache(2);
+
+  CHECK(cache.lookup(0x80000000) == nullptr);
+  CHECK(cache.compile(0x80000000, backend, mem) != nullptr);
+  CHECK(cache.compile(0x80000010, backend, mem) != nullptr);
+  CHECK(cache.lookup(0x80000000) != nullptr);
+  // Another mirror of a cached address misses on the tag.
+  CHECK(cache.lookup(0x00000000) == nullptr);
+
+  // Both blocks are referenced, so the hand clears them and takes the first.
+  CHECK(cache.compile(0x80000020, backend, mem) != nullptr);
+  CHECK(cache.lookup(0x80000000) == nullptr);
+  CHECK(cache.lookup(0x80000010) != nullptr);
+  // The hand sweeps both second chances again and lands on 0x80000010.
+  CHECK(cache.compile(0x80000030, backend, mem) != nullptr);
+  CHECK(cache.snapshot().size() == 2);
+  CHECK(cache.snapshot()[0].pc == 0x80000020 || cache.snapshot()[1].pc == 0x80000020);
+
+  const ps1emu::DynarecCache::Stats &stats = cache.stats();
+  CHECK(stats.hits == 2);
+  CHECK(stats.misses == 3);
+  CHECK(stats.evictions == 2);
+
+  cache.invalidate_range(0x00000030, 4);
+  CHECK(cache.lookup(0x80000030) == nullptr);
+  CHECK(stats.invalidations == 1);
+  return true;
+}
+
+static bool test_dynarec_exception_in_block() {
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  cpu.set_mode(ps1emu::CpuCore::Mode::Dynarec);
+  cpu.set_dynarec_hot_threshold(1);
+
+  mem.write32(0x00000000, encode_i(0x09, 0, 1, 0x1001)); // addiu r1, r0, 0x1001
+  mem.write32(0x00000004, encode_i(0x23, 0, 2, 0x2000)); // lw r2, 0x2000(r0)
+  mem.write32(0x00000008, encode_i(0x23, 1, 3, 0));      // lw r3, 0(r1) (misaligned)
+  mem.write32(0x0000000C, encode_i(0x09, 0, 4, 1));      // addiu r4, r0, 1
+  mem.write32(0x00002000, 0xCAFEBABE);
+
+  auto &st = cpu.state();
+  st.pc = 0x00000000;
+  st.next_pc = st.pc + 4;
+  uint32_t cycles = cpu.step();
+
+  ps1emu::CpuExceptionInfo info;
+  CHECK(cycles == 3);
+  CHECK(cpu.consume_exception(info));
+  CHECK(info.code == 4);
+  CHECK(info.pc == 0x00000008);
+  CHECK(info.badvaddr == 0x00001001);
+  CHECK(st.cop0.epc == 0x00000008);
+  CHECK(st.pc == 0xBFC00080);
+  CHECK(st.gpr[1] == 0x1001);
+  CHECK(st.gpr[2] == 0xCAFEBABE);
+  CHECK(st.gpr[4] == 0);
+  return true;
+}
+
+static bool test_dynarec_delay_slot_load_crosses_block() {
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  cpu.set_mode(ps1emu::CpuCore::Mode::Dynarec);
+  cpu.set_dynarec_hot_threshold(1);
+
+  mem.write32(0x00000000, encode_j(0x02, 0x100));        // j 0x100
+  mem.write32(0x00000004, encode_i(0x23, 0, 1, 0x2000)); // lw r1, 0x2000(r0) (delay slot)
+  mem.write32(0x00000100, encode_r(1, 0, 2, 0, 0x21));   // addu r2, r1, r0 (old r1)
+  mem.write32(0x00000104, encode_r(1, 0, 3, 0, 0x21));   // addu r3, r1, r0 (new r1)
+  mem.write32(0x00002000, 0x00ABCDEF);
+
+  auto &st = cpu.state();
+  st.gpr[1] = 7;
+  st.pc = 0x00000000;
+  st.next_pc = st.pc + 4;
+  cpu.step();
+  CHECK(st.pc == 0x100);
+  cpu.step();
+  cpu.step();
+
+  CHECK(st.gpr[2] == 7);
+  CHECK(st.gpr[3] == 0x00ABCDEF);
+  return true;
+}
+
 static bool test_dma_irq() {
   ps1emu::MmioBus mmio;
   mmio.reset();
@@ -1020,6 +1885,29 @@ static bool test_timer2_clock_div128() {
   return true;
 }
 
+static bool test_timer_follows_attached_clock() {
+  ps1emu::Scheduler clock;
+  ps1emu::MmioBus mmio;
+  mmio.reset();
+  mmio.attach_clock(clock);
+
+  mmio.write16(0x1F801108, 1000); // timer0 target
+  mmio.write16(0x1F801104, (1u << 4)); // irq on target
+  CHECK(mmio.next_event_time() == 1000);
+
+  // The counter is derived from the clock when read; nothing ticks it.
+  clock.advance(300);
+  CHECK(mmio.read16(0x1F801100) == 300);
+  CHECK((mmio.irq_stat() & (1u << 4)) == 0);
+
+  clock.advance(700);
+  CHECK(clock.now() >= mmio.next_event_time());
+  mmio.catch_up();
+  CHECK((mmio.irq_stat() & (1u << 4)) != 0);
+  CHECK(mmio.read16(0x1F801100) == 1000);
+  return true;
+}
+
 static bool test_joypad_stub_ready() {
   ps1emu::MmioBus mmio;
   mmio.reset();
@@ -1130,6 +2018,94 @@ static bool test_spu_status_tracks_ctrl() {
   return true;
 }
 
+static bool test_mmio_attention_flag() {
+  ps1emu::MmioBus mmio;
+  mmio.reset();
+  CHECK(!mmio.needs_attention());
+
+  mmio.tick(100000);
+  mmio.read32(0x1F801814); // GPUSTAT
+  mmio.write16(0x1F801DAA, 0x0030);
+  CHECK(!mmio.needs_attention());
+
+  mmio.write32(0x1F801810, 0xE1000000); // GP0
+  CHECK(mmio.needs_attention());
+  mmio.clear_attention();
+
+  mmio.write16(0x1F801D80, 0x3FFF); // SPU main volume left
+  CHECK(mmio.needs_attention());
+  mmio.clear_attention();
+
+  mmio.write32(0x1F8010A8, 1u << 24); // DMA2 CHCR start
+  CHECK(mmio.needs_attention());
+  mmio.clear_attention();
+  CHECK(!mmio.needs_attention());
+  return true;
+}
+
+static bool test_mmio_register_dispatch() {
+  ps1emu::MmioBus mmio;
+  mmio.reset();
+
+  // Byte halves of a 16-bit register land in the same slot.
+  mmio.write8(0x1F801074, 0x0D);
+  mmio.write8(0x1F801075, 0x04);
+  CHECK(mmio.read16(0x1F801074) == 0x040D);
+  CHECK(mmio.read8(0x1F801075) == 0x04);
+  CHECK(mmio.irq_mask() == 0x040D);
+
+  // Slots next to a register stay plain memory.
+  mmio.write16(0x1F801076, 0xBEEF);
+  CHECK(mmio.read16(0x1F801076) == 0xBEEF);
+  CHECK(mmio.irq_mask() == 0x040D);
+  mmio.write32(0x1F801000, 0x1F000000); // Expansion 1 base
+  CHECK(mmio.read32(0x1F801000) == 0x1F000000);
+
+  // 32-bit registers keep their per-unit decode.
+  mmio.write32(0x1F8010C0, 0x00123450); // DMA4 MADR
+  CHECK(mmio.dma_madr(4) == 0x00123450);
+  CHECK(mmio.read32(0x1F8010C0) == 0x00123450);
+  mmio.write16(0x1F801128, 0x1234); // T2 target
+  CHECK(mmio.read32(0x1F801128) == 0x1234);
+  CHECK(mmio.read16(0x1F801118) == 0x0000);
+
+  // SPU voice registers answer 32-bit reads from the register file.
+  mmio.write16(0x1F801C10, 0x2222);
+  CHECK(mmio.read32(0x1F801C10) == 0x2222);
+  return true;
+}
+
+static bool test_mmio_reset_clears_devices() {
+  ps1emu::MmioBus fresh;
+  fresh.reset();
+  ps1emu::MmioBus mmio;
+  mmio.reset();
+  bool line = false;
+  mmio.set_irq_line_hook([](void *ctx, bool asserted) { *static_cast<bool *>(ctx) = asserted; },
+                         &line);
+
+  mmio.write16(0x1F801074, 0x0001); // I_MASK
+  mmio.write16(0x1F801104, 0x0008); // T0 mode
+  mmio.write16(0x1F801108, 0x0100); // T0 target
+  mmio.write32(0x1F8010A0, 0x1000); // DMA2 MADR
+  mmio.write32(0x1F801814, 0x08000001); // GP1 display mode
+  mmio.write16(0x1F80104A, 0x0003); // JOY_CTRL
+  mmio.write16(0x1F801DAA, 0x8000); // SPUCNT
+  mmio.write8(0x1F801800, 0x01); // CD index
+  mmio.tick(600000);
+  CHECK(line);
+
+  mmio.reset();
+  CHECK(!line);
+  const uint32_t regs32[] = {0x1F801070, 0x1F801074, 0x1F801104, 0x1F801108, 0x1F8010A0,
+                             0x1F801814, 0x1F80104A, 0x1F801DAA, 0x1F801DAE};
+  for (uint32_t addr : regs32) {
+    CHECK(mmio.read32(addr) == fresh.read32(addr));
+  }
+  CHECK(mmio.read8(0x1F801800) == fresh.read8(0x1F801800));
+  return true;
+}
+
 static bool test_gpu_packet_parsing() {
   std::vector<uint32_t> words = {0x02000000, 0x00000000, 0x00000000};
   std::vector<uint32_t> remainder;
@@ -1184,6 +2160,107 @@ static bool test_memory_map_mmio() {
   return true;
 }
 
+static bool test_memory_map_page_table() {
+  ps1emu::MemoryMap mem;
+  ps1emu::BiosImage bios;
+  mem.reset();
+  bios.load_hle_stub();
+  mem.load_bios(bios);
+
+  // RAM is mirrored through KUSEG/KSEG0/KSEG1 and every 2 MiB.
+  mem.write32(0x80001000, 0xA1B2C3D4);
+  CHECK(mem.read32(0x00001000) == 0xA1B2C3D4u);
+  CHECK(mem.read32(0xA0201000) == 0xA1B2C3D4u);
+  CHECK(mem.read16(0x00001002) == 0xA1B2u);
+  CHECK(mem.read8(0x00001001) == 0xC3u);
+  mem.write16(0x00001002, 0x5566);
+  CHECK(mem.read32(0x00001000) == 0x5566C3D4u);
+
+  // Unaligned accesses still compose bytes, including across a page edge.
+  mem.write32(0x00001FFE, 0x11223344);
+  CHECK(mem.read32(0x00001FFE) == 0x11223344u);
+  CHECK(mem.read16(0x00001FFF) == 0x2233u);
+
+  // Scratchpad is 1 KiB; the rest of its page reads as open bus.
+  mem.write32(0x1F8003FC, 0xCAFEF00D);
+  CHECK(mem.read32(0x1F8003FC) == 0xCAFEF00Du);
+  mem.write32(0x1F800400, 0x12345678);
+  CHECK(mem.read32(0x1F800400) == 0xFFFFFFFFu);
+
+  // BIOS is read-only and visible through KSEG1.
+  CHECK(mem.read8(0xBFC00000) == 'P');
+  mem.write8(0xBFC00000, 0x00);
+  CHECK(mem.read8(0x1FC00000) == 'P');
+  return true;
+}
+
+static bool test_fastmem_dynarec_slow_paths() {
+  ps1emu::MemoryMap mem;
+  ps1emu::MmioBus mmio;
+  ps1emu::Scheduler sched;
+  mem.reset();
+  mmio.reset();
+  sched.reset();
+  mem.attach_mmio(mmio);
+  std::string error;
+  if (!ps1emu::CpuCore::dynarec_available() || !mem.enable_fastmem(error)) {
+    return true;
+  }
+  CHECK(mem.fastmem_base() != nullptr);
+  mem.write32(0x1F800020, 0x5CA7C4D0u);
+  uint32_t aliased = 0;
+  std::memcpy(&aliased, mem.fastmem_base() + 0x9F800020u, sizeof(aliased));
+  CHECK(aliased == 0x5CA7C4D0u);
+
+  ps1emu::CpuCore cpu(mem, sched);
+  cpu.reset();
+  cpu.set_mode(ps1emu::CpuCore::Mode::Dynarec);
+  cpu.set_dynarec_hot_threshold(1);
+  const uint32_t program[] = {
+      0x3C041F80, // lui r4, 0x1F80
+      0x34051234, // ori r5, r0, 0x1234
+      0xAC850010, // sw r5, 0x10(r4)     scratchpad: mapped directly
+      0x8C860010, // lw r6, 0x10(r4)
+      0x3C078000, // lui r7, 0x8000
+      0xA4E51000, // sh r5, 0x1000(r7)   RAM through KSEG0
+      0x90E81001, // lbu r8, 0x1001(r7)
+      0x84E91000, // lh r9, 0x1000(r7)
+      0x8C8B1074, // lw r11, 0x1074(r4)  I_MASK
+      0xAC050034, // sw r5, 0x34(r0)     code page: write-protected
+      0x00000000, // nop
+      0x00000000, // nop
+      0x00000000, // nop
+      0x0000000C, // syscall
+  };
+  for (size_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+    mem.write32(static_cast<uint32_t>(i * 4), program[i]);
+  }
+
+  auto &st = cpu.state();
+  // Run twice so the second pass goes through the backpatched sites.
+  for (int pass = 0; pass < 2; ++pass) {
+    st.pc = 0x00000000;
+    st.next_pc = st.pc + 4;
+    ps1emu::CpuExceptionInfo info;
+    bool trapped = false;
+    for (int guard = 0; guard < 100 && !trapped; ++guard) {
+      cpu.step();
+      trapped = cpu.consume_exception(info);
+    }
+    CHECK(trapped);
+    CHECK(info.pc == 0x34);
+    CHECK(st.gpr[6] == 0x1234u);
+    CHECK(st.gpr[8] == 0x12u);
+    CHECK(st.gpr[9] == 0x1234u);
+    CHECK(st.gpr[11] == mmio.irq_mask());
+    CHECK(mem.read32(0x1F800010) == 0x1234u);
+    CHECK(mem.read16(0x00001000) == 0x1234u);
+    CHECK(mem.read32(0x00000034) == 0x1234u);
+    mem.write32(0x00000034, 0x0000000C);
+  }
+  return true;
+}
+
 static bool test_cdrom_iso_read_mmio() {
   ScopedTempFile iso("/tmp/ps1emu_test.iso");
 
@@ -1880,6 +2957,96 @@ static bool test_stub_plugins_handshake() {
   return true;
 }
 
+static bool test_shm_ring_transport() {
+  auto host_ring = std::make_unique<ps1emu::ShmRing>();
+  std::string error;
+  CHECK(host_ring->create(4096, error));
+  auto plugin_ring = std::make_unique<ps1emu::ShmRing>();
+  CHECK(plugin_ring->attach(dup(host_ring->fd()), error));
+  host_ring->close_fd();
+
+  int to_plugin[2];
+  int to_host[2];
+  CHECK(pipe(to_plugin) == 0);
+  CHECK(pipe(to_host) == 0);
+  ps1emu::IpcChannel host(to_host[0], to_plugin[1]);
+  ps1emu::IpcChannel plugin(to_plugin[0], to_host[1]);
+  host.use_ring(std::move(host_ring));
+  plugin.use_ring(std::move(plugin_ring));
+
+  // Frames close to the ring size, so every round wraps the indices.
+  for (uint32_t round = 0; round < 5; ++round) {
+    std::vector<uint8_t> payload(3000);
+    for (size_t i = 0; i < payload.size(); ++i) {
+      payload[i] = static_cast<uint8_t>(i * 7 + round);
+    }
+    CHECK(host.send_frame(0x0001, payload));
+    uint16_t type = 0;
+    std::vector<uint8_t> received;
+    CHECK(plugin.recv_frame(type, received));
+    CHECK(type == 0x0001);
+    CHECK(received == payload);
+    CHECK(plugin.send_frame(0x0002, {static_cast<uint8_t>(round)}));
+    CHECK(host.recv_frame(type, received));
+    CHECK(type == 0x0002 && received.size() == 1 && received[0] == round);
+  }
+
+  // A reply larger than the ring streams through while the host reads it.
+  ps1emu::SandboxOptions sandbox;
+  sandbox.enabled = false;
+  ps1emu::PluginHost plugins;
+  plugins.set_shm_ring(true);
+  CHECK(plugins.launch_plugin(ps1emu::PluginType::Gpu, "./build/ps1emu_gpu_stub", sandbox));
+  CHECK(plugins.handshake(ps1emu::PluginType::Gpu));
+  CHECK(plugins.uses_shm_ring(ps1emu::PluginType::Gpu));
+  CHECK(plugins.enter_frame_mode(ps1emu::PluginType::Gpu));
+  std::vector<uint8_t> request = {0, 0, 0, 0, 0x00, 0x04, 0x00, 0x02}; // 1024x512
+  CHECK(plugins.send_frame(ps1emu::PluginType::Gpu, 0x0004, request));
+  uint16_t type = 0;
+  std::vector<uint8_t> vram;
+  CHECK(plugins.recv_frame(ps1emu::PluginType::Gpu, type, vram));
+  CHECK(type == 0x0005);
+  CHECK(vram.size() == 1024u * 512u * 2u);
+  plugins.shutdown_all();
+  return true;
+}
+
+static bool test_shm_ring_rejects_corrupt_indices() {
+  // Offsets of head/tail in ShmRingShared: an 8-byte header, then two
+  // 64-byte-aligned ShmRingState blocks of 192 bytes each.
+  const size_t kHostToPluginHead = 64;
+  const size_t kPluginToHostTail = 64 + 192 + 64;
+  const size_t kMapSize = 64 + 192 * 2 + 4096 * 2;
+  std::string error;
+  std::vector<uint8_t> buffer(8192, 0x5A);
+
+  // The peer moves head past tail: the used count wraps far beyond the ring.
+  ps1emu::ShmRing writer;
+  CHECK(writer.create(4096, error));
+  auto *peer = static_cast<uint8_t *>(mmap(nullptr, kMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, writer.fd(), 0));
+  CHECK(peer != MAP_FAILED);
+  uint64_t bad_head = 8192;
+  std::memcpy(peer + kHostToPluginHead, &bad_head, sizeof(bad_head));
+  CHECK(!writer.write(buffer.data(), buffer.size()));
+  munmap(peer, kMapSize);
+
+  // The peer pushes tail several rings ahead of head.
+  ps1emu::ShmRing reader;
+  CHECK(reader.create(4096, error));
+  peer = static_cast<uint8_t *>(mmap(nullptr, kMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, reader.fd(), 0));
+  CHECK(peer != MAP_FAILED);
+  uint64_t bad_tail = 4096 * 4;
+  std::memcpy(peer + kPluginToHostTail, &bad_tail, sizeof(bad_tail));
+  CHECK(!reader.read(buffer.data(), buffer.size()));
+
+  // Exactly one full ring is still legal.
+  bad_tail = 4096;
+  std::memcpy(peer + kPluginToHostTail, &bad_tail, sizeof(bad_tail));
+  CHECK(reader.read(buffer.data(), 4096));
+  munmap(peer, kMapSize);
+  return true;
+}
+
 static bool test_gpu_pipeline_dma_integration() {
   ScopedConfigFile config("ps1emu_tests.conf");
   CHECK(write_test_config(config.path));
@@ -1914,6 +3081,207 @@ static bool test_gpu_pipeline_dma_integration() {
   return true;
 }
 
+static bool test_gpu_batched_submission() {
+  ScopedConfigFile config("ps1emu_tests_gpu_batch.conf");
+  CHECK(write_test_config(config.path));
+  {
+    std::ofstream file(config.path, std::ios::app);
+    file << "gpu.async_submit=true\n";
+  }
+
+  ScopedCore scoped;
+  CHECK(scoped.core.initialize(config.path));
+  scoped.active = true;
+  CHECK(ps1emu::EmulatorCoreTestAccess::gpu_batching(scoped.core));
+
+  auto &mmio = ps1emu::EmulatorCoreTestAccess::mmio(scoped.core);
+  // Two fills queue up without a round trip to the plugin.
+  for (uint32_t color : {0x000000FFu, 0x0000FF00u}) {
+    mmio.write32(0x1F801810, 0x02000000u | color);
+    mmio.write32(0x1F801810, 0x01000200); // 512,256: outside the display area
+    mmio.write32(0x1F801810, 0x00010010); // 16x1
+  }
+  ps1emu::EmulatorCoreTestAccess::flush_gpu(scoped.core);
+  CHECK(ps1emu::EmulatorCoreTestAccess::gpu_batch_bytes(scoped.core) == 2 * 4 * 4);
+
+  // A VRAM read is a sync point: the batch goes out first, so the read sees the last fill.
+  mmio.write32(0x1F801810, 0xC0000000u);
+  mmio.write32(0x1F801810, 0x01000200);
+  mmio.write32(0x1F801810, 0x00010002); // 2x1
+  ps1emu::EmulatorCoreTestAccess::flush_gpu(scoped.core);
+  CHECK(ps1emu::EmulatorCoreTestAccess::gpu_batch_bytes(scoped.core) == 0);
+  for (int i = 0; i < 64 && (mmio.read32(0x1F801814) & (1u << 27)) == 0; ++i) {
+    mmio.tick(1);
+  }
+  CHECK(mmio.read32(0x1F801810) == 0x03E003E0u);
+  return true;
+}
+
+static bool test_gpu_shared_vram_readback() {
+  // Same GPUREAD words with and without the shared VRAM mirror, including a
+  // read that runs off the right edge of VRAM.
+  for (bool shared : {true, false}) {
+    ScopedConfigFile config("ps1emu_tests_shared_vram.conf");
+    CHECK(write_test_config(config.path));
+    {
+      std::ofstream file(config.path, std::ios::app);
+      file << "gpu.shared_vram=" << (shared ? "true" : "false") << "\n";
+    }
+
+    ScopedCore scoped;
+    CHECK(scoped.core.initialize(config.path));
+    scoped.active = true;
+    CHECK(ps1emu::EmulatorCoreTestAccess::gpu_shared_vram(scoped.core) == shared);
+
+    auto &mmio = ps1emu::EmulatorCoreTestAccess::mmio(scoped.core);
+    mmio.write32(0x1F801810, 0x020000FFu);
+    mmio.write32(0x1F801810, 0x010003F0); // 1008,256
+    mmio.write32(0x1F801810, 0x00010010); // 16x1
+    mmio.write32(0x1F801810, 0xC0000000u);
+    mmio.write32(0x1F801810, 0x010003FF); // 1023,256
+    mmio.write32(0x1F801810, 0x00010002); // 2x1
+    ps1emu::EmulatorCoreTestAccess::flush_gpu(scoped.core);
+    for (int i = 0; i < 64 && (mmio.read32(0x1F801814) & (1u << 27)) == 0; ++i) {
+      mmio.tick(1);
+    }
+    CHECK(mmio.read32(0x1F801810) == 0x0000001Fu);
+
+    if (shared) {
+      // No GP0/GP1 traffic since the last fence: the next read needs no round trip.
+      CHECK(ps1emu::EmulatorCoreTestAccess::gpu_vram_synced(scoped.core));
+    }
+  }
+  return true;
+}
+
+static bool test_plugin_library_mode() {
+  ps1emu::PluginLibrary wrong_type;
+  std::string error;
+  CHECK(!wrong_type.load("./build/libps1emu_gpu_plugin.so", PS1EMU_PLUGIN_SPU, error));
+  CHECK(!error.empty());
+
+  ScopedConfigFile config("ps1emu_tests_library.conf");
+  CHECK(write_test_config(config.path));
+  {
+    std::ofstream file(config.path, std::ios::app);
+    file << "plugin.gpu=./build/libps1emu_gpu_plugin.so\n";
+    file << "plugin.gpu_mode=library\n";
+    file << "plugin.spu=./build/libps1emu_spu_plugin.so\n";
+    file << "plugin.spu_mode=library\n";
+  }
+
+  ScopedCore scoped;
+  CHECK(scoped.core.initialize(config.path));
+  scoped.active = true;
+
+  auto &mmio = ps1emu::EmulatorCoreTestAccess::mmio(scoped.core);
+  mmio.write16(0x1F801D80, 0x2000); // SPU main volume goes to the library's set_volume
+  mmio.write32(0x1F801810, 0x0200FF00u);
+  mmio.write32(0x1F801810, 0x01000200); // 512,256
+  mmio.write32(0x1F801810, 0x00010010); // 16x1
+  mmio.write32(0x1F801810, 0xC0000000u);
+  mmio.write32(0x1F801810, 0x01000200);
+  mmio.write32(0x1F801810, 0x00010002); // 2x1
+  scoped.core.run_for_cycles(64);
+  for (int i = 0; i < 64 && (mmio.read32(0x1F801814) & (1u << 27)) == 0; ++i) {
+    mmio.tick(1);
+  }
+  CHECK(mmio.read32(0x1F801810) == 0x03E003E0u);
+  return true;
+}
+
+static bool test_gpu_triangle_rasterizer() {
+  ps1emu::PluginLibrary library;
+  std::string error;
+  CHECK(library.load("./build/libps1emu_gpu_plugin.so", PS1EMU_PLUGIN_GPU, error));
+  const ps1emu_gpu_vtable_t *gpu = library.gpu();
+  CHECK(gpu != nullptr);
+
+  const uint32_t packets[] = {
+      // Flat red right triangle with legs of 4 at 512,256.
+      4, 0x200000F8u, 0x01000200u, 0x01000204u, 0x01040200u,
+      // Gouraud triangle at 512,264 whose red rises by 1 per pixel across the top row.
+      6, 0x30000000u, 0x01080200u, 0x00000080u, 0x01080280u, 0x00000000u, 0x01280200u,
+  };
+  gpu->submit_gp0(library.instance(), packets, sizeof(packets) / sizeof(packets[0]));
+
+  uint16_t flat[5 * 5] = {};
+  gpu->read_vram(library.instance(), 512, 256, 5, 5, flat);
+  // Right and bottom edges are left out: 4,3,2,1 pixels on rows 256..259.
+  for (int y = 0; y < 5; ++y) {
+    for (int x = 0; x < 5; ++x) {
+      bool inside = x + y < 4;
+      CHECK(flat[y * 5 + x] == (inside ? 0x001Fu : 0u));
+    }
+  }
+
+  uint16_t ramp[128] = {};
+  gpu->read_vram(library.instance(), 512, 264, 128, 1, ramp);
+  for (int x = 0; x < 128; ++x) {
+    CHECK(ramp[x] == static_cast<uint16_t>(x >> 3));
+  }
+  uint16_t past_end = 0xFFFF;
+  gpu->read_vram(library.instance(), 640, 264, 1, 1, &past_end);
+  CHECK(past_end == 0);
+  return true;
+}
+
+static bool test_gpu_span_kernels_match_scalar() {
+  const SpanKernels scalar = span_kernels_for(SpanIsa::Scalar);
+  uint32_t state = 0x12345678u;
+  auto next = [&state]() {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+  };
+  constexpr int kCount = 61; // odd so every kernel also runs its tail
+  uint16_t src[kCount];
+  uint16_t dst[kCount];
+  uint16_t texel[kCount];
+  uint32_t shade[kCount];
+  uint8_t cover[kCount];
+  for (SpanIsa isa : {SpanIsa::Sse2, SpanIsa::Avx2}) {
+    if (!span_isa_supported(isa)) {
+      continue;
+    }
+    const SpanKernels kernels = span_kernels_for(isa);
+    CHECK(kernels.isa == isa);
+    for (int round = 0; round < 128; ++round) {
+      for (int i = 0; i < kCount; ++i) {
+        src[i] = static_cast<uint16_t>(next());
+        dst[i] = static_cast<uint16_t>(next());
+        texel[i] = static_cast<uint16_t>(next());
+        shade[i] = next() & 0x00FFFFFFu;
+        cover[i] = static_cast<uint8_t>(next() & 1u);
+      }
+      SpanWriteParams params;
+      params.x = static_cast<int>(next() & 0x3FFu);
+      params.y = static_cast<int>(next() & 0x1FFu);
+      params.blend_mode = round & 3;
+      params.semi = (round & 4) != 0;
+      params.dither = (round & 8) != 0;
+      params.mask_set = (round & 16) != 0;
+      params.mask_eval = (round & 32) != 0;
+      const uint8_t *use_cover = (round & 64) ? cover : nullptr;
+
+      uint16_t expect[kCount];
+      uint16_t got[kCount];
+      std::copy(dst, dst + kCount, expect);
+      std::copy(dst, dst + kCount, got);
+      scalar.write(expect, src, use_cover, kCount, params);
+      kernels.write(got, src, use_cover, kCount, params);
+      CHECK(std::equal(expect, expect + kCount, got));
+
+      scalar.modulate(expect, texel, shade, kCount);
+      kernels.modulate(got, texel, shade, kCount);
+      CHECK(std::equal(expect, expect + kCount, got));
+    }
+  }
+  CHECK(span_modulate(0x7FFF, 0x808080u) == 0x3DEF);
+  CHECK(span_blend(0x0008, 0x0008, 1) == 0x0010);
+  CHECK(span_blend(0x0010, 0x0010, 1) == 0x001F);
+  return true;
+}
+
 static bool test_gpu_dma_read_to_ram() {
   ScopedConfigFile config("ps1emu_tests_gpu_dma_read.conf");
   CHECK(write_test_config(config.path));
@@ -2106,15 +3474,18 @@ int main() {
     bool (*fn)();
   } tests[] = {
       {"load_delay", test_load_delay},
+      {"interpreter_sees_code_writes", test_interpreter_sees_code_writes},
       {"cpu_reset_state", test_cpu_reset_state},
       {"cache_isolated_store_ignored", test_cache_isolated_store_ignored},
       {"branch_delay", test_branch_delay},
       {"cpu_exception_trace", test_cpu_exception_trace},
       {"cpu_exception_sr_shift", test_cpu_exception_sr_shift},
+      {"cpu_irq_line_pushed_by_bus", test_cpu_irq_line_pushed_by_bus},
       {"branch_likely_not_taken", test_branch_likely_not_taken},
       {"branch_likely_taken", test_branch_likely_taken},
       {"mmio_gpu_fifo", test_mmio_gpu_fifo},
       {"vblank_irq", test_vblank_irq},
+      {"vblank_requests_present", test_vblank_requests_present},
       {"gpu_status_bits", test_gpu_status_bits},
       {"gpu_read_fifo", test_gpu_read_fifo},
       {"gpu_dma_request_bits", test_gpu_dma_request_bits},
@@ -2134,6 +3505,21 @@ int main() {
       {"gte_dpcs_depth_cue", test_gte_dpcs_depth_cue_extremes},
       {"gte_command_cycles", test_gte_command_cycles},
       {"gte_lwc2_delay", test_gte_lwc2_delay},
+      {"scheduler_heap_cancel_reschedule", test_scheduler_heap_cancel_reschedule},
+      {"cpu_idle_loop_detection", test_cpu_idle_loop_detection},
+      {"dynarec_matches_interpreter", test_dynarec_matches_interpreter},
+      {"threaded_matches_interpreter", test_threaded_matches_interpreter},
+      {"dynarec_compiles_blocks", test_dynarec_compiles_blocks},
+      {"dynarec_sees_code_writes", test_dynarec_sees_code_writes},
+      {"dynarec_links_blocks", test_dynarec_links_blocks},
+      {"dynarec_promotes_hot_blocks", test_dynarec_promotes_hot_blocks},
+      {"dynarec_chain_stops_at_step_budget", test_dynarec_chain_stops_at_step_budget},
+      {"threaded_run_stops_at_step_budget", test_threaded_run_stops_at_step_budget},
+      {"dynarec_profile_round_trip", test_dynarec_profile_round_trip},
+      {"dynarec_ir_optimizes_block", test_dynarec_ir_optimizes_block},
+      {"dynarec_cache_clock_eviction", test_dynarec_cache_clock_eviction},
+      {"dynarec_exception_in_block", test_dynarec_exception_in_block},
+      {"dynarec_delay_slot_load_crosses_block", test_dynarec_delay_slot_load_crosses_block},
       {"dma_irq", test_dma_irq},
       {"dma_dicr_clears_irq", test_dma_dicr_clears_irq},
       {"timer_irq_on_target", test_timer_irq_on_target},
@@ -2145,6 +3531,7 @@ int main() {
       {"timer0_clock_dotclock", test_timer0_clock_dotclock},
       {"timer2_clock_div32", test_timer2_clock_div32},
       {"timer2_clock_div128", test_timer2_clock_div128},
+      {"timer_follows_attached_clock", test_timer_follows_attached_clock},
       {"joypad_stub_ready", test_joypad_stub_ready},
       {"joypad_rx_ready_after_write", test_joypad_rx_ready_after_write},
       {"joypad_dtr_gates_tx", test_joypad_dtr_gates_tx},
@@ -2152,9 +3539,14 @@ int main() {
       {"sio1_stub_ready", test_sio1_stub_ready},
       {"sio1_rx_ready_after_write", test_sio1_rx_ready_after_write},
       {"spu_status_tracks_ctrl", test_spu_status_tracks_ctrl},
+      {"mmio_attention_flag", test_mmio_attention_flag},
+      {"mmio_register_dispatch", test_mmio_register_dispatch},
+      {"mmio_reset_clears_devices", test_mmio_reset_clears_devices},
       {"gpu_packet_parsing", test_gpu_packet_parsing},
       {"gpu_packet_parsing_edges", test_gpu_packet_parsing_edges},
       {"memory_map_mmio", test_memory_map_mmio},
+      {"memory_map_page_table", test_memory_map_page_table},
+      {"fastmem_dynarec_slow_paths", test_fastmem_dynarec_slow_paths},
       {"cdrom_iso_read_mmio", test_cdrom_iso_read_mmio},
       {"cdrom_cue_read_mmio", test_cdrom_cue_read_mmio},
       {"cdrom_param_filter_roundtrip", test_cdrom_param_filter_roundtrip},
@@ -2174,7 +3566,14 @@ int main() {
       {"xa_adpcm_zero_decode", test_xa_adpcm_zero_decode},
       {"xa_adpcm_8bit_zero_decode", test_xa_adpcm_8bit_zero_decode},
       {"stub_plugins_handshake", test_stub_plugins_handshake},
+      {"shm_ring_transport", test_shm_ring_transport},
+      {"shm_ring_rejects_corrupt_indices", test_shm_ring_rejects_corrupt_indices},
       {"gpu_pipeline_dma_integration", test_gpu_pipeline_dma_integration},
+      {"gpu_batched_submission", test_gpu_batched_submission},
+      {"gpu_shared_vram_readback", test_gpu_shared_vram_readback},
+      {"plugin_library_mode", test_plugin_library_mode},
+      {"gpu_triangle_rasterizer", test_gpu_triangle_rasterizer},
+      {"gpu_span_kernels_match_scalar", test_gpu_span_kernels_match_scalar},
       {"gpu_dma_read_to_ram", test_gpu_dma_read_to_ram},
       {"gpu_dma_linked_list", test_gpu_dma_linked_list},
       {"dma_decrement_and_blocks", test_dma_decrement_and_blocks},